@@ -0,0 +1,335 @@
+// Benchmark runner for libpsf
+//
+// Times the main operations of the library on one or more PSF files and
+// reports the best time, the decode throughput and the number of heap
+// allocations per operation.
+
+#include "psf.h"
+#include "psfdata.h"
+#include "psfinternal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+//
+// Allocation counting
+//
+static unsigned long g_nallocs = 0;
+
+void *operator new(std::size_t size) {
+    g_nallocs++;
+    void *p = malloc(size ? size : 1);
+    if(p == NULL)
+	throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, std::size_t) noexcept { free(p); }
+void operator delete[](void *p, std::size_t) noexcept { free(p); }
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+//
+// A benchmarked operation. setup() and teardown() are not timed.
+//
+class Operation {
+ public:
+    Operation(const std::string &name) : m_name(name) {}
+    virtual ~Operation() {}
+
+    virtual void setup() {}
+    virtual void run() = 0;
+    virtual void teardown() {}
+
+    // Number of decoded payload bytes per run, 0 if not applicable
+    virtual double payload() const { return 0; }
+
+    const std::string &name() const { return m_name; }
+ private:
+    std::string m_name;
+};
+
+struct Result {
+    double seconds;
+    double allocs;
+};
+
+static Result measure(Operation &op, int repeat) {
+    Result result;
+    result.seconds = -1;
+    result.allocs = 0;
+
+    for(int i=0; i < repeat; i++) {
+	op.setup();
+
+	unsigned long allocs = g_nallocs;
+	double start = now();
+	op.run();
+	double elapsed = now() - start;
+	result.allocs += g_nallocs - allocs;
+
+	op.teardown();
+
+	if(result.seconds < 0 || elapsed < result.seconds)
+	    result.seconds = elapsed;
+    }
+    result.allocs /= repeat;
+
+    return result;
+}
+
+static void report(Operation &op, const Result &result) {
+    std::cout << "  " << std::left << std::setw(10) << op.name() << std::right
+	      << std::setw(14) << std::fixed << std::setprecision(3) << result.seconds * 1e3;
+    if(op.payload() > 0)
+	std::cout << std::setw(10) << std::setprecision(3) << op.payload() / result.seconds * 1e-9;
+    else
+	std::cout << std::setw(10) << "-";
+    std::cout << std::setw(12) << std::setprecision(1) << result.allocs << std::endl;
+}
+
+//
+// Operations
+//
+class OpenOp : public Operation {
+ public:
+    OpenOp(const std::string &filename, const PSFIOOptions &options) :
+	Operation("open"), m_filename(filename), m_options(options), m_ds(NULL) {}
+    void run() { m_ds = new PSFDataSet(m_filename, m_options); }
+    void teardown() { delete m_ds; m_ds = NULL; }
+ private:
+    std::string m_filename;
+    PSFIOOptions m_options;
+    PSFDataSet *m_ds;
+};
+
+class CloseOp : public Operation {
+ public:
+    CloseOp(const std::string &filename) : Operation("close"), m_filename(filename), m_ds(NULL) {}
+    void setup() { m_ds = new PSFDataSet(m_filename); }
+    void run() { m_ds->close(); }
+    void teardown() { delete m_ds; m_ds = NULL; }
+ private:
+    std::string m_filename;
+    PSFDataSet *m_ds;
+};
+
+// Lists all signal names and resolves each of them to its trace
+class NamesOp : public Operation {
+ public:
+    NamesOp(PSFFile &psf, bool swept) : Operation("names"), m_psf(psf), m_swept(swept) {}
+    void run() {
+	NameList names = m_psf.get_names();
+	for(NameList::const_iterator i=names.begin(); i != names.end(); i++)
+	    if(m_swept)
+		m_psf.get_trace_section().get_trace_by_name(*i);
+	    else
+		m_psf.get_value(*i);
+    }
+ private:
+    PSFFile &m_psf;
+    bool m_swept;
+};
+
+class SingleOp : public Operation {
+ public:
+    SingleOp(PSFDataSet &ds, const std::string &name, double payload) :
+	Operation("single"), m_ds(ds), m_name(name), m_payload(payload) {}
+    void run() { delete m_ds.get_signal_vector(m_name); }
+    double payload() const { return m_payload; }
+ private:
+    PSFDataSet &m_ds;
+    std::string m_name;
+    double m_payload;
+};
+
+class MultiOp : public Operation {
+ public:
+    MultiOp(PSFFile &psf, Filter &filter, double payload) :
+	Operation("multi"), m_psf(psf), m_filter(filter), m_payload(payload) {}
+    void run() { delete m_psf.get_value_section_sweep().get_values(m_filter); }
+    double payload() const { return m_payload; }
+ private:
+    PSFFile &m_psf;
+    Filter &m_filter;
+    double m_payload;
+};
+
+class SweepOp : public Operation {
+ public:
+    SweepOp(PSFDataSet &ds, double payload) : Operation("sweep"), m_ds(ds), m_payload(payload) {}
+    void run() { delete m_ds.get_sweep_values(); }
+    double payload() const { return m_payload; }
+ private:
+    PSFDataSet &m_ds;
+    double m_payload;
+};
+
+class StructOp : public Operation {
+ public:
+    StructOp(PSFDataSet &ds, const std::string &name, double payload) :
+	Operation("struct"), m_ds(ds), m_name(name), m_payload(payload) {}
+    void setup() { m_ds.set_invertstruct(true); }
+    void run() { delete m_ds.get_signal(m_name); }
+    void teardown() { m_ds.set_invertstruct(false); }
+    double payload() const { return m_payload; }
+ private:
+    PSFDataSet &m_ds;
+    std::string m_name;
+    double m_payload;
+};
+
+class TransposeOp : public Operation {
+ public:
+    TransposeOp(PSFDataSet &ds, int nthreads, double payload) :
+	Operation("transpose"), m_ds(ds), m_nthreads(nthreads), m_payload(payload) {}
+    void run() { m_ds.get_signal_matrix(m_nthreads); }
+    double payload() const { return m_payload; }
+ private:
+    PSFDataSet &m_ds;
+    int m_nthreads;
+    double m_payload;
+};
+
+static void run_file(const std::string &filename, int repeat, int nmulti, int nthreads,
+		     const PSFIOOptions &options) {
+    struct stat st;
+    if(stat(filename.c_str(), &st) != 0) {
+	perror(filename.c_str());
+	exit(1);
+    }
+
+    PSFDataSet ds(filename, options);
+    PSFFile psf(filename, options);
+    psf.open();
+
+    NameList names = ds.get_signal_names();
+    bool swept = ds.is_swept();
+    int npoints = ds.get_sweep_npoints();
+
+    std::cout << filename << ": " << std::fixed << std::setprecision(1) << st.st_size / 1e6 << " MB, "
+	      << names.size() << " signals x " << npoints << " points" << std::endl;
+    std::cout << "  " << std::left << std::setw(10) << "operation" << std::right
+	      << std::setw(14) << "best [ms]" << std::setw(10) << "GB/s"
+	      << std::setw(12) << "allocs/op" << std::endl;
+
+    std::vector<Operation *> ops;
+    ops.push_back(new OpenOp(filename, options));
+    ops.push_back(new NamesOp(psf, swept));
+
+    Filter filter;
+    if(swept) {
+	const TraceSection &traces = psf.get_trace_section();
+	const std::string &name = names[names.size() / 2];
+	const DataTypeRef &trace = traces.get_trace_by_name(name);
+	double tracebytes = (double)npoints * trace.datasize();
+
+	ops.push_back(new SingleOp(ds, name, tracebytes));
+
+	double multibytes = 0;
+	for(int i=0; i < (int)names.size() && (nmulti <= 0 || i < nmulti); i++) {
+	    filter.push_back(&traces.get_trace_by_name(names[i]));
+	    multibytes += (double)npoints * traces.get_trace_by_name(names[i]).datasize();
+	}
+	ops.push_back(new MultiOp(psf, filter, multibytes));
+
+	const DataTypeRef &sweep = dynamic_cast<const DataTypeRef &>(*psf.get_sweep_section().at(0));
+	ops.push_back(new SweepOp(ds, (double)npoints * sweep.datasize()));
+
+	if(trace.get_datatype().m_datatypeid == TYPEID_STRUCT)
+	    ops.push_back(new StructOp(ds, name, tracebytes));
+
+	// All real signals
+	double realbytes = 0;
+	for(NameList::const_iterator i=names.begin(); i != names.end(); i++)
+	    switch(traces.get_trace_by_name(*i).get_datatype().m_datatypeid) {
+	    case TYPEID_INT8:
+	    case TYPEID_INT32:
+	    case TYPEID_DOUBLE:
+		realbytes += (double)npoints * traces.get_trace_by_name(*i).datasize();
+	    }
+	if(realbytes > 0)
+	    ops.push_back(new TransposeOp(ds, nthreads, realbytes));
+    }
+    ops.push_back(new CloseOp(filename));
+
+    for(std::vector<Operation *>::iterator i=ops.begin(); i != ops.end(); i++) {
+	report(**i, measure(**i, repeat));
+	delete *i;
+    }
+    std::cout << std::endl;
+}
+
+static void usage() {
+    std::cerr << "Usage: psfbench [-r repeat] [-m nmulti] [-t nthreads] [-b mmap|pread] "
+	      << "[-a normal|sequential|random|willneed|hugepage] file..." << std::endl;
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    int repeat = 5;
+    int nmulti = 0;
+    int nthreads = 0;
+    PSFIOOptions options;
+
+    int c;
+    while((c = getopt(argc, argv, "r:m:t:b:a:")) != -1) {
+	std::string arg = optarg ? optarg : "";
+
+	switch(c) {
+	case 'r': repeat = atoi(optarg); break;
+	case 'm': nmulti = atoi(optarg); break;
+	case 't': nthreads = atoi(optarg); break;
+	case 'b':
+	    if(arg == "mmap")
+		options.backend = IO_MMAP;
+	    else if(arg == "pread")
+		options.backend = IO_PREAD;
+	    else
+		usage();
+	    break;
+	case 'a':
+	    if(arg == "normal")
+		options.advice = ADVICE_NORMAL;
+	    else if(arg == "sequential")
+		options.advice = ADVICE_SEQUENTIAL;
+	    else if(arg == "random")
+		options.advice = ADVICE_RANDOM;
+	    else if(arg == "willneed")
+		options.advice = ADVICE_WILLNEED;
+	    else if(arg == "hugepage")
+		options.advice = ADVICE_HUGEPAGE;
+	    else
+		usage();
+	    break;
+	default: usage();
+	}
+    }
+
+    if(optind >= argc || repeat < 1)
+	usage();
+
+    for(int i=optind; i < argc; i++)
+	run_file(argv[i], repeat, nmulti, nthreads, options);
+
+    return 0;
+}
@@ -0,0 +1,156 @@
+// Load test of psfd
+//
+// Simulates many concurrent clients of a running psfd that request random
+// signals and ranges of points of the given files, and reports the query
+// rate, the throughput and the latency percentiles.
+
+#include "psf.h"
+#include "psfdata.h"
+#include "psfclient.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+//
+// Client thread, sends nqueries queries of up to maxpoints points and
+// records their latency
+//
+struct LoadClient {
+    std::string socket;
+    const std::vector<std::string> *files;
+    int nqueries, maxpoints;
+    unsigned int seed;
+
+    std::vector<double> latencies;
+    double bytes;
+    int errors;
+
+    void run();
+    static void *start(void *client) { ((LoadClient *)client)->run(); return NULL; }
+};
+
+void LoadClient::run() {
+    bytes = 0;
+    errors = 0;
+
+    try {
+	PSFClient client(socket);
+
+	std::vector<std::vector<std::string> > names;
+	for(size_t i=0; i < files->size(); i++)
+	    names.push_back(client.get_signal_names((*files)[i]));
+
+	for(int q=0; q < nqueries; q++) {
+	    int file = rand_r(&seed) % files->size();
+	    if(names[file].empty())
+		continue;
+
+	    const std::string &name = names[file][rand_r(&seed) % names[file].size()];
+	    int start = maxpoints ? rand_r(&seed) % (maxpoints * 4) : 0;
+	    int n = maxpoints ? 1 + rand_r(&seed) % maxpoints : INT_MAX;
+
+	    double t = now();
+	    try {
+		PSFSharedArray *array = client.get_signal((*files)[file], name, start, n);
+
+		// Touch the values like a client that uses them
+		volatile double sum = 0;
+		for(int i=0; i < array->size(); i++)
+		    sum += array->data()[i];
+
+		bytes += array->size() * (array->is_complex() ? 16.0 : 8.0);
+		delete array;
+	    } catch(NotImplemented &) {
+		// Non swept or struct signals
+	    }
+	    latencies.push_back(now() - t);
+	}
+    } catch(std::exception &) {
+	errors++;
+    }
+}
+
+static void usage() {
+    std::cerr << "Usage: psfdload [-s socket] [-c nclients] [-q nqueries] [-n maxpoints] file..." << std::endl;
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    std::string socket = psfd_default_socket();
+    int nclients = 16;
+    int nqueries = 100;
+    int maxpoints = 0;
+
+    int c;
+    while((c = getopt(argc, argv, "s:c:q:n:")) != -1) {
+	switch(c) {
+	case 's': socket = optarg; break;
+	case 'c': nclients = atoi(optarg); break;
+	case 'q': nqueries = atoi(optarg); break;
+	case 'n': maxpoints = atoi(optarg); break;
+	default: usage();
+	}
+    }
+
+    if(optind >= argc || nclients < 1 || nqueries < 1)
+	usage();
+
+    std::vector<std::string> files(argv + optind, argv + argc);
+
+    std::vector<LoadClient> clients(nclients);
+    std::vector<pthread_t> threads(nclients);
+
+    double t = now();
+    for(int i=0; i < nclients; i++) {
+	clients[i].socket = socket;
+	clients[i].files = &files;
+	clients[i].nqueries = nqueries;
+	clients[i].maxpoints = maxpoints;
+	clients[i].seed = i + 1;
+	pthread_create(&threads[i], NULL, &LoadClient::start, &clients[i]);
+    }
+
+    std::vector<double> latencies;
+    double bytes = 0;
+    int errors = 0;
+    for(int i=0; i < nclients; i++) {
+	pthread_join(threads[i], NULL);
+	latencies.insert(latencies.end(), clients[i].latencies.begin(), clients[i].latencies.end());
+	bytes += clients[i].bytes;
+	errors += clients[i].errors;
+    }
+    t = now() - t;
+
+    if(latencies.empty()) {
+	std::cerr << "psfdload: no queries completed, is psfd running on " << socket << "?" << std::endl;
+	return 1;
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+
+    std::cout << std::fixed << std::setprecision(2)
+	      << "clients        " << nclients << std::endl
+	      << "queries        " << latencies.size() << std::endl
+	      << "failed clients " << errors << std::endl
+	      << "queries/s      " << latencies.size() / t << std::endl
+	      << "MB/s           " << bytes / t / 1e6 << std::endl
+	      << "latency ms     p50 " << latencies[latencies.size() / 2] * 1e3
+	      << "  p99 " << latencies[latencies.size() * 99 / 100] * 1e3
+	      << "  max " << latencies.back() * 1e3 << std::endl;
+
+    return errors ? 1 : 0;
+}
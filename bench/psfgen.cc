@@ -0,0 +1,194 @@
+// Synthetic PSF file generator for the benchmark suite
+//
+// Writes PSF files of a configurable number of signals and sweep points with
+// PSFWriter in the layouts that libpsf reads: simple sweeps, windowed sweeps,
+// simple sweeps with a trace group, struct valued traces and non swept values.
+
+#include "psf.h"
+#include "psfdata.h"
+#include "psfwriter.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+enum Layout { SIMPLE, WINDOWED, GROUPED, STRUCT, NONSWEEP };
+
+const char *structmembers[] = { "vgs", "vds", "ids", "gm", "gds" };
+const int nstructmembers = sizeof(structmembers) / sizeof(structmembers[0]);
+
+struct Options {
+    Layout layout;
+    int datatypeid;
+    int nsignals;
+    int npoints;
+    int windowsize;
+    std::string filename;
+};
+
+static std::string signal_name(int i) {
+    std::stringstream name;
+    name << "sig" << i;
+    return name.str();
+}
+
+// Cheap deterministic waveform so that generation of large files is I/O bound
+static double signal_value(int signal, int point) {
+    return ((point + 7 * signal) % 1000) * 1e-3;
+}
+
+// Non-uniform but monotonic sweep values
+static double sweep_value(int point) {
+    return 1e-12 * ((double)point * 7 + (point % 7));
+}
+
+// Scalar holding the value of a signal at a point for the generic writer interface
+static PSFScalar *new_value(const Options &opt) {
+    if(opt.layout == STRUCT) {
+	Struct s;
+	for(int m=0; m < nstructmembers; m++)
+	    s[structmembers[m]] = new PSFDoubleScalar();
+	return new StructScalar(s);
+    } else if(opt.datatypeid == TYPEID_INT32)
+	return new PSFInt32Scalar();
+    else if(opt.datatypeid == TYPEID_COMPLEXDOUBLE)
+	return new PSFComplexDoubleScalar();
+    else
+	return new PSFDoubleScalar();
+}
+
+static void set_value(PSFScalar *scalar, const Options &opt, int signal, int point) {
+    double v = signal_value(signal, point);
+
+    if(StructScalar *s = dynamic_cast<StructScalar *>(scalar)) {
+	for(int m=0; m < nstructmembers; m++)
+	    dynamic_cast<PSFDoubleScalar *>(s->value[structmembers[m]])->value = v * (m + 1);
+    } else if(PSFInt32Scalar *i = dynamic_cast<PSFInt32Scalar *>(scalar))
+	i->value = point + signal;
+    else if(PSFComplexDoubleScalar *c = dynamic_cast<PSFComplexDoubleScalar *>(scalar))
+	c->value = PSFComplexDouble(v, -v);
+    else
+	dynamic_cast<PSFDoubleScalar *>(scalar)->value = v;
+}
+
+static void generate(const Options &opt) {
+    PSFWriter writer(opt.filename);
+
+    writer.add_header_property("simulator", PSFStringScalar("psfgen"));
+
+    PSFStringScalar node("node"), volt("V"), second("s");
+    PropertyMap typeprops, sweepprops;
+    typeprops["key"] = &node;
+    typeprops["units"] = &volt;
+    sweepprops["units"] = &second;
+
+    int sweeptype = writer.add_type("sweep", TYPEID_DOUBLE);
+
+    int valuetype;
+    if(opt.layout == STRUCT) {
+	PSFWriter::StructMembers members;
+	for(int m=0; m < nstructmembers; m++)
+	    members.push_back(std::make_pair(structmembers[m], TYPEID_DOUBLE));
+	valuetype = writer.add_struct_type("opinfo", members, typeprops);
+    } else
+	valuetype = writer.add_type("V", opt.datatypeid, typeprops);
+
+    if(opt.layout == NONSWEEP) {
+	PSFScalar *value = new_value(opt);
+	for(int j=0; j < opt.nsignals; j++) {
+	    set_value(value, opt, j, 0);
+	    writer.add_value(signal_name(j), valuetype, *value);
+	}
+	delete value;
+	writer.close();
+	return;
+    }
+
+    writer.add_sweep("time", sweeptype, sweepprops);
+
+    std::string group = (opt.layout == WINDOWED || opt.layout == GROUPED) ? "group" : "";
+    for(int j=0; j < opt.nsignals; j++)
+	writer.add_trace(signal_name(j), valuetype, group);
+
+    if(opt.layout == WINDOWED)
+	writer.set_window_size(opt.windowsize);
+
+    if(opt.layout != STRUCT && opt.datatypeid == TYPEID_DOUBLE) {
+	std::vector<double> values(opt.nsignals);
+	for(int i=0; i < opt.npoints; i++) {
+	    for(int j=0; j < opt.nsignals; j++)
+		values[j] = signal_value(j, i);
+	    writer.append_point(sweep_value(i), &values[0]);
+	}
+    } else {
+	std::vector<const PSFScalar *> values;
+	for(int j=0; j < opt.nsignals; j++)
+	    values.push_back(new_value(opt));
+
+	PSFDoubleScalar sweep;
+	for(int i=0; i < opt.npoints; i++) {
+	    sweep.value = sweep_value(i);
+	    for(int j=0; j < opt.nsignals; j++)
+		set_value(const_cast<PSFScalar *>(values[j]), opt, j, i);
+	    writer.append_point(sweep, values);
+	}
+
+	for(int j=0; j < opt.nsignals; j++)
+	    delete values[j];
+    }
+
+    writer.close();
+}
+
+static void usage() {
+    std::cerr << "Usage: psfgen [-l simple|windowed|grouped|struct|nonsweep] "
+	      << "[-d double|complex|int32] [-s signals] [-p points] [-w windowsize] -o file"
+	      << std::endl;
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    Options opt;
+    opt.layout = SIMPLE;
+    opt.datatypeid = TYPEID_DOUBLE;
+    opt.nsignals = 100;
+    opt.npoints = 10000;
+    opt.windowsize = 4096;
+
+    int c;
+    while((c = getopt(argc, argv, "l:d:s:p:w:o:")) != -1) {
+	std::string arg(optarg ? optarg : "");
+	switch(c) {
+	case 'l':
+	    if(arg == "simple") opt.layout = SIMPLE;
+	    else if(arg == "windowed") opt.layout = WINDOWED;
+	    else if(arg == "grouped") opt.layout = GROUPED;
+	    else if(arg == "struct") opt.layout = STRUCT;
+	    else if(arg == "nonsweep") opt.layout = NONSWEEP;
+	    else usage();
+	    break;
+	case 'd':
+	    if(arg == "double") opt.datatypeid = TYPEID_DOUBLE;
+	    else if(arg == "complex") opt.datatypeid = TYPEID_COMPLEXDOUBLE;
+	    else if(arg == "int32") opt.datatypeid = TYPEID_INT32;
+	    else usage();
+	    break;
+	case 's': opt.nsignals = atoi(optarg); break;
+	case 'p': opt.npoints = atoi(optarg); break;
+	case 'w': opt.windowsize = atoi(optarg); break;
+	case 'o': opt.filename = arg; break;
+	default: usage();
+	}
+    }
+
+    if(opt.filename.empty() || opt.nsignals < 1 || opt.npoints < 1 || opt.windowsize < 1)
+	usage();
+
+    generate(opt);
+
+    return 0;
+}
@@ -0,0 +1,117 @@
+"""Client of psfd, the PSF query daemon.
+
+Signals are returned as read only numpy arrays that map the shared memory
+segment the daemon decoded them into, so they are not copied.
+
+    client = psfclient.PSFClient()
+    out = client.get_signal("sim.raw/tran.tran", "out")
+
+The client talks to the daemon over its socket and does not use the libpsf
+extension module. It needs Python 3.3 or later for socket.recvmsg, which
+receives the shared memory descriptors, and numpy.
+"""
+
+import array
+import mmap
+import os
+import socket
+import struct
+
+import numpy
+
+INT_MAX = 2 ** 31 - 1
+
+REDUCTION_FIELDS = ["npoints", "xstart", "xend", "min", "max", "min_x", "max_x",
+                    "average", "rms", "integral"]
+
+
+def default_socket():
+    """Socket of psfd, $XDG_RUNTIME_DIR/psfd.sock or /tmp/psfd-<uid>.sock"""
+    if os.environ.get("XDG_RUNTIME_DIR"):
+        return os.path.join(os.environ["XDG_RUNTIME_DIR"], "psfd.sock")
+    return "/tmp/psfd-%d.sock" % os.getuid()
+
+
+class PSFClientError(RuntimeError):
+    """Error replied by psfd, the argument is the name of the exception"""
+
+
+class PSFClient(object):
+    def __init__(self, path=None):
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.sock.connect(path or default_socket())
+
+    def close(self):
+        self.sock.close()
+
+    def list(self):
+        """Files opened by the daemon"""
+        return self._request(["list"])[0]
+
+    def get_signal_names(self, filename):
+        return self._request(["names", os.path.realpath(filename)])[0]
+
+    def get_signal(self, filename, name, start=0, n=INT_MAX):
+        """numpy array of n points of a signal starting at point start"""
+        return self._request_array(["signal", os.path.realpath(filename), name, str(start), str(n)])
+
+    def get_sweep_values(self, filename, start=0, n=INT_MAX):
+        return self._request_array(["sweep", os.path.realpath(filename), str(start), str(n)])
+
+    def get_signal_reduction(self, filename, name, start=0, n=INT_MAX):
+        """Dict of min, max, average, rms and integral of n points starting at start"""
+        fields = self._request(["reduce", os.path.realpath(filename), name, str(start), str(n)])[0]
+        result = dict(zip(REDUCTION_FIELDS, [float(f) for f in fields]))
+        result["npoints"] = int(result["npoints"])
+        return result
+
+    # Messages are a native 32 bit length followed by newline separated fields
+    def _request(self, message):
+        payload = "\n".join(message).encode()
+        self.sock.sendall(struct.pack("=I", len(payload)) + payload)
+
+        header, fd = self._recv_header()
+        payload = self._recv_exactly(struct.unpack("=I", header)[0])
+        reply = payload.decode().split("\n")
+
+        if reply[0] != "ok":
+            if fd is not None:
+                os.close(fd)
+            raise PSFClientError(reply[1] if len(reply) > 1 else "ServerError")
+
+        return reply[1:], fd
+
+    def _request_array(self, message):
+        (dtype, npoints), fd = self._request(message)
+        dtype = numpy.complex128 if dtype == "complex" else numpy.float64
+        try:
+            size = int(npoints) * numpy.dtype(dtype).itemsize
+            if size == 0:
+                return numpy.zeros(0, dtype)
+            # The array keeps the mapping, which keeps the segment
+            segment = mmap.mmap(fd, size, mmap.MAP_SHARED, mmap.PROT_READ)
+            return numpy.frombuffer(segment, dtype)
+        finally:
+            os.close(fd)
+
+    # The length and the descriptor passed with it
+    def _recv_header(self):
+        header, fd = b"", None
+        while len(header) < 4:
+            data, ancdata, flags, addr = self.sock.recvmsg(4 - len(header), socket.CMSG_LEN(4))
+            if not data:
+                raise PSFClientError("ConnectionError")
+            for level, kind, cdata in ancdata:
+                if level == socket.SOL_SOCKET and kind == socket.SCM_RIGHTS:
+                    fd = array.array("i", cdata[:4])[0]
+            header += data
+        return header, fd
+
+    def _recv_exactly(self, n):
+        data = b""
+        while len(data) < n:
+            chunk = self.sock.recv(n - len(data))
+            if not chunk:
+                raise PSFClientError("ConnectionError")
+            data += chunk
+        return data
@@ -0,0 +1,13 @@
+#!/usr/bin/env python3
+
+from setuptools import setup
+
+setup(
+    name="psfclient",
+    description="Client of psfd, the PSF query daemon",
+    py_modules=["psfclient"],
+    packages=["tests"],
+    python_requires=">=3.3",
+    install_requires=["numpy"],
+    test_suite="tests",
+    )
@@ -0,0 +1,82 @@
+import unittest
+import os
+import shutil
+import subprocess
+import tempfile
+import time
+
+import numpy
+
+import psfclient
+
+topdir = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "..")
+timesweep = os.path.join(topdir, "bindings", "python", "tests", "data", "timeSweep")
+dcop = os.path.join(topdir, "test", "data", "dcOp.dc")
+
+# psfd of the build tree unless $PSFD names another one
+psfd = os.environ.get("PSFD", os.path.join(topdir, "src", "psfd"))
+
+
+@unittest.skipUnless(os.access(psfd, os.X_OK), "psfd is not built")
+class test_psfclient(unittest.TestCase):
+
+    def setUp(self):
+        self.dir = tempfile.mkdtemp()
+        self.socket = os.path.join(self.dir, "psfd.sock")
+        self.daemon = subprocess.Popen([psfd, "-s", self.socket])
+
+        for i in range(100):
+            if os.path.exists(self.socket):
+                break
+            time.sleep(0.05)
+
+        self.client = psfclient.PSFClient(self.socket)
+
+
+    def tearDown(self):
+        self.client.close()
+        self.daemon.terminate()
+        self.daemon.wait()
+        shutil.rmtree(self.dir)
+
+
+    def test_names(self):
+        names = self.client.get_signal_names(timesweep)
+        self.assertTrue("PSUP" in names)
+        self.assertEqual(self.client.list(), [os.path.realpath(timesweep)])
+
+
+    def test_get_signal(self):
+        sweep = self.client.get_sweep_values(timesweep)
+        signal = self.client.get_signal(timesweep, "PSUP")
+        self.assertEqual(len(signal), len(sweep))
+        self.assertEqual(signal.dtype, numpy.float64)
+        self.assertFalse(signal.flags.writeable)
+
+        part = self.client.get_signal(timesweep, "PSUP", 10, 5)
+        self.assertEqual(list(part), list(signal[10:15]))
+
+
+    def test_get_signal_reduction(self):
+        signal = self.client.get_signal(timesweep, "INP")
+        result = self.client.get_signal_reduction(timesweep, "INP")
+        self.assertEqual(result["npoints"], len(signal))
+        self.assertEqual(result["min"], signal.min())
+        self.assertEqual(result["max"], signal.max())
+
+
+    def test_errors(self):
+        with self.assertRaises(psfclient.PSFClientError) as context:
+            self.client.get_signal(timesweep, "nonexisting")
+        self.assertEqual(context.exception.args[0], "NotFound")
+
+        with self.assertRaises(psfclient.PSFClientError) as context:
+            self.client.get_signal(dcop, "vout")
+        self.assertEqual(context.exception.args[0], "NotImplemented")
+
+        # The connection is kept after errors
+        self.assertEqual(len(self.client.get_signal(timesweep, "PSUP", 0, 1)), 1)
+
+
+if __name__ == '__main__':
+    unittest.main()
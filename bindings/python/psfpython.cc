@@ -1,5 +1,11 @@
 #include "psf.h"
 #include "psfdata.h"
+#include "psfrawdir.h"
+#include "psfstack.h"
+#include "psfpyramid.h"
+#include "psfblockiterator.h"
+#include "psfasync.h"
+#include "psftext.h"
 
 #include <boost/python/module.hpp>
 #include <boost/python/def.hpp>
@@ -11,9 +17,12 @@
 #include <boost/python/exception_translator.hpp>
 #include <boost/python/dict.hpp>
 #include <boost/python/docstring_options.hpp>
+#include <boost/python/make_constructor.hpp>
 
 #include <sstream>
 
+#include <limits.h>
+
 #include <Python.h>
 #include <numpy/arrayobject.h>
 
@@ -163,6 +172,457 @@ struct PSFBase_to_numpyarray {
   }
 };
 
+struct PSFStats_to_python {
+  static PyObject *convert(const PSFStats& stats) {
+    dict d;
+
+    d["open_time"] = stats.open_time;
+    d["header_time"] = stats.header_time;
+    d["type_time"] = stats.type_time;
+    d["sweep_time"] = stats.sweep_time;
+    d["trace_time"] = stats.trace_time;
+    d["value_time"] = stats.value_time;
+    d["decode_time"] = stats.decode_time;
+    d["decode_calls"] = stats.decode_calls;
+    d["points_decoded"] = stats.points_decoded;
+    d["traces_decoded"] = stats.traces_decoded;
+    d["metadata_bytes"] = stats.metadata_bytes;
+    d["value_bytes"] = stats.value_bytes;
+    d["objects_allocated"] = stats.objects_allocated;
+    d["minor_faults"] = stats.minor_faults;
+    d["major_faults"] = stats.major_faults;
+    d["cache_hits"] = stats.cache_hits;
+    d["cache_misses"] = stats.cache_misses;
+    d["read_calls"] = stats.read_calls;
+    d["read_bytes"] = stats.read_bytes;
+    d["prefetch_bytes"] = stats.prefetch_bytes;
+
+    return incref(d.ptr());
+  }
+};
+
+std::vector<std::string> list_to_names(py::list names) {
+  std::vector<std::string> namevec;
+  for(int i=0; i < len(names); i++)
+    namevec.push_back(extract<std::string>(names[i]));
+  return namevec;
+}
+
+// Dictionary of signals decoded in one pass
+PyObject *psfdataset_get_signals(const PSFDataSet &ds, py::list names) {
+  std::vector<std::string> namevec = list_to_names(names);
+
+  std::vector<PSFBase *> signals = ds.get_signals(namevec);
+
+  PyObject *dict = PyDict_New();
+
+  for(size_t i=0; i < signals.size(); i++) {
+    // Vectors are deleted by the conversion
+    bool isvector = dynamic_cast<PSFVector *>(signals[i]) != NULL;
+
+    PyObject *value = PSFBase_to_numpyarray::convert(signals[i]);
+    PyDict_SetItemString(dict, namevec[i].c_str(), value);
+    Py_DECREF(value);
+
+    if(!isvector)
+      delete signals[i];
+  }
+
+  return dict;
+}
+
+void psfrawdir_prefetch(PSFRawDir &rawdir, py::list names) {
+  rawdir.prefetch(list_to_names(names));
+}
+
+PSFDataSet *psfdataset_init_io(std::string filename, std::string backend, std::string advice,
+				int blocksize, long cachesize) {
+  PSFIOOptions options;
+
+  if(backend == "mmap")
+    options.backend = IO_MMAP;
+  else if(backend == "pread")
+    options.backend = IO_PREAD;
+  else
+    throw NotImplemented();
+
+  if(advice == "normal")
+    options.advice = ADVICE_NORMAL;
+  else if(advice == "sequential")
+    options.advice = ADVICE_SEQUENTIAL;
+  else if(advice == "random")
+    options.advice = ADVICE_RANDOM;
+  else if(advice == "willneed")
+    options.advice = ADVICE_WILLNEED;
+  else if(advice == "hugepage")
+    options.advice = ADVICE_HUGEPAGE;
+  else
+    throw NotImplemented();
+
+  options.blocksize = blocksize;
+  options.cachesize = cachesize;
+
+  return new PSFDataSet(filename, options);
+}
+
+PSFStack *psfstack_init(py::list filenames, int nworkers) {
+  return new PSFStack(list_to_names(filenames), nworkers);
+}
+
+// 2-d numpy array of the signal with one row per file
+PyObject *psfstack_stack(PSFStack &stack, std::string signal) {
+  npy_intp dims[2] = { stack.get_nruns(), stack.get_npoints() };
+  PyObject *result = PyArray_SimpleNew(2, dims, PyArray_DOUBLE);
+
+  try {
+    stack.stack(signal, (double *)PyArray_DATA((PyArrayObject *)result));
+  } catch (...) {
+    Py_DECREF(result);
+    throw;
+  }
+
+  return result;
+}
+
+PyObject *double_vector_to_numpyarray(const std::vector<double> &vec) {
+  return create_numpy_vector(vec.size(), PyArray_DOUBLE, vec.empty() ? NULL : (void *)&vec[0], true);
+}
+
+PyObject *psfstack_reduce(PSFStack &stack, std::string signal, py::list percentiles) {
+  std::vector<double> pvec;
+  for(int i=0; i < len(percentiles); i++)
+    pvec.push_back(extract<double>(percentiles[i]));
+
+  PSFReduction reduction;
+  stack.reduce(signal, reduction, pvec);
+
+  dict d;
+  d["nruns"] = reduction.nruns;
+  d["mean"] = handle<>(double_vector_to_numpyarray(reduction.mean));
+  d["stddev"] = handle<>(double_vector_to_numpyarray(reduction.stddev));
+  d["min"] = handle<>(double_vector_to_numpyarray(reduction.min));
+  d["max"] = handle<>(double_vector_to_numpyarray(reduction.max));
+
+  py::list plist;
+  for(unsigned int i=0; i < reduction.percentiles.size(); i++)
+    plist.append(handle<>(double_vector_to_numpyarray(reduction.percentiles[i])));
+  d["percentiles"] = plist;
+
+  return incref(d.ptr());
+}
+
+struct PSFSweepReduction_to_python {
+  static PyObject *convert(const PSFSweepReduction& r) {
+    dict d;
+
+    d["npoints"] = r.npoints;
+    d["xstart"] = r.xstart;
+    d["xend"] = r.xend;
+    d["min"] = r.min;
+    d["max"] = r.max;
+    d["min_x"] = r.min_x;
+    d["max_x"] = r.max_x;
+    d["peak_to_peak"] = r.peak_to_peak();
+    d["average"] = r.average;
+    d["rms"] = r.rms;
+    d["integral"] = r.integral;
+
+    return incref(d.ptr());
+  }
+};
+
+// Dictionary of reductions of several signals computed in one pass
+PyObject *psfdataset_get_signal_reductions(const PSFDataSet &ds, py::list names, int start, int n) {
+  std::vector<std::string> namevec = list_to_names(names);
+
+  std::vector<PSFSweepReduction> reductions = ds.get_signal_reductions(namevec, start, n);
+
+  dict d;
+  for(size_t i=0; i < reductions.size(); i++)
+    d[namevec[i]] = reductions[i];
+
+  return incref(d.ptr());
+}
+
+struct PSFDecimation_to_python {
+  static PyObject *convert(const PSFDecimation& d) {
+    dict result;
+
+    result["x"] = handle<>(double_vector_to_numpyarray(d.x));
+    result["min"] = handle<>(double_vector_to_numpyarray(d.min));
+    result["max"] = handle<>(double_vector_to_numpyarray(d.max));
+
+    return incref(result.ptr());
+  }
+};
+
+PSFDecimation psfdataset_get_signal_decimated(const PSFDataSet &ds, std::string name,
+					      double lo, double hi, int nbuckets, std::string mode) {
+  if(mode == "lttb")
+    return ds.get_signal_decimated(name, lo, hi, nbuckets, DECIMATE_LTTB);
+  else if(mode == "minmax")
+    return ds.get_signal_decimated(name, lo, hi, nbuckets, DECIMATE_MINMAX);
+  else
+    throw NotImplemented();
+}
+
+// Dictionary of numpy arrays of several signals resampled onto a sweep grid
+PyObject *psfdataset_get_signals_resampled(const PSFDataSet &ds, py::list names,
+					   py::object grid, std::string method) {
+  PSFInterpolation interpolation;
+  if(method == "linear")
+    interpolation = INTERP_LINEAR;
+  else if(method == "hold")
+    interpolation = INTERP_HOLD;
+  else if(method == "cubic")
+    interpolation = INTERP_CUBIC;
+  else
+    throw NotImplemented();
+
+  std::vector<std::string> namevec = list_to_names(names);
+
+  PyObject *gridarray = PyArray_ContiguousFromObject(grid.ptr(), PyArray_DOUBLE, 1, 1);
+  if(gridarray == NULL)
+    throw_error_already_set();
+
+  const double *gridptr = (const double *)PyArray_DATA((PyArrayObject *)gridarray);
+  std::vector<double> gridvec(gridptr, gridptr + PyArray_DIM((PyArrayObject *)gridarray, 0));
+  Py_DECREF(gridarray);
+
+  std::vector<PSFVector *> signals = ds.get_signals_resampled(namevec, gridvec, interpolation);
+
+  PyObject *dict = PyDict_New();
+
+  for(size_t i=0; i < signals.size(); i++) {
+    PyObject *value = psfvector_to_numpyarray(signals[i], true);
+    PyDict_SetItemString(dict, namevec[i].c_str(), value);
+    Py_DECREF(value);
+  }
+
+  return dict;
+}
+
+py::list psfdataset_get_sweep_shape(const PSFDataSet &ds) {
+  std::vector<int> shape = ds.get_sweep_shape();
+
+  py::list result;
+  for(size_t i=0; i < shape.size(); i++)
+    result.append(shape[i]);
+
+  return result;
+}
+
+// Dict of numpy arrays of real valued outputs of a complex signal
+PyObject *psfdataset_get_signal_complex(const PSFDataSet &ds, std::string name, py::list outputs) {
+  std::vector<std::string> names = list_to_names(outputs);
+
+  std::vector<PSFComplexOutput> outputvec;
+  for(size_t i=0; i < names.size(); i++) {
+    if(names[i] == "real")
+      outputvec.push_back(COMPLEX_REAL);
+    else if(names[i] == "imag")
+      outputvec.push_back(COMPLEX_IMAG);
+    else if(names[i] == "mag")
+      outputvec.push_back(COMPLEX_MAG);
+    else if(names[i] == "db20")
+      outputvec.push_back(COMPLEX_DB20);
+    else if(names[i] == "phase")
+      outputvec.push_back(COMPLEX_PHASE);
+    else if(names[i] == "phase_unwrapped")
+      outputvec.push_back(COMPLEX_PHASE_UNWRAPPED);
+    else if(names[i] == "group_delay")
+      outputvec.push_back(COMPLEX_GROUP_DELAY);
+    else
+      throw NotImplemented();
+  }
+
+  std::vector<PSFVector *> signals = ds.get_signal_complex(name, outputvec);
+
+  PyObject *dict = PyDict_New();
+
+  for(size_t i=0; i < signals.size(); i++) {
+    PyObject *value = psfvector_to_numpyarray(signals[i], true);
+    PyDict_SetItemString(dict, names[i].c_str(), value);
+    Py_DECREF(value);
+  }
+
+  return dict;
+}
+
+// Dict of the sweep names, the coordinates of each axis and the signal as an
+// N-D numpy array of a slice of a nested sweep
+PyObject *psfdataset_get_signal_array(const PSFDataSet &ds, std::string name,
+				      py::list start, py::list count) {
+  std::vector<int> startvec, countvec;
+  for(int i=0; i < len(start); i++)
+    startvec.push_back(extract<int>(start[i]));
+  for(int i=0; i < len(count); i++)
+    countvec.push_back(extract<int>(count[i]));
+
+  PSFSweepArray array = ds.get_signal_array(name, startvec, countvec);
+
+  // The data vector is deleted by the conversion
+  handle<> flat(psfvector_to_numpyarray(array.data, true));
+
+  std::vector<npy_intp> dims(array.shape.begin(), array.shape.end());
+  PyArray_Dims newshape = { &dims[0], (int)dims.size() };
+  handle<> data(PyArray_Newshape((PyArrayObject *)flat.get(), &newshape, NPY_CORDER));
+
+  dict d;
+  py::list names, axes;
+  for(size_t i=0; i < array.names.size(); i++) {
+    names.append(array.names[i]);
+    axes.append(handle<>(double_vector_to_numpyarray(array.axes[i])));
+  }
+  d["names"] = names;
+  d["axes"] = axes;
+  d["data"] = data;
+
+  return incref(d.ptr());
+}
+
+// Dict of the signal names, the sweep values and a 2-D numpy array with one
+// row per signal
+PyObject *psfdataset_get_signal_matrix(const PSFDataSet &ds, py::list signals, int nthreads) {
+  PSFSignalMatrix matrix = ds.get_signal_matrix(list_to_names(signals), nthreads);
+
+  npy_intp dims[2] = { (npy_intp)matrix.names.size(), matrix.npoints };
+  handle<> data(PyArray_SimpleNew(2, dims, PyArray_DOUBLE));
+  if(!matrix.values.empty())
+    memcpy(PyArray_DATA((PyArrayObject *)data.get()), &matrix.values[0],
+	   matrix.values.size() * sizeof(double));
+
+  dict d;
+  py::list names;
+  for(size_t i=0; i < matrix.names.size(); i++)
+    names.append(matrix.names[i]);
+  d["names"] = names;
+  d["sweep"] = handle<>(double_vector_to_numpyarray(matrix.x));
+  d["data"] = data;
+
+  return incref(d.ptr());
+}
+
+// Write the sweep and signals as delimited text, returns the number of bytes
+uint64_t psfdataset_export_text(const PSFDataSet &ds, std::string filename, py::list signals,
+				int start, int n, char separator, bool header, int nthreads) {
+  PSFTextExport exporter(ds);
+  exporter.set_signals(list_to_names(signals));
+  exporter.set_range(start, n);
+  exporter.set_separator(separator);
+  exporter.set_header(header);
+  exporter.set_nthreads(nthreads);
+  exporter.write(filename);
+  return exporter.get_bytes();
+}
+
+// Decode n points of a signal from point start into a writable C contiguous
+// float64 or complex128 numpy array, returns the number of points
+int psfdataset_get_signal_into(const PSFDataSet &ds, std::string name, py::object array, int start, int n) {
+  PyArrayObject *a = (PyArrayObject *)array.ptr();
+
+  if(!PyArray_Check(array.ptr()) || !PyArray_ISCARRAY(a)) {
+    PyErr_SetString(PyExc_ValueError, "Array must be a writable C contiguous numpy array");
+    throw_error_already_set();
+  }
+
+  size_t capacity = PyArray_SIZE(a);
+
+  if(PyArray_TYPE(a) == PyArray_DOUBLE)
+    return ds.get_signal_into(name, (double *)PyArray_DATA(a), capacity, start, n);
+  else if(PyArray_TYPE(a) == PyArray_CDOUBLE)
+    return ds.get_signal_into(name, (PSFComplexDouble *)PyArray_DATA(a), capacity, start, n);
+
+  PyErr_SetString(PyExc_ValueError, "Array must be of type float64 or complex128");
+  throw_error_already_set();
+  return 0;
+}
+
+dict psf_file_cache_stats() {
+  PSFFileCacheStats stats = psf_get_file_cache_stats();
+
+  dict d;
+  d["hits"] = stats.hits;
+  d["misses"] = stats.misses;
+  d["evictions"] = stats.evictions;
+  d["files"] = stats.files;
+  d["bytes"] = stats.bytes;
+
+  return d;
+}
+
+// Block iterator of a list of signal names
+class PyBlockIterator : public PSFBlockIterator {
+public:
+  PyBlockIterator(const PSFDataSet &ds, py::list names, int blocksize=DEFAULT_BLOCKSIZE) :
+    PSFBlockIterator(ds, list_to_names(names), blocksize) {}
+};
+
+// Copy of a vector of the current block, the vectors are reused by the next block
+PyObject *block_vector_to_numpyarray(const PSFVector &vec) {
+  if (const PSFDoubleVector *f64v = dynamic_cast<const PSFDoubleVector *>(&vec))
+    return create_numpy_vector(f64v->size(), PyArray_DOUBLE, (void *)&(*f64v)[0], true);
+  else if (const PSFComplexDoubleVector *cf64v = dynamic_cast<const PSFComplexDoubleVector *>(&vec))
+    return create_numpy_vector(cf64v->size(), PyArray_CDOUBLE, (void *)&(*cf64v)[0], true);
+  else
+    throw NotImplemented();
+}
+
+py::object psfblockiterator_iter(py::object self) {
+  return self;
+}
+
+// Dict of the first point, the sweep values and a list of the signals of the next block
+PyObject *psfblockiterator_next(PyBlockIterator &blocks) {
+  if(!blocks.next()) {
+    PyErr_SetNone(PyExc_StopIteration);
+    throw_error_already_set();
+  }
+
+  dict d;
+  d["start"] = blocks.get_start();
+  d["sweep"] = handle<>(block_vector_to_numpyarray(blocks.get_sweep_values()));
+
+  py::list values;
+  for(int i=0; i < blocks.get_nsignals(); i++)
+    values.append(handle<>(block_vector_to_numpyarray(blocks.get_values(i))));
+  d["values"] = values;
+
+  return incref(d.ptr());
+}
+
+PSFFuture *psfasyncreader_get_signals_async(PSFAsyncReader &reader, py::list names) {
+  return reader.get_signals_async(list_to_names(names));
+}
+
+void psfasyncreader_prefetch(PSFAsyncReader &reader, py::list names, int start, int n) {
+  reader.prefetch(list_to_names(names), start, n);
+}
+
+// Copy of an extracted signal, the signals are owned by the future
+PyObject *future_value_to_python(const PSFBase *value) {
+  if(const PSFScalar *scalar = dynamic_cast<const PSFScalar *>(value))
+    return psfscalar_to_python(scalar);
+  else if(const PSFVector *vector = dynamic_cast<const PSFVector *>(value))
+    return block_vector_to_numpyarray(*vector);
+  else
+    throw NotImplemented();
+}
+
+PyObject *psffuture_get(const PSFFuture &future) {
+  return future_value_to_python(future.get());
+}
+
+py::list psffuture_get_all(const PSFFuture &future) {
+  const std::vector<PSFBase *> &values = future.get_all();
+
+  py::list result;
+  for(unsigned int i=0; i < values.size(); i++)
+    result.append(handle<>(future_value_to_python(values[i])));
+
+  return result;
+}
+
 // Exception translators    
 void translate_exception(IncorrectChunk const& e) {
   std::stringstream msg; msg << "Incorrect chunk " << e.chunktype;
@@ -184,6 +644,26 @@ void translate_exception_fileopenerror(FileOpenError const& e) {
   PyErr_SetString(PyExc_IOError, msg.str().c_str());
 }
 
+void translate_exception_invalidfileerror(InvalidFileError const& e) {
+  std::stringstream msg; msg << "Invalid PSF file";
+  PyErr_SetString(PyExc_IOError, msg.str().c_str());
+}
+
+void translate_exception_filereaderror(FileReadError const& e) {
+  std::stringstream msg; msg << "File read error";
+  PyErr_SetString(PyExc_IOError, msg.str().c_str());
+}
+
+void translate_exception_invalidexpression(InvalidExpression const& e) {
+  std::stringstream msg; msg << "Invalid expression";
+  PyErr_SetString(PyExc_ValueError, msg.str().c_str());
+}
+
+void translate_exception_cancelled(Cancelled const& e) {
+  std::stringstream msg; msg << "Cancelled";
+  PyErr_SetString(PyExc_RuntimeError, msg.str().c_str());
+}
+
 
 BOOST_PYTHON_MODULE(libpsf)
 { 
@@ -193,6 +673,9 @@ BOOST_PYTHON_MODULE(libpsf)
   to_python_converter<PSFVector *, PSFVector_to_numpyarray>();
   to_python_converter<const PSFScalar *, PSFScalar_to_python>();
   to_python_converter<Struct, Struct_to_python>();
+  to_python_converter<PSFStats, PSFStats_to_python>();
+  to_python_converter<PSFSweepReduction, PSFSweepReduction_to_python>();
+  to_python_converter<PSFDecimation, PSFDecimation_to_python>();
   to_python_converter<std::vector<std::string,class std::allocator<std::string> >, VecToList<std::string> >();
 
   bool show_user_defined = true;
@@ -200,8 +683,27 @@ BOOST_PYTHON_MODULE(libpsf)
   bool show_py_signatures = true;
   docstring_options doc_options(show_user_defined, show_py_signatures, show_cpp_signatures);
 
+  def("enable_file_cache", &psf_enable_file_cache, (arg("maxbytes")),
+      "Share opened files between data sets of the same unmodified file, and keep "
+      "unused files open until their metadata exceeds maxbytes, 0 disables the cache");
+  def("clear_file_cache", &psf_clear_file_cache,
+      "Close the cached files that are not used by a data set");
+  def("get_file_cache_stats", &psf_file_cache_stats,
+      "Dict of hits, misses, evictions, files and bytes of the file cache");
+  def("enable_stats", &psf_enable_stats, (arg("enable")),
+      "Enable or disable collection of performance statistics");
+  def("stats_enabled", &psf_stats_enabled,
+      "Return True if performance statistics are collected");
+
   class_<PSFDataSet>("PSFDataSet", "Open a psf results file.",
 		     init<std::string>((arg("self"), arg("filename"))))
+    .def("__init__",
+	 make_constructor(&psfdataset_init_io, default_call_policies(),
+			  (arg("filename"), arg("backend"), arg("advice")="normal",
+			   arg("blocksize")=4 << 20, arg("cachesize")=256L << 20)),
+	 "Open a psf results file with the mmap or pread I/O backend and an access advice "
+	 "of normal, sequential, random, willneed or hugepage. The pread backend keeps up to "
+	 "cachesize bytes of blocks that are no longer decoded")
     .def("get_nsweeps",
 	 &PSFDataSet::get_nsweeps,
 	 (arg("self")),
@@ -219,7 +721,7 @@ BOOST_PYTHON_MODULE(libpsf)
 	 (arg("self")),
 	 "Parameter that has been swept")
     .def("get_sweep_values",
-	 &PSFDataSet::get_sweep_values,
+	 (PSFVector *(PSFDataSet::*)() const) &PSFDataSet::get_sweep_values,
 	 (arg("self")),
 	 "numpy array of swept values",
 	 return_value_policy<return_by_value>())
@@ -246,15 +748,247 @@ BOOST_PYTHON_MODULE(libpsf)
 	 &PSFDataSet::close,
 	 (arg("self")),
 	 "Close PSF data set")
+    .def("get_stats",
+	 &PSFDataSet::get_stats,
+	 (arg("self")),
+	 "Dict of performance statistics collected while enabled with enable_stats()",
+	 return_value_policy<return_by_value>())
+    .def("reset_stats",
+	 &PSFDataSet::reset_stats,
+	 (arg("self")),
+	 "Reset the performance statistics")
+    .def("prefetch",
+	 &PSFDataSet::prefetch,
+	 (arg("self"), arg("start"), arg("n")),
+	 "Start reading n sweep points from point start in the background")
+    .def("get_signals",
+	 &psfdataset_get_signals,
+	 (arg("self"), arg("signals")),
+	 "Dict of numpy arrays of several signals decoded in one pass")
+    .def("get_signal_reduction",
+	 (PSFSweepReduction (PSFDataSet::*)(std::string, int, int) const) &PSFDataSet::get_signal_reduction,
+	 (arg("self"), arg("signal"), arg("start")=0, arg("n")=INT_MAX),
+	 "Dict of min, max, average, rms and integral of n sweep points starting at start")
+    .def("get_signal_reductions",
+	 &psfdataset_get_signal_reductions,
+	 (arg("self"), arg("signals"), arg("start")=0, arg("n")=INT_MAX),
+	 "Dict of reductions of several signals computed in one pass")
+    .def("get_signal_decimated",
+	 &psfdataset_get_signal_decimated,
+	 (arg("self"), arg("signal"), arg("lo"), arg("hi"), arg("nbuckets"), arg("mode")="minmax"),
+	 "Dict of x, min and max numpy arrays of the signal in the sweep range [lo, hi] "
+	 "decimated to nbuckets buckets, mode is 'minmax' or 'lttb'")
+    .def("get_signals_resampled",
+	 &psfdataset_get_signals_resampled,
+	 (arg("self"), arg("signals"), arg("grid"), arg("method")="linear"),
+	 "Dict of numpy arrays of several signals resampled onto an ascending sweep grid, "
+	 "method is 'linear', 'hold' or 'cubic'")
+    .def("get_signal_expression",
+	 (PSFVector *(PSFDataSet::*)(std::string) const) &PSFDataSet::get_signal_expression,
+	 (arg("self"), arg("expression")),
+	 "numpy array of an expression over signals, e.g. 'db20(V(out)/V(in))', evaluated "
+	 "while the signals are decoded",
+	 return_value_policy<return_by_value>())
+    .def("get_signal_complex",
+	 &psfdataset_get_signal_complex,
+	 (arg("self"), arg("signal"), arg("outputs")),
+	 "Dict of numpy arrays of outputs of a complex signal computed while it is decoded, "
+	 "outputs are 'real', 'imag', 'mag', 'db20', 'phase', 'phase_unwrapped' and "
+	 "'group_delay' with the phase in degrees")
+    .def("get_sweep_shape",
+	 &psfdataset_get_sweep_shape,
+	 (arg("self")),
+	 "List of the number of points of each sweep of a nested sweep, outermost first")
+    .def("get_signal_array",
+	 &psfdataset_get_signal_array,
+	 (arg("self"), arg("signal"), arg("start")=py::list(), arg("count")=py::list()),
+	 "Dict of sweep names, axis coordinates and an N-D numpy array of the signal in a "
+	 "nested sweep, start and count select a slice of the outer sweeps, IndexError if the "
+	 "slice is outside of the sweeps")
+    .def("get_signal_matrix",
+	 &psfdataset_get_signal_matrix,
+	 (arg("self"), arg("signals")=py::list(), arg("nthreads")=0),
+	 "Dict of signal names, sweep values and a 2-D numpy array with one row per real "
+	 "signal, all real signals if signals is empty, decoded by nthreads threads")
+    .def("export_text",
+	 &psfdataset_export_text,
+	 (arg("self"), arg("filename"), arg("signals")=py::list(), arg("start")=0, arg("n")=INT_MAX,
+	  arg("separator")=',', arg("header")=true, arg("nthreads")=0),
+	 "Write the sweep and signals to a CSV file, all real and complex signals if signals is "
+	 "empty, with shortest round trip values formatted by nthreads threads, returns the "
+	 "number of bytes")
+    .def("get_signal_size",
+	 (int (PSFDataSet::*)(std::string, int, int) const) &PSFDataSet::get_signal_size,
+	 (arg("self"), arg("signal"), arg("start")=0, arg("n")=INT_MAX),
+	 "Number of points of n sweep points of a signal starting at start")
+    .def("get_signal_into",
+	 &psfdataset_get_signal_into,
+	 (arg("self"), arg("signal"), arg("array"), arg("start")=0, arg("n")=INT_MAX),
+	 "Decode at most n sweep points of a signal starting at start into a float64 or "
+	 "complex128 numpy array without allocating, returns the number of points")
     .add_property("invertstruct",
 		  &PSFDataSet::get_invertstruct,
 		  &PSFDataSet::set_invertstruct)
     ;
+
+  class_<PSFRawDir, boost::noncopyable>("PSFRawDir",
+		    "Lazily opened PSF files of a raw directory.",
+		    init<std::string, optional<int> >((arg("self"), arg("dirname"), arg("nworkers")=0)))
+    .def("get_names",
+	 &PSFRawDir::get_names,
+	 (arg("self")),
+	 "Return a list of the PSF file names",
+	 return_value_policy<return_by_value>())
+    .def("__contains__",
+	 &PSFRawDir::has,
+	 (arg("self"), arg("name")))
+    .def("__getitem__",
+	 &PSFRawDir::get,
+	 (arg("self"), arg("name")),
+	 "Data set by file or analysis name, opened on first access",
+	 return_internal_reference<>())
+    .def("prefetch",
+	 &psfrawdir_prefetch,
+	 (arg("self"), arg("names")),
+	 "Open the named data sets in the background")
+    .def("prefetch_all",
+	 &PSFRawDir::prefetch_all,
+	 (arg("self")),
+	 "Open all data sets in the background")
+    .def("wait",
+	 &PSFRawDir::wait,
+	 (arg("self")),
+	 "Wait until the prefetched data sets have been opened")
+    ;
     
+  class_<PSFStack, boost::noncopyable>("PSFStack",
+		   "Signals of many PSF files with identical structure, e.g. Monte Carlo runs.",
+		   no_init)
+    .def("__init__",
+	 make_constructor(&psfstack_init, default_call_policies(),
+			  (arg("filenames"), arg("nworkers")=0)))
+    .def("get_nruns",
+	 &PSFStack::get_nruns,
+	 (arg("self")),
+	 "Return the number of files")
+    .def("get_npoints",
+	 &PSFStack::get_npoints,
+	 (arg("self")),
+	 "Return the number of points of the signals")
+    .def("stack",
+	 &psfstack_stack,
+	 (arg("self"), arg("signal")),
+	 "2-d numpy array of the signal with one row per file, read in parallel")
+    .def("reduce",
+	 &psfstack_reduce,
+	 (arg("self"), arg("signal"), arg("percentiles")=py::list()),
+	 "Dict of per point mean, stddev, min, max and percentiles over the files")
+    ;
+
+  class_<PSFPyramid, boost::noncopyable>("PSFPyramid",
+		     "Persisted multi-resolution min/max pyramid of a signal.",
+		     init<const PSFDataSet &, std::string, optional<std::string> >
+		     ((arg("self"), arg("dataset"), arg("signal"), arg("filename")=""))
+		     [with_custodian_and_ward<1, 2>()])
+    .def("get_filename",
+	 &PSFPyramid::get_filename,
+	 (arg("self")),
+	 "Return the pyramid file name",
+	 return_value_policy<return_by_value>())
+    .def("get_nlevels",
+	 &PSFPyramid::get_nlevels,
+	 (arg("self")),
+	 "Return the number of levels")
+    .def("is_built",
+	 &PSFPyramid::is_built,
+	 (arg("self")),
+	 "True if the pyramid was built rather than loaded from file")
+    .def("get_decimated",
+	 &PSFPyramid::get_decimated,
+	 (arg("self"), arg("lo"), arg("hi"), arg("nbuckets")),
+	 "Dict of x, min and max numpy arrays of the sweep range [lo, hi]")
+    ;
+
+  class_<PyBlockIterator, boost::noncopyable>("PSFBlockIterator",
+		    "Iterator over blocks of points of signals of a swept data set.",
+		    init<const PSFDataSet &, py::list, optional<int> >
+		    ((arg("self"), arg("dataset"), arg("signals"),
+		      arg("blocksize")=(int)PSFBlockIterator::DEFAULT_BLOCKSIZE))
+		    [with_custodian_and_ward<1, 2>()])
+    .def("__iter__", &psfblockiterator_iter)
+    .def("__next__",
+	 &psfblockiterator_next,
+	 (arg("self")),
+	 "Dict of the first point, the sweep values and the list of signals of the next block")
+    .def("next",
+	 &psfblockiterator_next,
+	 (arg("self")))
+    ;
+
+  class_<PSFAsyncReader, boost::noncopyable>("PSFAsyncReader",
+		    "Extraction of signals of a data set in the background by worker threads.",
+		    init<const PSFDataSet &, optional<int, int> >
+		    ((arg("self"), arg("dataset"), arg("nworkers")=0,
+		      arg("blocksize")=(int)PSFAsyncReader::DEFAULT_BLOCKSIZE))
+		    [with_custodian_and_ward<1, 2>()])
+    .def("get_signal_async",
+	 &PSFAsyncReader::get_signal_async,
+	 (arg("self"), arg("signal")),
+	 "PSFFuture of the signal",
+	 return_value_policy<manage_new_object>())
+    .def("get_signals_async",
+	 &psfasyncreader_get_signals_async,
+	 (arg("self"), arg("signals")),
+	 "PSFFuture of several signals decoded in one pass",
+	 return_value_policy<manage_new_object>())
+    .def("prefetch",
+	 &psfasyncreader_prefetch,
+	 (arg("self"), arg("signals"), arg("start")=0, arg("n")=-1),
+	 "Read the values of signals that will be requested soon in the background, "
+	 "n < 0 reads to the end of the sweep")
+    .def("wait",
+	 &PSFAsyncReader::wait,
+	 (arg("self")),
+	 "Wait until all extractions and prefetches have finished")
+    ;
+
+  class_<PSFFuture, boost::noncopyable>("PSFFuture",
+		    "Signals being extracted by a PSFAsyncReader, deleting it cancels the extraction.",
+		    no_init)
+    .def("ready",
+	 &PSFFuture::ready,
+	 (arg("self")),
+	 "True when get() returns without waiting")
+    .def("wait",
+	 &PSFFuture::wait,
+	 (arg("self")),
+	 "Wait until the extraction has finished")
+    .def("cancel",
+	 &PSFFuture::cancel,
+	 (arg("self")),
+	 "Stop the extraction")
+    .def("cancelled",
+	 &PSFFuture::cancelled,
+	 (arg("self")),
+	 "True if the extraction was cancelled")
+    .def("get",
+	 &psffuture_get,
+	 (arg("self")),
+	 "Wait for the first signal and return it as a numpy array")
+    .def("get_all",
+	 &psffuture_get_all,
+	 (arg("self")),
+	 "Wait for the signals and return a list of numpy arrays in the order of the names")
+    ;
+
   class_<IncorrectChunk> incorrectChunkClass("IncorrectChunk", init<int>());
   //    class_<NotFound> incorrectChunkClass("NotFound", init<>());
   boost::python::register_exception_translator<IncorrectChunk>(&translate_exception);
   boost::python::register_exception_translator<NotFound>(&translate_exception_notfound);
   boost::python::register_exception_translator<FileOpenError>(&translate_exception_fileopenerror);
+  boost::python::register_exception_translator<InvalidFileError>(&translate_exception_invalidfileerror);
+  boost::python::register_exception_translator<FileReadError>(&translate_exception_filereaderror);
+  boost::python::register_exception_translator<InvalidExpression>(&translate_exception_invalidexpression);
+  boost::python::register_exception_translator<Cancelled>(&translate_exception_cancelled);
   boost::python::register_exception_translator<UnknownType>(&translate_exception_unknown_type);
 }
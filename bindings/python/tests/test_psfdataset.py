@@ -1,5 +1,8 @@
 import unittest
 import os
+import tempfile
+
+import numpy
 
 import libpsf
 
@@ -53,7 +56,254 @@ class test_tran(unittest.TestCase):
         self.assertTrue(self.psf.is_swept())
 
 
+    def test_get_signal_reduction(self):
+        signal = self.psf.get_signal("PSUP")
+        result = self.psf.get_signal_reduction("PSUP")
+        self.assertEqual(result["npoints"], 323)
+        self.assertEqual(result["min"], min(signal))
+        self.assertEqual(result["max"], max(signal))
+
+        result = self.psf.get_signal_reductions(["PSUP"], 10, 5)
+        self.assertEqual(result["PSUP"]["npoints"], 5)
+
+
+    def test_get_signal_decimated(self):
+        result = self.psf.get_signal_decimated("PSUP", 0, 1e-8, 10)
+        self.assertEqual(len(result["x"]), 10)
+        self.assertEqual(result["min"][0], 1.2)
+
+        result = self.psf.get_signal_decimated("PSUP", 0, 1e-8, 10, mode="lttb")
+        self.assertEqual(result["x"][0], 0.0)
+        self.assertEqual(list(result["min"]), list(result["max"]))
+
+
+    def test_get_signals_resampled(self):
+        sweep = self.psf.get_sweep_values()
+        grid = [sweep[0], sweep[10], 2e-8]
+        result = self.psf.get_signals_resampled(["PSUP"], grid)
+        self.assertEqual(len(result["PSUP"]), 3)
+        self.assertEqual(result["PSUP"][0], 1.2)
+        self.assertEqual(result["PSUP"][1], self.psf.get_signal("PSUP")[10])
+        self.assertTrue(result["PSUP"][2] != result["PSUP"][2])
+
+        result = self.psf.get_signals_resampled(["PSUP"], grid, method="hold")
+        self.assertEqual(result["PSUP"][0], 1.2)
+
+
+    def test_get_signal_array(self):
+        self.assertEqual(self.psf.get_sweep_shape(), [323])
+
+        result = self.psf.get_signal_array("PSUP")
+        self.assertEqual(result["names"], list(self.psf.get_sweep_param_names()))
+        self.assertEqual(result["data"].shape, (323,))
+        self.assertEqual(list(result["axes"][0]), list(self.psf.get_sweep_values()))
+
+        # A single sweep has no outer sweeps to slice
+        self.assertRaises(IndexError, self.psf.get_signal_array, "PSUP", [0], [1])
+
+
+    def test_block_iterator(self):
+        signal = self.psf.get_signal("PSUP")
+        blocks = list(libpsf.PSFBlockIterator(self.psf, ["PSUP"], 100))
+        self.assertEqual([block["start"] for block in blocks], [0, 100, 200, 300])
+        self.assertEqual(len(blocks[3]["sweep"]), 23)
+        self.assertEqual(list(blocks[1]["values"][0]), list(signal[100:200]))
+
+
+    def test_get_signal_matrix(self):
+        result = self.psf.get_signal_matrix(nthreads=2)
+        self.assertEqual(result["data"].shape, (len(result["names"]), 323))
+        self.assertEqual(list(result["sweep"]), list(self.psf.get_sweep_values()))
+
+        row = result["names"].index("PSUP")
+        self.assertEqual(list(result["data"][row]), list(self.psf.get_signal("PSUP")))
+
+
+    def test_get_signal_into(self):
+        self.assertEqual(self.psf.get_signal_size("PSUP"), 323)
+        self.assertEqual(self.psf.get_signal_size("PSUP", 300, 100), 23)
+
+        signal = self.psf.get_signal("PSUP")
+        out = numpy.zeros(100)
+        self.assertEqual(self.psf.get_signal_into("PSUP", out, 50), 100)
+        self.assertEqual(list(out), list(signal[50:150]))
+
+        self.assertRaises(ValueError, self.psf.get_signal_into, "PSUP", numpy.zeros(10, dtype=numpy.int32))
+
+    def test_get_signal_async(self):
+        reader = libpsf.PSFAsyncReader(self.psf, blocksize=100)
+        reader.prefetch(["INN"])
+        reader.prefetch(["INN"], 0, 10)
+
+        future = reader.get_signal_async("PSUP")
+        futures = reader.get_signals_async(["PSUP", "INN"])
+        self.assertEqual(list(future.get()), list(self.psf.get_signal("PSUP")))
+        self.assertTrue(future.ready())
+        self.assertEqual(list(futures.get_all()[1]), list(self.psf.get_signal("INN")))
+
+        future = reader.get_signal_async("PSUP")
+        future.cancel()
+        self.assertTrue(future.cancelled() or len(future.get()) == 323)
+
+        self.assertRaises(RuntimeError, reader.get_signal_async("nonexisting").get)
+
+
     # FIXME This test segfaults
     # def test_get_signal_properties(self):
     #     self.psf.get_signal_properties("PSUP")
 
+
+
+class test_ac(unittest.TestCase):
+
+    def setUp(self):
+        self.psf = libpsf.PSFDataSet(os.path.dirname(__file__) + "/data/frequencySweep")
+
+
+    def test_get_signal_complex(self):
+        signal = self.psf.get_signal("NET88")
+        result = self.psf.get_signal_complex("NET88", ["real", "imag", "mag", "phase"])
+
+        self.assertEqual(list(result["real"]), list(signal.real))
+        self.assertEqual(list(result["imag"]), list(signal.imag))
+        for z, mag in zip(signal, result["mag"]):
+            self.assertAlmostEqual(abs(z), mag)
+        self.assertTrue(max(abs(result["phase"])) <= 180)
+
+
+    def test_get_signal_expression(self):
+        product = self.psf.get_signal_expression("V(NET88) * V(LORX_ICM)")
+        for z, a, b in zip(product, self.psf.get_signal("NET88"), self.psf.get_signal("LORX_ICM")):
+            self.assertAlmostEqual(z, a * b)
+
+        self.assertRaises(ValueError, self.psf.get_signal_expression, "db20(NET88")
+
+
+    def test_export_text(self):
+        fd, filename = tempfile.mkstemp(suffix=".csv")
+        os.close(fd)
+        try:
+            nbytes = self.psf.export_text(filename, ["NET88"], nthreads=2)
+            self.assertEqual(nbytes, os.path.getsize(filename))
+
+            data = numpy.loadtxt(filename, delimiter=",", skiprows=1)
+            signal = self.psf.get_signal("NET88")
+            self.assertEqual(list(data[:, 0]), list(self.psf.get_sweep_values()))
+            self.assertEqual(list(data[:, 1]), list(signal.real))
+            self.assertEqual(list(data[:, 2]), list(signal.imag))
+        finally:
+            os.remove(filename)
+
+
+
+class test_stats(unittest.TestCase):
+
+    def tearDown(self):
+        libpsf.enable_stats(False)
+
+
+    def test_disabled(self):
+        libpsf.enable_stats(False)
+        psf = libpsf.PSFDataSet(os.path.dirname(__file__) + "/data/timeSweep")
+        psf.get_signal("PSUP")
+        self.assertEqual(psf.get_stats()["decode_calls"], 0)
+
+
+    def test_enabled(self):
+        libpsf.enable_stats(True)
+        psf = libpsf.PSFDataSet(os.path.dirname(__file__) + "/data/timeSweep")
+        psf.get_signal("PSUP")
+
+        stats = psf.get_stats()
+        self.assertEqual(stats["decode_calls"], 1)
+        self.assertEqual(stats["points_decoded"], 323)
+        self.assertEqual(stats["traces_decoded"], 1)
+        self.assertTrue(stats["metadata_bytes"] > 0)
+        self.assertTrue(stats["objects_allocated"] > 0)
+
+        psf.reset_stats()
+        self.assertEqual(psf.get_stats()["decode_calls"], 0)
+
+
+    def test_pread(self):
+        libpsf.enable_stats(True)
+        filename = os.path.dirname(__file__) + "/data/timeSweep"
+        psf = libpsf.PSFDataSet(filename, "pread", "sequential", 65536)
+        psf.prefetch(0, 100)
+
+        signal = psf.get_signal("PSUP")
+        self.assertEqual(list(signal), list(libpsf.PSFDataSet(filename).get_signal("PSUP")))
+
+        stats = psf.get_stats()
+        self.assertTrue(stats["read_calls"] > 0)
+        self.assertTrue(stats["prefetch_bytes"] > 0)
+
+
+    def test_file_cache(self):
+        libpsf.enable_file_cache(1 << 20)
+        filename = os.path.dirname(__file__) + "/data/timeSweep"
+        before = libpsf.get_file_cache_stats()
+
+        psf1 = libpsf.PSFDataSet(filename)
+        psf2 = libpsf.PSFDataSet(filename)
+        self.assertEqual(list(psf1.get_signal("PSUP")), list(psf2.get_signal("PSUP")))
+
+        stats = libpsf.get_file_cache_stats()
+        self.assertEqual(stats["misses"] - before["misses"], 1)
+        self.assertEqual(stats["hits"] - before["hits"], 1)
+
+        libpsf.enable_file_cache(0)
+
+
+class test_rawdir(unittest.TestCase):
+
+    def setUp(self):
+        self.rawdir = libpsf.PSFRawDir(os.path.dirname(__file__) + "/data")
+
+
+    def test_get_names(self):
+        names = self.rawdir.get_names()
+        self.assertTrue("timeSweep" in names)
+        self.assertTrue("pss0.fd.pss" in names)
+
+
+    def test_getitem(self):
+        self.assertTrue("pss0" in self.rawdir)
+        self.assertEqual(self.rawdir["timeSweep"].get_sweep_npoints(), 323)
+        self.assertRaises(RuntimeError, lambda: self.rawdir["ac"])
+
+
+    def test_prefetch(self):
+        self.rawdir.prefetch_all()
+        self.rawdir.wait()
+        self.assertTrue(self.rawdir["timeSweep"].is_swept())
+
+
+    def test_get_signals(self):
+        names = list(self.rawdir["timeSweep"].get_signal_names())[:2]
+        signals = self.rawdir["timeSweep"].get_signals(names)
+        self.assertEqual(sorted(signals.keys()), sorted(names))
+        self.assertEqual(list(signals["PSUP"]),
+                         list(self.rawdir["timeSweep"].get_signal("PSUP")))
+
+
+
+class test_stack(unittest.TestCase):
+
+    def setUp(self):
+        filename = os.path.dirname(__file__) + "/data/timeSweep"
+        self.stack = libpsf.PSFStack([filename] * 3)
+
+
+    def test_stack(self):
+        values = self.stack.stack("PSUP")
+        self.assertEqual(values.shape, (3, 323))
+        self.assertEqual(values[2, 0], 1.2)
+
+
+    def test_reduce(self):
+        result = self.stack.reduce("PSUP", [50])
+        self.assertEqual(result["nruns"], 3)
+        self.assertEqual(result["mean"][0], 1.2)
+        self.assertEqual(result["stddev"][0], 0.0)
+        self.assertEqual(result["percentiles"][0][0], 1.2)
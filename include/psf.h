@@ -2,6 +2,7 @@
 #define _PSF
 
 #include <stdlib.h>
+#include <stdint.h>
 
 #include <exception>
 #include <vector>
@@ -34,17 +35,171 @@ class NotImplemented:   public std::exception {};
 class FileOpenError:    public std::exception {};
 class InvalidFileError: public std::exception {};
 class FileCloseError:   public std::exception {};
+class FileReadError:    public std::exception {};
+class InvalidExpression: public std::exception {};
 class NotFound:         public std::exception {};
 class DataSetNotOpen:   public std::exception {};
 class PropertyNotFound: public std::exception {};
+class FileWriteError:   public std::exception {};
+class InvalidWriterState: public std::exception {};
+class ConnectionError:  public std::exception {};
+class ServerError:      public std::exception {};
+class Cancelled:        public std::exception {};
 
 #include "psfdata.h"
 
 typedef std::map<std::string, const PSFScalar *> PropertyMap;
 
+//
+// Performance statistics of a PSF file. The statistics are only collected
+// while enabled with psf_enable_stats(), times are in seconds.
+//
+struct PSFStats {
+    PSFStats() { reset(); }
+    void reset();
+
+    // Time spent in open and in deserializing each section
+    double open_time, header_time, type_time, sweep_time, trace_time, value_time;
+
+    // Value decoding
+    double decode_time;
+    uint64_t decode_calls, points_decoded, traces_decoded;
+
+    // Bytes parsed as metadata and spanned by the decoded values
+    uint64_t metadata_bytes, value_bytes;
+
+    // Chunks, scalars and vectors allocated
+    uint64_t objects_allocated;
+
+    // Page faults during open and decoding
+    uint64_t minor_faults, major_faults;
+
+    // Lookups in lazily built indexes
+    uint64_t cache_hits, cache_misses;
+
+    // Reads of the pread backend and bytes hinted by prefetch()
+    uint64_t read_calls, read_bytes, prefetch_bytes;
+};
+
+//
+// I/O of a PSF file. The mmap backend maps the file and passes the advice to
+// the kernel. The pread backend reads the parts of the file that are decoded
+// into memory in aligned blocks of blocksize bytes, which avoids many small
+// page faults on network file systems. Blocks that are no longer decoded are
+// kept up to cachesize bytes, the least recently used are dropped beyond it.
+//
+enum PSFIOBackend {IO_MMAP, IO_PREAD};
+enum PSFIOAdvice {ADVICE_NORMAL, ADVICE_SEQUENTIAL, ADVICE_RANDOM, ADVICE_WILLNEED, ADVICE_HUGEPAGE};
+
+struct PSFIOOptions {
+    PSFIOOptions() : backend(IO_MMAP), advice(ADVICE_NORMAL), blocksize(4 << 20),
+		     cachesize(256L << 20) {}
+
+    PSFIOBackend backend;
+    PSFIOAdvice advice;
+    int blocksize;
+    long cachesize;
+};
+
+//
+// Reduction of a signal over a range of sweep points, computed while the
+// signal is decoded. The integral uses the trapezoidal rule over the sweep
+// values, average and rms are integrals divided by the sweep span.
+//
+struct PSFSweepReduction {
+    int npoints;
+    double xstart, xend;
+
+    double min, max;
+
+    // Sweep values of the first min and max
+    double min_x, max_x;
+
+    double average, rms, integral;
+
+    double peak_to_peak() const { return max - min; }
+};
+
+//
+// Signal decimated to buckets of equal sweep span for display. Min/max
+// decimation gives the sweep value of the first point and the min and max of
+// every non empty bucket. LTTB gives the selected points with min equal to
+// max.
+//
+enum PSFDecimationMode {DECIMATE_MINMAX, DECIMATE_LTTB};
+
+struct PSFDecimation {
+    std::vector<double> x, min, max;
+};
+
+// Interpolation of signals between sweep points. Hold keeps the value of the
+// preceding point, cubic is a cubic Hermite spline with three point slopes.
+enum PSFInterpolation {INTERP_LINEAR, INTERP_HOLD, INTERP_CUBIC};
+
+// Real valued outputs of a complex signal. The phase is in degrees, the
+// unwrapped phase has no jumps larger than 180 degrees between points and
+// the group delay is -dphase/domega in seconds of a frequency sweep.
+enum PSFComplexOutput {COMPLEX_REAL, COMPLEX_IMAG, COMPLEX_MAG, COMPLEX_DB20, COMPLEX_PHASE,
+		       COMPLEX_PHASE_UNWRAPPED, COMPLEX_GROUP_DELAY};
+
+//
+// Signal of a nested sweep as a contiguous row major array with the
+// outermost sweep first. The coordinates of each axis are the values of its
+// sweep at the first point of the inner sweeps. The data vector is owned by
+// the caller.
+//
+struct PSFSweepArray {
+    std::vector<std::string> names;
+    std::vector<int> shape;
+    std::vector<std::vector<double> > axes;
+    PSFVector *data;
+};
+
+//
+// Real signals of a file transposed to a contiguous column major matrix,
+// column j holds the values of signal names[j] at all npoints sweep points.
+//
+struct PSFSignalMatrix {
+    std::vector<std::string> names;
+    int npoints;
+    std::vector<double> x;
+    std::vector<double> values;
+
+    const double *column(int j) const { return &values[(size_t)j * npoints]; }
+};
+
+// Global switch of statistics collection, disabled by default
+void psf_enable_stats(bool enable);
+bool psf_stats_enabled();
+
+//
+// Process wide cache of opened files, disabled by default. While enabled
+// data sets of the same unmodified file share its parsed metadata and
+// mapping, and files that are no longer used stay open until the metadata
+// size of the cached files exceeds maxbytes. Data sets that share a file
+// share its statistics.
+//
+struct PSFFileCacheStats {
+    uint64_t hits, misses, evictions;
+
+    // Cached files and the size of their metadata
+    uint64_t files, bytes;
+};
+
+void psf_enable_file_cache(size_t maxbytes);
+bool psf_file_cache_enabled();
+void psf_clear_file_cache();
+PSFFileCacheStats psf_get_file_cache_stats();
+
+//
+// A PSF file opened for reading. The const member functions may be called
+// by several threads at the same time, open(), close() and
+// set_invertstruct() may not. Statistics are not synchronized and may
+// undercount while several threads decode.
+//
 class PSFDataSet {
  public:
-    PSFDataSet(std::string filename);
+    PSFDataSet(std::string filename, const PSFIOOptions &options=PSFIOOptions());
     ~PSFDataSet();
     void close();
     void open();
@@ -58,22 +213,118 @@ class PSFDataSet {
     const std::vector<std::string> get_sweep_param_names() const;
     int get_sweep_npoints() const;
     PSFVector *get_sweep_values() const;
+    PSFVector *get_sweep_values(int start, int n) const;
+
+    // Number of points of each sweep of a nested sweep, outermost first
+    std::vector<int> get_sweep_shape() const;
 
     const PropertyMap &get_signal_properties(std::string name) const;
     PSFBase *get_signal(std::string name) const;
     PSFVector *get_signal_vector(std::string name) const;
+    PSFVector *get_signal_vector(std::string name, int start, int n) const;
     const PSFScalar& get_signal_scalar(std::string name) const;
 
+    // Several signals, swept signals are decoded in a single pass
+    std::vector<PSFBase *> get_signals(const std::vector<std::string> &names) const;
+
+    // Reductions of real swept signals without decoding them to vectors
+    PSFSweepReduction get_signal_reduction(std::string name) const;
+    PSFSweepReduction get_signal_reduction(std::string name, int start, int n) const;
+    std::vector<PSFSweepReduction> get_signal_reductions(const std::vector<std::string> &names) const;
+    std::vector<PSFSweepReduction> get_signal_reductions(const std::vector<std::string> &names,
+							  int start, int n) const;
+
+    // Decimate the points with sweep values in [lo, hi] to nbuckets
+    // buckets. The sweep must be monotonic, the buckets of a descending
+    // sweep are returned from hi down to lo.
+    PSFDecimation get_signal_decimated(std::string name, double lo, double hi, int nbuckets,
+				       PSFDecimationMode mode=DECIMATE_MINMAX) const;
+
+    // Real signals interpolated at the values of an ascending sweep grid,
+    // NaN outside the sweep. The signals are decoded and interpolated in
+    // bounded chunks. The sweep must be ascending, descending sweeps throw
+    // NotImplemented.
+    std::vector<PSFVector *> get_signals_resampled(const std::vector<std::string> &names,
+						   const std::vector<double> &grid,
+						   PSFInterpolation method=INTERP_LINEAR) const;
+
+    // Signal of a nested sweep as an N-D array. The slice selects count[i]
+    // points from start[i] of the outer sweeps, outermost first, and only the
+    // selected inner sweeps are decoded. Missing entries select the rest of
+    // the sweep. Throws std::out_of_range for more entries than outer sweeps
+    // or a slice outside of a sweep.
+    PSFSweepArray get_signal_array(std::string name) const;
+    PSFSweepArray get_signal_array(std::string name, const std::vector<int> &start,
+				   const std::vector<int> &count) const;
+
+    // Real valued outputs of a complex signal computed in one pass, one
+    // double vector per output
+    std::vector<PSFVector *> get_signal_complex(std::string name,
+						const std::vector<PSFComplexOutput> &outputs) const;
+    std::vector<PSFVector *> get_signal_complex(std::string name,
+						const std::vector<PSFComplexOutput> &outputs,
+						int start, int n) const;
+
+    // Signal computed from an expression over signals, e.g.
+    // db20(V(out)/V(in)), evaluated in blocks while the signals are decoded.
+    // The result is a double vector, or a complex vector if the expression
+    // has a complex value.
+    PSFVector *get_signal_expression(std::string expression) const;
+    PSFVector *get_signal_expression(std::string expression, int start, int n) const;
+
+    // Real swept signals transposed to a matrix, all real signals if names
+    // is empty. The file is decoded in blocks of points and signals that fit
+    // the cache by nthreads threads, one per processor if 0.
+    PSFSignalMatrix get_signal_matrix(int nthreads=0) const;
+    PSFSignalMatrix get_signal_matrix(const std::vector<std::string> &names, int nthreads=0) const;
+
+    // Decode swept signals straight into caller arrays of capacity points
+    // each, without allocating vectors. Integer signals are converted to
+    // double, complex signals need complex arrays. At most capacity points
+    // from point start are decoded, the number of points is returned.
+    // get_signal_size() returns the number of points of a range of a signal
+    // to size the arrays. Files without a sweep throw NotImplemented.
+    int get_signal_size(std::string name) const;
+    int get_signal_size(std::string name, int start, int n) const;
+    int get_signal_into(std::string name, double *out, size_t capacity) const;
+    int get_signal_into(std::string name, double *out, size_t capacity, int start, int n) const;
+    int get_signal_into(std::string name, PSFComplexDouble *out, size_t capacity) const;
+    int get_signal_into(std::string name, PSFComplexDouble *out, size_t capacity,
+			int start, int n) const;
+    int get_signals_into(const std::vector<std::string> &names, double *const *outs,
+			 size_t capacity) const;
+    int get_signals_into(const std::vector<std::string> &names, double *const *outs,
+			 size_t capacity, int start, int n) const;
+    int get_sweep_values_into(double *out, size_t capacity) const;
+    int get_sweep_values_into(double *out, size_t capacity, int start, int n) const;
+
+    // Start reading the n sweep points from point start in the background
+    void prefetch(int start, int n) const;
+
     void set_invertstruct(bool value);
     bool get_invertstruct() const;
 
+    const PSFStats &get_stats() const;
+    void reset_stats();
+
+    const std::string &get_filename() const { return m_filename; }
+
  private:
+    friend class PSFPyramid;
+    friend class PSFBlockIterator;
+    friend class PSFAsyncReader;
+    friend class PSFTextExport;
+
     void verify_open() const;
 
     PSFFile *m_psf;
     std::string m_filename;
+    PSFIOOptions m_options;
     bool m_invertstruct;
     bool m_is_open;
+
+    // m_psf is shared through the file cache
+    bool m_cached;
 };
 
 #endif
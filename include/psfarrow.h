@@ -0,0 +1,83 @@
+#ifndef _PSF_ARROW
+#define _PSF_ARROW
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "psf.h"
+
+//
+// Streaming export of a PSF file to the Apache Arrow IPC format
+//
+// The sweep and every trace become one column each. Struct traces are
+// written as Arrow struct columns and complex values as structs of a real
+// and an imaginary part. Type, trace and header properties are stored as
+// field and schema metadata.
+//
+// The sweep is decoded and written in record batches of at most
+// batch size points so the memory use is independent of the file size.
+// Files without a sweep are written as a single row.
+//
+class PSFArrowExport {
+ public:
+    enum Format {
+	STREAM,                     // Arrow IPC stream
+	FILE                        // Arrow IPC file, also known as Feather version 2
+    };
+
+    PSFArrowExport(std::string filename);
+    ~PSFArrowExport();
+
+    void set_format(Format format) { m_format = format; }
+    // Number of sweep points per record batch, 0 selects it from the row size
+    void set_batch_size(int npoints);
+
+    // Export only the given signals instead of all signals
+    void set_signals(const std::vector<std::string> &names) { m_signals = names; }
+
+    // Export to a file, "-" is standard output
+    void write(const std::string &filename);
+    void write(int fd);
+
+    // Exported column, the children of struct columns are their fields
+    struct Column {
+	std::string name;
+	int datatypeid;
+	std::vector<Column> children;
+	std::vector<std::pair<std::string, std::string> > metadata;
+    };
+
+ private:
+
+    struct Block {
+	uint64_t offset;
+	uint32_t metadatalength;
+	uint64_t bodylength;
+    };
+
+    void write_schema();
+    uint32_t write_message(const std::string &header, const std::string &body);
+    void write_batch(int n, const std::vector<PSFVector *> &vectors);
+    void write_swept();
+    void write_nonswept();
+
+    void output(const char *buf, std::size_t size);
+    void flush();
+
+    PSFFile *m_psf;
+    Format m_format;
+    int m_batchsize;
+    std::vector<std::string> m_signals;
+
+    // Output state
+    int m_fd;
+    std::string m_outbuf;
+    uint64_t m_pos;
+    std::vector<Column> m_columns;
+    std::vector<std::pair<std::string, std::string> > m_metadata;
+    std::vector<Block> m_blocks;
+};
+
+#endif
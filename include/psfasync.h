@@ -0,0 +1,103 @@
+#ifndef _PSFASYNC
+#define _PSFASYNC
+
+#include "psf.h"
+
+#include <string>
+#include <vector>
+
+class WorkerPool;
+
+//
+// Signals being extracted in the background by a PSFAsyncReader. Deleting
+// the future cancels the extraction if it has not finished.
+//
+class PSFFuture {
+ public:
+    ~PSFFuture();
+
+    // True when get() returns without waiting
+    bool ready() const;
+    void wait() const;
+
+    // Stop the extraction, a queued extraction never starts and a running
+    // one stops after the block of points it decodes
+    void cancel();
+    bool cancelled() const;
+
+    // Wait for the signals and return them in the order of the names. The
+    // signals are owned by the future. Throws Cancelled if the extraction
+    // was cancelled, else the exception of the extraction if it failed.
+    // get() returns the first signal and throws NotFound if no names were
+    // given.
+    const std::vector<PSFBase *> &get_all() const;
+    PSFBase *get() const;
+
+ private:
+    friend class PSFAsyncReader;
+
+    struct State;
+
+    PSFFuture(State *state) : m_state(state) {}
+    PSFFuture(const PSFFuture &);
+    PSFFuture &operator=(const PSFFuture &);
+
+    State *m_state;
+};
+
+//
+// Extraction of the signals of a data set by a pool of worker threads, so
+// interactive tools do not block while a signal is decoded. Swept signals
+// are decoded in blocks of points, real signals to double vectors and
+// complex signals to complex vectors. The data set must outlive the reader.
+//
+//     PSFAsyncReader reader(ds);
+//     PSFFuture *out = reader.get_signal_async("out");
+//     reader.prefetch(next_names);
+//     ...
+//     plot(out->get());
+//     delete out;
+//
+class PSFAsyncReader {
+ public:
+    static const int DEFAULT_BLOCKSIZE = 65536;
+
+    PSFAsyncReader(const PSFDataSet &ds, int nworkers=0, int blocksize=DEFAULT_BLOCKSIZE);
+
+    // Cancels the pending extractions
+    ~PSFAsyncReader();
+
+    // Start extracting signals, the caller deletes the future
+    PSFFuture *get_signal_async(const std::string &name);
+    PSFFuture *get_signals_async(const std::vector<std::string> &names);
+
+    // Hint that the signals will be requested soon. The pages of their
+    // values are read ahead and the indexes of the data set are built in
+    // the background. Unknown names are ignored. The values of a point are
+    // stored together, so the whole value section of the n points from
+    // point start is read ahead whichever signals are named; n < 0 reads
+    // to the end of the sweep.
+    void prefetch(const std::vector<std::string> &names, int start=0, int n=-1);
+
+    // Wait until all extractions and prefetches have finished
+    void wait();
+
+ private:
+    class ExtractTask;
+    class PrefetchTask;
+
+    PSFAsyncReader(const PSFAsyncReader &);
+    PSFAsyncReader &operator=(const PSFAsyncReader &);
+
+    // Decode the signals into the state, false if stopped by a cancel
+    bool extract(const std::vector<std::string> &names, PSFFuture::State *state) const;
+
+    const PSFDataSet &m_ds;
+    int m_blocksize;
+    WorkerPool *m_pool;
+
+    // Set when the reader is deleted to stop running extractions
+    bool m_closing;
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef _PSFBLOCKITERATOR
+#define _PSFBLOCKITERATOR
+
+#include "psf.h"
+
+#include <string>
+#include <vector>
+
+//
+// Iterator over consecutive blocks of the points of a swept data set. The
+// sweep values and the selected signals of each block are decoded into
+// vectors that are reused by the next block, so sweeps of any length are
+// processed in constant memory.
+//
+//     PSFBlockIterator blocks(ds, names);
+//     while(blocks.next())
+//         process(blocks.get_sweep_values(), blocks.get_values(0));
+//
+class PSFBlockIterator {
+ public:
+    static const int DEFAULT_BLOCKSIZE = 65536;
+
+    PSFBlockIterator(const PSFDataSet &ds, const std::vector<std::string> &names,
+		     int blocksize=DEFAULT_BLOCKSIZE);
+    ~PSFBlockIterator();
+
+    // Decode the next block, false when all points have been decoded
+    bool next();
+
+    // First point and number of points of the current block
+    int get_start() const;
+    int size() const;
+
+    int get_nsignals() const;
+
+    // Vectors of the current block, valid until the next call of next().
+    // The signals are in the order of the names.
+    const PSFVector &get_sweep_values() const;
+    const PSFVector &get_values(int i) const;
+
+ private:
+    PSFBlockIterator(const PSFBlockIterator &);
+    PSFBlockIterator &operator=(const PSFBlockIterator &);
+
+    struct State;
+    State *m_state;
+};
+
+#endif
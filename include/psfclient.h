@@ -0,0 +1,74 @@
+#ifndef _PSFCLIENT
+#define _PSFCLIENT
+
+#include "psf.h"
+
+#include <limits.h>
+
+#include <string>
+#include <vector>
+
+// Socket of psfd, $XDG_RUNTIME_DIR/psfd.sock or /tmp/psfd-<uid>.sock
+std::string psfd_default_socket();
+
+//
+// Values of a signal decoded by psfd into a shared memory segment, mapped
+// read only without copying them
+//
+class PSFSharedArray {
+ public:
+    ~PSFSharedArray();
+
+    int size() const { return m_npoints; }
+    bool is_complex() const { return m_complex; }
+
+    const double *data() const { return (const double *)m_data; }
+    const PSFComplexDouble *complex_data() const { return (const PSFComplexDouble *)m_data; }
+
+ private:
+    friend class PSFClient;
+
+    PSFSharedArray(int fd, int npoints, bool complex);
+    PSFSharedArray(const PSFSharedArray &);
+    PSFSharedArray &operator=(const PSFSharedArray &);
+
+    void *m_data;
+    size_t m_size;
+    int m_npoints;
+    bool m_complex;
+};
+
+//
+// Connection to psfd, the PSF query daemon. Relative file names are
+// resolved before they are sent. A client is used by one thread at a time,
+// errors of the server are thrown as the exceptions of PSFDataSet.
+//
+class PSFClient {
+ public:
+    PSFClient(const std::string &path=psfd_default_socket());
+    ~PSFClient();
+
+    // Files opened by the server
+    std::vector<std::string> list();
+
+    std::vector<std::string> get_signal_names(const std::string &filename);
+
+    // Values of n points of a signal or the sweep starting at point start
+    PSFSharedArray *get_signal(const std::string &filename, const std::string &name,
+			       int start=0, int n=INT_MAX);
+    PSFSharedArray *get_sweep_values(const std::string &filename, int start=0, int n=INT_MAX);
+
+    PSFSweepReduction get_signal_reduction(const std::string &filename, const std::string &name,
+					   int start=0, int n=INT_MAX);
+
+ private:
+    PSFClient(const PSFClient &);
+    PSFClient &operator=(const PSFClient &);
+
+    std::vector<std::string> request(const std::vector<std::string> &message, int *fd=NULL);
+    PSFSharedArray *request_array(const std::vector<std::string> &message);
+
+    int m_sock;
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef _PSFPYRAMID
+#define _PSFPYRAMID
+
+#include "psf.h"
+
+#include <string>
+#include <vector>
+
+//
+// Multi-resolution min/max pyramid of a swept signal for interactive zooming
+// in long transients. Level 0 holds the min and max of blocks of BLOCKSIZE
+// points and every following level combines FACTOR blocks of the level
+// below.
+//
+// The pyramid is saved to a file and reused as long as the PSF file is not
+// modified. Decimation of a range that spans few blocks is read from the
+// data set instead.
+//
+class PSFPyramid {
+ public:
+    static const int BLOCKSIZE = 64;
+    static const int FACTOR = 4;
+
+    // Load the pyramid of the signal from filename, or build it and save it
+    // if the file is missing or out of date. The default filename is the
+    // PSF file name followed by the signal name and .pyr.
+    PSFPyramid(const PSFDataSet &ds, const std::string &signal, const std::string &filename="");
+
+    const std::string &get_filename() const { return m_filename; }
+    int get_nlevels() const { return m_levels.size(); }
+
+    // True if the pyramid was built rather than loaded from file
+    bool is_built() const { return m_built; }
+
+    // Min/max decimation of the sweep range [lo, hi], approximated to the
+    // blocks of the chosen level at the edges of the range. Descending
+    // sweeps are decimated without the pyramid.
+    PSFDecimation get_decimated(double lo, double hi, int nbuckets) const;
+
+ private:
+    bool load();
+    void build();
+    void save() const;
+
+    const PSFDataSet &m_ds;
+    std::string m_signal, m_filename;
+
+    // Size and modification time of the PSF file
+    uint64_t m_psfsize;
+    int64_t m_psfmtime;
+
+    std::vector<PSFDecimation> m_levels;
+    bool m_built;
+};
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef _PSFRAWDIR
+#define _PSFRAWDIR
+
+#include "psf.h"
+
+#include <string>
+#include <vector>
+
+class Mutex;
+class Condition;
+class WorkerPool;
+
+//
+// The PSF files of a simulator raw directory. The files are found when the
+// directory is scanned but only opened on first access, or in the
+// background by a pool of worker threads when prefetched.
+//
+// A data set is looked up by its file name, e.g. "tran.tran", or by the
+// analysis name before the first '.', e.g. "tran".
+//
+class PSFRawDir {
+ public:
+    PSFRawDir(std::string dirname, int nworkers=0);
+    ~PSFRawDir();
+
+    const std::string &get_dirname() const { return m_dirname; }
+    const std::vector<std::string> &get_names() const { return m_names; }
+    bool has(const std::string &name) const;
+
+    // Return the data set, waiting for it to be opened if needed
+    PSFDataSet &get(const std::string &name);
+    PSFDataSet &operator[](const std::string &name) { return get(name); }
+
+    // Start opening data sets in the background
+    void prefetch(const std::vector<std::string> &names);
+    void prefetch_all();
+
+    // Wait until all prefetched data sets have been opened
+    void wait();
+
+ private:
+    struct Entry;
+    class OpenTask;
+
+    PSFRawDir(const PSFRawDir &);
+    PSFRawDir &operator=(const PSFRawDir &);
+
+    void scan();
+    Entry *find(const std::string &name) const;
+    void open_entry(Entry *entry);
+
+    std::string m_dirname;
+    std::vector<std::string> m_names;
+    std::vector<Entry *> m_entries;
+
+    int m_nworkers;
+    WorkerPool *m_pool;
+    Mutex *m_mutex;
+    Condition *m_opened;
+};
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef _PSFSTACK
+#define _PSFSTACK
+
+#include "psf.h"
+
+#include <string>
+#include <vector>
+
+class WorkerPool;
+
+//
+// Per point statistics of a signal over many runs
+//
+struct PSFReduction {
+    int nruns;
+    std::vector<double> mean, stddev, min, max;
+
+    // Values at the requested percentiles, in the requested order
+    std::vector<std::vector<double> > percentiles;
+};
+
+//
+// The same signals extracted from many PSF files of identical structure, e.g.
+// the runs of a Monte Carlo or corner analysis. The files are read in
+// parallel by a pool of worker threads, each file is only open while its
+// values are copied.
+//
+// Real signals are converted to double, non swept signals are stacked as a
+// single point.
+//
+class PSFStack {
+ public:
+    PSFStack(const std::vector<std::string> &filenames, int nworkers=0);
+    ~PSFStack();
+
+    int get_nruns() const { return m_filenames.size(); }
+
+    // Number of points of the signals, all files must have the same
+    int get_npoints();
+
+    // Stack the signal into data which must hold nruns x npoints values, row
+    // i is the signal of file i
+    void stack(const std::string &signal, double *data);
+
+    // Stack several signals, data holds nsignals x nruns x npoints values
+    void stack(const std::vector<std::string> &signals, double *data);
+
+    // Mean, sample standard deviation, min and max of every point computed
+    // without holding the runs in memory. Percentiles (0-100) are
+    // interpolated between the closest runs and need the stacked signal.
+    void reduce(const std::string &signal, PSFReduction &result,
+		const std::vector<double> &percentiles=std::vector<double>());
+
+    // Percentile of each column of a nruns x npoints matrix
+    static void percentile(const double *data, int nruns, int npoints,
+			   double p, double *result);
+
+ private:
+    class StackTask;
+    class ReduceTask;
+
+    PSFStack(const PSFStack &);
+    PSFStack &operator=(const PSFStack &);
+
+    void run_tasks();
+
+    std::vector<std::string> m_filenames;
+    int m_npoints;
+    WorkerPool *m_pool;
+};
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef _PSF_TEXT
+#define _PSF_TEXT
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "psf.h"
+
+//
+// Streaming export of the sweep and signals of a data set to CSV or other
+// delimited text
+//
+// Each row holds the sweep value and the signal values of a sweep point,
+// complex signals have a real and an imaginary column. Values are written
+// with the fewest digits that read back as the same double. Files without a
+// sweep are written as a single row.
+//
+// The sweep is decoded in blocks of points that are formatted in parallel
+// by nthreads threads, so the memory use is independent of the file size.
+//
+class PSFTextExport {
+ public:
+    PSFTextExport(const PSFDataSet &ds);
+
+    // Export only the given real or complex signals instead of all of them
+    void set_signals(const std::vector<std::string> &names) { m_signals = names; }
+
+    // Export n sweep points starting at point start
+    void set_range(int start, int n) { m_start = start; m_n = n; }
+
+    void set_separator(char separator) { m_separator = separator; }
+    void set_header(bool header) { m_header = header; }
+
+    // Sweep points per block, 0 selects it from the row size
+    void set_block_size(int npoints);
+
+    // Formatting threads, one per processor if 0
+    void set_nthreads(int nthreads) { m_nthreads = nthreads; }
+
+    // Export to a file, "-" is standard output
+    void write(const std::string &filename);
+    void write(int fd);
+
+    // Bytes written by the last export
+    uint64_t get_bytes() const { return m_bytes; }
+
+    // Shortest text that reads back as value, buf holds at least
+    // MAX_DOUBLE_LENGTH characters. Returns the end of the text.
+    static const int MAX_DOUBLE_LENGTH = 32;
+    static char *format_double(double value, char *buf);
+
+ private:
+    class DecodeTask;
+    class FormatTask;
+
+    struct Column {
+	std::string name;
+	bool complex;
+    };
+
+    std::vector<Column> get_columns() const;
+    void write_swept();
+    void write_nonswept();
+    void write_header(const std::vector<std::string> &names);
+
+    void output(const char *buf, std::size_t size);
+    void flush();
+
+    const PSFDataSet &m_ds;
+    std::vector<std::string> m_signals;
+    int m_start, m_n;
+    char m_separator;
+    bool m_header;
+    int m_blocksize;
+    int m_nthreads;
+
+    // Output state
+    int m_fd;
+    std::string m_outbuf;
+    uint64_t m_bytes;
+};
+
+#endif
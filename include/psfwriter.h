@@ -0,0 +1,162 @@
+#ifndef _PSF_WRITER
+#define _PSF_WRITER
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "psf.h"
+
+//
+// Streaming PSF file writer
+//
+// Usage: define the header properties, types, sweep and traces, then
+// append the sweep points one by one and finally close the file. Files
+// without a sweep hold non swept values added with add_value().
+//
+// Nested sweeps are defined by calling add_sweep() once per sweep, starting
+// with the innermost. The points are appended with the value of every sweep
+// with the inner sweep varying fastest. Nested sweeps can not be windowed.
+//
+// Points are written to disk as they are appended, only a single window of
+// values is kept in memory for windowed sweeps.
+//
+class PSFWriter {
+ public:
+    typedef std::vector<std::pair<std::string, int> > StructMembers;
+
+    PSFWriter(std::string filename);
+    ~PSFWriter();
+
+    void add_header_property(const std::string &name, const PSFScalar &value);
+
+    // Define a data type, returns its id
+    int add_type(const std::string &name, int datatypeid,
+		 const PropertyMap &properties=PropertyMap());
+
+    // Define a struct type of (name, datatypeid) members, returns its id
+    int add_struct_type(const std::string &name, const StructMembers &members,
+			const PropertyMap &properties=PropertyMap());
+
+    void add_sweep(const std::string &name, int type,
+		   const PropertyMap &properties=PropertyMap());
+
+    // Define a trace, optionally as member of a named group. Traces of
+    // windowed sweeps are always stored in groups.
+    int add_trace(const std::string &name, int type, const std::string &group="",
+		  const PropertyMap &properties=PropertyMap());
+
+    // Store the sweep in windows of the given size in bytes
+    void set_window_size(int windowsize);
+
+    // Append a sweep point, values are given in the order the traces were added
+    void append_point(const PSFScalar &sweepvalue, const std::vector<const PSFScalar *> &values);
+    void append_point(const std::vector<const PSFScalar *> &sweepvalues,
+		      const std::vector<const PSFScalar *> &values);
+    void append_point(double sweepvalue, const double *values);
+
+    // Add a value to a file without sweep
+    void add_value(const std::string &name, int type, const PSFScalar &value,
+		   const PropertyMap &properties=PropertyMap());
+
+    int get_npoints() const { return m_npoints; }
+
+    void close();
+
+ private:
+    struct Type {
+	int id;
+	std::string name;
+	int datatypeid;
+	int datasize;
+	StructMembers members;
+	std::string properties;
+    };
+
+    struct Trace {
+	int id;
+	std::string name;
+	int type;
+	int group;
+	std::string properties;
+    };
+
+    struct Sweep {
+	int id;
+	std::string name;
+	int type;
+	std::string properties;
+    };
+
+    struct Group {
+	int id;
+	std::string name;
+	std::vector<int> traces;
+    };
+
+    enum State { DEFINE, VALUES, CLOSED };
+
+    const Type &get_type(int id) const;
+    int new_id() { return m_nextid++; }
+
+    void begin_values();
+    void end_values();
+
+    void write_header_section();
+    void write_type_section();
+    void write_sweep_section();
+    void write_trace_section();
+    void write_nonsweep_value_section();
+
+    void put_int32(std::string &buf, uint32_t value) const;
+    void put_double(std::string &buf, double value) const;
+    void put_string(std::string &buf, const std::string &value) const;
+    void put_property(std::string &buf, const std::string &name, const PSFScalar &value) const;
+    void put_properties(std::string &buf, const PropertyMap &properties) const;
+    void put_data(std::string &buf, const Type &type, const PSFScalar &value) const;
+
+    void put_point(double sweepvalue);
+    void flush_window();
+
+    void write(const std::string &buf);
+    void flush();
+    void patch_int32(uint64_t pos, uint32_t value);
+    void patch_double(uint64_t pos, double value);
+
+    std::string m_filename;
+    int m_fd;
+    State m_state;
+    int m_nextid;
+
+    std::string m_header;
+    std::vector<std::string> m_headernames;
+    std::vector<Type> m_types;
+    std::vector<Trace> m_traces;
+    std::vector<Group> m_groups;
+    std::vector<int> m_order;        // Trace indices in file order
+    int m_sweeptype;
+    int m_sweepid;
+    std::string m_sweepname;
+    std::string m_sweepproperties;
+    std::vector<Sweep> m_outersweeps;
+    std::string m_nonsweepvalues;
+    std::vector<std::pair<std::string, uint32_t> > m_nonsweepindex;
+    int m_windowsize;
+
+    // Output state
+    std::string m_outbuf;
+    uint64_t m_pos;
+    std::vector<std::pair<int, uint32_t> > m_toc;
+    uint64_t m_npointspos, m_sweepminpos, m_sweepmaxpos, m_valueendpos;
+    int m_npoints;
+    double m_sweepmin, m_sweepmax;
+    bool m_alldouble;
+
+    // Current window of a windowed sweep
+    int m_windowpoints, m_windown;
+    std::string m_windowparams;
+    std::vector<std::string> m_windowvalues;
+};
+
+#endif
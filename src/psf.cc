@@ -1,29 +1,54 @@
 #include "psf.h"
 #include "psfinternal.h"
 #include "psfdata.h"
+#include "psffilecache.h"
 
-PSFDataSet::PSFDataSet(std::string filename) : m_filename(filename), m_invertstruct(false) {
-    m_psf     = new PSFFile(m_filename.c_str());
+#include <limits.h>
+
+#include <algorithm>
+
+PSFDataSet::PSFDataSet(std::string filename, const PSFIOOptions &options) :
+    m_filename(filename), m_options(options), m_invertstruct(false) {
+    m_psf     = new PSFFile(m_filename.c_str(), options);
     m_is_open = false;
+    m_cached  = false;
     
     open();
 }
 
 PSFDataSet::~PSFDataSet() {
-    m_psf->close();
-    delete m_psf;
+    if(m_cached)
+	PSFFileCache::instance().release(m_psf);
+    else {
+	m_psf->close();
+	delete m_psf;
+    }
 }
 
 void PSFDataSet::close() {
     if (m_is_open) {
-	m_psf->close();
+	if(m_cached) {
+	    // The closed data set keeps a file of its own
+	    PSFFileCache::instance().release(m_psf);
+	    m_psf = new PSFFile(m_filename.c_str(), m_options);
+	    m_cached = false;
+	} else
+	    m_psf->close();
 	m_is_open = false;
     }
 }
 
 void PSFDataSet::open() {
     if (! m_is_open) {
-	m_psf->open();
+	PSFFileCache &cache = PSFFileCache::instance();
+
+	if(cache.enabled()) {
+	    PSFFile *psf = cache.acquire(m_filename, m_options);
+	    delete m_psf;
+	    m_psf = psf;
+	    m_cached = true;
+	} else
+	    m_psf->open();
 	m_is_open = true;
     }
 }
@@ -58,6 +83,18 @@ PSFVector *PSFDataSet::get_sweep_values() const {
     return m_psf->get_param_values();
 }
 
+PSFVector *PSFDataSet::get_sweep_values(int start, int n) const {	
+    verify_open();
+
+    return m_psf->get_param_values(start, n);
+}
+
+std::vector<int> PSFDataSet::get_sweep_shape() const {
+    verify_open();
+
+    return m_psf->get_sweep_shape();
+}
+
 PSFBase* PSFDataSet::get_signal(std::string name) const {
     verify_open();
 
@@ -79,12 +116,199 @@ PSFBase* PSFDataSet::get_signal(std::string name) const {
     }
 }
 
+std::vector<PSFBase *> PSFDataSet::get_signals(const std::vector<std::string> &names) const {
+    verify_open();
+
+    std::vector<PSFBase *> result;
+
+    if (is_swept()) {
+	std::vector<PSFVector *> vectors = m_psf->get_values(names);
+
+	for(std::vector<PSFVector *>::iterator i=vectors.begin(); i != vectors.end(); i++) {
+	    if(m_invertstruct && dynamic_cast<const StructVector *>(*i)) {
+		result.push_back(new VectorStruct(*dynamic_cast<const StructVector *>(*i)));
+		delete *i;
+	    } else
+		result.push_back(*i);
+	}
+    } else {
+	try {
+	    for(std::vector<std::string>::const_iterator i=names.begin(); i != names.end(); i++)
+		result.push_back(m_psf->get_value(*i).clone());
+	} catch (...) {
+	    for(std::vector<PSFBase *>::iterator i=result.begin(); i != result.end(); i++)
+		delete *i;
+	    throw;
+	}
+    }
+
+    return result;
+}
+
+PSFSweepReduction PSFDataSet::get_signal_reduction(std::string name) const {
+    return get_signal_reduction(name, 0, INT_MAX);
+}
+
+PSFSweepReduction PSFDataSet::get_signal_reduction(std::string name, int start, int n) const {
+    return get_signal_reductions(std::vector<std::string>(1, name), start, n).at(0);
+}
+
+std::vector<PSFSweepReduction> PSFDataSet::get_signal_reductions(const std::vector<std::string> &names) const {
+    return get_signal_reductions(names, 0, INT_MAX);
+}
+
+std::vector<PSFSweepReduction> PSFDataSet::get_signal_reductions(const std::vector<std::string> &names,
+								  int start, int n) const {
+    verify_open();
+
+    return m_psf->reduce(names, start, n);
+}
+
+PSFDecimation PSFDataSet::get_signal_decimated(std::string name, double lo, double hi, int nbuckets,
+					       PSFDecimationMode mode) const {
+    verify_open();
+
+    return m_psf->decimate(name, lo, hi, nbuckets, mode);
+}
+
+std::vector<PSFVector *> PSFDataSet::get_signals_resampled(const std::vector<std::string> &names,
+							   const std::vector<double> &grid,
+							   PSFInterpolation method) const {
+    verify_open();
+
+    return m_psf->resample(names, grid, method);
+}
+
+PSFSweepArray PSFDataSet::get_signal_array(std::string name) const {
+    return get_signal_array(name, std::vector<int>(), std::vector<int>());
+}
+
+PSFSweepArray PSFDataSet::get_signal_array(std::string name, const std::vector<int> &start,
+					   const std::vector<int> &count) const {
+    verify_open();
+
+    return m_psf->get_array(name, start, count);
+}
+
+std::vector<PSFVector *> PSFDataSet::get_signal_complex(std::string name,
+							const std::vector<PSFComplexOutput> &outputs) const {
+    return get_signal_complex(name, outputs, 0, INT_MAX);
+}
+
+std::vector<PSFVector *> PSFDataSet::get_signal_complex(std::string name,
+							const std::vector<PSFComplexOutput> &outputs,
+							int start, int n) const {
+    verify_open();
+
+    return m_psf->get_complex(name, outputs, start, n);
+}
+
+PSFVector *PSFDataSet::get_signal_expression(std::string expression) const {
+    return get_signal_expression(expression, 0, INT_MAX);
+}
+
+PSFVector *PSFDataSet::get_signal_expression(std::string expression, int start, int n) const {
+    verify_open();
+
+    return m_psf->evaluate(expression, start, n);
+}
+
+PSFSignalMatrix PSFDataSet::get_signal_matrix(int nthreads) const {
+    return get_signal_matrix(std::vector<std::string>(), nthreads);
+}
+
+PSFSignalMatrix PSFDataSet::get_signal_matrix(const std::vector<std::string> &names, int nthreads) const {
+    verify_open();
+
+    return m_psf->transpose(names, nthreads);
+}
+
+int PSFDataSet::get_signal_size(std::string name) const {
+    return get_signal_size(name, 0, get_sweep_npoints());
+}
+
+int PSFDataSet::get_signal_size(std::string name, int start, int n) const {
+    verify_open();
+
+    // Throws NotFound for unknown signals
+    m_psf->get_trace_section().get_trace_by_name(name);
+
+    int npoints = get_sweep_npoints();
+
+    if(start < 0)
+	start = 0;
+    if(start > npoints)
+	start = npoints;
+
+    return std::max(std::min(n, npoints - start), 0);
+}
+
+// Limit a range to the capacity of the caller arrays
+static int clip_capacity(int n, size_t capacity) {
+    if(n < 0)
+	return 0;
+    else
+	return (size_t)n > capacity ? (int)capacity : n;
+}
+
+int PSFDataSet::get_signal_into(std::string name, double *out, size_t capacity) const {
+    return get_signal_into(name, out, capacity, 0, get_sweep_npoints());
+}
+
+int PSFDataSet::get_signal_into(std::string name, double *out, size_t capacity, int start, int n) const {
+    verify_open();
+
+    return m_psf->get_values_into(std::vector<std::string>(1, name), start, clip_capacity(n, capacity),
+				  &out, (double *)NULL);
+}
+
+int PSFDataSet::get_signal_into(std::string name, PSFComplexDouble *out, size_t capacity) const {
+    return get_signal_into(name, out, capacity, 0, get_sweep_npoints());
+}
+
+int PSFDataSet::get_signal_into(std::string name, PSFComplexDouble *out, size_t capacity,
+				int start, int n) const {
+    verify_open();
+
+    return m_psf->get_values_into(std::vector<std::string>(1, name), start, clip_capacity(n, capacity),
+				  &out, (double *)NULL);
+}
+
+int PSFDataSet::get_signals_into(const std::vector<std::string> &names, double *const *outs,
+				 size_t capacity) const {
+    return get_signals_into(names, outs, capacity, 0, get_sweep_npoints());
+}
+
+int PSFDataSet::get_signals_into(const std::vector<std::string> &names, double *const *outs,
+				 size_t capacity, int start, int n) const {
+    verify_open();
+
+    return m_psf->get_values_into(names, start, clip_capacity(n, capacity), outs, (double *)NULL);
+}
+
+int PSFDataSet::get_sweep_values_into(double *out, size_t capacity) const {
+    return get_sweep_values_into(out, capacity, 0, get_sweep_npoints());
+}
+
+int PSFDataSet::get_sweep_values_into(double *out, size_t capacity, int start, int n) const {
+    verify_open();
+
+    return m_psf->get_values_into(std::vector<std::string>(), start, clip_capacity(n, capacity),
+				  (double *const *)NULL, out);
+}
+
 PSFVector *PSFDataSet::get_signal_vector(std::string name) const {	
     verify_open();
 
     return m_psf->get_values(name);
 }
 
+PSFVector *PSFDataSet::get_signal_vector(std::string name, int start, int n) const {	
+    verify_open();
+
+    return m_psf->get_values(name, start, n);
+}
+
 const PSFScalar& PSFDataSet::get_signal_scalar(std::string name) const {	
     verify_open();
 
@@ -111,6 +335,12 @@ bool PSFDataSet::is_swept() const {
     return nsweeps > 0;
 }
 
+void PSFDataSet::prefetch(int start, int n) const {
+    verify_open();
+
+    m_psf->prefetch(start, n);
+}
+
 void PSFDataSet::set_invertstruct(bool value) {
     verify_open();
     m_invertstruct = value; 
@@ -121,9 +351,16 @@ bool PSFDataSet::get_invertstruct() const {
     return m_invertstruct;  
 }
 
+const PSFStats &PSFDataSet::get_stats() const {
+    return m_psf->get_stats();
+}
+
+void PSFDataSet::reset_stats() {
+    m_psf->get_stats().reset();
+}
+
 inline void PSFDataSet::verify_open() const {
-    if (!m_is_open) {
-	std::cerr << "Data set is not open" << std::endl;
+    // No output, the data set may be read by several threads
+    if (!m_is_open)
 	throw DataSetNotOpen();
-    }
 }
@@ -0,0 +1,62 @@
+#include "psf.h"
+#include "psfarrow.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+static void usage() {
+    std::cerr << "Usage: psf2arrow [-f] [-b npoints] [-s signal]... psffile [outfile]" << std::endl
+	      << std::endl
+	      << "Convert a PSF file to an Arrow IPC stream, or with -f to an Arrow IPC" << std::endl
+	      << "(Feather) file. The output is written to standard output unless an" << std::endl
+	      << "output file is given." << std::endl
+	      << std::endl
+	      << "  -f          write the Arrow IPC file format" << std::endl
+	      << "  -b npoints  sweep points per record batch" << std::endl
+	      << "  -s signal   export only the given signal, may be repeated" << std::endl;
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    PSFArrowExport::Format format = PSFArrowExport::STREAM;
+    int batchsize = 0;
+    std::vector<std::string> signals;
+
+    int c;
+    while((c = getopt(argc, argv, "fb:s:")) != -1) {
+	switch(c) {
+	case 'f': format = PSFArrowExport::FILE; break;
+	case 'b': batchsize = atoi(optarg); break;
+	case 's': signals.push_back(optarg); break;
+	default: usage();
+	}
+    }
+
+    if(optind >= argc || argc - optind > 2)
+	usage();
+
+    std::string outfile(optind + 1 < argc ? argv[optind + 1] : "-");
+
+    try {
+	PSFArrowExport exporter(argv[optind]);
+	exporter.set_format(format);
+	exporter.set_batch_size(batchsize);
+	exporter.set_signals(signals);
+	exporter.write(outfile);
+    } catch (FileOpenError &) {
+	std::cerr << "psf2arrow: cannot open file" << std::endl;
+	return 1;
+    } catch (NotFound &) {
+	std::cerr << "psf2arrow: signal not found" << std::endl;
+	return 1;
+    } catch (std::exception &) {
+	std::cerr << "psf2arrow: conversion of " << argv[optind] << " failed" << std::endl;
+	return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,687 @@
+#include "psf.h"
+#include "psfdata.h"
+#include "psfinternal.h"
+#include "psfarrow.h"
+
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+// Size of the output buffer that is collected before writing to the file
+static const std::size_t WRITEBUFFER_SIZE = 1 << 20;
+
+// Approximate size of the decoded values of a record batch
+static const std::size_t BATCH_BYTES = 16 << 20;
+static const int MAX_BATCH_POINTS = 1 << 16;
+
+//
+// Arrow metadata constants, see Schema.fbs, Message.fbs and File.fbs of
+// the Arrow format specification
+//
+static const int ARROW_METADATA_V5 = 4;
+
+static const int ARROW_TYPE_INT = 2;
+static const int ARROW_TYPE_FLOATINGPOINT = 3;
+static const int ARROW_TYPE_STRUCT = 13;
+
+static const int ARROW_PRECISION_DOUBLE = 2;
+
+static const int ARROW_HEADER_SCHEMA = 1;
+static const int ARROW_HEADER_RECORDBATCH = 3;
+
+static const char ARROW_MAGIC[] = "ARROW1";
+
+//
+// Minimal flatbuffer serializer for the Arrow metadata
+//
+// Objects are written front to back, a table is followed by the objects it
+// refers to so that all offsets point forward as the format requires.
+// Flatbuffers are little endian.
+//
+
+static void put_le(std::string &buf, uint64_t value, int size) {
+    for(int i=0; i < size; i++)
+	buf += (char)((value >> (8 * i)) & 0xff);
+}
+
+static void set_le32(std::string &buf, std::size_t pos, uint32_t value) {
+    for(int i=0; i < 4; i++)
+	buf[pos + i] = (char)((value >> (8 * i)) & 0xff);
+}
+
+static void pad_to(std::string &buf, std::size_t align) {
+    buf.append((align - buf.size() % align) % align, '\0');
+}
+
+class FlatObject {
+ public:
+    virtual ~FlatObject() {}
+
+    // Append the object to buf and return the position offsets refer to
+    virtual uint32_t serialize(std::string &buf) const = 0;
+};
+
+class FlatString: public FlatObject {
+ public:
+    FlatString(const std::string &value) : m_value(value) {}
+
+    uint32_t serialize(std::string &buf) const {
+	pad_to(buf, 4);
+	uint32_t pos = buf.size();
+	put_le(buf, m_value.size(), 4);
+	buf += m_value;
+	buf += '\0';
+	return pos;
+    }
+
+ private:
+    std::string m_value;
+};
+
+// Vector of fixed size structs stored inline
+class FlatStructVector: public FlatObject {
+ public:
+    FlatStructVector(int align) : m_align(align), m_n(0) {}
+
+    void add(const std::string &element) {
+	m_data += element;
+	m_n++;
+    }
+
+    uint32_t serialize(std::string &buf) const {
+	// The elements following the length must be aligned
+	while((buf.size() + 4) % m_align)
+	    buf += '\0';
+	uint32_t pos = buf.size();
+	put_le(buf, m_n, 4);
+	buf += m_data;
+	return pos;
+    }
+
+ private:
+    int m_align, m_n;
+    std::string m_data;
+};
+
+// Vector of tables or strings
+class FlatVector: public FlatObject {
+ public:
+    ~FlatVector() {
+	for(std::vector<FlatObject *>::const_iterator i=m_items.begin(); i != m_items.end(); i++)
+	    delete *i;
+    }
+
+    void add(FlatObject *item) { m_items.push_back(item); }
+
+    bool empty() const { return m_items.empty(); }
+
+    uint32_t serialize(std::string &buf) const {
+	pad_to(buf, 4);
+	uint32_t pos = buf.size();
+	put_le(buf, m_items.size(), 4);
+	buf.append(4 * m_items.size(), '\0');
+
+	for(std::size_t i=0; i < m_items.size(); i++) {
+	    uint32_t offsetpos = pos + 4 + 4 * i;
+	    set_le32(buf, offsetpos, m_items[i]->serialize(buf) - offsetpos);
+	}
+	return pos;
+    }
+
+ private:
+    std::vector<FlatObject *> m_items;
+};
+
+class FlatTable: public FlatObject {
+ public:
+    ~FlatTable() {
+	for(std::vector<Field>::const_iterator i=m_fields.begin(); i != m_fields.end(); i++)
+	    delete i->child;
+    }
+
+    void add_scalar(int slot, uint64_t value, int size) {
+	Field field = { slot, size, value, NULL };
+	m_fields.push_back(field);
+    }
+
+    void add_child(int slot, FlatObject *child) {
+	Field field = { slot, 4, 0, child };
+	m_fields.push_back(field);
+    }
+
+    uint32_t serialize(std::string &buf) const;
+
+ private:
+    struct Field {
+	int slot;
+	int size;
+	uint64_t value;
+	FlatObject *child;
+    };
+
+    static bool larger(const Field &a, const Field &b) { return a.size > b.size; }
+
+    std::vector<Field> m_fields;
+};
+
+uint32_t FlatTable::serialize(std::string &buf) const {
+    int nslots = 0;
+    for(std::vector<Field>::const_iterator i=m_fields.begin(); i != m_fields.end(); i++)
+	nslots = std::max(nslots, i->slot + 1);
+
+    // Place the largest fields first to keep the padding small
+    std::vector<Field> fields(m_fields);
+    std::stable_sort(fields.begin(), fields.end(), larger);
+
+    // The vtable is written right before the table which is aligned so that
+    // all of its fields are naturally aligned
+    pad_to(buf, 2);
+    uint32_t vtablepos = buf.size();
+    uint32_t vtablesize = 4 + 2 * nslots;
+    uint32_t tablepos = (vtablepos + vtablesize + 7) & ~7;
+
+    std::vector<uint16_t> offsets(nslots, 0);
+    std::vector<uint32_t> fieldpos;
+    uint32_t pos = tablepos + 4;
+    for(std::vector<Field>::const_iterator i=fields.begin(); i != fields.end(); i++) {
+	pos = (pos + i->size - 1) / i->size * i->size;
+	fieldpos.push_back(pos);
+	offsets[i->slot] = pos - tablepos;
+	pos += i->size;
+    }
+
+    put_le(buf, vtablesize, 2);
+    put_le(buf, pos - tablepos, 2);
+    for(int i=0; i < nslots; i++)
+	put_le(buf, offsets[i], 2);
+
+    buf.append(tablepos - buf.size(), '\0');
+    put_le(buf, tablepos - vtablepos, 4);
+    for(std::size_t i=0; i < fields.size(); i++) {
+	buf.append(fieldpos[i] - buf.size(), '\0');
+	put_le(buf, fields[i].value, fields[i].size);
+    }
+
+    for(std::size_t i=0; i < fields.size(); i++)
+	if(fields[i].child)
+	    set_le32(buf, fieldpos[i], fields[i].child->serialize(buf) - fieldpos[i]);
+
+    return tablepos;
+}
+
+static std::string flatbuffer(const FlatTable &root) {
+    std::string buf(4, '\0');
+    set_le32(buf, 0, root.serialize(buf));
+    return buf;
+}
+
+//
+// Arrow metadata
+//
+
+typedef std::vector<std::pair<std::string, std::string> > KeyValueList;
+
+static FlatVector *arrow_metadata(const KeyValueList &metadata) {
+    FlatVector *vec = new FlatVector();
+    for(KeyValueList::const_iterator i=metadata.begin(); i != metadata.end(); i++) {
+	FlatTable *keyvalue = new FlatTable();
+	keyvalue->add_child(0, new FlatString(i->first));
+	keyvalue->add_child(1, new FlatString(i->second));
+	vec->add(keyvalue);
+    }
+    return vec;
+}
+
+static FlatTable *arrow_message(int headertype, FlatTable *header, uint64_t bodylength) {
+    FlatTable *message = new FlatTable();
+    message->add_scalar(0, ARROW_METADATA_V5, 2);
+    message->add_scalar(1, headertype, 1);
+    message->add_child(2, header);
+    message->add_scalar(3, bodylength, 8);
+    return message;
+}
+
+//
+// Record batch body
+//
+
+static void put_node(std::string &nodes, int n) {
+    put_le(nodes, n, 8);     // length
+    put_le(nodes, 0, 8);     // null count
+}
+
+static void put_buffer(std::string &buffers, std::string &body, const void *data, std::size_t size) {
+    put_le(buffers, body.size(), 8);
+    put_le(buffers, size, 8);
+    if(size > 0)
+	body.append((const char *)data, size);
+    pad_to(body, 8);
+}
+
+template<class T>
+static void put_vector(std::string &buffers, std::string &body, const PSFVector *vec) {
+    const std::vector<T> &v = dynamic_cast<const PSFVectorT<T> &>(*vec);
+
+    // Validity bitmap is omitted since there are no null values
+    put_buffer(buffers, body, NULL, 0);
+    put_buffer(buffers, body, v.empty() ? NULL : &v[0], v.size() * sizeof(T));
+}
+
+static FlatTable *arrow_field(const PSFArrowExport::Column &column) {
+    FlatTable *type = new FlatTable();
+    int typetype;
+
+    switch(column.datatypeid) {
+    case TYPEID_DOUBLE:
+	typetype = ARROW_TYPE_FLOATINGPOINT;
+	type->add_scalar(0, ARROW_PRECISION_DOUBLE, 2);
+	break;
+    case TYPEID_INT32:
+	typetype = ARROW_TYPE_INT;
+	type->add_scalar(0, 32, 4);
+	type->add_scalar(1, 1, 1);
+	break;
+    case TYPEID_INT8:
+	typetype = ARROW_TYPE_INT;
+	type->add_scalar(0, 8, 4);
+	type->add_scalar(1, 1, 1);
+	break;
+    default:
+	// Complex values and structs
+	typetype = ARROW_TYPE_STRUCT;
+    }
+
+    // Readers require the children vector also for primitive types
+    FlatVector *children = new FlatVector();
+    for(std::vector<PSFArrowExport::Column>::const_iterator i=column.children.begin(); 
+	i != column.children.end(); i++)
+	children->add(arrow_field(*i));
+
+    FlatTable *field = new FlatTable();
+    field->add_child(0, new FlatString(column.name));
+    field->add_scalar(1, 0, 1);
+    field->add_scalar(2, typetype, 1);
+    field->add_child(3, type);
+    field->add_child(5, children);
+    if(!column.metadata.empty())
+	field->add_child(6, arrow_metadata(column.metadata));
+
+    return field;
+}
+
+static FlatTable *arrow_schema(const std::vector<PSFArrowExport::Column> &columns, 
+			       const KeyValueList &metadata) {
+    FlatVector *fields = new FlatVector();
+    for(std::vector<PSFArrowExport::Column>::const_iterator i=columns.begin(); i != columns.end(); i++)
+	fields->add(arrow_field(*i));
+
+    FlatTable *schema = new FlatTable();
+    schema->add_scalar(0, 0, 2);     // Little endian
+    schema->add_child(1, fields);
+    if(!metadata.empty())
+	schema->add_child(2, arrow_metadata(metadata));
+
+    return schema;
+}
+
+//
+// Append the nodes and buffers of a column to a record batch
+//
+static void put_column(std::string &nodes, std::string &buffers, std::string &body,
+		       const PSFArrowExport::Column &column, const PSFVector *vec) {
+    int n = vec->size();
+
+    put_node(nodes, n);
+
+    switch(column.datatypeid) {
+    case TYPEID_DOUBLE:
+	put_vector<PSFDouble>(buffers, body, vec);
+	break;
+    case TYPEID_INT32:
+	put_vector<PSFInt32>(buffers, body, vec);
+	break;
+    case TYPEID_INT8:
+	put_vector<PSFInt8>(buffers, body, vec);
+	break;
+    case TYPEID_COMPLEXDOUBLE: {
+	const PSFComplexDoubleVector &cvec = dynamic_cast<const PSFComplexDoubleVector &>(*vec);
+	PSFDoubleVector re, im;
+	re.resize(n);
+	im.resize(n);
+	for(int i=0; i < n; i++) {
+	    re[i] = cvec[i].real();
+	    im[i] = cvec[i].imag();
+	}
+
+	put_buffer(buffers, body, NULL, 0);
+	put_column(nodes, buffers, body, column.children[0], &re);
+	put_column(nodes, buffers, body, column.children[1], &im);
+	break;
+    }
+    case TYPEID_STRUCT: {
+	VectorStruct members(dynamic_cast<const StructVector &>(*vec));
+
+	put_buffer(buffers, body, NULL, 0);
+	for(std::vector<PSFArrowExport::Column>::const_iterator i=column.children.begin(); 
+	    i != column.children.end(); i++)
+	    put_column(nodes, buffers, body, *i, members[i->name]);
+
+	for(VectorStruct::const_iterator i=members.begin(); i != members.end(); i++)
+	    delete i->second;
+	break;
+    }
+    default:
+	throw UnknownType(column.datatypeid);
+    }
+}
+
+//
+// PSFArrowExport
+//
+
+PSFArrowExport::PSFArrowExport(std::string filename) :
+    m_format(STREAM), m_batchsize(0), m_fd(-1), m_pos(0) {
+    m_psf = new PSFFile(filename);
+    m_psf->open();
+}
+
+PSFArrowExport::~PSFArrowExport() {
+    delete m_psf;
+}
+
+void PSFArrowExport::set_batch_size(int npoints) {
+    m_batchsize = std::max(npoints, 0);
+}
+
+// Add properties to the metadata of a column, replacing existing keys
+static void add_metadata(PSFArrowExport::Column &column, const PropertyBlock &properties) {
+    const PropertyMap &props = properties.get_propmap();
+
+    for(PropertyMap::const_iterator i=props.begin(); i != props.end(); i++) {
+	std::vector<std::pair<std::string, std::string> >::iterator j;
+	for(j=column.metadata.begin(); j != column.metadata.end(); j++)
+	    if(j->first == i->first)
+		break;
+
+	if(j != column.metadata.end())
+	    j->second = i->second->tostring();
+	else
+	    column.metadata.push_back(std::make_pair(i->first, i->second->tostring()));
+    }
+}
+
+// Column of a type, struct members and complex parts become children
+static PSFArrowExport::Column new_column(const std::string &name, const DataTypeDef &type) {
+    typedef PSFArrowExport::Column Column;
+
+    Column column;
+    column.name = name;
+    column.datatypeid = type.m_datatypeid;
+
+    if(type.m_datatypeid == TYPEID_COMPLEXDOUBLE) {
+	Column part;
+	part.datatypeid = TYPEID_DOUBLE;
+	part.name = "real";
+	column.children.push_back(part);
+	part.name = "imag";
+	column.children.push_back(part);
+    } else if(type.m_datatypeid == TYPEID_STRUCT) {
+	for(Container::const_iterator i=type.m_structdef->begin(); i != type.m_structdef->end(); i++) {
+	    const DataTypeDef &member = dynamic_cast<const DataTypeDef &>(**i);
+	    column.children.push_back(new_column(member.get_name(), member));
+	}
+    } else if(type.m_datatypeid != TYPEID_DOUBLE && type.m_datatypeid != TYPEID_INT32 &&
+	      type.m_datatypeid != TYPEID_INT8)
+	throw UnknownType(type.m_datatypeid);
+
+    add_metadata(column, type.get_properties());
+
+    return column;
+}
+
+void PSFArrowExport::write(const std::string &filename) {
+    if(filename == "-") {
+	write(STDOUT_FILENO);
+	return;
+    }
+
+    int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if(fd == -1)
+	throw FileOpenError();
+
+    try {
+	write(fd);
+    } catch (...) {
+	::close(fd);
+	throw;
+    }
+
+    if(::close(fd) == -1)
+	throw FileCloseError();
+}
+
+void PSFArrowExport::write(int fd) {
+    m_fd = fd;
+    m_pos = 0;
+    m_outbuf.clear();
+    m_columns.clear();
+    m_blocks.clear();
+
+    // Header properties are stored as schema metadata
+    m_metadata.clear();
+    const PropertyMap &header = m_psf->get_header_properties().get_propmap();
+    for(PropertyMap::const_iterator i=header.begin(); i != header.end(); i++)
+	m_metadata.push_back(std::make_pair(i->first, i->second->tostring()));
+
+    if(m_format == FILE) {
+	std::string magic(ARROW_MAGIC, sizeof(ARROW_MAGIC) - 1);
+	pad_to(magic, 8);
+	output(magic.data(), magic.size());
+    }
+
+    if((int)m_psf->get_header_properties().find("PSF sweeps") > 0)
+	write_swept();
+    else
+	write_nonswept();
+
+    // End of stream marker
+    std::string buf;
+    put_le(buf, 0xffffffff, 4);
+    put_le(buf, 0, 4);
+    output(buf.data(), buf.size());
+
+    if(m_format == FILE) {
+	FlatTable footer;
+	footer.add_scalar(0, ARROW_METADATA_V5, 2);
+	footer.add_child(1, arrow_schema(m_columns, m_metadata));
+	footer.add_child(2, new FlatStructVector(8));
+
+	FlatStructVector *blocks = new FlatStructVector(8);
+	for(std::vector<Block>::const_iterator i=m_blocks.begin(); i != m_blocks.end(); i++) {
+	    std::string block;
+	    put_le(block, i->offset, 8);
+	    put_le(block, i->metadatalength, 4);
+	    put_le(block, 0, 4);
+	    put_le(block, i->bodylength, 8);
+	    blocks->add(block);
+	}
+	footer.add_child(3, blocks);
+
+	buf = flatbuffer(footer);
+	put_le(buf, buf.size(), 4);
+	buf.append(ARROW_MAGIC, sizeof(ARROW_MAGIC) - 1);
+	output(buf.data(), buf.size());
+    }
+
+    flush();
+    m_fd = -1;
+}
+
+void PSFArrowExport::write_swept() {
+    const ValueSectionSweep &values = m_psf->get_value_section_sweep();
+    const DataTypeRef &sweep = dynamic_cast<const DataTypeRef &>(*m_psf->get_sweep_section().at(0));
+
+    Column column = new_column(sweep.get_name(), sweep.get_datatype());
+    add_metadata(column, sweep.get_properties());
+    m_columns.push_back(column);
+
+    std::vector<std::string> names = m_signals;
+    if(names.empty())
+	names = m_psf->get_names();
+
+    Filter filter;
+    std::size_t rowsize = sweep.datasize();
+    for(std::vector<std::string>::const_iterator i=names.begin(); i != names.end(); i++) {
+	const DataTypeRef &trace = m_psf->get_trace_section().get_trace_by_name(*i);
+	const PropertyBlock &typeprops = trace.get_datatype().get_properties();
+
+	// Traces of the sweep parameter in waveform families have no values
+	if(m_signals.empty() && typeprops.hasprop("key") && typeprops.find("key").tostring() == "sweep")
+	    continue;
+
+	column = new_column(*i, trace.get_datatype());
+	add_metadata(column, trace.get_properties());
+	m_columns.push_back(column);
+
+	filter.push_back(&trace);
+	rowsize += trace.datasize();
+    }
+
+    int batchsize = m_batchsize;
+    if(batchsize == 0)
+	batchsize = std::max(1, std::min(MAX_BATCH_POINTS, (int)(BATCH_BYTES / rowsize)));
+
+    write_schema();
+
+    int npoints = values.get_npoints();
+    for(int start=0; start < npoints; start += batchsize) {
+	SweepValue *v = values.get_values(filter, start, batchsize);
+
+	std::vector<PSFVector *> vectors;
+	vectors.push_back(v->get_param_values());
+	vectors.insert(vectors.end(), v->begin(), v->end());
+
+	write_batch(vectors[0]->size(), vectors);
+
+	delete v;
+    }
+}
+
+void PSFArrowExport::write_nonswept() {
+    const ValueSectionNonSweep &values = m_psf->get_value_section_nonsweep();
+
+    std::vector<std::string> names = m_signals;
+    if(names.empty())
+	names = m_psf->get_names();
+
+    std::vector<PSFVector *> vectors;
+    for(std::vector<std::string>::const_iterator i=names.begin(); i != names.end(); i++) {
+	const NonSweepValue &value = dynamic_cast<const NonSweepValue &>(values.get_child(*i));
+
+	Column column = new_column(*i, value.get_datatype());
+	add_metadata(column, value.get_properties());
+	m_columns.push_back(column);
+
+	PSFVector *vec = value.get_datatype().new_vector();
+	if(StructVector *structvec = dynamic_cast<StructVector *>(vec))
+	    structvec->push_back(dynamic_cast<const StructScalar &>(value.get_value()).value);
+	else {
+	    vec->resize(1);
+	    vec->assign_scalar(0, value.get_value());
+	}
+	vectors.push_back(vec);
+    }
+
+    write_schema();
+
+    try {
+	write_batch(1, vectors);
+    } catch (...) {
+	for(std::vector<PSFVector *>::const_iterator i=vectors.begin(); i != vectors.end(); i++)
+	    delete *i;
+	throw;
+    }
+
+    for(std::vector<PSFVector *>::const_iterator i=vectors.begin(); i != vectors.end(); i++)
+	delete *i;
+}
+
+void PSFArrowExport::write_schema() {
+    FlatTable *message = arrow_message(ARROW_HEADER_SCHEMA, arrow_schema(m_columns, m_metadata), 0);
+    write_message(flatbuffer(*message), "");
+    delete message;
+}
+
+void PSFArrowExport::write_batch(int n, const std::vector<PSFVector *> &vectors) {
+    std::string nodes, buffers, body;
+
+    for(std::size_t i=0; i < m_columns.size(); i++)
+	put_column(nodes, buffers, body, m_columns[i], vectors[i]);
+
+    FlatStructVector *nodevec = new FlatStructVector(8);
+    for(std::size_t i=0; i < nodes.size(); i += 16)
+	nodevec->add(nodes.substr(i, 16));
+
+    FlatStructVector *buffervec = new FlatStructVector(8);
+    for(std::size_t i=0; i < buffers.size(); i += 16)
+	buffervec->add(buffers.substr(i, 16));
+
+    FlatTable *batch = new FlatTable();
+    batch->add_scalar(0, n, 8);
+    batch->add_child(1, nodevec);
+    batch->add_child(2, buffervec);
+
+    Block block;
+    block.offset = m_pos;
+    block.bodylength = body.size();
+
+    FlatTable *message = arrow_message(ARROW_HEADER_RECORDBATCH, batch, body.size());
+    std::string header = flatbuffer(*message);
+    delete message;
+
+    block.metadatalength = write_message(header, body);
+    m_blocks.push_back(block);
+}
+
+//
+// Write an encapsulated message, returns the size of its metadata
+//
+uint32_t PSFArrowExport::write_message(const std::string &header, const std::string &body) {
+    // The body must start at a multiple of 8 bytes
+    uint32_t size = (header.size() + 8 + 7) / 8 * 8 - 8;
+
+    std::string buf;
+    put_le(buf, 0xffffffff, 4);
+    put_le(buf, size, 4);
+    buf += header;
+    buf.append(size - header.size(), '\0');
+    output(buf.data(), buf.size());
+    output(body.data(), body.size());
+
+    return size + 8;
+}
+
+void PSFArrowExport::output(const char *buf, std::size_t size) {
+    m_outbuf.append(buf, size);
+    m_pos += size;
+
+    if(m_outbuf.size() >= WRITEBUFFER_SIZE)
+	flush();
+}
+
+void PSFArrowExport::flush() {
+    const char *p = m_outbuf.data();
+    std::size_t left = m_outbuf.size();
+
+    while(left > 0) {
+	ssize_t n = ::write(m_fd, p, left);
+	if(n < 0)
+	    throw FileWriteError();
+	p += n;
+	left -= n;
+    }
+    m_outbuf.clear();
+}
@@ -0,0 +1,301 @@
+#include "psfasync.h"
+#include "psfinternal.h"
+#include "psfthread.h"
+
+#include <algorithm>
+#include <new>
+
+// Exceptions are passed from the worker threads to the waiting thread
+enum AsyncError {ASYNC_OK, ASYNC_CANCELLED, ASYNC_NOTFOUND, ASYNC_NOTIMPLEMENTED,
+		 ASYNC_DATASETNOTOPEN, ASYNC_FILEREADERROR, ASYNC_INVALIDFILEERROR,
+		 ASYNC_NOMEMORY};
+
+//
+// State shared by a future and the task of its extraction, deleted by the
+// last of them
+//
+struct PSFFuture::State {
+    enum Status {QUEUED, RUNNING, DONE};
+
+    State() : status(QUEUED), error(ASYNC_OK), cancel(false), refs(2) {}
+    ~State() { clear(); }
+
+    void clear() {
+	for(std::vector<PSFBase *>::iterator i=values.begin(); i != values.end(); i++)
+	    delete *i;
+	values.clear();
+    }
+
+    // Called with the mutex held
+    void finish(AsyncError e) {
+	if(e != ASYNC_OK)
+	    clear();
+	error = e;
+	status = DONE;
+	finished.broadcast();
+    }
+
+    bool cancelled() const { return __atomic_load_n(&cancel, __ATOMIC_RELAXED); }
+
+    void release() {
+	mutex.lock();
+	bool last = --refs == 0;
+	mutex.unlock();
+
+	if(last)
+	    delete this;
+    }
+
+    void rethrow() const {
+	switch(error) {
+	case ASYNC_CANCELLED: throw Cancelled();
+	case ASYNC_NOTFOUND: throw NotFound();
+	case ASYNC_NOTIMPLEMENTED: throw NotImplemented();
+	case ASYNC_DATASETNOTOPEN: throw DataSetNotOpen();
+	case ASYNC_FILEREADERROR: throw FileReadError();
+	case ASYNC_INVALIDFILEERROR: throw InvalidFileError();
+	case ASYNC_NOMEMORY: throw std::bad_alloc();
+	default: break;
+	}
+    }
+
+    Mutex mutex;
+    Condition finished;
+    Status status;
+    AsyncError error;
+    bool cancel;
+    int refs;
+
+    std::vector<PSFBase *> values;
+};
+
+PSFFuture::~PSFFuture() {
+    cancel();
+    m_state->release();
+}
+
+bool PSFFuture::ready() const {
+    ScopedLock lock(m_state->mutex);
+    return m_state->status == State::DONE;
+}
+
+void PSFFuture::wait() const {
+    ScopedLock lock(m_state->mutex);
+
+    while(m_state->status != State::DONE)
+	m_state->finished.wait(m_state->mutex);
+}
+
+void PSFFuture::cancel() {
+    ScopedLock lock(m_state->mutex);
+
+    if(m_state->status == State::QUEUED)
+	m_state->finish(ASYNC_CANCELLED);
+    else if(m_state->status == State::RUNNING)
+	__atomic_store_n(&m_state->cancel, true, __ATOMIC_RELAXED);
+}
+
+bool PSFFuture::cancelled() const {
+    ScopedLock lock(m_state->mutex);
+    return m_state->status == State::DONE && m_state->error == ASYNC_CANCELLED;
+}
+
+const std::vector<PSFBase *> &PSFFuture::get_all() const {
+    wait();
+    m_state->rethrow();
+    return m_state->values;
+}
+
+PSFBase *PSFFuture::get() const {
+    const std::vector<PSFBase *> &values = get_all();
+
+    if(values.empty())
+	throw NotFound();
+
+    return values[0];
+}
+
+class PSFAsyncReader::ExtractTask: public WorkerPool::Task {
+public:
+    ExtractTask(const PSFAsyncReader *reader, const std::vector<std::string> &names,
+		PSFFuture::State *state) : m_reader(reader), m_names(names), m_state(state) {}
+
+    // Tasks that never ran are deleted by the pool
+    ~ExtractTask() {
+	m_state->mutex.lock();
+	if(m_state->status != PSFFuture::State::DONE)
+	    m_state->finish(ASYNC_CANCELLED);
+	m_state->mutex.unlock();
+
+	m_state->release();
+    }
+
+    void run() {
+	{
+	    ScopedLock lock(m_state->mutex);
+	    if(m_state->status != PSFFuture::State::QUEUED)
+		return;
+	    m_state->status = PSFFuture::State::RUNNING;
+	}
+
+	AsyncError error = ASYNC_OK;
+	try {
+	    if(!m_reader->extract(m_names, m_state))
+		error = ASYNC_CANCELLED;
+	} catch (const NotFound &) {
+	    error = ASYNC_NOTFOUND;
+	} catch (const NotImplemented &) {
+	    error = ASYNC_NOTIMPLEMENTED;
+	} catch (const DataSetNotOpen &) {
+	    error = ASYNC_DATASETNOTOPEN;
+	} catch (const FileReadError &) {
+	    error = ASYNC_FILEREADERROR;
+	} catch (const std::bad_alloc &) {
+	    error = ASYNC_NOMEMORY;
+	} catch (...) {
+	    error = ASYNC_INVALIDFILEERROR;
+	}
+
+	ScopedLock lock(m_state->mutex);
+	if(error == ASYNC_OK && m_state->cancelled())
+	    error = ASYNC_CANCELLED;
+	m_state->finish(error);
+    }
+
+private:
+    const PSFAsyncReader *m_reader;
+    std::vector<std::string> m_names;
+    PSFFuture::State *m_state;
+};
+
+class PSFAsyncReader::PrefetchTask: public WorkerPool::Task {
+public:
+    PrefetchTask(const PSFDataSet &ds, const std::vector<std::string> &names, int start, int n) :
+	m_ds(ds), m_names(names), m_start(start), m_n(n) {}
+
+    void run() {
+	try {
+	    if(!m_ds.is_swept())
+		return;
+
+	    // The values of a point are stored together, so the pages of any
+	    // known signal span the whole value section of the range
+	    for(std::vector<std::string>::const_iterator i=m_names.begin(); i != m_names.end(); i++) {
+		try {
+		    m_ds.m_psf->get_trace_section().get_trace_by_name(*i);
+		} catch (const NotFound &) {
+		    continue;
+		}
+
+		// Seeking the first point builds the window index
+		m_ds.prefetch(m_start, m_n < 0 ? m_ds.get_sweep_npoints() : m_n);
+		m_ds.get_sweep_shape();
+		break;
+	    }
+	} catch (...) {
+	    // Errors are reported by the extraction
+	}
+    }
+
+private:
+    const PSFDataSet &m_ds;
+    std::vector<std::string> m_names;
+    int m_start, m_n;
+};
+
+PSFAsyncReader::PSFAsyncReader(const PSFDataSet &ds, int nworkers, int blocksize) :
+    m_ds(ds), m_blocksize(blocksize < 1 ? DEFAULT_BLOCKSIZE : blocksize), m_closing(false) {
+    m_pool = new WorkerPool(nworkers);
+}
+
+PSFAsyncReader::~PSFAsyncReader() {
+    // Running extractions stop after their block, queued ones are cancelled
+    // when the pool deletes them
+    __atomic_store_n(&m_closing, true, __ATOMIC_RELAXED);
+    delete m_pool;
+}
+
+PSFFuture *PSFAsyncReader::get_signal_async(const std::string &name) {
+    return get_signals_async(std::vector<std::string>(1, name));
+}
+
+PSFFuture *PSFAsyncReader::get_signals_async(const std::vector<std::string> &names) {
+    PSFFuture::State *state = new PSFFuture::State();
+    PSFFuture *future = new PSFFuture(state);
+
+    m_pool->submit(new ExtractTask(this, names, state));
+
+    return future;
+}
+
+void PSFAsyncReader::prefetch(const std::vector<std::string> &names, int start, int n) {
+    m_pool->submit(new PrefetchTask(m_ds, names, start, n));
+}
+
+void PSFAsyncReader::wait() {
+    m_pool->wait();
+}
+
+bool PSFAsyncReader::extract(const std::vector<std::string> &names, PSFFuture::State *state) const {
+    std::vector<PSFBase *> &values = state->values;
+
+    if(!m_ds.is_swept()) {
+	for(unsigned int i=0; i < names.size(); i++)
+	    values.push_back(m_ds.get_signal(names[i]));
+	return true;
+    }
+
+    int npoints = m_ds.get_sweep_npoints();
+
+    // Real signals are decoded together, complex signals one at a time and
+    // other signals at once
+    std::vector<std::string> realnames, complexnames;
+    std::vector<PSFDoubleVector *> reals;
+    std::vector<PSFComplexDoubleVector *> complexes;
+
+    for(unsigned int i=0; i < names.size(); i++) {
+	const DataTypeRef &trace = m_ds.m_psf->get_trace_section().get_trace_by_name(names[i]);
+
+	switch(trace.get_def().m_datatypeid) {
+	case TYPEID_INT8:
+	case TYPEID_INT32:
+	case TYPEID_DOUBLE:
+	    reals.push_back(new PSFDoubleVector());
+	    reals.back()->resize(npoints);
+	    values.push_back(reals.back());
+	    realnames.push_back(names[i]);
+	    break;
+	case TYPEID_COMPLEXDOUBLE:
+	    complexes.push_back(new PSFComplexDoubleVector());
+	    complexes.back()->resize(npoints);
+	    values.push_back(complexes.back());
+	    complexnames.push_back(names[i]);
+	    break;
+	default:
+	    values.push_back(m_ds.get_signal(names[i]));
+	}
+    }
+
+    std::vector<double *> outs(reals.size());
+
+    for(int start=0; start < npoints; start += m_blocksize) {
+	if(state->cancelled() || __atomic_load_n(&m_closing, __ATOMIC_RELAXED))
+	    return false;
+
+	int n = std::min(m_blocksize, npoints - start);
+
+	if(!reals.empty()) {
+	    for(unsigned int i=0; i < reals.size(); i++)
+		outs[i] = &(*reals[i])[start];
+	    m_ds.m_psf->get_values_into(realnames, start, n, &outs[0], (double *)NULL);
+	}
+
+	for(unsigned int i=0; i < complexes.size(); i++) {
+	    PSFComplexDouble *out = &(*complexes[i])[start];
+	    m_ds.m_psf->get_values_into(std::vector<std::string>(1, complexnames[i]), start, n,
+					&out, (double *)NULL);
+	}
+    }
+
+    return true;
+}
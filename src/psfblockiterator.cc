@@ -0,0 +1,72 @@
+#include "psfblockiterator.h"
+#include "psfinternal.h"
+
+struct PSFBlockIterator::State {
+    State(const ValueSectionSweep &values, int blocksize) :
+	values(values), blocksize(blocksize), value(values.new_value()),
+	block(values.end()), end(values.end()), started(false) {}
+    ~State() { delete value; }
+
+    const ValueSectionSweep &values;
+    int blocksize;
+    Filter filter;
+    SweepValue *value;
+    ValueSectionSweep::iterator block, end;
+    bool started;
+};
+
+PSFBlockIterator::PSFBlockIterator(const PSFDataSet &ds, const std::vector<std::string> &names,
+				   int blocksize) : m_state(NULL) {
+    if(!ds.is_swept())
+	throw NotImplemented();
+
+    if(blocksize < 1)
+	blocksize = DEFAULT_BLOCKSIZE;
+
+    const ValueSectionSweep &values = ds.m_psf->get_value_section_sweep();
+
+    m_state = new State(values, blocksize);
+
+    try {
+	for(std::vector<std::string>::const_iterator i=names.begin(); i != names.end(); i++)
+	    m_state->filter.push_back(&ds.m_psf->get_trace_section().get_trace_by_name(*i));
+    } catch (...) {
+	delete m_state;
+	throw;
+    }
+}
+
+PSFBlockIterator::~PSFBlockIterator() {
+    delete m_state;
+}
+
+bool PSFBlockIterator::next() {
+    // The first block is decoded by the first call of next()
+    if(!m_state->started) {
+	m_state->block = m_state->values.begin(m_state->value, m_state->filter, m_state->blocksize);
+	m_state->started = true;
+    } else if(m_state->block != m_state->end)
+	++m_state->block;
+
+    return m_state->block != m_state->end;
+}
+
+int PSFBlockIterator::get_start() const {
+    return m_state->block.get_point();
+}
+
+int PSFBlockIterator::size() const {
+    return m_state->block.get_n();
+}
+
+int PSFBlockIterator::get_nsignals() const {
+    return m_state->filter.size();
+}
+
+const PSFVector &PSFBlockIterator::get_sweep_values() const {
+    return *m_state->value->get_param_values();
+}
+
+const PSFVector &PSFBlockIterator::get_values(int i) const {
+    return *m_state->value->at(i);
+}
@@ -0,0 +1,196 @@
+#include "psf.h"
+#include "psfclient.h"
+#include "psfsocket.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <sstream>
+
+std::string psfd_default_socket() {
+    const char *dir = getenv("XDG_RUNTIME_DIR");
+
+    if(dir && *dir)
+	return std::string(dir) + "/psfd.sock";
+
+    std::stringstream path;
+    path << "/tmp/psfd-" << getuid() << ".sock";
+    return path.str();
+}
+
+static std::string absolute_path(const std::string &filename) {
+    char *path = realpath(filename.c_str(), NULL);
+
+    if(!path)
+	throw FileOpenError();
+
+    std::string result(path);
+    free(path);
+    return result;
+}
+
+static std::string format_int(int value) {
+    std::stringstream s;
+    s << value;
+    return s.str();
+}
+
+PSFSharedArray::PSFSharedArray(int fd, int npoints, bool complex) :
+    m_data(NULL), m_npoints(npoints), m_complex(complex) {
+    m_size = (size_t)npoints * (complex ? sizeof(PSFComplexDouble) : sizeof(double));
+
+    if(m_size > 0) {
+	m_data = mmap(0, m_size, PROT_READ, MAP_SHARED, fd, 0);
+
+	if(m_data == MAP_FAILED) {
+	    close(fd);
+	    throw ConnectionError();
+	}
+    }
+
+    // The mapping keeps the segment
+    close(fd);
+}
+
+PSFSharedArray::~PSFSharedArray() {
+    if(m_data)
+	munmap(m_data, m_size);
+}
+
+PSFClient::PSFClient(const std::string &path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+
+    if(path.size() >= sizeof(addr.sun_path))
+	throw ConnectionError();
+    strcpy(addr.sun_path, path.c_str());
+
+    m_sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(m_sock == -1)
+	throw ConnectionError();
+
+    if(connect(m_sock, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+	close(m_sock);
+	throw ConnectionError();
+    }
+}
+
+PSFClient::~PSFClient() {
+    close(m_sock);
+}
+
+std::vector<std::string> PSFClient::request(const std::vector<std::string> &message, int *fd) {
+    send_message(m_sock, message);
+
+    Message reply;
+    int passed;
+    if(!recv_message(m_sock, reply, &passed))
+	throw ConnectionError();
+
+    if(reply[0] == "ok") {
+	if(fd)
+	    *fd = passed;
+	else if(passed != -1)
+	    close(passed);
+
+	reply.erase(reply.begin());
+	return reply;
+    }
+
+    if(passed != -1)
+	close(passed);
+
+    const std::string &error = reply.size() > 1 ? reply[1] : "";
+    if(error == "NotFound")
+	throw NotFound();
+    else if(error == "FileOpenError")
+	throw FileOpenError();
+    else if(error == "InvalidFileError")
+	throw InvalidFileError();
+    else if(error == "FileReadError")
+	throw FileReadError();
+    else if(error == "NotImplemented")
+	throw NotImplemented();
+    else
+	throw ServerError();
+}
+
+PSFSharedArray *PSFClient::request_array(const std::vector<std::string> &message) {
+    int fd;
+    std::vector<std::string> reply = request(message, &fd);
+
+    if(reply.size() != 2 || fd == -1) {
+	if(fd != -1)
+	    close(fd);
+	throw ConnectionError();
+    }
+
+    return new PSFSharedArray(fd, atoi(reply[1].c_str()), reply[0] == "complex");
+}
+
+std::vector<std::string> PSFClient::list() {
+    return request(std::vector<std::string>(1, "list"));
+}
+
+std::vector<std::string> PSFClient::get_signal_names(const std::string &filename) {
+    std::vector<std::string> message;
+    message.push_back("names");
+    message.push_back(absolute_path(filename));
+
+    return request(message);
+}
+
+PSFSharedArray *PSFClient::get_signal(const std::string &filename, const std::string &name,
+				      int start, int n) {
+    std::vector<std::string> message;
+    message.push_back("signal");
+    message.push_back(absolute_path(filename));
+    message.push_back(name);
+    message.push_back(format_int(start));
+    message.push_back(format_int(n));
+
+    return request_array(message);
+}
+
+PSFSharedArray *PSFClient::get_sweep_values(const std::string &filename, int start, int n) {
+    std::vector<std::string> message;
+    message.push_back("sweep");
+    message.push_back(absolute_path(filename));
+    message.push_back(format_int(start));
+    message.push_back(format_int(n));
+
+    return request_array(message);
+}
+
+PSFSweepReduction PSFClient::get_signal_reduction(const std::string &filename, const std::string &name,
+						  int start, int n) {
+    std::vector<std::string> message;
+    message.push_back("reduce");
+    message.push_back(absolute_path(filename));
+    message.push_back(name);
+    message.push_back(format_int(start));
+    message.push_back(format_int(n));
+
+    std::vector<std::string> reply = request(message);
+    if(reply.size() != 10)
+	throw ConnectionError();
+
+    PSFSweepReduction result;
+    result.npoints = atoi(reply[0].c_str());
+    result.xstart = strtod(reply[1].c_str(), NULL);
+    result.xend = strtod(reply[2].c_str(), NULL);
+    result.min = strtod(reply[3].c_str(), NULL);
+    result.max = strtod(reply[4].c_str(), NULL);
+    result.min_x = strtod(reply[5].c_str(), NULL);
+    result.max_x = strtod(reply[6].c_str(), NULL);
+    result.average = strtod(reply[7].c_str(), NULL);
+    result.rms = strtod(reply[8].c_str(), NULL);
+    result.integral = strtod(reply[9].c_str(), NULL);
+
+    return result;
+}
@@ -0,0 +1,144 @@
+#include "psf.h"
+#include "psfdata.h"
+#include "psfinternal.h"
+
+#include <math.h>
+
+//
+// Kernels of the real outputs of complex values held in separate real and
+// imaginary arrays. The loops have no dependencies between points, except
+// for unwrapping, so the compiler can vectorize them.
+//
+static void magnitude(const double *re, const double *im, int n, double *out) {
+    for(int i=0; i < n; i++)
+	out[i] = sqrt(re[i] * re[i] + im[i] * im[i]);
+}
+
+// 20 log10 |z| as 10 log10 |z|^2, which saves the square root
+static void db20(const double *re, const double *im, int n, double *out) {
+    for(int i=0; i < n; i++)
+	out[i] = 10 * log10(re[i] * re[i] + im[i] * im[i]);
+}
+
+static void phase(const double *re, const double *im, int n, double *out) {
+    for(int i=0; i < n; i++)
+	out[i] = atan2(im[i], re[i]) * (180 / M_PI);
+}
+
+// Add multiples of 360 degrees to remove jumps larger than 180 degrees
+static void unwrap(const double *phase, int n, double *out) {
+    double correction = 0;
+
+    for(int i=0; i < n; i++) {
+	if(i > 0) {
+	    double d = phase[i] - phase[i - 1];
+
+	    if(fabs(d) > 180)
+		correction -= 360 * floor((d + 180) / 360);
+	}
+	out[i] = phase[i] + correction;
+    }
+}
+
+// -dphase/domega from the unwrapped phase in degrees, central differences
+// inside the sweep and one sided differences at its ends
+static void group_delay(const double *x, const double *phase, int n, double *out) {
+    for(int i=0; i < n; i++) {
+	int lo = std::max(i - 1, 0), hi = std::min(i + 1, n - 1);
+
+	if(hi > lo && x[hi] != x[lo])
+	    out[i] = -(phase[hi] - phase[lo]) / (x[hi] - x[lo]) / 360;
+	else
+	    out[i] = NAN;
+    }
+}
+
+std::vector<PSFVector *> ValueSectionSweep::get_complex(const std::string &name,
+							const std::vector<PSFComplexOutput> &outputs,
+							int start, int n) const {
+    const DataTypeRef &trace = m_psf->get_trace_section().get_trace_by_name(name);
+
+    switch(trace.get_def().m_datatypeid) {
+    case TYPEID_INT8:
+    case TYPEID_INT32:
+    case TYPEID_DOUBLE:
+    case TYPEID_COMPLEXDOUBLE:
+	break;
+    default:
+	throw NotImplemented();
+    }
+
+    Filter filter;
+    filter.push_back(&trace);
+
+    // Clip the range to the available points
+    if(start < 0)
+	start = 0;
+    if(start > m_npoints)
+	start = m_npoints;
+    if(n > m_npoints - start)
+	n = m_npoints - start;
+    if(n < 0)
+	n = 0;
+
+    // Decode into separate arrays in one pass
+    std::vector<double> x, re, im;
+    x.reserve(n);
+    re.reserve(n);
+    im.reserve(n);
+
+    std::vector<ComplexCollector> collectors(1, ComplexCollector(&x, &re, &im));
+    reduce(filter, start, n, collectors);
+
+    // The phase and unwrapped phase are shared by the outputs that need them
+    std::vector<double> wrapped, unwrapped;
+    for(std::vector<PSFComplexOutput>::const_iterator i=outputs.begin(); i != outputs.end(); i++)
+	if(*i == COMPLEX_PHASE_UNWRAPPED || *i == COMPLEX_GROUP_DELAY) {
+	    wrapped.resize(n);
+	    unwrapped.resize(n);
+	    if(n > 0) {
+		phase(&re[0], &im[0], n, &wrapped[0]);
+		unwrap(&wrapped[0], n, &unwrapped[0]);
+	    }
+	    break;
+	}
+
+    std::vector<PSFVector *> result;
+    for(std::vector<PSFComplexOutput>::const_iterator i=outputs.begin(); i != outputs.end(); i++) {
+	PSFDoubleVector *vec = new PSFDoubleVector();
+	result.push_back(vec);
+	vec->resize(n);
+
+	if(n == 0)
+	    continue;
+
+	double *out = &vec->at(0);
+
+	switch(*i) {
+	case COMPLEX_REAL:
+	    std::copy(re.begin(), re.end(), out);
+	    break;
+	case COMPLEX_IMAG:
+	    std::copy(im.begin(), im.end(), out);
+	    break;
+	case COMPLEX_MAG:
+	    magnitude(&re[0], &im[0], n, out);
+	    break;
+	case COMPLEX_DB20:
+	    db20(&re[0], &im[0], n, out);
+	    break;
+	case COMPLEX_PHASE:
+	    phase(&re[0], &im[0], n, out);
+	    break;
+	case COMPLEX_PHASE_UNWRAPPED:
+	    std::copy(unwrapped.begin(), unwrapped.end(), out);
+	    break;
+	case COMPLEX_GROUP_DELAY:
+	    group_delay(&x[0], &unwrapped[0], n, out);
+	    break;
+	}
+    }
+    PSF_STATS_ADD(objects_allocated, outputs.size());
+
+    return result;
+}
@@ -0,0 +1,307 @@
+#include "psf.h"
+#include "psfcompress.h"
+
+#include <unistd.h>
+#include <string.h>
+#include <limits.h>
+
+#include <algorithm>
+
+// Read exactly len bytes at offset, returns false at the end of the file
+static bool read_at(int fd, void *buf, size_t len, off_t offset) {
+    char *dest = (char *)buf;
+
+    while(len > 0) {
+	ssize_t n = pread(fd, dest, len, offset);
+
+	if(n < 0)
+	    throw FileReadError();
+	if(n == 0)
+	    return false;
+
+	dest += n;
+	offset += n;
+	len -= n;
+    }
+
+    return true;
+}
+
+CompressedFile::CompressedFile(int fd) :
+    m_fd(fd), m_size(0), m_active(false), m_raw(false), m_in(0), m_out(0), m_inbuf(CHUNK) {
+    if(!_index_members())
+	_index_stream();
+}
+
+CompressedFile::~CompressedFile() {
+    if(m_active)
+	inflateEnd(&m_stream);
+}
+
+bool CompressedFile::is_compressed(int fd) {
+    unsigned char magic[2];
+
+    return read_at(fd, magic, 2, 0) && magic[0] == 0x1f && magic[1] == 0x8b;
+}
+
+//
+// Index the members of a file where each member has the BGZF extra field
+// with its compressed size. Returns false for other files.
+//
+bool CompressedFile::_index_members() {
+    off_t end = lseek(m_fd, 0, SEEK_END);
+    off_t offset = 0;
+    off_t out = 0;
+
+    std::vector<AccessPoint> index;
+
+    while(offset < end) {
+	// Fixed header, extra field length and the BGZF subfield
+	unsigned char header[18];
+	if(!read_at(m_fd, header, sizeof(header), offset))
+	    return false;
+
+	if(header[0] != 0x1f || header[1] != 0x8b || header[2] != 8 || !(header[3] & 4))
+	    return false;
+
+	int xlen = header[10] | header[11] << 8;
+	if(xlen != 6 || header[12] != 'B' || header[13] != 'C' || header[14] != 2 || header[15] != 0)
+	    return false;
+
+	int blocksize = (header[16] | header[17] << 8) + 1;
+
+	// Decompressed size of the member
+	unsigned char trailer[4];
+	if(!read_at(m_fd, trailer, sizeof(trailer), offset + blocksize - 4))
+	    return false;
+	uint32_t isize = trailer[0] | trailer[1] << 8 | trailer[2] << 16 | (uint32_t)trailer[3] << 24;
+
+	if(isize > 0) {
+	    AccessPoint point;
+	    point.in = offset;
+	    point.out = out;
+	    point.bits = 0;
+	    index.push_back(point);
+	}
+
+	offset += blocksize;
+	out += isize;
+    }
+
+    if(index.empty())
+	return false;
+
+    m_index.swap(index);
+    m_size = out;
+
+    return true;
+}
+
+//
+// Decompress the whole file and save an access point after about every
+// SPAN bytes of output and at the start of each member.
+//
+void CompressedFile::_index_stream() {
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+
+    if(inflateInit2(&strm, 31) != Z_OK)
+	throw InvalidFileError();
+
+    std::vector<unsigned char> window(WINSIZE);
+
+    off_t totin = 0;
+    off_t totout = 0, last = 0;
+
+    AccessPoint start;
+    start.in = 0;
+    start.out = 0;
+    start.bits = 0;
+    m_index.push_back(start);
+
+    bool memberend = false, padding = false;
+
+    try {
+	while(!padding) {
+	    ssize_t n = pread(m_fd, &m_inbuf[0], m_inbuf.size(), totin);
+
+	    if(n < 0)
+		throw FileReadError();
+	    if(n == 0)
+		break;
+
+	    strm.next_in = &m_inbuf[0];
+	    strm.avail_in = n;
+
+	    do {
+		if(memberend) {
+		    // Next member, unless the rest of the file is padding
+		    if(strm.next_in[0] != 0x1f) {
+			padding = true;
+			break;
+		    }
+
+		    AccessPoint point;
+		    point.in = totin;
+		    point.out = totout;
+		    point.bits = 0;
+		    m_index.push_back(point);
+
+		    inflateReset(&strm);
+		    memberend = false;
+		    last = totout;
+		}
+
+		if(strm.avail_out == 0) {
+		    strm.next_out = &window[0];
+		    strm.avail_out = WINSIZE;
+		}
+
+		totin += strm.avail_in;
+		totout += strm.avail_out;
+		int ret = inflate(&strm, Z_BLOCK);
+		totin -= strm.avail_in;
+		totout -= strm.avail_out;
+
+		if(ret == Z_NEED_DICT || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR)
+		    throw InvalidFileError();
+
+		if(ret == Z_STREAM_END) {
+		    memberend = true;
+		    continue;
+		}
+
+		// At the end of a deflate block that is not the last one
+		if((strm.data_type & 128) && !(strm.data_type & 64) && totout - last > SPAN) {
+		    AccessPoint point;
+		    point.in = totin;
+		    point.out = totout;
+		    point.bits = strm.data_type & 7;
+
+		    // Unwrap the circular output window
+		    int left = strm.avail_out;
+		    point.window.resize(WINSIZE);
+		    if(left)
+			memcpy(&point.window[0], &window[WINSIZE - left], left);
+		    if(left < WINSIZE)
+			memcpy(&point.window[left], &window[0], WINSIZE - left);
+
+		    m_index.push_back(point);
+		    last = totout;
+		}
+	    } while(strm.avail_in != 0);
+	}
+    } catch (...) {
+	inflateEnd(&strm);
+	throw;
+    }
+
+    inflateEnd(&strm);
+
+    // Truncated file
+    if(!memberend)
+	throw InvalidFileError();
+
+    m_size = totout;
+}
+
+void CompressedFile::read(char *dest, off_t offset, long len) {
+    if(offset < 0 || len < 0 || offset + len > m_size)
+	throw FileReadError();
+
+    // Last access point before the offset
+    const AccessPoint *point = NULL;
+    for(int lo=0, hi=m_index.size(); lo < hi;) {
+	int mid = (lo + hi) / 2;
+
+	if(m_index[mid].out <= offset) {
+	    point = &m_index[mid];
+	    lo = mid + 1;
+	} else
+	    hi = mid;
+    }
+
+    // Continue the previous read unless an access point is closer
+    if(!m_active || offset < m_out || point->out > m_out)
+	_start(*point);
+
+    _inflate(NULL, offset - m_out);
+    _inflate(dest, len);
+}
+
+void CompressedFile::_start(const AccessPoint &point) {
+    if(m_active)
+	inflateEnd(&m_stream);
+
+    memset(&m_stream, 0, sizeof(m_stream));
+    m_active = false;
+
+    m_raw = !point.window.empty();
+    if(inflateInit2(&m_stream, m_raw ? -15 : 31) != Z_OK)
+	throw FileReadError();
+    m_active = true;
+
+    m_in = point.in;
+    m_out = point.out;
+
+    if(point.bits) {
+	unsigned char byte;
+	if(!read_at(m_fd, &byte, 1, m_in - 1))
+	    throw FileReadError();
+	inflatePrime(&m_stream, point.bits, byte >> (8 - point.bits));
+    }
+
+    if(m_raw)
+	inflateSetDictionary(&m_stream, &point.window[0], point.window.size());
+}
+
+//
+// Decompress the next len bytes into dest, or skip them if dest is NULL
+//
+void CompressedFile::_inflate(char *dest, long len) {
+    std::vector<unsigned char> discard(dest ? 0 : std::min(len, (long)CHUNK));
+
+    while(len > 0) {
+	if(m_stream.avail_in == 0) {
+	    ssize_t n = pread(m_fd, &m_inbuf[0], m_inbuf.size(), m_in);
+
+	    if(n <= 0)
+		throw FileReadError();
+
+	    m_in += n;
+	    m_stream.next_in = &m_inbuf[0];
+	    m_stream.avail_in = n;
+	}
+
+	long chunk = std::min(len, (long)(dest ? INT_MAX : discard.size()));
+	m_stream.next_out = dest ? (Bytef *)dest : &discard[0];
+	m_stream.avail_out = chunk;
+
+	int ret = inflate(&m_stream, Z_NO_FLUSH);
+
+	long n = chunk - m_stream.avail_out;
+	m_out += n;
+	len -= n;
+	if(dest)
+	    dest += n;
+
+	if(ret == Z_STREAM_END)
+	    _next_member();
+	else if(ret != Z_OK && ret != Z_BUF_ERROR)
+	    throw FileReadError();
+    }
+}
+
+void CompressedFile::_next_member() {
+    if(m_raw) {
+	// Skip the member trailer that the raw stream leaves in the input
+	int skip = std::min(8U, m_stream.avail_in);
+	m_stream.next_in += skip;
+	m_stream.avail_in -= skip;
+	m_in += 8 - skip;
+
+	inflateReset2(&m_stream, 31);
+	m_raw = false;
+    } else
+	inflateReset(&m_stream);
+}
@@ -0,0 +1,68 @@
+#ifndef _PSF_COMPRESS
+#define _PSF_COMPRESS
+
+#include <sys/types.h>
+
+#include <vector>
+
+#include <zlib.h>
+
+//
+// Random access to a gzip compressed PSF file without decompressing it to
+// disk. An index of access points is built when the file is opened. Files
+// made of members that store their compressed size in the header, like the
+// BGZF files written by bgzip, are indexed from the member headers alone.
+// Other files are decompressed once and the decompressor state is saved
+// every SPAN bytes of output. A read that continues the previous read
+// continues its decompression, other reads start from the last access point
+// before them.
+//
+class CompressedFile {
+ public:
+    CompressedFile(int fd);
+    ~CompressedFile();
+
+    // True if the file starts with the gzip magic number
+    static bool is_compressed(int fd);
+
+    // Size of the decompressed file
+    off_t size() const { return m_size; }
+
+    // Decompress len bytes from offset of the decompressed file into dest
+    void read(char *dest, off_t offset, long len);
+
+ private:
+    static const long SPAN = 8 << 20;
+    static const int WINSIZE = 32768;
+    static const int CHUNK = 65536;
+
+    struct AccessPoint {
+	off_t in;		// Offset of the first full byte of compressed input
+	off_t out;		// Offset in the decompressed file
+	int bits;		// Number of bits of the access point in the byte before in
+	std::vector<unsigned char> window; // Dictionary, empty at the start of a member
+    };
+
+    CompressedFile(const CompressedFile &);
+    CompressedFile &operator=(const CompressedFile &);
+
+    bool _index_members();
+    void _index_stream();
+
+    void _start(const AccessPoint &point);
+    void _inflate(char *dest, long len);
+    void _next_member();
+
+    int m_fd;
+    off_t m_size;
+    std::vector<AccessPoint> m_index;
+
+    // Decompression stream of the last read
+    z_stream m_stream;
+    bool m_active, m_raw;
+    off_t m_in;
+    off_t m_out;
+    std::vector<unsigned char> m_inbuf;
+};
+
+#endif
@@ -18,9 +18,10 @@ Chunk * Container::deserialize_child(const char **buf) {
 	
     child = child_factory(childtype);
 
-    if(child)
+    if(child) {
+	PSF_STATS_ADD(objects_allocated, 1);
 	(*buf) += child->deserialize(*buf);
-    else 
+    } else 
 	// If child is NULL an endmarker was found and its chunk type shall be consumed
 	(*buf) += 4;
 
@@ -53,7 +54,7 @@ NameList Container::get_names() const {
 // SimpleContainer
 //
 
-int SimpleContainer::deserialize(const char *buf, int abspos) {
+int SimpleContainer::deserialize(const char *buf, long abspos) {
     const char *startbuf = buf;
 
     buf += Chunk::deserialize(buf);
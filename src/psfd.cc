@@ -0,0 +1,65 @@
+#include "psf.h"
+#include "psfclient.h"
+#include "psfserver.h"
+
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <string>
+
+static PSFServer *server = NULL;
+
+static void usage() {
+    std::cerr << "Usage: psfd [-s socket] [-c megabytes]" << std::endl
+	      << std::endl
+	      << "Serve queries on PSF files to local clients over a Unix domain socket." << std::endl
+	      << "Files stay open with their parsed metadata, shared by all clients, and" << std::endl
+	      << "signals are passed in shared memory. Files are opened with the rights of" << std::endl
+	      << "the user running psfd, so only clients of the same user are served." << std::endl
+	      << std::endl
+	      << "  -s socket     socket path, default " << psfd_default_socket() << std::endl
+	      << "  -c megabytes  metadata of unused files kept open, default 1024" << std::endl;
+    exit(1);
+}
+
+static void terminate(int) {
+    if(server)
+	server->stop();
+}
+
+int main(int argc, char *argv[]) {
+    std::string path = psfd_default_socket();
+    long cachesize = 1024;
+
+    int c;
+    while((c = getopt(argc, argv, "s:c:")) != -1) {
+	switch(c) {
+	case 's': path = optarg; break;
+	case 'c': cachesize = atol(optarg); break;
+	default: usage();
+	}
+    }
+
+    if(optind != argc || cachesize <= 0)
+	usage();
+
+    psf_enable_file_cache((size_t)cachesize << 20);
+
+    try {
+	server = new PSFServer(path);
+    } catch (ConnectionError &) {
+	std::cerr << "psfd: cannot listen on " << path << std::endl;
+	return 1;
+    }
+
+    signal(SIGINT, terminate);
+    signal(SIGTERM, terminate);
+    signal(SIGPIPE, SIG_IGN);
+
+    server->run();
+    delete server;
+
+    return 0;
+}
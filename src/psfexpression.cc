@@ -0,0 +1,536 @@
+#include "psf.h"
+#include "psfdata.h"
+#include "psfinternal.h"
+#include "psfexpression.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include <complex>
+
+// Points evaluated at a time, small enough for the node buffers to stay in cache
+static const int BLOCKSIZE = 4096;
+
+// Deepest nesting of parentheses, functions and unary operators, deeper
+// expressions are rejected instead of overflowing the stack of the parser
+static const int MAX_DEPTH = 256;
+
+Expression::Expression(const std::string &text) : m_text(text), m_pos(0), m_depth(0) {
+    _expr();
+
+    _skip_space();
+    if(m_pos != m_text.size())
+	throw InvalidExpression();
+}
+
+//
+// Recursive descent parser, the nodes of the operands are added before the
+// node of their operator
+//
+int Expression::_expr() {
+    int node = _term();
+
+    for(;;) {
+	if(_accept('+'))
+	    node = _add(OP_ADD, node, _term());
+	else if(_accept('-'))
+	    node = _add(OP_SUB, node, _term());
+	else
+	    return node;
+    }
+}
+
+int Expression::_term() {
+    int node = _unary();
+
+    for(;;) {
+	if(_accept('*'))
+	    node = _add(OP_MUL, node, _unary());
+	else if(_accept('/'))
+	    node = _add(OP_DIV, node, _unary());
+	else
+	    return node;
+    }
+}
+
+// Every level of nesting passes here
+int Expression::_unary() {
+    if(++m_depth > MAX_DEPTH)
+	throw InvalidExpression();
+
+    int node;
+    if(_accept('-'))
+	node = _add(OP_NEG, _unary());
+    else if(_accept('+'))
+	node = _unary();
+    else
+	node = _power();
+
+    m_depth--;
+    return node;
+}
+
+int Expression::_power() {
+    int node = _primary();
+
+    // Right associative, binds tighter than unary minus on its left
+    if(_accept('^'))
+	node = _add(OP_POW, node, _unary());
+
+    return node;
+}
+
+int Expression::_primary() {
+    _skip_space();
+
+    if(m_pos == m_text.size())
+	throw InvalidExpression();
+
+    char c = m_text[m_pos];
+
+    if(_accept('(')) {
+	int node = _expr();
+	_expect(')');
+	return node;
+    }
+
+    if(isdigit(c) || c == '.') {
+	const char *start = m_text.c_str() + m_pos;
+	char *end;
+	double value = strtod(start, &end);
+
+	if(end == start)
+	    throw InvalidExpression();
+	m_pos += end - start;
+
+	int node = _add(OP_CONST, -1);
+	m_nodes[node].value = value;
+	return node;
+    }
+
+    if(c == '"') {
+	size_t end = m_text.find('"', m_pos + 1);
+	if(end == std::string::npos)
+	    throw InvalidExpression();
+
+	std::string name = m_text.substr(m_pos + 1, end - m_pos - 1);
+	m_pos = end + 1;
+	return _signal(name);
+    }
+
+    if(!isalpha(c) && c != '_')
+	throw InvalidExpression();
+
+    // Names may contain the characters of hierarchical and bus names
+    size_t start = m_pos;
+    while(m_pos < m_text.size() && (isalnum(m_text[m_pos]) || strchr("_.:<>[]!$#", m_text[m_pos])))
+	m_pos++;
+    std::string name = m_text.substr(start, m_pos - start);
+
+    size_t namepos = m_pos;
+    if(!_accept('('))
+	return _signal(name);
+
+    if(name == "V" || name == "I" || name == "v" || name == "i") {
+	// Anything up to the closing parenthesis is the signal name
+	size_t end = m_text.find(')', m_pos);
+	if(end == std::string::npos)
+	    throw InvalidExpression();
+
+	std::string signal = m_text.substr(m_pos, end - m_pos);
+	signal.erase(0, signal.find_first_not_of(" \t"));
+	signal.erase(signal.find_last_not_of(" \t") + 1);
+	if(signal.size() > 1 && signal[0] == '"' && signal[signal.size() - 1] == '"')
+	    signal = signal.substr(1, signal.size() - 2);
+
+	m_pos = end + 1;
+	return _signal(signal);
+    }
+
+    Function function;
+    if(!_function(name, function)) {
+	m_pos = namepos;
+	throw InvalidExpression();
+    }
+
+    int arg = _expr();
+    _expect(')');
+
+    int node = _add(OP_FUNC, arg);
+    m_nodes[node].function = function;
+    return node;
+}
+
+bool Expression::_function(const std::string &name, Function &function) {
+    if(name == "abs" || name == "mag")
+	function = FUNC_ABS;
+    else if(name == "phase")
+	function = FUNC_PHASE;
+    else if(name == "real")
+	function = FUNC_REAL;
+    else if(name == "imag")
+	function = FUNC_IMAG;
+    else if(name == "db10")
+	function = FUNC_DB10;
+    else if(name == "db20")
+	function = FUNC_DB20;
+    else if(name == "sqrt")
+	function = FUNC_SQRT;
+    else if(name == "exp")
+	function = FUNC_EXP;
+    else if(name == "log")
+	function = FUNC_LOG;
+    else if(name == "log10")
+	function = FUNC_LOG10;
+    else if(name == "sin")
+	function = FUNC_SIN;
+    else if(name == "cos")
+	function = FUNC_COS;
+    else if(name == "tan")
+	function = FUNC_TAN;
+    else
+	return false;
+
+    return true;
+}
+
+int Expression::_add(Op op, int a, int b) {
+    Node node;
+    node.op = op;
+    node.function = FUNC_ABS;
+    node.a = a;
+    node.b = b;
+    node.value = 0;
+    node.signal = -1;
+    node.complex = false;
+    node.re = node.im = NULL;
+
+    m_nodes.push_back(node);
+
+    return m_nodes.size() - 1;
+}
+
+int Expression::_signal(const std::string &name) {
+    int node = _add(OP_SIGNAL, -1);
+
+    std::vector<std::string>::const_iterator i = std::find(m_names.begin(), m_names.end(), name);
+    m_nodes[node].signal = i - m_names.begin();
+    if(i == m_names.end())
+	m_names.push_back(name);
+
+    return node;
+}
+
+void Expression::_skip_space() {
+    while(m_pos < m_text.size() && isspace(m_text[m_pos]))
+	m_pos++;
+}
+
+bool Expression::_accept(char c) {
+    _skip_space();
+
+    if(m_pos < m_text.size() && m_text[m_pos] == c) {
+	m_pos++;
+	return true;
+    } else
+	return false;
+}
+
+void Expression::_expect(char c) {
+    if(!_accept(c))
+	throw InvalidExpression();
+}
+
+void Expression::resolve(const std::vector<bool> &complex) {
+    for(std::vector<Node>::iterator i=m_nodes.begin(); i != m_nodes.end(); i++)
+	switch(i->op) {
+	case OP_CONST:
+	    i->complex = false;
+	    break;
+	case OP_SIGNAL:
+	    i->complex = complex.at(i->signal);
+	    break;
+	case OP_NEG:
+	    i->complex = m_nodes[i->a].complex;
+	    break;
+	case OP_FUNC:
+	    i->complex = i->function >= FUNC_SQRT && m_nodes[i->a].complex;
+	    break;
+	default:
+	    i->complex = m_nodes[i->a].complex || m_nodes[i->b].complex;
+	}
+}
+
+void Expression::evaluate(int n, const std::vector<const double *> &re,
+			  const std::vector<const double *> &im) {
+    if((int)m_zeros.size() < n)
+	m_zeros.resize(n, 0.0);
+
+    // Operands precede their operators
+    for(std::vector<Node>::iterator i=m_nodes.begin(); i != m_nodes.end(); i++) {
+	if(i->op == OP_SIGNAL) {
+	    i->re = re.at(i->signal);
+	    i->im = i->complex ? im.at(i->signal) : NULL;
+	} else
+	    _evaluate(*i, n);
+    }
+}
+
+const double *Expression::_imag(const Node &node) const {
+    return node.complex ? node.im : &m_zeros[0];
+}
+
+//
+// Evaluate a node from the values of its operands. The loops over real
+// values and over separate real and imaginary parts vectorize, the
+// transcendental functions of complex values use std::complex.
+//
+void Expression::_evaluate(Node &node, int n) {
+    if((int)node.rebuf.size() < n)
+	node.rebuf.resize(n);
+    if(node.complex && (int)node.imbuf.size() < n)
+	node.imbuf.resize(n);
+
+    double *re = &node.rebuf[0];
+    double *im = node.complex ? &node.imbuf[0] : NULL;
+    node.re = re;
+    node.im = im;
+
+    if(node.op == OP_CONST) {
+	std::fill(re, re + n, node.value);
+	return;
+    }
+
+    const Node &a = m_nodes[node.a];
+    const double *are = a.re, *aim = _imag(a);
+
+    if(node.op == OP_FUNC) {
+	switch(node.function) {
+	case FUNC_ABS:
+	    if(a.complex)
+		for(int k=0; k < n; k++)
+		    re[k] = sqrt(are[k] * are[k] + aim[k] * aim[k]);
+	    else
+		for(int k=0; k < n; k++)
+		    re[k] = fabs(are[k]);
+	    break;
+	case FUNC_PHASE:
+	    for(int k=0; k < n; k++)
+		re[k] = atan2(aim[k], are[k]) * (180 / M_PI);
+	    break;
+	case FUNC_REAL:
+	    std::copy(are, are + n, re);
+	    break;
+	case FUNC_IMAG:
+	    std::copy(aim, aim + n, re);
+	    break;
+	case FUNC_DB10:
+	    for(int k=0; k < n; k++)
+		re[k] = 5 * log10(are[k] * are[k] + aim[k] * aim[k]);
+	    break;
+	case FUNC_DB20:
+	    for(int k=0; k < n; k++)
+		re[k] = 10 * log10(are[k] * are[k] + aim[k] * aim[k]);
+	    break;
+	default:
+	    for(int k=0; k < n; k++) {
+		if(node.complex) {
+		    std::complex<double> z(are[k], aim[k]), result;
+
+		    switch(node.function) {
+		    case FUNC_SQRT: result = sqrt(z); break;
+		    case FUNC_EXP: result = exp(z); break;
+		    case FUNC_LOG: result = log(z); break;
+		    case FUNC_LOG10: result = log10(z); break;
+		    case FUNC_SIN: result = sin(z); break;
+		    case FUNC_COS: result = cos(z); break;
+		    default: result = tan(z); break;
+		    }
+
+		    re[k] = result.real();
+		    im[k] = result.imag();
+		} else {
+		    double x = are[k];
+
+		    switch(node.function) {
+		    case FUNC_SQRT: re[k] = sqrt(x); break;
+		    case FUNC_EXP: re[k] = exp(x); break;
+		    case FUNC_LOG: re[k] = log(x); break;
+		    case FUNC_LOG10: re[k] = log10(x); break;
+		    case FUNC_SIN: re[k] = sin(x); break;
+		    case FUNC_COS: re[k] = cos(x); break;
+		    default: re[k] = tan(x); break;
+		    }
+		}
+	    }
+	}
+	return;
+    }
+
+    if(node.op == OP_NEG) {
+	for(int k=0; k < n; k++)
+	    re[k] = -are[k];
+	if(node.complex)
+	    for(int k=0; k < n; k++)
+		im[k] = -aim[k];
+	return;
+    }
+
+    const Node &b = m_nodes[node.b];
+    const double *bre = b.re, *bim = _imag(b);
+
+    if(!node.complex) {
+	switch(node.op) {
+	case OP_ADD:
+	    for(int k=0; k < n; k++)
+		re[k] = are[k] + bre[k];
+	    break;
+	case OP_SUB:
+	    for(int k=0; k < n; k++)
+		re[k] = are[k] - bre[k];
+	    break;
+	case OP_MUL:
+	    for(int k=0; k < n; k++)
+		re[k] = are[k] * bre[k];
+	    break;
+	case OP_DIV:
+	    for(int k=0; k < n; k++)
+		re[k] = are[k] / bre[k];
+	    break;
+	default:
+	    for(int k=0; k < n; k++)
+		re[k] = pow(are[k], bre[k]);
+	}
+	return;
+    }
+
+    switch(node.op) {
+    case OP_ADD:
+	for(int k=0; k < n; k++) {
+	    re[k] = are[k] + bre[k];
+	    im[k] = aim[k] + bim[k];
+	}
+	break;
+    case OP_SUB:
+	for(int k=0; k < n; k++) {
+	    re[k] = are[k] - bre[k];
+	    im[k] = aim[k] - bim[k];
+	}
+	break;
+    case OP_MUL:
+	for(int k=0; k < n; k++) {
+	    double r = are[k] * bre[k] - aim[k] * bim[k];
+	    im[k] = are[k] * bim[k] + aim[k] * bre[k];
+	    re[k] = r;
+	}
+	break;
+    case OP_DIV:
+	for(int k=0; k < n; k++) {
+	    double d = bre[k] * bre[k] + bim[k] * bim[k];
+	    double r = (are[k] * bre[k] + aim[k] * bim[k]) / d;
+	    im[k] = (aim[k] * bre[k] - are[k] * bim[k]) / d;
+	    re[k] = r;
+	}
+	break;
+    default:
+	for(int k=0; k < n; k++) {
+	    std::complex<double> result = pow(std::complex<double>(are[k], aim[k]),
+					      std::complex<double>(bre[k], bim[k]));
+	    re[k] = result.real();
+	    im[k] = result.imag();
+	}
+    }
+}
+
+PSFVector *ValueSectionSweep::evaluate(const std::string &text, int start, int n) const {
+    Expression expression(text);
+
+    // Resolve the signals through the trace section
+    const std::vector<std::string> &names = expression.get_names();
+    Filter filter;
+    std::vector<bool> complex;
+    for(std::vector<std::string>::const_iterator i=names.begin(); i != names.end(); i++) {
+	const DataTypeRef &trace = m_psf->get_trace_section().get_trace_by_name(*i);
+
+	switch(trace.get_def().m_datatypeid) {
+	case TYPEID_INT8:
+	case TYPEID_INT32:
+	case TYPEID_DOUBLE:
+	case TYPEID_COMPLEXDOUBLE:
+	    break;
+	default:
+	    throw NotImplemented();
+	}
+
+	filter.push_back(&trace);
+	complex.push_back(trace.get_def().m_datatypeid == TYPEID_COMPLEXDOUBLE);
+    }
+    expression.resolve(complex);
+
+    // Clip the range to the available points
+    if(start < 0)
+	start = 0;
+    if(start > m_npoints)
+	start = m_npoints;
+    if(n > m_npoints - start)
+	n = m_npoints - start;
+    if(n < 0)
+	n = 0;
+
+    PSFDoubleVector *realresult = NULL;
+    PSFComplexDoubleVector *complexresult = NULL;
+    PSFVector *result;
+    if(expression.is_complex())
+	result = complexresult = new PSFComplexDoubleVector();
+    else
+	result = realresult = new PSFDoubleVector();
+    PSF_STATS_ADD(objects_allocated, 1);
+
+    try {
+	if(realresult)
+	    realresult->resize(n);
+	else
+	    complexresult->resize(n);
+
+	int nsignals = filter.size();
+	std::vector<std::vector<double> > re(nsignals), im(nsignals);
+	std::vector<const double *> reptr(nsignals), imptr(nsignals);
+	DecodePlan plan(m_psf, filter, DecodePlan::COMPLEX);
+
+	for(int s=start; s < start + n; s += BLOCKSIZE) {
+	    int count = std::min(BLOCKSIZE, start + n - s);
+
+	    // Decode only the signals of the expression
+	    std::vector<ComplexCollector> collectors;
+	    for(int j=0; j < nsignals; j++) {
+		re[j].clear();
+		im[j].clear();
+		collectors.push_back(ComplexCollector(NULL, &re[j], &im[j]));
+	    }
+	    if(nsignals > 0)
+		reduce(plan, s, count, collectors);
+
+	    for(int j=0; j < nsignals; j++) {
+		reptr[j] = &re[j][0];
+		imptr[j] = complex[j] ? &im[j][0] : NULL;
+	    }
+
+	    expression.evaluate(count, reptr, imptr);
+
+	    const double *resultre = expression.get_real();
+	    if(realresult)
+		std::copy(resultre, resultre + count, &realresult->at(s - start));
+	    else {
+		const double *resultim = expression.get_imag();
+		for(int k=0; k < count; k++)
+		    (*complexresult)[s - start + k] = PSFComplexDouble(resultre[k], resultim[k]);
+	    }
+	}
+    } catch (...) {
+	delete result;
+	throw;
+    }
+
+    return result;
+}
@@ -0,0 +1,82 @@
+#ifndef _PSF_EXPRESSION
+#define _PSF_EXPRESSION
+
+#include <string>
+#include <vector>
+
+//
+// Expression over signals, for example V(outp)-V(outn), I(vdd)*V(vdd) or
+// db20(V(out)/V(in)). Signals are plain names, names in double quotes or
+// the name inside V() or I(). The operators are + - * / ^ and the functions
+// abs, mag, phase, real, imag, db10, db20, sqrt, exp, log, log10, sin, cos
+// and tan. Phases are in degrees. An expression with a complex signal is
+// evaluated in complex arithmetic where needed.
+//
+// The expression is parsed once into nodes in evaluation order and is then
+// evaluated on blocks of points, with one buffer per node of the size of a
+// block.
+//
+class Expression {
+ public:
+    Expression(const std::string &text);
+
+    // Names of the signals of the expression, in the order of their index
+    const std::vector<std::string> &get_names() const { return m_names; }
+
+    // Set which signals are complex, before evaluation
+    void resolve(const std::vector<bool> &complex);
+
+    bool is_complex() const { return m_nodes.back().complex; }
+
+    // Evaluate n points from the real and imaginary parts of the signals,
+    // the imaginary part of a real signal is NULL
+    void evaluate(int n, const std::vector<const double *> &re, const std::vector<const double *> &im);
+
+    // Result of the last evaluation
+    const double *get_real() const { return m_nodes.back().re; }
+    const double *get_imag() const { return m_nodes.back().im; }
+
+ private:
+    enum Op {OP_CONST, OP_SIGNAL, OP_NEG, OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_POW, OP_FUNC};
+    enum Function {FUNC_ABS, FUNC_PHASE, FUNC_REAL, FUNC_IMAG, FUNC_DB10, FUNC_DB20,
+		   FUNC_SQRT, FUNC_EXP, FUNC_LOG, FUNC_LOG10, FUNC_SIN, FUNC_COS, FUNC_TAN};
+
+    struct Node {
+	Op op;
+	Function function;
+	int a, b;		// Operand nodes
+	double value;		// Constant
+	int signal;		// Signal index
+	bool complex;
+
+	// Values of the last evaluation and the buffers that hold them
+	const double *re, *im;
+	std::vector<double> rebuf, imbuf;
+    };
+
+    int _expr();
+    int _term();
+    int _unary();
+    int _power();
+    int _primary();
+
+    int _add(Op op, int a, int b=-1);
+    int _signal(const std::string &name);
+    static bool _function(const std::string &name, Function &function);
+    void _skip_space();
+    bool _accept(char c);
+    void _expect(char c);
+
+    void _evaluate(Node &node, int n);
+    const double *_imag(const Node &node) const;
+
+    std::string m_text;
+    size_t m_pos;
+    int m_depth;
+
+    std::vector<Node> m_nodes;
+    std::vector<std::string> m_names;
+    std::vector<double> m_zeros;
+};
+
+#endif
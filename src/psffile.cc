@@ -1,6 +1,7 @@
 #include "psf.h"
 #include "psfdata.h"
 #include "psfinternal.h"
+#include "psfcompress.h"
 
 #include <stdio.h>
 #include <fcntl.h>
@@ -9,12 +10,16 @@
 #include <sys/mman.h>
 #include <unistd.h>
 
-PSFFile::PSFFile(std::string filename) : 
-    m_header(NULL), m_types(NULL), m_sweeps(NULL), 
+PSFFile::PSFFile(std::string filename, const PSFIOOptions &options) : 
+    m_options(options), m_header(NULL), m_types(NULL), m_sweeps(NULL), 
     m_traces(NULL), m_sweepvalues(NULL), m_nonsweepvalues(NULL) {
 
     m_filename = filename;
+    m_metadatasize = 0;
     m_fd = -1;
+    m_buffer = NULL;
+    m_compressed = NULL;
+    m_cachedbytes = 0;
 }
 
 PSFFile::~PSFFile() {
@@ -33,9 +38,10 @@ PSFFile::~PSFFile() {
     close();
 }
 
-void PSFFile::deserialize(const char *buf, int size) {
+void PSFFile::deserialize(const char *buf, off_t size) {
     // Last word contains the size of the data
     uint32_t datasize;	
+    load(buf + size - 4, 4);
     datasize = GET_INT32(buf+size-4);
 	
     // Read section index table
@@ -43,9 +49,11 @@ void PSFFile::deserialize(const char *buf, int size) {
     std::map<int, Section> sections;
 
     int nsections = (size - datasize - 12) / 8;
-    int lastoffset = 0, lastsectionnum = -1;
+    uint32_t lastoffset = 0;
+    int lastsectionnum = -1;
 
     const char *toc = buf + size - 12 - nsections*8;
+    load(toc, nsections*8);
     Section section;
     for(int i=0; i < nsections; i++) {
 	section.n = GET_INT32(toc + 8*i);
@@ -61,29 +69,48 @@ void PSFFile::deserialize(const char *buf, int size) {
     }
     sections[section.n].size = size - section.offset;
 
-    m_header = new HeaderSection();
-    m_header->deserialize(buf + sections[SECTION_HEADER].offset, sections[SECTION_HEADER].offset);
+    // Swept values are loaded and counted when they are decoded, only the
+    // start of the value section is needed here
+    for(std::map<int, Section>::const_iterator i=sections.begin(); i != sections.end(); i++)
+	if(i->first != SECTION_VALUE || sections.find(SECTION_SWEEP) == sections.end()) {
+	    load(buf + i->second.offset, i->second.size);
+	    m_metadatasize += i->second.size;
+
+	    if(psf_stats)
+		m_stats.metadata_bytes += i->second.size;
+	} else
+	    load(buf + i->second.offset, std::min(i->second.size, 32L));
+
+    {
+	StatsScope scope(m_stats, &PSFStats::header_time);
+	m_header = new HeaderSection();
+	m_header->deserialize(buf + sections[SECTION_HEADER].offset, sections[SECTION_HEADER].offset);
+    }
 
     // Read types
     if (sections.find(SECTION_TYPE) != sections.end()) {
+	StatsScope scope(m_stats, &PSFStats::type_time);
 	m_types = new TypeSection();
 	m_types->deserialize(buf + sections[SECTION_TYPE].offset, sections[SECTION_TYPE].offset);
     }
 
     // Read sweeps
     if (sections.find(SECTION_SWEEP) != sections.end()) {	
+	StatsScope scope(m_stats, &PSFStats::sweep_time);
 	m_sweeps = new SweepSection(this);
 	m_sweeps->deserialize(buf + sections[SECTION_SWEEP].offset, sections[SECTION_SWEEP].offset);
     }
 
     // Read traces
     if (sections.find(SECTION_TRACE) != sections.end()) {	
+	StatsScope scope(m_stats, &PSFStats::trace_time);
 	m_traces = new TraceSection(this);
 	m_traces->deserialize(buf + sections[SECTION_TRACE].offset, sections[SECTION_TRACE].offset);
     }
 
     // Read values
     if (sections.find(SECTION_VALUE) != sections.end()) {	
+	StatsScope scope(m_stats, &PSFStats::value_time);
 	if(m_sweeps != NULL) {
 	    m_sweepvalues = new ValueSectionSweep(this);
 	    m_sweepvalues->deserialize(buf + sections[SECTION_VALUE].offset, sections[SECTION_VALUE].offset);
@@ -96,14 +123,54 @@ void PSFFile::deserialize(const char *buf, int size) {
 }
 
 void PSFFile::open() {
-    m_fd = ::open(m_filename.c_str(), O_RDONLY);
+    int fd = ::open(m_filename.c_str(), O_RDONLY);
   
-    if (m_fd == -1)
+    if (fd == -1)
 	throw FileOpenError();
-  
-    m_size = lseek(m_fd, 0, SEEK_END);
-  
-    m_buffer = (char *)mmap(0, m_size, PROT_READ, MAP_SHARED, m_fd, 0);
+
+    open(fd);
+}
+
+void PSFFile::open(int fd) {
+    StatsScope scope(m_stats, &PSFStats::open_time);
+
+    m_fd = fd;
+
+    if(CompressedFile::is_compressed(m_fd)) {
+	// Compressed files are decompressed block by block like the pread
+	// backend reads them
+	m_compressed = new CompressedFile(m_fd);
+	m_size = m_compressed->size();
+	m_options.backend = IO_PREAD;
+    } else
+	m_size = lseek(m_fd, 0, SEEK_END);
+
+    if(m_options.backend == IO_PREAD) {
+	// The file is read into an anonymous mapping block by block
+	m_buffer = (char *)mmap(0, m_size, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+	// Blocks are dropped with madvise, they must be whole pages
+	long pagesize = sysconf(_SC_PAGESIZE);
+	if(m_options.blocksize < pagesize)
+	    m_options.blocksize = pagesize;
+	m_options.blocksize -= m_options.blocksize % pagesize;
+
+	long nblocks = (m_size + m_options.blocksize - 1) / m_options.blocksize;
+	m_loaded.assign(nblocks, false);
+	m_loads.assign(nblocks, 0);
+	m_cachepos.assign(nblocks, std::list<long>::iterator());
+	m_cache.clear();
+	m_cachedbytes = 0;
+    } else
+	m_buffer = (char *)mmap(0, m_size, PROT_READ, MAP_SHARED, m_fd, 0);
+
+    if (m_buffer == MAP_FAILED) {
+	m_buffer = NULL;
+	throw FileOpenError();
+    }
+
+    advise();
   
     if(validate())
 	deserialize((const char *)m_buffer, m_size);
@@ -111,8 +178,208 @@ void PSFFile::open() {
 	throw InvalidFileError();
 }
 
+void PSFFile::advise() {
+    if(m_options.backend == IO_PREAD) {
+	switch(m_options.advice) {
+	case ADVICE_SEQUENTIAL:
+	    posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	    break;
+	case ADVICE_RANDOM:
+	    posix_fadvise(m_fd, 0, 0, POSIX_FADV_RANDOM);
+	    break;
+	case ADVICE_WILLNEED:
+	    posix_fadvise(m_fd, 0, 0, POSIX_FADV_WILLNEED);
+	    break;
+	case ADVICE_HUGEPAGE:
+#ifdef MADV_HUGEPAGE
+	    madvise((void *)m_buffer, m_size, MADV_HUGEPAGE);
+#endif
+	    break;
+	default:
+	    break;
+	}
+    } else {
+	// Advice is only a hint, failures are ignored
+	switch(m_options.advice) {
+	case ADVICE_SEQUENTIAL:
+	    madvise((void *)m_buffer, m_size, MADV_SEQUENTIAL);
+	    break;
+	case ADVICE_RANDOM:
+	    madvise((void *)m_buffer, m_size, MADV_RANDOM);
+	    break;
+	case ADVICE_WILLNEED:
+	    madvise((void *)m_buffer, m_size, MADV_WILLNEED);
+	    break;
+	case ADVICE_HUGEPAGE:
+#ifdef MADV_HUGEPAGE
+	    madvise((void *)m_buffer, m_size, MADV_HUGEPAGE);
+#endif
+	    break;
+	default:
+	    break;
+	}
+    }
+}
+
+//
+// Blocks of the pread backend holding len bytes from ptr, false if there
+// are none
+//
+bool PSFFile::_blocks(const char *ptr, long len, long *first, long *last) const {
+    if(m_options.backend != IO_PREAD || len <= 0)
+	return false;
+
+    long start = std::max(ptr - m_buffer, 0L);
+    long end = std::min(ptr - m_buffer + len, (long)m_size);
+
+    if(start >= end)
+	return false;
+
+    *first = start / m_options.blocksize;
+    *last = (end - 1) / m_options.blocksize;
+    return true;
+}
+
+void PSFFile::load(const char *ptr, long len) const {
+    long first, last;
+    if(!_blocks(ptr, len, &first, &last))
+	return;
+
+    ScopedLock lock(m_loadmutex);
+
+    // Blocks with loads are not dropped, cached blocks leave the cache
+    for(long block = first; block <= last; block++)
+	if(m_loads[block]++ == 0 && m_loaded[block]) {
+	    m_cache.erase(m_cachepos[block]);
+	    m_cachedbytes -= m_options.blocksize;
+	}
+
+    try {
+	_read_blocks(first, last);
+    } catch(...) {
+	_release(first, last);
+	throw;
+    }
+}
+
+void PSFFile::unload(const char *ptr, long len) const {
+    long first, last;
+    if(!_blocks(ptr, len, &first, &last))
+	return;
+
+    ScopedLock lock(m_loadmutex);
+    _release(first, last);
+}
+
+//
+// Read the blocks from first to last that are not loaded, called with the
+// load mutex held
+//
+void PSFFile::_read_blocks(long first, long last) const {
+    long blocksize = m_options.blocksize;
+
+    for(long block = first; block <= last; block++) {
+	if(m_loaded[block])
+	    continue;
+
+	// Read consecutive blocks that are missing with a single call
+	long lastblock = block;
+	while(lastblock < last && !m_loaded[lastblock + 1])
+	    lastblock++;
+
+	off_t offset = block * blocksize;
+	size_t size = std::min((lastblock + 1) * blocksize, (long)m_size) - offset;
+
+	char *dest = (char *)m_buffer + offset;
+
+	while(size > 0) {
+	    ssize_t n;
+
+	    if(m_compressed) {
+		m_compressed->read(dest, offset, size);
+		n = size;
+	    } else
+		n = pread(m_fd, dest, size, offset);
+
+	    if(n <= 0)
+		throw FileReadError();
+
+	    dest += n;
+	    offset += n;
+	    size -= n;
+
+	    if(psf_stats) {
+		m_stats.read_calls++;
+		m_stats.read_bytes += n;
+	    }
+	}
+
+	for(; block <= lastblock; block++)
+	    m_loaded[block] = true;
+	block--;
+    }
+}
+
+//
+// Release a load of the blocks from first to last and drop the least
+// recently released blocks beyond the cache size, called with the load
+// mutex held
+//
+void PSFFile::_release(long first, long last) const {
+    long blocksize = m_options.blocksize;
+
+    for(long block = first; block <= last; block++)
+	if(--m_loads[block] == 0 && m_loaded[block]) {
+	    m_cachepos[block] = m_cache.insert(m_cache.end(), block);
+	    m_cachedbytes += blocksize;
+	}
+
+    while(m_cachedbytes > m_options.cachesize && !m_cache.empty()) {
+	long block = m_cache.front();
+	m_cache.pop_front();
+	m_cachedbytes -= blocksize;
+	m_loaded[block] = false;
+
+	// The pages of the anonymous mapping are freed and read again
+	// as zeros
+	off_t offset = block * blocksize;
+	madvise((void *)(m_buffer + offset), std::min((off_t)blocksize, m_size - offset),
+		MADV_DONTNEED);
+    }
+}
+
+void PSFFile::prefetch(const char *ptr, long len) const {
+    long start = std::max(ptr - m_buffer, 0L);
+    long end = std::min(ptr - m_buffer + len, (long)m_size);
+
+    // Offsets in the compressed file are not known
+    if(start >= end || m_compressed)
+	return;
+
+    if(m_options.backend == IO_PREAD)
+	posix_fadvise(m_fd, start, end - start, POSIX_FADV_WILLNEED);
+    else {
+	// The address must be page aligned
+	long pagesize = sysconf(_SC_PAGESIZE);
+	long pagestart = start - start % pagesize;
+	madvise((void *)(m_buffer + pagestart), end - pagestart, MADV_WILLNEED);
+    }
+
+    if(psf_stats)
+	m_stats.prefetch_bytes += end - start;
+}
+
 void PSFFile::close() {
-    munmap((void*) m_buffer, m_size);
+    // The mapping may be reused by other threads once it has been unmapped
+    if(m_buffer) {
+	munmap((void*) m_buffer, m_size);
+	m_buffer = NULL;
+    }
+
+    if(m_compressed) {
+	delete m_compressed;
+	m_compressed = NULL;
+    }
     
     if(m_fd != -1) {
 	int rval = ::close(m_fd);
@@ -125,16 +392,13 @@ void PSFFile::close() {
 }
 
 bool PSFFile::validate() const {
-    std::ifstream fstr(m_filename.c_str());
-	
-    fstr.seekg(-12, std::ios::end);
+    if(m_size < 12)
+	return false;
 
-    char clarissa[9];
-	
-    fstr.read(clarissa, 8);
-    clarissa[8]=0;
-	
-    return !strcmp(clarissa, "Clarissa");
+    const char *clarissa = m_buffer + m_size - 12;
+    load(clarissa, 8);
+
+    return !strncmp(clarissa, "Clarissa", 8);
 }	
 
 
@@ -159,9 +423,112 @@ PSFVector* PSFFile::get_values(std::string name) const {
 	return NULL;
 }	
 
+PSFVector* PSFFile::get_param_values(int start, int n) const {
+    if (m_sweepvalues != NULL) 
+	return m_sweepvalues->get_param_values(start, n);
+    else
+	return NULL;
+}
+
+PSFVector* PSFFile::get_values(std::string name, int start, int n) const {
+    if(m_sweepvalues)
+	return m_sweepvalues->get_values(name, start, n);
+    else
+	return NULL;
+}	
+
+std::vector<PSFVector *> PSFFile::get_values(const NameList &names) const {
+    if(m_sweepvalues)
+	return m_sweepvalues->get_values(names);
+    else
+	return std::vector<PSFVector *>();
+}
+
+template<class T>
+int PSFFile::get_values_into(const NameList &names, int start, int n, T *const *outs, double *x) const {
+    if(m_sweepvalues)
+	return m_sweepvalues->get_values_into(names, start, n, outs, x);
+    else
+	throw NotImplemented();
+}
+
+template int PSFFile::get_values_into(const NameList &, int, int, double *const *, double *) const;
+template int PSFFile::get_values_into(const NameList &, int, int, PSFComplexDouble *const *, double *) const;
+
+std::vector<PSFSweepReduction> PSFFile::reduce(const NameList &names, int start, int n) const {
+    if(m_sweepvalues)
+	return m_sweepvalues->reduce(names, start, n);
+    else
+	throw NotImplemented();
+}
+
+PSFDecimation PSFFile::decimate(const std::string &name, double lo, double hi, int nbuckets,
+				PSFDecimationMode mode) const {
+    if(m_sweepvalues)
+	return m_sweepvalues->decimate(name, lo, hi, nbuckets, mode);
+    else
+	throw NotImplemented();
+}
+
+std::vector<PSFVector *> PSFFile::resample(const NameList &names, const std::vector<double> &grid,
+					   PSFInterpolation method) const {
+    if(m_sweepvalues)
+	return m_sweepvalues->resample(names, grid, method);
+    else
+	throw NotImplemented();
+}
+
+std::vector<int> PSFFile::get_sweep_shape() const {
+    if(m_sweepvalues)
+	return m_sweepvalues->get_shape();
+    else
+	return std::vector<int>();
+}
+
+PSFSweepArray PSFFile::get_array(const std::string &name, const std::vector<int> &start,
+				 const std::vector<int> &count) const {
+    if(m_sweepvalues)
+	return m_sweepvalues->get_array(name, start, count);
+    else
+	throw NotImplemented();
+}
+
+std::vector<PSFVector *> PSFFile::get_complex(const std::string &name,
+					      const std::vector<PSFComplexOutput> &outputs,
+					      int start, int n) const {
+    if(m_sweepvalues)
+	return m_sweepvalues->get_complex(name, outputs, start, n);
+    else
+	throw NotImplemented();
+}
+
+PSFVector *PSFFile::evaluate(const std::string &expression, int start, int n) const {
+    if(m_sweepvalues)
+	return m_sweepvalues->evaluate(expression, start, n);
+    else
+	throw NotImplemented();
+}
+
+PSFSignalMatrix PSFFile::transpose(const NameList &names, int nthreads) const {
+    if(m_sweepvalues)
+	return m_sweepvalues->transpose(names, nthreads);
+    else
+	throw NotImplemented();
+}
+
+void PSFFile::prefetch(int start, int n) const {
+    if(m_sweepvalues)
+	m_sweepvalues->prefetch(start, n);
+}
+
+// Properties of a value of a file without a sweep, or of a trace
 const PropertyBlock &PSFFile::get_value_properties(std::string name) const {
-  //FIXME, check for NULL m_nonsweepvalues
-  return m_nonsweepvalues->get_value_properties(name);
+    if(m_nonsweepvalues)
+	return m_nonsweepvalues->get_value_properties(name);
+    else if(m_traces)
+	return m_traces->get_trace_by_name(name).get_properties();
+    else
+	throw NotFound();
 }
 
 const PSFScalar& PSFFile::get_value(std::string name) const {
@@ -0,0 +1,212 @@
+#include "psf.h"
+#include "psfinternal.h"
+#include "psffilecache.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+void psf_enable_file_cache(size_t maxbytes) {
+    PSFFileCache::instance().set_maxbytes(maxbytes);
+}
+
+bool psf_file_cache_enabled() {
+    return PSFFileCache::instance().enabled();
+}
+
+void psf_clear_file_cache() {
+    PSFFileCache::instance().clear();
+}
+
+PSFFileCacheStats psf_get_file_cache_stats() {
+    return PSFFileCache::instance().get_stats();
+}
+
+bool PSFFileCache::Key::operator<(const Key &other) const {
+    if(dev != other.dev)
+	return dev < other.dev;
+    if(ino != other.ino)
+	return ino < other.ino;
+    if(size != other.size)
+	return size < other.size;
+    if(mtime != other.mtime)
+	return mtime < other.mtime;
+    if(mtime_nsec != other.mtime_nsec)
+	return mtime_nsec < other.mtime_nsec;
+    if(backend != other.backend)
+	return backend < other.backend;
+    if(advice != other.advice)
+	return advice < other.advice;
+    if(blocksize != other.blocksize)
+	return blocksize < other.blocksize;
+    return cachesize < other.cachesize;
+}
+
+PSFFileCache::PSFFileCache() : m_maxbytes(0) {
+    m_stats.hits = m_stats.misses = m_stats.evictions = 0;
+    m_stats.files = m_stats.bytes = 0;
+}
+
+PSFFileCache::~PSFFileCache() {
+    // Files still used by data sets are left to them
+    clear();
+}
+
+// Never destroyed, data sets may release files during exit
+PSFFileCache &PSFFileCache::instance() {
+    static PSFFileCache *cache = new PSFFileCache();
+
+    return *cache;
+}
+
+//
+// The key is taken from the opened file, so a file that is replaced after
+// the lookup is not parsed under the key of the file it replaced
+//
+PSFFile *PSFFileCache::acquire(const std::string &filename, const PSFIOOptions &options) {
+    struct stat st;
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if(fd == -1)
+	throw FileOpenError();
+
+    if(fstat(fd, &st) == -1) {
+	::close(fd);
+	throw FileOpenError();
+    }
+
+    Key key;
+    key.dev = st.st_dev;
+    key.ino = st.st_ino;
+    key.size = st.st_size;
+    key.mtime = st.st_mtim.tv_sec;
+    key.mtime_nsec = st.st_mtim.tv_nsec;
+    key.backend = options.backend;
+    key.advice = options.advice;
+    key.blocksize = options.blocksize;
+    key.cachesize = options.cachesize;
+
+    {
+	ScopedLock lock(m_mutex);
+
+	std::map<Key, Entry *>::iterator i = m_entries.find(key);
+	if(i != m_entries.end()) {
+	    Entry *entry = i->second;
+
+	    if(entry->refs++ == 0)
+		m_unused.erase(entry->unused);
+	    m_stats.hits++;
+
+	    ::close(fd);
+	    return entry->psf;
+	}
+
+	m_stats.misses++;
+    }
+
+    // Parse the file without holding the lock
+    PSFFile *psf = NULL;
+    try {
+	psf = new PSFFile(filename, options);
+	psf->open(fd);
+    } catch(...) {
+	// The file owns the descriptor once it is created
+	if(psf)
+	    delete psf;
+	else
+	    ::close(fd);
+	throw;
+    }
+
+    ScopedLock lock(m_mutex);
+
+    // Another thread may have parsed the same file meanwhile
+    std::map<Key, Entry *>::iterator i = m_entries.find(key);
+    if(i != m_entries.end()) {
+	Entry *entry = i->second;
+
+	if(entry->refs++ == 0)
+	    m_unused.erase(entry->unused);
+	delete psf;
+
+	return entry->psf;
+    }
+
+    Entry *entry = new Entry();
+    entry->key = key;
+    entry->psf = psf;
+    entry->size = psf->get_metadata_size();
+    entry->refs = 1;
+
+    m_entries[key] = entry;
+    m_files[psf] = entry;
+    m_stats.files++;
+    m_stats.bytes += entry->size;
+
+    _evict();
+
+    return psf;
+}
+
+void PSFFileCache::release(PSFFile *psf) {
+    ScopedLock lock(m_mutex);
+
+    Entry *entry = m_files[psf];
+
+    if(--entry->refs == 0) {
+	m_unused.push_front(entry);
+	entry->unused = m_unused.begin();
+
+	_evict();
+    }
+}
+
+bool PSFFileCache::enabled() const {
+    ScopedLock lock(m_mutex);
+
+    return m_maxbytes > 0;
+}
+
+void PSFFileCache::set_maxbytes(size_t maxbytes) {
+    ScopedLock lock(m_mutex);
+
+    m_maxbytes = maxbytes;
+    _evict();
+}
+
+void PSFFileCache::clear() {
+    ScopedLock lock(m_mutex);
+
+    while(!m_unused.empty()) {
+	Entry *entry = m_unused.back();
+	m_unused.pop_back();
+	_remove(entry);
+    }
+}
+
+PSFFileCacheStats PSFFileCache::get_stats() {
+    ScopedLock lock(m_mutex);
+
+    return m_stats;
+}
+
+// Close unused files until the cached files fit the limit
+void PSFFileCache::_evict() {
+    while(m_stats.bytes > m_maxbytes && !m_unused.empty()) {
+	Entry *entry = m_unused.back();
+	m_unused.pop_back();
+	_remove(entry);
+
+	m_stats.evictions++;
+    }
+}
+
+void PSFFileCache::_remove(Entry *entry) {
+    m_entries.erase(entry->key);
+    m_files.erase(entry->psf);
+    m_stats.files--;
+    m_stats.bytes -= entry->size;
+
+    delete entry->psf;
+    delete entry;
+}
@@ -0,0 +1,79 @@
+#ifndef _PSF_FILECACHE
+#define _PSF_FILECACHE
+
+#include "psf.h"
+#include "psfthread.h"
+
+#include <sys/types.h>
+
+#include <list>
+#include <map>
+
+//
+// Process wide cache of opened and parsed files, keyed by the device, inode,
+// size and modification time of the file and the I/O options, so a modified
+// file is parsed again. A file is shared by all data sets that acquire it
+// and is kept after the last one released it, until the metadata size of
+// the cached files exceeds the limit. Unused files are then closed least
+// recently used first.
+//
+class PSFFileCache {
+ public:
+    PSFFileCache();
+    ~PSFFileCache();
+
+    static PSFFileCache &instance();
+
+    // Opened file of filename, parsed on a miss
+    PSFFile *acquire(const std::string &filename, const PSFIOOptions &options);
+    void release(PSFFile *psf);
+
+    // Limit of the metadata size, 0 disables the cache
+    void set_maxbytes(size_t maxbytes);
+    bool enabled() const;
+
+    // Close the unused files
+    void clear();
+
+    PSFFileCacheStats get_stats();
+
+ private:
+    struct Key {
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	long mtime, mtime_nsec;
+	PSFIOBackend backend;
+	PSFIOAdvice advice;
+	int blocksize;
+	long cachesize;
+
+	bool operator<(const Key &other) const;
+    };
+
+    struct Entry {
+	Key key;
+	PSFFile *psf;
+	long size;
+	int refs;
+
+	// Position in the list of unused files
+	std::list<Entry *>::iterator unused;
+    };
+
+    void _evict();
+    void _remove(Entry *entry);
+
+    mutable Mutex m_mutex;
+    size_t m_maxbytes;
+
+    std::map<Key, Entry *> m_entries;
+    std::map<const PSFFile *, Entry *> m_files;
+
+    // Unused files, most recently released first
+    std::list<Entry *> m_unused;
+
+    PSFFileCacheStats m_stats;
+};
+
+#endif
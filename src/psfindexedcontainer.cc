@@ -43,7 +43,7 @@ int TraceIndex::deserialize(const char *buf) {
 }
 
 
-int IndexedContainer::deserialize(const char *buf, int abspos) {
+int IndexedContainer::deserialize(const char *buf, long abspos) {
     const char *startbuf = buf;
 
     buf += Chunk::deserialize(buf);
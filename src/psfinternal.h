@@ -2,6 +2,7 @@
 #define _PSF_INTERNAL
 
 #include <stdint.h>
+#include <sys/types.h>
 #include <arpa/inet.h>
 #include <endian.h>
 #include <string.h>
@@ -10,6 +11,11 @@
 #include <fstream>
 #include <list>
 #include <vector>
+#include <algorithm>
+
+#include <time.h>
+
+#include "psfthread.h"
 
 #ifdef HAVE_TR1_UNORDERED_MAP
 #include <tr1/unordered_map>
@@ -38,7 +44,7 @@
 typedef struct {
     uint32_t n;
     uint32_t offset;
-    int size;
+    long size;
 } Section;
 
 //
@@ -47,11 +53,14 @@ typedef struct {
 class Chunk;
 class Property;
 class PSFFile;
+class CompressedFile;
 class StructDef;
+class DataTypeDef;
 class DataTypeRef;
 class PSFScalar;
 class SweepValue;
 class SweepValueSimple;
+class ValueSectionSweep;
 
 //
 // PSF data types
@@ -76,6 +85,30 @@ typedef std::map<std::string, int> NameIdMap;
 typedef std::map<int, const Chunk *> IdMap;
 #endif
 
+//
+// Statistics collection
+//
+extern bool psf_stats;
+
+// Statistics of the file that is currently parsed or decoded by this thread
+extern __thread PSFStats *psf_current_stats;
+
+#define PSF_STATS_ADD(field, n) \
+    do { if(psf_stats && psf_current_stats) psf_current_stats->field += (n); } while(0)
+
+// Accumulates the time and page faults of a scope if statistics are enabled
+class StatsScope {
+ public:
+    StatsScope(PSFStats &stats, double PSFStats::*time);
+    ~StatsScope();
+
+ private:
+    PSFStats *m_stats, *m_prevstats;
+    double PSFStats::*m_time;
+    struct timespec m_start;
+    long m_minflt, m_majflt;
+};
+
 class DataList : public std::vector<PSFScalar *> {
  public:
     ~DataList() { clear(); }
@@ -178,7 +211,7 @@ public:
 
 class SimpleContainer: public Container {
 public:
-    virtual int deserialize(const char *buf, int abspos);
+    virtual int deserialize(const char *buf, long abspos);
 
     virtual void print(std::ostream &stream) const;
     
@@ -218,7 +251,7 @@ class TraceIndex: public Chunk {
 
 class IndexedContainer: public Container {
  public:	
-    virtual int deserialize(const char *buf, int abspos);
+    virtual int deserialize(const char *buf, long abspos);
 
     virtual const Chunk & get_child(int id) const;
     virtual const Chunk & get_child(std::string name) const;
@@ -231,6 +264,13 @@ class IndexedContainer: public Container {
     NameIndexMap namemap;
 };
 
+//
+// Decoder of n values that are stride bytes apart in the file to an array.
+// A decoder is selected once per trace from its data type, so the loops over
+// the points have no type switches or virtual calls.
+//
+typedef void (*DecodeFunction)(const DataTypeDef &def, void *dest, const char *buf, int n, int stride);
+
 class DataTypeDef: public Container {
  public:
     static const int type = 16;
@@ -257,6 +297,18 @@ class DataTypeDef: public Container {
     
     int deserialize_data(void *data, const char *buf) const;
 
+    // Read a real value converted to double
+    double deserialize_double(const char *buf) const;
+
+    // Read a real or complex value converted to complex
+    PSFComplexDouble deserialize_complex(const char *buf) const;
+
+    // Decoders to the element type of the vectors of this type, to double
+    // and to complex
+    DecodeFunction get_decoder() const;
+    DecodeFunction get_double_decoder() const;
+    DecodeFunction get_complex_decoder() const;
+
     int datasize() const { return _datasize; }
 
     virtual int32_t get_id() const { return m_id; };
@@ -324,6 +376,8 @@ public:
 
     const DataTypeDef& get_datatype() const;
 
+    const PropertyBlock& get_properties() const { return m_properties; }
+
     void *new_dataobject() const;
     PSFVector *new_vector() const;
 
@@ -362,8 +416,19 @@ class StructDef: public Container {
     int datasize() const { return _datasize; };
 
     virtual int deserialize(const char *buf);
+
+    // Layout of an item of the struct in the file
+    struct Item {
+	std::string name;
+	const DataTypeDef *def;
+	int offset;
+	DecodeFunction decode;
+    };
+
+    const std::vector<Item> &get_items() const { return m_items; }
  private:
     int _datasize;
+    std::vector<Item> m_items;
 };
 
 //
@@ -378,7 +443,7 @@ public:
 
     virtual Chunk *child_factory(int chunktype) const;
     
-    virtual int deserialize(const char *buf, int abspos);
+    virtual int deserialize(const char *buf, long abspos);
 
     const PropertyBlock& get_properties() const { return m_properties; }
 
@@ -471,6 +536,8 @@ class NonSweepValue : public Chunk {
 
     const PSFScalar& get_value() const { return *m_value; } 
 
+    const DataTypeDef& get_datatype() const;
+
     const PropertyBlock& get_properties() const { return m_propblock; }
 
     virtual int deserialize(const char *buf);
@@ -488,65 +555,377 @@ class NonSweepValue : public Chunk {
     PSFFile *m_psf;
 };
 
+//
+// Running reduction of a trace, fed with the sweep and trace value of each
+// point in order
+//
+class Reducer {
+public:
+    Reducer() : m_n(0), m_integral(0), m_integral2(0) {}
+
+    void add(double x, double y) {
+	if(m_n == 0) {
+	    m_xstart = x;
+	    m_min = m_max = y;
+	    m_minx = m_maxx = x;
+	} else {
+	    double dx = x - m_x;
+	    m_integral += 0.5 * dx * (y + m_y);
+	    m_integral2 += 0.5 * dx * (y * y + m_y * m_y);
+
+	    if(y < m_min) {
+		m_min = y;
+		m_minx = x;
+	    }
+	    if(y > m_max) {
+		m_max = y;
+		m_maxx = x;
+	    }
+	}
+	m_x = x;
+	m_y = y;
+	m_n++;
+    }
+
+    void finish() {}
+
+    void get_result(PSFSweepReduction &result) const;
+
+private:
+    int m_n;
+    double m_xstart, m_x, m_y;
+    double m_min, m_max, m_minx, m_maxx;
+    double m_integral, m_integral2;
+};
+
+//
+// Min/max decimation to buckets of equal sweep span
+//
+class Decimator {
+public:
+    Decimator(double lo, double hi, int nbuckets, PSFDecimation *result) :
+	m_lo(lo), m_scale(hi > lo ? nbuckets / (hi - lo) : 0), m_nbuckets(nbuckets),
+	m_bucket(-1), m_result(result) {}
+
+    void add(double x, double y) {
+	int bucket = get_bucket(x);
+
+	if(bucket != m_bucket) {
+	    m_result->x.push_back(x);
+	    m_result->min.push_back(y);
+	    m_result->max.push_back(y);
+	    m_bucket = bucket;
+	} else if(y < m_result->min.back())
+	    m_result->min.back() = y;
+	else if(y > m_result->max.back())
+	    m_result->max.back() = y;
+    }
+
+    void finish() {}
+
+protected:
+    int get_bucket(double x) const {
+	int bucket = (int)((x - m_lo) * m_scale);
+	return std::min(std::max(bucket, 0), m_nbuckets - 1);
+    }
+
+    void emit(double x, double y) {
+	m_result->x.push_back(x);
+	m_result->min.push_back(y);
+	m_result->max.push_back(y);
+    }
+
+    double m_lo, m_scale;
+    int m_nbuckets, m_bucket;
+    PSFDecimation *m_result;
+};
+
+//
+// Largest triangle three buckets decimation. A point of a bucket is selected
+// once the next bucket is complete so only two buckets are held in memory.
+// The first and last point are always kept.
+//
+class LTTBDecimator: public Decimator {
+public:
+    typedef std::vector<std::pair<double, double> > Points;
+
+    LTTBDecimator(double lo, double hi, int nbuckets, PSFDecimation *result) :
+	Decimator(lo, hi, nbuckets, result), m_first(true) {}
+
+    void add(double x, double y) {
+	if(m_first) {
+	    select_point(x, y);
+	    m_first = false;
+	    return;
+	}
+
+	int bucket = get_bucket(x);
+
+	if(bucket != m_bucket && !m_current.empty()) {
+	    double cx, cy;
+	    average(m_current, cx, cy);
+	    select(m_pending, cx, cy);
+	    m_pending.swap(m_current);
+	    m_current.clear();
+	}
+
+	m_bucket = bucket;
+	m_current.push_back(std::make_pair(x, y));
+    }
+
+    void finish();
+
+private:
+    void select_point(double x, double y) {
+	emit(x, y);
+	m_ax = x;
+	m_ay = y;
+    }
+
+    static void average(const Points &points, double &x, double &y);
+
+    // Select the point giving the largest triangle with the previously
+    // selected point and (cx, cy)
+    void select(const Points &points, double cx, double cy);
+
+    bool m_first;
+    double m_ax, m_ay;
+    Points m_pending, m_current;
+};
+
+//
+// Min and max of blocks of a fixed number of points
+//
+class PyramidBuilder {
+public:
+    PyramidBuilder(int blocksize, PSFDecimation *result) :
+	m_blocksize(blocksize), m_n(0), m_result(result) {}
+
+    void add(double x, double y) {
+	if(m_n % m_blocksize == 0) {
+	    m_result->x.push_back(x);
+	    m_result->min.push_back(y);
+	    m_result->max.push_back(y);
+	} else if(y < m_result->min.back())
+	    m_result->min.back() = y;
+	else if(y > m_result->max.back())
+	    m_result->max.back() = y;
+	m_n++;
+    }
+
+    void finish() {}
+
+private:
+    int m_blocksize;
+    long m_n;
+    PSFDecimation *m_result;
+};
+
+//
+// Collect the values of a trace, and optionally the sweep values, in a
+// buffer
+//
+class Collector {
+public:
+    Collector(std::vector<double> *x, std::vector<double> *y) : m_x(x), m_y(y) {}
+
+    void add(double x, double y) {
+	if(m_x)
+	    m_x->push_back(x);
+	m_y->push_back(y);
+    }
+
+    void finish() {}
+
+private:
+    std::vector<double> *m_x, *m_y;
+};
+
+// Collects the real and imaginary parts of a trace in separate vectors
+class ComplexCollector {
+public:
+    ComplexCollector(std::vector<double> *x, std::vector<double> *re, std::vector<double> *im) :
+	m_x(x), m_re(re), m_im(im) {}
+
+    void add(double x, const PSFComplexDouble &y) {
+	if(m_x)
+	    m_x->push_back(x);
+	m_re->push_back(y.real());
+	m_im->push_back(y.imag());
+    }
+
+    void finish() {}
+
+private:
+    std::vector<double> *m_x, *m_re, *m_im;
+};
+
+//
+// Plan of the decoding of a filter of traces, built once and reused for all
+// blocks that are decoded with the filter. It holds the value offset, size,
+// data type, decoder and destination of each trace, sorted by offset so the
+// values of a point or window are read in order.
+//
+class DecodePlan {
+ public:
+    // Traces are decoded to the element type of their data type, to double
+    // or to complex. The sweep values are decoded to their element type or
+    // to double.
+    enum Target {NATIVE, DOUBLE, COMPLEX};
+
+    struct Entry {
+	int offset;
+	int datasize;
+	const DataTypeDef *def;
+	DecodeFunction decode;
+	int column;		// Index of the trace in the filter
+    };
+
+    typedef std::vector<Entry>::const_iterator const_iterator;
+
+    DecodePlan(PSFFile *psf, const Filter &filter, Target target);
+
+    // True if the plan decodes the filter of the file to the target
+    bool matches(const PSFFile *psf, const Filter &filter, Target target) const {
+	return psf == m_psf && target == m_target && filter == m_filter;
+    }
+
+    const_iterator begin() const { return m_entries.begin(); }
+    const_iterator end() const { return m_entries.end(); }
+    int size() const { return m_entries.size(); }
+    const Entry &operator[](int i) const { return m_entries[i]; }
+
+    // Sweep parameter, with offset 0 and column -1
+    const Entry &get_param() const { return m_param; }
+
+ private:
+    PSFFile *m_psf;
+    Filter m_filter;
+    Target m_target;
+    Entry m_param;
+    std::vector<Entry> m_entries;
+};
+
+// Type of the trace values passed to the add() function of a consumer and
+// the decode target of that type
+template<class Consumer>
+struct ConsumerValue {
+    typedef double type;
+    static const DecodePlan::Target target = DecodePlan::DOUBLE;
+};
+
+template<>
+struct ConsumerValue<ComplexCollector> {
+    typedef PSFComplexDouble type;
+    static const DecodePlan::Target target = DecodePlan::COMPLEX;
+};
+
+// Decode target of values decoded into caller arrays of type T
+template<class T>
+struct DecodeTarget {
+    static const DecodePlan::Target target = DecodePlan::DOUBLE;
+};
+
+template<>
+struct DecodeTarget<PSFComplexDouble> {
+    static const DecodePlan::Target target = DecodePlan::COMPLEX;
+};
+
 class SweepValue: public Chunk, public std::vector<PSFVector *> {
 public:
     static const int type = 16;
 
-    SweepValue() : m_paramvalues(NULL) { m_chunktype = type; }
+    SweepValue() : m_paramvalues(NULL), m_plan(NULL) { m_chunktype = type; }
     virtual ~SweepValue();
 
     const std::string& get_name() const { return m_name.value; }
 
     PSFVector *get_param_values(bool release=false);
 
-    virtual int deserialize(const char *buf, int *n, int windowoffset, PSFFile *psf, Filter &filter) {};
+    // Size the sweep and trace vectors for n points, the vectors of a
+    // previous decode of the same traces are reused
+    void resize_vectors(const DataTypeRef &paramtype, Filter &filter, int n);
+
+    virtual long deserialize(const char *buf, int *n, int windowoffset, PSFFile *psf, Filter &filter) { return 0; }
 
  protected:
+    // Plan of the decoding of the filter, the plan of the previous decode
+    // is reused if it has the same filter
+    const DecodePlan &get_plan(PSFFile *psf, Filter &filter);
+
     int m_id;
     PSFStringScalar m_name;
     int m_linktypeid;
     PSFVector *m_paramvalues;
+    DecodePlan *m_plan;
 
 };
 
 class SweepValueSimple: public SweepValue {
  public:
-    int deserialize(const char *buf, int *n, int windowoffset, PSFFile *psf, Filter &filter);
+    long deserialize(const char *buf, int *n, int windowoffset, PSFFile *psf, Filter &filter);
+    // Feed n points of the filtered traces to one consumer per trace
+    // without storing them
+    template<class Consumer>
+    long reduce(const char *buf, int n, PSFFile *psf, const DecodePlan &plan,
+	       std::vector<Consumer> &consumers);
+    // Decode n points of the traces of the plan straight into the arrays
+    // outs[column], and the sweep values into x unless it is NULL
+    template<class T>
+    long decode_into(const char *buf, int n, PSFFile *psf, const DecodePlan &plan,
+		    T *const *outs, double *x);
 };
 
 class SweepValueWindowed: public SweepValue {
  public:
-    int deserialize(const char *buf, int *n, int windowoffset, PSFFile *psf, Filter &filter);
+    long deserialize(const char *buf, int *n, int windowoffset, PSFFile *psf, Filter &filter);
+    // Feed n points of the filtered traces to one consumer per trace
+    // without storing them
+    template<class Consumer>
+    long reduce(const char *buf, int n, int windowoffset, PSFFile *psf, const DecodePlan &plan,
+	       std::vector<Consumer> &consumers);
+    // Decode n points of the traces of the plan straight into the arrays
+    // outs[column], and the sweep values into x unless it is NULL
+    template<class T>
+    long decode_into(const char *buf, int n, int windowoffset, PSFFile *psf, const DecodePlan &plan,
+		    T *const *outs, double *x);
 };    
 
+//
+// Iterator over consecutive blocks of up to blocksize sweep points. Each
+// block is decoded into the vectors of the same value.
+//
 template <class T>
 class SweepValueIterator : 	
 public boost::iterator_facade<SweepValueIterator<T>, T, boost::forward_traversal_tag> {
  public:
- SweepValueIterator(T *v, const char *valuebuf, PSFFile *psf, ChildList *filter) : 
-    m_v(v), m_psf(psf), m_filter(filter) {
-	m_buf = valuebuf;
-	m_nextbuf = m_buf + deserialize();
+ SweepValueIterator(T *v, const ValueSectionSweep *values, Filter *filter, int point, int blocksize) :
+    m_v(v), m_values(values), m_filter(filter), m_point(point), m_blocksize(blocksize) {
+	m_n = deserialize();
     }
+
+    // First point and number of points of the current block
+    int get_point() const { return m_point; }
+    int get_n() const { return m_n; }
     
  private:
     friend class boost::iterator_core_access;
 
     void increment() {
-	m_buf = m_nextbuf;
-	m_nextbuf = m_buf + deserialize();
+	m_point += m_n;
+	m_n = deserialize();
     }
 
     T& dereference() const { return *m_v; }	
 
-    bool equal(SweepValueIterator const & other) const { return this->buf == other.buf; }
+    bool equal(SweepValueIterator const & other) const { return m_point == other.m_point; }
 
     int deserialize();
     
-    const char *m_buf, *m_nextbuf;
     T *m_v;
-    ChildList *m_filter;
-    PSFFile *m_psf;
+    const ValueSectionSweep *m_values;
+    Filter *m_filter;
+    int m_point, m_n, m_blocksize;
 };
 
 class ValueSectionNonSweep: public IndexedContainer {
@@ -568,7 +947,7 @@ public:
     
     ValueSectionSweep(PSFFile *psf);
 
-    virtual int deserialize(const char *buf, int abspos);
+    virtual int deserialize(const char *buf, long abspos);
     
     // Allocate a value of correct class
     SweepValue *new_value() const;
@@ -577,21 +956,104 @@ public:
     PSFVector* get_values(std::string name) const;
     PSFVector* get_param_values() const;
 
+    // Decode the n sweep points starting at point start
+    SweepValue *get_values(Filter &filter, int start, int n) const;
+
+    // Decode into the vectors of value, returns the number of points after
+    // clipping to the sweep
+    int get_values(Filter &filter, int start, int n, SweepValue *value) const;
+    PSFVector* get_values(std::string name, int start, int n) const;
+    PSFVector* get_param_values(int start, int n) const;
+
+    // Decode several traces in one pass over the value section
+    std::vector<PSFVector *> get_values(const NameList &names) const;
+
+    // Reduce n points of the traces starting at point start
+    std::vector<PSFSweepReduction> reduce(const NameList &names, int start, int n) const;
+
+    // Feed n points of the traces starting at point start to one consumer
+    // per trace
+    template<class Consumer>
+    void reduce(Filter &filter, int start, int n, std::vector<Consumer> &consumers) const;
+
+    // Same with a plan that is reused for several ranges of points
+    template<class Consumer>
+    void reduce(const DecodePlan &plan, int start, int n, std::vector<Consumer> &consumers) const;
+
+    // Decode n points of the traces starting at point start into caller
+    // arrays of double or complex values, one per trace, and the sweep
+    // values into x unless it is NULL. Returns the number of points.
+    template<class T>
+    int get_values_into(const NameList &names, int start, int n, T *const *outs, double *x) const;
+
+    // Traces with real values that can be reduced
+    Filter get_real_traces(const NameList &names) const;
+
+    // Sweep value of a point, and the first point of a monotonic sweep
+    // with a sweep value not before x in the direction of the sweep, or
+    // after x if after is true
+    double get_param_value(int point) const;
+    bool is_descending() const;
+    int find_point(double x, bool after=false) const;
+
+    PSFDecimation decimate(const std::string &name, double lo, double hi, int nbuckets,
+			   PSFDecimationMode mode) const;
+
+    // Interpolate the traces at the sweep values of an ascending grid
+    std::vector<PSFVector *> resample(const NameList &names, const std::vector<double> &grid,
+				      PSFInterpolation method) const;
+
+    // Number of points of each sweep of a nested sweep, outermost first
+    const std::vector<int> &get_shape() const;
+
+    std::vector<PSFVector *> get_complex(const std::string &name,
+					 const std::vector<PSFComplexOutput> &outputs,
+					 int start, int n) const;
+
+    // Evaluate an expression over the traces
+    PSFVector *evaluate(const std::string &expression, int start, int n) const;
+
+    // Transpose real traces, all real traces if names is empty, to a matrix
+    PSFSignalMatrix transpose(const NameList &names, int nthreads) const;
+
+    PSFSweepArray get_array(const std::string &name, const std::vector<int> &start,
+			    const std::vector<int> &count) const;
+
+    int get_npoints() const { return m_npoints; }
+
+    // Hint that the points will be decoded soon
+    void prefetch(int start, int n) const;
+
     int get_valueoffset(int id) const;
     int get_valuesize() const { return m_valuesize; };
 
     typedef SweepValueIterator<SweepValue> iterator;
-    const iterator begin(SweepValue *, ChildList &filter) const ;
+    const iterator begin(SweepValue *, Filter &filter, int blocksize) const;
     const iterator end() const;
 
 private:
     void _create_valueoffsetmap(bool windowedsweep);
+    void _create_windowindex() const;
+    const char *_seek_point(int point, int *windowoffset) const;
+    long _point_bytes(const char *buf, int start, int n) const;
     
     PSFFile *m_psf;
 
-    int m_valuesize, m_ntraces;
+    int m_valuesize, m_ntraces, m_npoints;
     TraceIDOffsetMap m_offsetmap;
     const char *m_valuebuf, *endbuf;
+
+    // Start of each window and index of its first point, built on first seek
+    mutable std::vector<const char *> m_windowbufs;
+    mutable std::vector<int> m_windowstarts;
+    mutable Once m_windowindex;
+
+    // Shape, point stride and coordinates of the axes of a nested sweep,
+    // outermost first, built on first use
+    void _create_sweepshape() const;
+    mutable std::vector<int> m_shape, m_strides;
+    mutable std::vector<std::vector<double> > m_axes;
+    mutable Once m_sweepshape;
     
     bool windowedsweep;
 };
@@ -599,39 +1061,107 @@ private:
 
 class PSFFile {	
 public:	
-    PSFFile(std::string filename);
+    PSFFile(std::string filename, const PSFIOOptions &options=PSFIOOptions());
     ~PSFFile();
     
     NameList get_param_names() const;
     PSFVector *get_param_values() const;
     const PropertyBlock &get_value_properties(std::string name) const;
     PSFVector *get_values(std::string name) const;
+    PSFVector *get_param_values(int start, int n) const;
+    PSFVector *get_values(std::string name, int start, int n) const;
+    std::vector<PSFVector *> get_values(const NameList &names) const;
+    template<class T>
+    int get_values_into(const NameList &names, int start, int n, T *const *outs, double *x) const;
+    std::vector<PSFSweepReduction> reduce(const NameList &names, int start, int n) const;
+    PSFDecimation decimate(const std::string &name, double lo, double hi, int nbuckets,
+			   PSFDecimationMode mode) const;
+    std::vector<PSFVector *> resample(const NameList &names, const std::vector<double> &grid,
+				      PSFInterpolation method) const;
+    std::vector<int> get_sweep_shape() const;
+    std::vector<PSFVector *> get_complex(const std::string &name,
+					 const std::vector<PSFComplexOutput> &outputs,
+					 int start, int n) const;
+    PSFVector *evaluate(const std::string &expression, int start, int n) const;
+    PSFSignalMatrix transpose(const NameList &names, int nthreads) const;
+    PSFSweepArray get_array(const std::string &name, const std::vector<int> &start,
+			    const std::vector<int> &count) const;
     const PSFScalar& get_value(std::string name) const;
+    void prefetch(int start, int n) const;
 
     NameList get_names() const;
     
     // Section access functions
     const TypeSection & get_type_section() const { return *m_types; };
     const SweepSection & get_sweep_section() const { return *m_sweeps; };
-    const TraceSection & get_trace_section() const { return *m_traces; };
+    const TraceSection & get_trace_section() const {
+	// Files without a sweep have no trace section
+	if(m_traces == NULL)
+	    throw NotImplemented();
+	return *m_traces;
+    };
     const ValueSectionSweep & get_value_section_sweep() const { return *m_sweepvalues; };
+    const ValueSectionNonSweep & get_value_section_nonsweep() const { return *m_nonsweepvalues; };
 
     // Header properties access functions
     const PropertyBlock& get_header_properties() const { return m_header->get_properties(); }
+
+    PSFStats &get_stats() const { return m_stats; }
+
+    // Size of the sections parsed on open
+    long get_metadata_size() const { return m_metadatasize; }
     
     void open();
+    // Open the file of the descriptor fd, which is closed by close()
+    void open(int fd);
     void close();
     
     bool validate() const;
 
+    // Make len bytes from ptr in the file buffer available until a matching
+    // unload(), the pread backend reads the blocks that have not been read
+    // before
+    void load(const char *ptr, long len) const;
+
+    // Release a load of len bytes from ptr. The pread backend keeps the
+    // released blocks up to the cache size and drops the least recently
+    // released blocks beyond it
+    void unload(const char *ptr, long len) const;
+
+    // Hint that len bytes from ptr will be loaded soon
+    void prefetch(const char *ptr, long len) const;
+
     std::string m_filename;
 
 private:
-    void deserialize(const char *buf, int size);
+    void deserialize(const char *buf, off_t size);
+    void advise();
+    bool _blocks(const char *ptr, long len, long *first, long *last) const;
+    void _read_blocks(long first, long last) const;
+    void _release(long first, long last) const;
 
     int m_fd;
     const char *m_buffer;
-    int m_size;
+    off_t m_size;
+    long m_metadatasize;
+
+    PSFIOOptions m_options;
+
+    // Blocks read by the pread backend and the number of loads of each
+    // that have not been released
+    mutable std::vector<bool> m_loaded;
+    mutable std::vector<int> m_loads;
+    mutable Mutex m_loadmutex;
+
+    // Loaded blocks without loads, least recently released first
+    mutable std::list<long> m_cache;
+    mutable std::vector<std::list<long>::iterator> m_cachepos;
+    mutable long m_cachedbytes;
+
+    // Decompressor of a gzip compressed file
+    CompressedFile *m_compressed;
+
+    mutable PSFStats m_stats;
 
     HeaderSection *m_header;
     TypeSection *m_types;
@@ -641,4 +1171,23 @@ private:
     ValueSectionNonSweep *m_nonsweepvalues;
 };
 
+//
+// Load of a part of the file buffer that is released when the scope ends
+//
+class LoadScope {
+ public:
+    LoadScope(const PSFFile *psf, const char *ptr, long len) : m_psf(psf), m_ptr(ptr), m_len(len) {
+	m_psf->load(ptr, len);
+    }
+    ~LoadScope() { m_psf->unload(m_ptr, m_len); }
+
+ private:
+    LoadScope(const LoadScope &);
+    LoadScope &operator=(const LoadScope &);
+
+    const PSFFile *m_psf;
+    const char *m_ptr;
+    long m_len;
+};
+
 #endif
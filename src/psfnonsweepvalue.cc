@@ -28,6 +28,10 @@ NonSweepValue::~NonSweepValue() {
 	delete(m_value);
 }
 
+const DataTypeDef& NonSweepValue::get_datatype() const {
+    return m_psf->get_type_section().get_typedef(m_valuetypeid);
+}
+
 int NonSweepValue::deserialize(const char *buf) {
     const char *startbuf = buf;
 
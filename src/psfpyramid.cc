@@ -0,0 +1,192 @@
+#include "psfpyramid.h"
+#include "psfinternal.h"
+
+#include <sys/stat.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <fstream>
+
+static const char magic[8] = {'P', 'S', 'F', 'P', 'Y', 'R', '1', 0};
+
+// Signal names may hold characters that are not valid in file names
+static std::string default_filename(const std::string &psffile, const std::string &signal) {
+    std::string name = signal;
+    std::replace(name.begin(), name.end(), '/', '_');
+    return psffile + "." + name + ".pyr";
+}
+
+PSFPyramid::PSFPyramid(const PSFDataSet &ds, const std::string &signal, const std::string &filename) :
+    m_ds(ds), m_signal(signal), m_filename(filename), m_built(false) {
+    if(m_filename.empty())
+	m_filename = default_filename(ds.get_filename(), signal);
+
+    struct stat st;
+    if(stat(ds.get_filename().c_str(), &st) != 0)
+	throw FileOpenError();
+    m_psfsize = st.st_size;
+    m_psfmtime = st.st_mtime;
+
+    if(!load()) {
+	build();
+	save();
+    }
+}
+
+void PSFPyramid::build() {
+    const ValueSectionSweep &values = m_ds.m_psf->get_value_section_sweep();
+
+    Filter filter = values.get_real_traces(NameList(1, m_signal));
+
+    m_levels.clear();
+    m_levels.push_back(PSFDecimation());
+
+    std::vector<PyramidBuilder> builders(1, PyramidBuilder(BLOCKSIZE, &m_levels.back()));
+    values.reduce(filter, 0, values.get_npoints(), builders);
+
+    while(m_levels.back().x.size() > 1) {
+	PSFDecimation level;
+	const PSFDecimation &below = m_levels.back();
+
+	for(unsigned int i=0; i < below.x.size(); i += FACTOR) {
+	    unsigned int end = std::min(i + FACTOR, (unsigned int)below.x.size());
+
+	    level.x.push_back(below.x[i]);
+	    level.min.push_back(*std::min_element(below.min.begin() + i, below.min.begin() + end));
+	    level.max.push_back(*std::max_element(below.max.begin() + i, below.max.begin() + end));
+	}
+
+	m_levels.push_back(level);
+    }
+
+    m_built = true;
+}
+
+bool PSFPyramid::load() {
+    std::ifstream in(m_filename.c_str(), std::ios::binary);
+
+    if(!in)
+	return false;
+
+    char filemagic[8];
+    int32_t blocksize, factor;
+    uint64_t psfsize;
+    int64_t psfmtime;
+    uint32_t namesize, nlevels;
+
+    in.read(filemagic, 8);
+    in.read((char *)&blocksize, sizeof(blocksize));
+    in.read((char *)&factor, sizeof(factor));
+    in.read((char *)&psfsize, sizeof(psfsize));
+    in.read((char *)&psfmtime, sizeof(psfmtime));
+    in.read((char *)&namesize, sizeof(namesize));
+
+    if(!in || memcmp(filemagic, magic, 8) != 0 || blocksize != BLOCKSIZE || factor != FACTOR ||
+       psfsize != m_psfsize || psfmtime != m_psfmtime || namesize != m_signal.size())
+	return false;
+
+    std::string name(namesize, ' ');
+    in.read(&name[0], namesize);
+    in.read((char *)&nlevels, sizeof(nlevels));
+
+    if(!in || name != m_signal)
+	return false;
+
+    std::vector<PSFDecimation> levels(nlevels);
+
+    for(unsigned int i=0; i < nlevels; i++) {
+	uint64_t n;
+	in.read((char *)&n, sizeof(n));
+
+	if(!in || n > m_psfsize)
+	    return false;
+
+	levels[i].x.resize(n);
+	levels[i].min.resize(n);
+	levels[i].max.resize(n);
+	if(n == 0)
+	    continue;
+	in.read((char *)&levels[i].x[0], n * sizeof(double));
+	in.read((char *)&levels[i].min[0], n * sizeof(double));
+	in.read((char *)&levels[i].max[0], n * sizeof(double));
+    }
+
+    if(!in)
+	return false;
+
+    m_levels.swap(levels);
+
+    return true;
+}
+
+// The pyramid is only a cache, it is kept in memory if it cannot be saved
+void PSFPyramid::save() const {
+    std::string tmpname = m_filename + ".tmp";
+    std::ofstream out(tmpname.c_str(), std::ios::binary);
+
+    int32_t blocksize = BLOCKSIZE, factor = FACTOR;
+    uint32_t namesize = m_signal.size(), nlevels = m_levels.size();
+
+    out.write(magic, 8);
+    out.write((const char *)&blocksize, sizeof(blocksize));
+    out.write((const char *)&factor, sizeof(factor));
+    out.write((const char *)&m_psfsize, sizeof(m_psfsize));
+    out.write((const char *)&m_psfmtime, sizeof(m_psfmtime));
+    out.write((const char *)&namesize, sizeof(namesize));
+    out.write(m_signal.data(), namesize);
+    out.write((const char *)&nlevels, sizeof(nlevels));
+
+    for(unsigned int i=0; i < nlevels; i++) {
+	uint64_t n = m_levels[i].x.size();
+	out.write((const char *)&n, sizeof(n));
+	if(n == 0)
+	    continue;
+	out.write((const char *)&m_levels[i].x[0], n * sizeof(double));
+	out.write((const char *)&m_levels[i].min[0], n * sizeof(double));
+	out.write((const char *)&m_levels[i].max[0], n * sizeof(double));
+    }
+
+    out.close();
+
+    if(!out || rename(tmpname.c_str(), m_filename.c_str()) != 0)
+	remove(tmpname.c_str());
+}
+
+PSFDecimation PSFPyramid::get_decimated(double lo, double hi, int nbuckets) const {
+    const std::vector<double> &x0 = m_levels[0].x;
+
+    // The blocks are searched in an ascending sweep
+    if(x0.size() > 1 && x0.back() < x0.front())
+	return m_ds.get_signal_decimated(m_signal, lo, hi, nbuckets);
+
+    // Blocks of level 0 holding lo and hi
+    long first = std::upper_bound(x0.begin(), x0.end(), lo) - x0.begin() - 1;
+    long last = std::upper_bound(x0.begin(), x0.end(), hi) - x0.begin() - 1;
+    first = std::max(first, 0L);
+
+    // Choose the coarsest level with at least two blocks per bucket
+    long nblocks = last - first + 1;
+    int level = -1;
+    for(long n = nblocks; level + 1 < (int)m_levels.size() && n >= 2L * nbuckets; n /= FACTOR)
+	level++;
+
+    if(level < 0 || nbuckets < 1)
+	return m_ds.get_signal_decimated(m_signal, lo, hi, nbuckets);
+
+    const PSFDecimation &blocks = m_levels[level];
+
+    PSFDecimation result;
+    Decimator decimator(lo, hi, nbuckets, &result);
+
+    long scale = 1;
+    for(int i=0; i < level; i++)
+	scale *= FACTOR;
+
+    for(long i=first / scale; i <= last / scale; i++) {
+	double x = std::max(blocks.x[i], lo);
+	decimator.add(x, blocks.min[i]);
+	decimator.add(x, blocks.max[i]);
+    }
+
+    return result;
+}
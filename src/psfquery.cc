@@ -0,0 +1,578 @@
+#include "psf.h"
+#include "psfdata.h"
+#include "psfthread.h"
+#include "psftext.h"
+
+#include <fnmatch.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+enum Format {FORMAT_CSV, FORMAT_RAW, FORMAT_NPY};
+
+static void usage() {
+    std::cerr << "Usage: psfquery [options] command psffile [signal...]" << std::endl
+	      << std::endl
+	      << "Query a PSF file. Signals are names or glob patterns, all signals if none" << std::endl
+	      << "are given." << std::endl
+	      << std::endl
+	      << "Commands:" << std::endl
+	      << "  list          names of the signals" << std::endl
+	      << "  props         header properties, or properties of the signals given" << std::endl
+	      << "  extract       sweep values and signals, one row per sweep point" << std::endl
+	      << "  reduce        min, max, average, rms and integral of real signals" << std::endl
+	      << std::endl
+	      << "Options:" << std::endl
+	      << "  -f format     extract as csv (default), raw float64 rows or npy" << std::endl
+	      << "  -o file       output file, default standard output" << std::endl
+	      << "  -s start      first sweep point" << std::endl
+	      << "  -n npoints    number of sweep points" << std::endl
+	      << "  -j nthreads   decode threads, one per processor if 0, default 1" << std::endl
+	      << "  -b npoints    sweep points decoded per block, default 65536" << std::endl
+	      << "  -t            report timing and counters on standard error" << std::endl;
+    exit(1);
+}
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static bool matches(const std::string &name, const std::string &pattern) {
+    return name == pattern || fnmatch(pattern.c_str(), name.c_str(), 0) == 0;
+}
+
+// Signals that match any of the patterns in the order of the file, all
+// signals if there are no patterns. Throws NotFound if a pattern matches
+// no signal.
+static std::vector<std::string> match_signals(const PSFDataSet &ds,
+					      const std::vector<std::string> &patterns) {
+    const std::vector<std::string> names = ds.get_signal_names();
+
+    if(patterns.empty())
+	return names;
+
+    std::vector<std::string> result;
+    std::vector<bool> used(patterns.size(), false);
+
+    for(std::vector<std::string>::const_iterator i=names.begin(); i != names.end(); i++) {
+	bool match = false;
+	for(unsigned int k=0; k < patterns.size(); k++)
+	    if(matches(*i, patterns[k]))
+		match = used[k] = true;
+	if(match)
+	    result.push_back(*i);
+    }
+
+    for(unsigned int k=0; k < patterns.size(); k++)
+	if(!used[k]) {
+	    std::cerr << "psfquery: no signal matches " << patterns[k] << std::endl;
+	    throw NotFound();
+	}
+
+    return result;
+}
+
+//
+// Writer of rows of double columns as raw float64 or npy. Rows are
+// collected in a large buffer that is written when full.
+//
+class RowWriter {
+ public:
+    RowWriter(FILE *out, Format format) : m_out(out), m_format(format), m_bytes(0) {
+	m_buf.reserve(BUFSIZE + 4096);
+    }
+
+    // Shape of the npy array
+    void begin(const std::vector<std::string> &names, long nrows);
+
+    // n rows of the columns
+    void write(const std::vector<const double *> &columns, int n);
+
+    // Write the buffered rows, throws FileWriteError
+    void flush();
+
+    uint64_t get_bytes() const { return m_bytes + m_buf.size(); }
+
+ private:
+    static const size_t BUFSIZE = 1 << 20;
+
+    FILE *m_out;
+    Format m_format;
+    std::string m_buf;
+    uint64_t m_bytes;
+};
+
+void RowWriter::begin(const std::vector<std::string> &names, long nrows) {
+    if(m_format == FORMAT_NPY) {
+	const uint16_t one = 1;
+	bool little = *(const char *)&one == 1;
+
+	std::ostringstream header;
+	header << "{'descr': '" << (little ? '<' : '>') << "f8', 'fortran_order': False, 'shape': ("
+	       << nrows << ", " << names.size() << "), }";
+
+	// Magic, version 1.0 and a header length that aligns the data to 64 bytes
+	std::string dict = header.str();
+	size_t total = 10 + dict.size() + 1;
+	dict.append((64 - total % 64) % 64, ' ');
+	dict += '\n';
+
+	uint16_t len = dict.size();
+	m_buf.append("\x93NUMPY\x01\x00", 8);
+	m_buf += (char)(len & 0xff);
+	m_buf += (char)(len >> 8);
+	m_buf += dict;
+    }
+}
+
+void RowWriter::write(const std::vector<const double *> &columns, int n) {
+    int ncolumns = columns.size();
+
+    for(int i=0; i < n; i++) {
+	for(int j=0; j < ncolumns; j++)
+	    m_buf.append((const char *)&columns[j][i], sizeof(double));
+
+	if(m_buf.size() >= BUFSIZE)
+	    flush();
+    }
+}
+
+void RowWriter::flush() {
+    if(m_buf.empty())
+	return;
+
+    if(fwrite(m_buf.data(), 1, m_buf.size(), m_out) != m_buf.size())
+	throw FileWriteError();
+
+    m_bytes += m_buf.size();
+    m_buf.clear();
+}
+
+//
+// Decoding of a group of real signals, or of one complex signal, of a block
+// of sweep points by a worker thread
+//
+class DecodeTask: public WorkerPool::Task {
+ public:
+    DecodeTask(const PSFDataSet &ds, const std::vector<std::string> &names,
+	       const std::vector<double *> &outs, PSFComplexDouble *complexout,
+	       int capacity, int start, int n, bool *failed) :
+	m_ds(ds), m_names(names), m_outs(outs), m_complexout(complexout),
+	m_capacity(capacity), m_start(start), m_n(n), m_failed(failed) {}
+
+    void run() {
+	try {
+	    if(m_complexout)
+		m_ds.get_signal_into(m_names[0], m_complexout, m_capacity, m_start, m_n);
+	    else
+		m_ds.get_signals_into(m_names, &m_outs[0], m_capacity, m_start, m_n);
+	} catch (std::exception &) {
+	    __atomic_store_n(m_failed, true, __ATOMIC_RELAXED);
+	}
+    }
+
+ private:
+    const PSFDataSet &m_ds;
+    std::vector<std::string> m_names;
+    std::vector<double *> m_outs;
+    PSFComplexDouble *m_complexout;
+    int m_capacity, m_start, m_n;
+    bool *m_failed;
+};
+
+//
+// Output column of a signal, complex signals have a real and an imaginary
+// column
+//
+struct Column {
+    std::string name;
+    bool complex;
+};
+
+// Real and complex signals, other signals are skipped with a warning
+static std::vector<Column> signal_columns(const PSFDataSet &ds, const std::vector<std::string> &names) {
+    std::vector<Column> columns;
+
+    for(std::vector<std::string>::const_iterator i=names.begin(); i != names.end(); i++) {
+	Column column;
+	column.name = *i;
+
+	// The type is checked before the empty range is decoded
+	try {
+	    double value;
+	    ds.get_signal_into(*i, &value, 0, 0, 0);
+	    column.complex = false;
+	} catch (NotImplemented &) {
+	    try {
+		PSFComplexDouble value;
+		ds.get_signal_into(*i, &value, 0, 0, 0);
+		column.complex = true;
+	    } catch (NotImplemented &) {
+		std::cerr << "psfquery: skipping " << *i << ", not a real or complex signal" << std::endl;
+		continue;
+	    }
+	}
+
+	columns.push_back(column);
+    }
+
+    return columns;
+}
+
+static std::vector<std::string> column_header(const std::vector<Column> &columns) {
+    std::vector<std::string> header;
+
+    for(std::vector<Column>::const_iterator i=columns.begin(); i != columns.end(); i++) {
+	if(i->complex) {
+	    header.push_back(i->name + ".re");
+	    header.push_back(i->name + ".im");
+	} else
+	    header.push_back(i->name);
+    }
+
+    return header;
+}
+
+// Sweep values and signals of the range, decoded in blocks of points. The
+// real signals of a block are split into one group per thread that are
+// each decoded in a single pass.
+static int extract_swept(const PSFDataSet &ds, const std::vector<std::string> &names,
+			 int start, int n, int nthreads, int blocksize, RowWriter &writer) {
+    std::vector<Column> columns = signal_columns(ds, names);
+
+    int npoints = ds.get_sweep_npoints();
+    start = std::max(std::min(start, npoints), 0);
+    n = std::max(std::min(n, npoints - start), 0);
+    blocksize = std::min(blocksize, std::max(n, 1));
+
+    std::vector<std::string> header = column_header(columns);
+    header.insert(header.begin(), ds.get_sweep_param_names()[0]);
+    writer.begin(header, n);
+
+    // Blocks of the sweep values, the real signals and the complex signals
+    std::vector<double> x(blocksize);
+    std::vector<std::string> realnames;
+    std::vector<std::vector<double> > reals, complexparts;
+    std::vector<std::vector<PSFComplexDouble> > complexes;
+    std::vector<std::string> complexnames;
+
+    std::vector<const double *> outcolumns(1, &x[0]);
+    for(std::vector<Column>::const_iterator i=columns.begin(); i != columns.end(); i++) {
+	if(i->complex) {
+	    complexnames.push_back(i->name);
+	    complexes.push_back(std::vector<PSFComplexDouble>(blocksize));
+	    complexparts.push_back(std::vector<double>(blocksize));
+	    complexparts.push_back(std::vector<double>(blocksize));
+	} else {
+	    realnames.push_back(i->name);
+	    reals.push_back(std::vector<double>(blocksize));
+	}
+    }
+
+    // Column pointers in the order of the file
+    unsigned int nreal = 0, ncomplex = 0;
+    for(std::vector<Column>::const_iterator i=columns.begin(); i != columns.end(); i++) {
+	if(i->complex) {
+	    outcolumns.push_back(&complexparts[2 * ncomplex][0]);
+	    outcolumns.push_back(&complexparts[2 * ncomplex + 1][0]);
+	    ncomplex++;
+	} else
+	    outcolumns.push_back(&reals[nreal++][0]);
+    }
+
+    WorkerPool pool(nthreads);
+    int ngroups = std::min(pool.get_nthreads(), (int)realnames.size());
+
+    for(int block=start; block < start + n; block += blocksize) {
+	int m = std::min(blocksize, start + n - block);
+	bool failed = false;
+
+	ds.get_sweep_values_into(&x[0], blocksize, block, m);
+
+	for(int g=0; g < ngroups; g++) {
+	    std::vector<std::string> groupnames;
+	    std::vector<double *> outs;
+	    for(unsigned int k=g; k < realnames.size(); k += ngroups) {
+		groupnames.push_back(realnames[k]);
+		outs.push_back(&reals[k][0]);
+	    }
+	    pool.submit(new DecodeTask(ds, groupnames, outs, NULL, blocksize, block, m, &failed));
+	}
+
+	for(unsigned int k=0; k < complexnames.size(); k++)
+	    pool.submit(new DecodeTask(ds, std::vector<std::string>(1, complexnames[k]),
+				       std::vector<double *>(), &complexes[k][0], blocksize,
+				       block, m, &failed));
+
+	pool.wait();
+
+	if(failed)
+	    throw FileReadError();
+
+	for(unsigned int k=0; k < complexes.size(); k++)
+	    for(int i=0; i < m; i++) {
+		complexparts[2 * k][i] = complexes[k][i].real();
+		complexparts[2 * k + 1][i] = complexes[k][i].imag();
+	    }
+
+	writer.write(outcolumns, m);
+    }
+
+    return n;
+}
+
+// CSV by the text exporter of the library, which formats blocks of rows in
+// parallel. Without patterns the exporter selects the signals.
+static int extract_csv(const PSFDataSet &ds, const std::vector<std::string> &names, bool all,
+		       int start, int n, int nthreads, int blocksize, FILE *out, uint64_t *bytes) {
+    PSFTextExport exporter(ds);
+
+    if(ds.is_swept() && !all) {
+	std::vector<Column> columns = signal_columns(ds, names);
+	std::vector<std::string> selected;
+	for(std::vector<Column>::const_iterator i=columns.begin(); i != columns.end(); i++)
+	    selected.push_back(i->name);
+	exporter.set_signals(selected);
+    } else if(!all)
+	exporter.set_signals(names);
+
+    exporter.set_range(start, n);
+    exporter.set_nthreads(nthreads);
+    exporter.set_block_size(blocksize);
+
+    if(fflush(out) != 0)
+	throw FileWriteError();
+    exporter.write(fileno(out));
+    *bytes = exporter.get_bytes();
+
+    if(!ds.is_swept())
+	return 1;
+
+    int npoints = ds.get_sweep_npoints();
+    start = std::max(std::min(start, npoints), 0);
+    return std::max(std::min(n, npoints - start), 0);
+}
+
+// Non swept signals as a single row
+static int extract_nonswept(const PSFDataSet &ds, const std::vector<std::string> &names,
+			    RowWriter &writer) {
+    std::vector<std::string> header;
+    std::vector<double> values;
+
+    for(std::vector<std::string>::const_iterator i=names.begin(); i != names.end(); i++) {
+	const PSFScalar &scalar = ds.get_signal_scalar(*i);
+
+	if(const PSFComplexDoubleScalar *z = dynamic_cast<const PSFComplexDoubleScalar *>(&scalar)) {
+	    header.push_back(*i + ".re");
+	    header.push_back(*i + ".im");
+	    values.push_back(z->value.real());
+	    values.push_back(z->value.imag());
+	} else if(dynamic_cast<const PSFDoubleScalar *>(&scalar) ||
+		  dynamic_cast<const PSFInt32Scalar *>(&scalar) ||
+		  dynamic_cast<const PSFInt8Scalar *>(&scalar)) {
+	    header.push_back(*i);
+	    values.push_back((double)scalar);
+	} else
+	    std::cerr << "psfquery: skipping " << *i << ", not a real or complex signal" << std::endl;
+    }
+
+    if(header.empty())
+	throw NotImplemented();
+
+    writer.begin(header, 1);
+
+    std::vector<const double *> columns;
+    for(unsigned int j=0; j < values.size(); j++)
+	columns.push_back(&values[j]);
+    writer.write(columns, 1);
+
+    return 1;
+}
+
+static void print_properties(const PropertyMap &props, const char *indent, FILE *out) {
+    for(PropertyMap::const_iterator i=props.begin(); i != props.end(); i++) {
+	std::ostringstream value;
+	value << *i->second;
+	fprintf(out, "%s%s: %s\n", indent, i->first.c_str(), value.str().c_str());
+    }
+}
+
+// Reductions of the real signals computed in a single pass, other signals
+// are skipped with a warning
+static void reduce(const PSFDataSet &ds, const std::vector<std::string> &signals,
+		   int start, int n, FILE *out) {
+    if(!ds.is_swept())
+	throw NotImplemented();
+
+    std::vector<Column> columns = signal_columns(ds, signals);
+
+    std::vector<std::string> names;
+    for(std::vector<Column>::const_iterator i=columns.begin(); i != columns.end(); i++)
+	if(i->complex)
+	    std::cerr << "psfquery: skipping " << i->name << ", not a real signal" << std::endl;
+	else
+	    names.push_back(i->name);
+
+    std::vector<PSFSweepReduction> reductions = ds.get_signal_reductions(names, start, n);
+
+    fprintf(out, "signal,npoints,xstart,xend,min,max,min_x,max_x,peak_to_peak,average,rms,integral\n");
+    for(unsigned int i=0; i < names.size(); i++) {
+	const PSFSweepReduction &r = reductions[i];
+	fprintf(out, "%s,%d,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g\n",
+		names[i].c_str(), r.npoints, r.xstart, r.xend, r.min, r.max, r.min_x, r.max_x,
+		r.peak_to_peak(), r.average, r.rms, r.integral);
+    }
+}
+
+static void report(const PSFDataSet &ds, double seconds, int nsignals, int npoints, uint64_t bytes) {
+    const PSFStats &stats = ds.get_stats();
+
+    std::cerr << std::fixed << std::setprecision(3)
+	      << "wall time       " << seconds * 1e3 << " ms" << std::endl
+	      << "open time       " << stats.open_time * 1e3 << " ms" << std::endl
+	      << "decode time     " << stats.decode_time * 1e3 << " ms" << std::endl
+	      << "signals         " << nsignals << std::endl
+	      << "points          " << npoints << std::endl
+	      << "decode calls    " << stats.decode_calls << std::endl
+	      << "points decoded  " << stats.points_decoded << std::endl
+	      << "metadata bytes  " << stats.metadata_bytes << std::endl
+	      << "value bytes     " << stats.value_bytes << std::endl
+	      << "read calls      " << stats.read_calls << std::endl
+	      << "page faults     " << stats.minor_faults << " minor, " << stats.major_faults << " major" << std::endl
+	      << "output bytes    " << bytes << std::endl
+	      << "output MB/s     " << std::setprecision(1) << bytes / seconds / 1e6 << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    Format format = FORMAT_CSV;
+    std::string outfile("-");
+    int start = 0, n = INT_MAX;
+    int nthreads = 1;
+    int blocksize = 65536;
+    bool timing = false;
+
+    int c;
+    while((c = getopt(argc, argv, "f:o:s:n:j:b:t")) != -1) {
+	switch(c) {
+	case 'f':
+	    if(!strcmp(optarg, "csv"))
+		format = FORMAT_CSV;
+	    else if(!strcmp(optarg, "raw"))
+		format = FORMAT_RAW;
+	    else if(!strcmp(optarg, "npy"))
+		format = FORMAT_NPY;
+	    else
+		usage();
+	    break;
+	case 'o': outfile = optarg; break;
+	case 's': start = atoi(optarg); break;
+	case 'n': n = atoi(optarg); break;
+	case 'j': nthreads = atoi(optarg); break;
+	case 'b': blocksize = atoi(optarg); break;
+	case 't': timing = true; break;
+	default: usage();
+	}
+    }
+
+    if(argc - optind < 2 || blocksize < 1 || nthreads < 0)
+	usage();
+
+    std::string command(argv[optind]);
+    std::string filename(argv[optind + 1]);
+    std::vector<std::string> patterns(argv + optind + 2, argv + argc);
+
+    if(command != "list" && command != "props" && command != "extract" && command != "reduce")
+	usage();
+
+    FILE *out = stdout;
+    if(outfile != "-" && !(out = fopen(outfile.c_str(), "wb"))) {
+	std::cerr << "psfquery: cannot open " << outfile << std::endl;
+	return 1;
+    }
+
+    if(timing)
+	psf_enable_stats(true);
+
+    double t = now();
+
+    try {
+	PSFDataSet ds(filename);
+
+	std::vector<std::string> names;
+	int npoints = 0;
+	uint64_t bytes = 0;
+
+	if(command == "list") {
+	    names = match_signals(ds, patterns);
+	    for(std::vector<std::string>::const_iterator i=names.begin(); i != names.end(); i++)
+		fprintf(out, "%s\n", i->c_str());
+	} else if(command == "props") {
+	    if(patterns.empty())
+		print_properties(ds.get_header_properties(), "", out);
+	    else {
+		names = match_signals(ds, patterns);
+		for(std::vector<std::string>::const_iterator i=names.begin(); i != names.end(); i++) {
+		    fprintf(out, "%s\n", i->c_str());
+		    print_properties(ds.get_signal_properties(*i), "  ", out);
+		}
+	    }
+	} else if(command == "extract") {
+	    names = match_signals(ds, patterns);
+
+	    if(format == FORMAT_CSV)
+		npoints = extract_csv(ds, names, patterns.empty(), start, n, nthreads, blocksize,
+				      out, &bytes);
+	    else {
+		RowWriter writer(out, format);
+		if(ds.is_swept())
+		    npoints = extract_swept(ds, names, start, n, nthreads, blocksize, writer);
+		else
+		    npoints = extract_nonswept(ds, names, writer);
+		writer.flush();
+		bytes = writer.get_bytes();
+	    }
+	} else {
+	    names = match_signals(ds, patterns);
+	    reduce(ds, names, start, n, out);
+	}
+
+	if(fflush(out) != 0)
+	    throw FileWriteError();
+
+	if(timing)
+	    report(ds, now() - t, names.size(), npoints, bytes);
+    } catch (FileOpenError &) {
+	std::cerr << "psfquery: cannot open " << filename << std::endl;
+	return 1;
+    } catch (NotFound &) {
+	// Reported by match_signals()
+	return 1;
+    } catch (NotImplemented &) {
+	std::cerr << "psfquery: " << command << " is not supported for the signals of " << filename << std::endl;
+	return 1;
+    } catch (FileWriteError &) {
+	std::cerr << "psfquery: cannot write " << outfile << std::endl;
+	return 1;
+    } catch (std::exception &) {
+	std::cerr << "psfquery: reading " << filename << " failed" << std::endl;
+	return 1;
+    }
+
+    if(out != stdout)
+	fclose(out);
+
+    return 0;
+}
@@ -0,0 +1,210 @@
+#include "psfrawdir.h"
+#include "psfthread.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+
+#include <algorithm>
+
+struct PSFRawDir::Entry {
+    enum State {CLOSED, OPENING, OPEN, FAILED};
+
+    Entry(const std::string &_name, const std::string &_path) :
+	name(_name), path(_path), state(CLOSED), dataset(NULL), invalid(false) {}
+    ~Entry() { delete dataset; }
+
+    std::string name, path;
+    State state;
+    PSFDataSet *dataset;
+
+    // Set if the file could be opened but not parsed
+    bool invalid;
+};
+
+class PSFRawDir::OpenTask: public WorkerPool::Task {
+public:
+    OpenTask(PSFRawDir *rawdir, Entry *entry) : m_rawdir(rawdir), m_entry(entry) {}
+    void run() { m_rawdir->open_entry(m_entry); }
+
+private:
+    PSFRawDir *m_rawdir;
+    Entry *m_entry;
+};
+
+// Check for the PSF trailer without parsing the file
+static bool is_psf_file(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+
+    if(fd == -1)
+	return false;
+
+    char trailer[8];
+    struct stat st;
+    bool result = fstat(fd, &st) == 0 && st.st_size >= 12 &&
+	pread(fd, trailer, 8, st.st_size - 12) == 8 &&
+	!memcmp(trailer, "Clarissa", 8);
+
+    ::close(fd);
+
+    return result;
+}
+
+PSFRawDir::PSFRawDir(std::string dirname, int nworkers) :
+    m_dirname(dirname), m_nworkers(nworkers), m_pool(NULL) {
+    m_mutex = new Mutex();
+    m_opened = new Condition();
+
+    try {
+	scan();
+    } catch (...) {
+	delete m_opened;
+	delete m_mutex;
+	throw;
+    }
+}
+
+PSFRawDir::~PSFRawDir() {
+    // Finish the running tasks before the entries are deleted
+    delete m_pool;
+
+    for(std::vector<Entry *>::iterator i=m_entries.begin(); i != m_entries.end(); i++)
+	delete *i;
+
+    delete m_opened;
+    delete m_mutex;
+}
+
+void PSFRawDir::scan() {
+    DIR *dir = opendir(m_dirname.c_str());
+
+    if(dir == NULL)
+	throw FileOpenError();
+
+    struct dirent *dirent;
+    while((dirent = readdir(dir)) != NULL) {
+	std::string name(dirent->d_name);
+
+	if(name.empty() || name[0] == '.')
+	    continue;
+
+	std::string path = m_dirname + "/" + name;
+
+	struct stat st;
+	if(stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+	    continue;
+
+	if(is_psf_file(path))
+	    m_names.push_back(name);
+    }
+
+    closedir(dir);
+
+    std::sort(m_names.begin(), m_names.end());
+
+    for(std::vector<std::string>::const_iterator i=m_names.begin(); i != m_names.end(); i++)
+	m_entries.push_back(new Entry(*i, m_dirname + "/" + *i));
+}
+
+PSFRawDir::Entry *PSFRawDir::find(const std::string &name) const {
+    for(std::vector<Entry *>::const_iterator i=m_entries.begin(); i != m_entries.end(); i++)
+	if((*i)->name == name)
+	    return *i;
+
+    // Analysis name
+    for(std::vector<Entry *>::const_iterator i=m_entries.begin(); i != m_entries.end(); i++)
+	if((*i)->name.substr(0, (*i)->name.find('.')) == name)
+	    return *i;
+
+    return NULL;
+}
+
+bool PSFRawDir::has(const std::string &name) const {
+    return find(name) != NULL;
+}
+
+void PSFRawDir::open_entry(Entry *entry) {
+    {
+	ScopedLock lock(*m_mutex);
+
+	if(entry->state != Entry::CLOSED)
+	    return;
+	entry->state = Entry::OPENING;
+    }
+
+    PSFDataSet *dataset = NULL;
+    bool invalid = false;
+
+    try {
+	dataset = new PSFDataSet(entry->path);
+    } catch (const FileOpenError &) {
+    } catch (...) {
+	invalid = true;
+    }
+
+    ScopedLock lock(*m_mutex);
+
+    entry->dataset = dataset;
+    entry->invalid = invalid;
+    entry->state = dataset ? Entry::OPEN : Entry::FAILED;
+
+    m_opened->broadcast();
+}
+
+PSFDataSet &PSFRawDir::get(const std::string &name) {
+    Entry *entry = find(name);
+
+    if(entry == NULL)
+	throw NotFound();
+
+    open_entry(entry);
+
+    ScopedLock lock(*m_mutex);
+
+    // Opened by another thread
+    while(entry->state == Entry::OPENING)
+	m_opened->wait(*m_mutex);
+
+    if(entry->state == Entry::FAILED) {
+	if(entry->invalid)
+	    throw InvalidFileError();
+	else
+	    throw FileOpenError();
+    }
+
+    return *entry->dataset;
+}
+
+void PSFRawDir::prefetch(const std::vector<std::string> &names) {
+    std::vector<Entry *> entries;
+
+    for(std::vector<std::string>::const_iterator i=names.begin(); i != names.end(); i++) {
+	Entry *entry = find(*i);
+
+	if(entry == NULL)
+	    throw NotFound();
+
+	entries.push_back(entry);
+    }
+
+    {
+	ScopedLock lock(*m_mutex);
+	if(m_pool == NULL)
+	    m_pool = new WorkerPool(m_nworkers);
+    }
+
+    for(std::vector<Entry *>::const_iterator i=entries.begin(); i != entries.end(); i++)
+	m_pool->submit(new OpenTask(this, *i));
+}
+
+void PSFRawDir::prefetch_all() {
+    prefetch(m_names);
+}
+
+void PSFRawDir::wait() {
+    if(m_pool)
+	m_pool->wait();
+}
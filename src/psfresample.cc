@@ -0,0 +1,161 @@
+#include "psf.h"
+#include "psfdata.h"
+#include "psfinternal.h"
+
+#include <math.h>
+
+// Bound of the memory holding the decoded points of a chunk
+static const long CHUNK_BYTES = 16 << 20;
+static const int CHUNK_MAXPOINTS = 65536;
+
+//
+// Grid point in an interval [x[k], x[k+1]] of a chunk with the interpolation
+// weights, shared by all traces
+//
+struct GridPoint {
+    int grid;
+    int k;
+    double t, h;
+    double h00, h10, h01, h11;
+};
+
+// Slope at point k from its neighbours, exact for quadratics
+static inline double slope(const double *x, const double *y, int k, int m) {
+    double h0 = k > 0 ? x[k] - x[k - 1] : 0;
+    double h1 = k < m - 1 ? x[k + 1] - x[k] : 0;
+
+    if(h0 > 0 && h1 > 0)
+	return ((y[k + 1] - y[k]) / h1 * h0 + (y[k] - y[k - 1]) / h0 * h1) / (h0 + h1);
+    else if(h1 > 0)
+	return (y[k + 1] - y[k]) / h1;
+    else if(h0 > 0)
+	return (y[k] - y[k - 1]) / h0;
+    else
+	return 0;
+}
+
+static void interpolate(const std::vector<GridPoint> &points, const std::vector<double> &x,
+			const std::vector<double> &y, PSFInterpolation method, double *result) {
+    for(std::vector<GridPoint>::const_iterator p=points.begin(); p != points.end(); p++) {
+	int k = p->k;
+
+	switch(method) {
+	case INTERP_HOLD:
+	    result[p->grid] = p->t < 1 ? y[k] : y[k + 1];
+	    break;
+	case INTERP_CUBIC: {
+	    double m0 = slope(&x[0], &y[0], k, x.size());
+	    double m1 = slope(&x[0], &y[0], k + 1, x.size());
+	    result[p->grid] = p->h00 * y[k] + p->h10 * p->h * m0 + p->h01 * y[k + 1] + p->h11 * p->h * m1;
+	    break;
+	}
+	default:
+	    result[p->grid] = y[k] + p->t * (y[k + 1] - y[k]);
+	}
+    }
+}
+
+std::vector<PSFVector *> ValueSectionSweep::resample(const NameList &names, const std::vector<double> &grid,
+						     PSFInterpolation method) const {
+    Filter filter = get_real_traces(names);
+    int ntraces = filter.size();
+
+    std::vector<PSFVector *> result;
+    std::vector<double *> outputs;
+    for(int j=0; j < ntraces; j++) {
+	PSFDoubleVector *vec = new PSFDoubleVector(NAN);
+	vec->resize(grid.size());
+	result.push_back(vec);
+	outputs.push_back(grid.empty() ? NULL : &vec->at(0));
+    }
+    PSF_STATS_ADD(objects_allocated, ntraces);
+
+    if(grid.empty() || m_npoints == 0 || ntraces == 0)
+	return result;
+
+    // The intervals are walked along the ascending grid
+    if(is_descending())
+	throw NotImplemented();
+
+    // Points around the grid, with one more point on each side for the slopes
+    int first = std::max(find_point(grid.front()) - 2, 0);
+    int last = std::min(find_point(grid.back()) + 2, m_npoints);
+
+    int chunk = std::min((long)CHUNK_MAXPOINTS, std::max(16L, CHUNK_BYTES / 8 / (ntraces + 1)));
+    DecodePlan plan(m_psf, filter, DecodePlan::DOUBLE);
+
+    std::vector<double> x;
+    std::vector<std::vector<double> > y(ntraces);
+    std::vector<GridPoint> points;
+    unsigned int gi = 0;
+
+    // Intervals [s, e) of the chunk, interval i lies between point i and i + 1
+    for(int s = first; s < std::max(last - 1, first + 1); s += chunk) {
+	int e = std::min(s + chunk, last - 1);
+	int ls = std::max(s - 1, 0);
+	int le = std::min(e + 2, m_npoints);
+
+	x.clear();
+	std::vector<Collector> collectors;
+	for(int j=0; j < ntraces; j++) {
+	    y[j].clear();
+	    collectors.push_back(Collector(j == 0 ? &x : NULL, &y[j]));
+	}
+	reduce(plan, ls, le - ls, collectors);
+
+	points.clear();
+
+	if(m_npoints == 1) {
+	    // A single point is only defined at its sweep value
+	    for(; gi < grid.size(); gi++)
+		if(grid[gi] == x[0]) {
+		    GridPoint p = { (int)gi, 0, 1, 0, 0, 0, 1, 0 };
+		    points.push_back(p);
+		}
+	    x.push_back(x[0]);
+	    for(int j=0; j < ntraces; j++)
+		y[j].push_back(y[j][0]);
+	}
+
+	for(int i = s; i < e; i++) {
+	    int k = i - ls;
+	    double x0 = x[k], x1 = x[k + 1];
+
+	    // The last interval of the sweep includes its end point
+	    bool lastinterval = i == m_npoints - 2;
+
+	    for(; gi < grid.size(); gi++) {
+		double g = grid[gi];
+
+		// Before the sweep
+		if(g < x0)
+		    continue;
+
+		if(g > x1 || (g == x1 && !lastinterval))
+		    break;
+
+		GridPoint p;
+		p.grid = gi;
+		p.k = k;
+		p.h = x1 - x0;
+		p.t = p.h > 0 ? (g - x0) / p.h : 1;
+
+		double t = p.t, t2 = t * t, t3 = t2 * t;
+		p.h00 = 2 * t3 - 3 * t2 + 1;
+		p.h10 = t3 - 2 * t2 + t;
+		p.h01 = -2 * t3 + 3 * t2;
+		p.h11 = t3 - t2;
+
+		points.push_back(p);
+	    }
+	}
+
+	for(int j=0; j < ntraces; j++)
+	    interpolate(points, x, y[j], method, outputs[j]);
+
+	if(gi == grid.size())
+	    break;
+    }
+
+    return result;
+}
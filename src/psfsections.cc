@@ -13,7 +13,7 @@ Chunk *HeaderSection::child_factory(int chunktype) const {
     }
 }
 
-int HeaderSection::deserialize(const char *buf, int abspos) {
+int HeaderSection::deserialize(const char *buf, long abspos) {
     int n = SimpleContainer::deserialize(buf, abspos);
 
     for(Container::const_iterator ichild=begin(); ichild !=end(); ichild++) {
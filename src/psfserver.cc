@@ -0,0 +1,319 @@
+#include "psf.h"
+#include "psfserver.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <algorithm>
+#include <sstream>
+
+static std::string format_double(double value) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.17g", value);
+    return buf;
+}
+
+static std::string format_int(long value) {
+    std::stringstream s;
+    s << value;
+    return s.str();
+}
+
+static int parse_int(const std::string &s) {
+    return atoi(s.c_str());
+}
+
+//
+// Shared memory segment of size bytes mapped for writing, the descriptor
+// is passed to the client
+//
+class Segment {
+ public:
+    Segment(size_t size) : m_data(NULL), m_size(size) {
+	m_fd = memfd_create("psfd", MFD_CLOEXEC);
+	if(m_fd == -1)
+	    throw ServerError();
+
+	if(size > 0) {
+	    if(ftruncate(m_fd, size) == -1) {
+		close(m_fd);
+		throw ServerError();
+	    }
+	    m_data = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+	    if(m_data == MAP_FAILED) {
+		close(m_fd);
+		throw ServerError();
+	    }
+	}
+    }
+
+    ~Segment() {
+	if(m_data)
+	    munmap(m_data, m_size);
+	close(m_fd);
+    }
+
+    void *data() const { return m_data; }
+    int fd() const { return m_fd; }
+
+ private:
+    int m_fd;
+    void *m_data;
+    size_t m_size;
+};
+
+PSFServer::PSFServer(const std::string &path) : m_path(path), m_stop(false) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+
+    if(path.size() >= sizeof(addr.sun_path))
+	throw ConnectionError();
+    strcpy(addr.sun_path, path.c_str());
+
+    m_sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(m_sock == -1)
+	throw ConnectionError();
+
+    // Only a stale socket is replaced, never another file
+    struct stat st;
+    if(lstat(path.c_str(), &st) == 0) {
+	if(!S_ISSOCK(st.st_mode)) {
+	    close(m_sock);
+	    throw ConnectionError();
+	}
+	unlink(path.c_str());
+    }
+
+    // The socket is only accessible by the user of the server
+    mode_t mask = umask(077);
+    int status = bind(m_sock, (struct sockaddr *)&addr, sizeof(addr));
+    umask(mask);
+
+    if(status == -1 || chmod(path.c_str(), 0600) == -1 || listen(m_sock, 64) == -1) {
+	close(m_sock);
+	throw ConnectionError();
+    }
+}
+
+// Files are opened with the credentials of the server, so only processes
+// of the same user are served
+static bool is_same_user(int sock) {
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+
+    if(getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) == -1)
+	return false;
+
+    return cred.uid == geteuid();
+}
+
+PSFServer::~PSFServer() {
+    stop();
+
+    // Close the connections and wait for their threads
+    {
+	ScopedLock lock(m_mutex);
+
+	for(std::set<int>::const_iterator i=m_connections.begin(); i != m_connections.end(); i++)
+	    shutdown(*i, SHUT_RDWR);
+
+	while(!m_connections.empty())
+	    m_closed.wait(m_mutex);
+    }
+
+    close(m_sock);
+    unlink(m_path.c_str());
+}
+
+void PSFServer::run() {
+    while(true) {
+	int sock = accept4(m_sock, NULL, NULL, SOCK_CLOEXEC);
+
+	if(__atomic_load_n(&m_stop, __ATOMIC_ACQUIRE)) {
+	    if(sock != -1)
+		close(sock);
+	    break;
+	}
+
+	if(sock == -1) {
+	    if(errno == EINTR || errno == ECONNABORTED)
+		continue;
+	    break;
+	}
+
+	if(!is_same_user(sock)) {
+	    close(sock);
+	    continue;
+	}
+
+	Connection *connection = new Connection();
+	connection->server = this;
+	connection->sock = sock;
+
+	pthread_t thread;
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	ScopedLock lock(m_mutex);
+
+	if(pthread_create(&thread, &attr, &PSFServer::serve, connection) == 0)
+	    m_connections.insert(sock);
+	else {
+	    close(sock);
+	    delete connection;
+	}
+
+	pthread_attr_destroy(&attr);
+    }
+}
+
+// Only async signal safe calls, psfd stops from its signal handler
+void PSFServer::stop() {
+    __atomic_store_n(&m_stop, true, __ATOMIC_RELEASE);
+
+    // Wake up accept
+    shutdown(m_sock, SHUT_RDWR);
+}
+
+void *PSFServer::serve(void *arg) {
+    Connection *connection = (Connection *)arg;
+    PSFServer *server = connection->server;
+    int sock = connection->sock;
+    delete connection;
+
+    try {
+	server->handle(sock);
+    } catch(std::exception &) {
+	// The client went away
+    }
+
+    ScopedLock lock(server->m_mutex);
+    server->m_connections.erase(sock);
+    close(sock);
+    server->m_closed.broadcast();
+
+    return NULL;
+}
+
+void PSFServer::handle(int sock) {
+    Message request;
+
+    while(recv_message(sock, request)) {
+	int fd = -1;
+	Message reply;
+
+	try {
+	    reply = dispatch(request, &fd);
+	} catch(NotFound &) {
+	    reply.assign(1, "error");
+	    reply.push_back("NotFound");
+	} catch(FileOpenError &) {
+	    reply.assign(1, "error");
+	    reply.push_back("FileOpenError");
+	} catch(InvalidFileError &) {
+	    reply.assign(1, "error");
+	    reply.push_back("InvalidFileError");
+	} catch(FileReadError &) {
+	    reply.assign(1, "error");
+	    reply.push_back("FileReadError");
+	} catch(NotImplemented &) {
+	    reply.assign(1, "error");
+	    reply.push_back("NotImplemented");
+	} catch(...) {
+	    reply.assign(1, "error");
+	    reply.push_back("ServerError");
+	}
+
+	send_message(sock, reply, fd);
+
+	if(fd != -1)
+	    close(fd);
+    }
+}
+
+Message PSFServer::dispatch(const Message &request, int *fd) {
+    const std::string &command = request[0];
+    Message reply(1, "ok");
+
+    if(command == "list" && request.size() == 1) {
+	ScopedLock lock(m_mutex);
+	reply.insert(reply.end(), m_files.begin(), m_files.end());
+	return reply;
+    }
+
+    if(request.size() < 2)
+	throw ServerError();
+
+    // Relative paths would be resolved in the directory of the server
+    if(request[1].empty() || request[1][0] != '/')
+	throw FileOpenError();
+
+    // Parsed once by the file cache and shared by all connections
+    PSFDataSet ds(request[1]);
+
+    {
+	ScopedLock lock(m_mutex);
+	m_files.insert(request[1]);
+    }
+
+    // Only swept files have signals to decode
+    if(command != "names" && !ds.is_swept())
+	throw NotImplemented();
+
+    if(command == "names" && request.size() == 2) {
+	std::vector<std::string> names = ds.get_signal_names();
+	reply.insert(reply.end(), names.begin(), names.end());
+    } else if(command == "signal" && request.size() == 5) {
+	const std::string &name = request[2];
+	int start = parse_int(request[3]), n = parse_int(request[4]);
+	int npoints = ds.get_signal_size(name, start, n);
+
+	// Real signals are decoded to doubles, complex signals to pairs
+	try {
+	    Segment segment(npoints * sizeof(double));
+	    ds.get_signal_into(name, (double *)segment.data(), npoints, start, npoints);
+	    reply.push_back("double");
+	    *fd = dup(segment.fd());
+	} catch(NotImplemented &) {
+	    Segment segment(npoints * sizeof(PSFComplexDouble));
+	    ds.get_signal_into(name, (PSFComplexDouble *)segment.data(), npoints, start, npoints);
+	    reply.push_back("complex");
+	    *fd = dup(segment.fd());
+	}
+	reply.push_back(format_int(npoints));
+    } else if(command == "sweep" && request.size() == 4) {
+	int start = parse_int(request[2]), n = parse_int(request[3]);
+	int npoints = std::max(std::min(n, ds.get_sweep_npoints() - std::max(start, 0)), 0);
+
+	Segment segment(npoints * sizeof(double));
+	ds.get_sweep_values_into((double *)segment.data(), npoints, start, npoints);
+	reply.push_back("double");
+	reply.push_back(format_int(npoints));
+	*fd = dup(segment.fd());
+    } else if(command == "reduce" && request.size() == 5) {
+	PSFSweepReduction r = ds.get_signal_reduction(request[2], parse_int(request[3]),
+						      parse_int(request[4]));
+	reply.push_back(format_int(r.npoints));
+	reply.push_back(format_double(r.xstart));
+	reply.push_back(format_double(r.xend));
+	reply.push_back(format_double(r.min));
+	reply.push_back(format_double(r.max));
+	reply.push_back(format_double(r.min_x));
+	reply.push_back(format_double(r.max_x));
+	reply.push_back(format_double(r.average));
+	reply.push_back(format_double(r.rms));
+	reply.push_back(format_double(r.integral));
+    } else
+	throw ServerError();
+
+    return reply;
+}
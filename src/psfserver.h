@@ -0,0 +1,73 @@
+#ifndef _PSF_SERVER
+#define _PSF_SERVER
+
+#include "psfsocket.h"
+#include "psfthread.h"
+
+#include <set>
+#include <string>
+
+//
+// Server of psfd. Clients connect to a Unix domain socket and send queries
+// on the PSF files of the host, each connection is served by a thread of
+// its own. The files are opened through the process wide file cache, so
+// all clients share one parsed copy of each file. Signal values are decoded
+// straight into a memfd shared memory segment that is passed to the client
+// and mapped by it, so they are never copied.
+//
+// Requests and replies, see psfsocket.h for the framing:
+//
+//   list                            ok file...
+//   names file                      ok signal...
+//   signal file name start n        ok double|complex npoints + segment
+//   sweep file start n              ok double npoints + segment
+//   reduce file name start n        ok npoints xstart xend min max min_x
+//                                      max_x average rms integral
+//
+// Files are absolute paths, others are replied as error FileOpenError.
+// Signals of files without a sweep are replied as error NotImplemented, other
+// errors as error and the name of the exception.
+//
+// The files are opened with the credentials of the server, so the socket is
+// only accessible by its user and connections of other users are closed. A
+// server is not meant to be shared by several users.
+//
+class PSFServer {
+ public:
+    // Listen on the socket at path with mode 0600, a stale socket is
+    // replaced
+    PSFServer(const std::string &path);
+    ~PSFServer();
+
+    // Accept connections until stop() is called
+    void run();
+
+    // Make run() return, may be called from a signal handler. The
+    // connections are closed when the server is deleted.
+    void stop();
+
+ private:
+    PSFServer(const PSFServer &);
+    PSFServer &operator=(const PSFServer &);
+
+    struct Connection {
+	PSFServer *server;
+	int sock;
+    };
+
+    static void *serve(void *connection);
+    void handle(int sock);
+    Message dispatch(const Message &request, int *fd);
+
+    std::string m_path;
+    int m_sock;
+    bool m_stop;
+
+    // Files opened by any client and the open connections
+    Mutex m_mutex;
+    Condition m_closed;
+    std::set<std::string> m_files;
+    std::set<int> m_connections;
+};
+
+#endif
@@ -0,0 +1,142 @@
+#include "psf.h"
+#include "psfsocket.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+
+// Longest message that is accepted
+static const uint32_t MAX_MESSAGE = 64 << 20;
+
+void send_message(int sock, const Message &message, int fd) {
+    std::string payload;
+    for(size_t i=0; i < message.size(); i++) {
+	if(i > 0)
+	    payload += '\n';
+	payload += message[i];
+    }
+
+    uint32_t len = payload.size();
+
+    struct iovec iov[2];
+    iov[0].iov_base = &len;
+    iov[0].iov_len = sizeof(len);
+    iov[1].iov_base = (void *)payload.data();
+    iov[1].iov_len = payload.size();
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+
+    char control[CMSG_SPACE(sizeof(int))];
+    if(fd != -1) {
+	memset(control, 0, sizeof(control));
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+
+    // The descriptor goes with the first byte, the rest is written as needed
+    size_t total = sizeof(len) + payload.size(), sent = 0;
+    while(sent < total) {
+	ssize_t n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+
+	if(n <= 0)
+	    throw ConnectionError();
+
+	sent += n;
+	msg.msg_control = NULL;
+	msg.msg_controllen = 0;
+
+	while(n > 0 && msg.msg_iovlen > 0) {
+	    size_t step = std::min((size_t)n, msg.msg_iov->iov_len);
+	    msg.msg_iov->iov_base = (char *)msg.msg_iov->iov_base + step;
+	    msg.msg_iov->iov_len -= step;
+	    n -= step;
+	    if(msg.msg_iov->iov_len == 0) {
+		msg.msg_iov++;
+		msg.msg_iovlen--;
+	    }
+	}
+    }
+}
+
+bool recv_message(int sock, Message &message, int *fd) {
+    uint32_t len;
+
+    struct iovec iov;
+    iov.iov_base = &len;
+    iov.iov_len = sizeof(len);
+
+    char control[CMSG_SPACE(sizeof(int))];
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    if(fd)
+	*fd = -1;
+
+    // The length and the passed descriptor
+    size_t received = 0;
+    while(received < sizeof(len)) {
+	ssize_t n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+
+	if(n == 0 && received == 0)
+	    return false;
+	if(n <= 0)
+	    throw ConnectionError();
+
+	for(struct cmsghdr *cmsg=CMSG_FIRSTHDR(&msg); cmsg; cmsg=CMSG_NXTHDR(&msg, cmsg))
+	    if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+		int passed;
+		memcpy(&passed, CMSG_DATA(cmsg), sizeof(int));
+
+		if(fd)
+		    *fd = passed;
+		else
+		    close(passed);
+	    }
+
+	received += n;
+	iov.iov_base = (char *)&len + received;
+	iov.iov_len = sizeof(len) - received;
+	msg.msg_control = NULL;
+	msg.msg_controllen = 0;
+    }
+
+    if(len > MAX_MESSAGE)
+	throw ConnectionError();
+
+    std::string payload(len, '\0');
+    for(received = 0; received < len; ) {
+	ssize_t n = read(sock, &payload[received], len - received);
+
+	if(n <= 0)
+	    throw ConnectionError();
+
+	received += n;
+    }
+
+    message.clear();
+    size_t start = 0;
+    for(size_t i=0; i <= payload.size(); i++)
+	if(i == payload.size() || payload[i] == '\n') {
+	    message.push_back(payload.substr(start, i - start));
+	    start = i + 1;
+	}
+
+    return true;
+}
@@ -0,0 +1,26 @@
+#ifndef _PSF_SOCKET
+#define _PSF_SOCKET
+
+#include <string>
+#include <vector>
+
+//
+// Messages of the psfd protocol over a Unix domain stream socket. A message
+// is a list of text fields, sent as its length in bytes as a native 32 bit
+// integer followed by the fields separated by newlines. A file descriptor
+// can be passed along with a message, which is how the values of a signal
+// are handed over in a shared memory segment.
+//
+// Requests are a command followed by its arguments, replies start with "ok"
+// or with "error" and the name of the exception.
+//
+typedef std::vector<std::string> Message;
+
+// Send a message and optionally pass the descriptor fd
+void send_message(int sock, const Message &message, int fd=-1);
+
+// Receive a message, a passed descriptor is returned in fd or -1 if there
+// is none. Returns false if the peer closed the connection.
+bool recv_message(int sock, Message &message, int *fd=NULL);
+
+#endif
@@ -0,0 +1,292 @@
+#include "psfstack.h"
+#include "psfthread.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+// Exceptions are passed from the worker threads to the calling thread
+enum StackError {STACK_OK, STACK_FILEOPENERROR, STACK_INVALIDFILEERROR,
+		 STACK_NOTFOUND, STACK_NOTIMPLEMENTED};
+
+struct StackState {
+    StackState() : error(STACK_OK) {}
+
+    void set_error(StackError e) {
+	ScopedLock lock(mutex);
+	if(error == STACK_OK)
+	    error = e;
+    }
+
+    bool failed() {
+	ScopedLock lock(mutex);
+	return error != STACK_OK;
+    }
+
+    void rethrow() {
+	switch(error) {
+	case STACK_FILEOPENERROR: throw FileOpenError();
+	case STACK_INVALIDFILEERROR: throw InvalidFileError();
+	case STACK_NOTFOUND: throw NotFound();
+	case STACK_NOTIMPLEMENTED: throw NotImplemented();
+	default: break;
+	}
+    }
+
+    Mutex mutex;
+    StackError error;
+};
+
+static double scalar_value(const PSFScalar &value) {
+    if(dynamic_cast<const PSFDoubleScalar *>(&value) ||
+       dynamic_cast<const PSFInt32Scalar *>(&value) ||
+       dynamic_cast<const PSFInt8Scalar *>(&value))
+	return (double)value;
+    else
+	throw NotImplemented();
+}
+
+// Copy the signals of a file to rows[i]
+static void read_file(const std::string &filename, const std::vector<std::string> &signals,
+		      int npoints, const std::vector<double *> &rows) {
+    PSFDataSet ds(filename);
+
+    if(ds.is_swept()) {
+	// The signals are decoded straight into the rows
+	if(ds.get_sweep_npoints() != npoints)
+	    throw InvalidFileError();
+
+	if(!rows.empty())
+	    ds.get_signals_into(signals, &rows[0], npoints);
+    } else {
+	if(npoints != 1)
+	    throw InvalidFileError();
+
+	for(unsigned int i=0; i < signals.size(); i++)
+	    rows[i][0] = scalar_value(ds.get_signal_scalar(signals[i]));
+    }
+}
+
+static void read_file(const std::string &filename, const std::vector<std::string> &signals,
+		      int npoints, const std::vector<double *> &rows, StackState &state) {
+    if(state.failed())
+	return;
+
+    try {
+	read_file(filename, signals, npoints, rows);
+    } catch (const FileOpenError &) {
+	state.set_error(STACK_FILEOPENERROR);
+    } catch (const NotFound &) {
+	state.set_error(STACK_NOTFOUND);
+    } catch (const NotImplemented &) {
+	state.set_error(STACK_NOTIMPLEMENTED);
+    } catch (...) {
+	state.set_error(STACK_INVALIDFILEERROR);
+    }
+}
+
+//
+// Running mean, sum of squared deviations, min and max of each point
+//
+struct Moments {
+    Moments(int npoints) : n(0), mean(npoints, 0.0), m2(npoints, 0.0),
+			   min(npoints, INFINITY), max(npoints, -INFINITY) {}
+
+    void add(const double *row) {
+	n++;
+	for(unsigned int j=0; j < mean.size(); j++) {
+	    double delta = row[j] - mean[j];
+	    mean[j] += delta / n;
+	    m2[j] += delta * (row[j] - mean[j]);
+	    min[j] = std::min(min[j], row[j]);
+	    max[j] = std::max(max[j], row[j]);
+	}
+    }
+
+    void merge(const Moments &other) {
+	if(other.n == 0)
+	    return;
+
+	double total = n + other.n;
+	for(unsigned int j=0; j < mean.size(); j++) {
+	    double delta = other.mean[j] - mean[j];
+	    mean[j] += delta * other.n / total;
+	    m2[j] += other.m2[j] + delta * delta * n * other.n / total;
+	    min[j] = std::min(min[j], other.min[j]);
+	    max[j] = std::max(max[j], other.max[j]);
+	}
+	n += other.n;
+    }
+
+    void get_result(PSFReduction &result) const {
+	result.nruns = n;
+	result.mean = mean;
+	result.min = min;
+	result.max = max;
+	result.stddev.resize(mean.size());
+	for(unsigned int j=0; j < mean.size(); j++)
+	    result.stddev[j] = n > 1 ? sqrt(m2[j] / (n - 1)) : 0.0;
+    }
+
+    long n;
+    std::vector<double> mean, m2, min, max;
+};
+
+class PSFStack::StackTask: public WorkerPool::Task {
+public:
+    StackTask(const std::string &filename, const std::vector<std::string> &signals,
+	      int npoints, const std::vector<double *> &rows, StackState &state) :
+	m_filename(filename), m_signals(signals), m_npoints(npoints), m_rows(rows), m_state(state) {}
+
+    void run() { read_file(m_filename, m_signals, m_npoints, m_rows, m_state); }
+
+private:
+    const std::string &m_filename;
+    const std::vector<std::string> &m_signals;
+    int m_npoints;
+    std::vector<double *> m_rows;
+    StackState &m_state;
+};
+
+// Reduce every nth file starting with the first one
+class PSFStack::ReduceTask: public WorkerPool::Task {
+public:
+    ReduceTask(const std::vector<std::string> &filenames, int first, int step,
+	       const std::string &signal, int npoints, Moments &result, StackState &state) :
+	m_filenames(filenames), m_first(first), m_step(step), m_signals(1, signal),
+	m_npoints(npoints), m_result(result), m_state(state) {}
+
+    void run() {
+	Moments moments(m_npoints);
+	std::vector<double> row(m_npoints);
+	std::vector<double *> rows(1, row.data());
+
+	for(unsigned int i=m_first; i < m_filenames.size(); i += m_step) {
+	    read_file(m_filenames[i], m_signals, m_npoints, rows, m_state);
+	    if(m_state.failed())
+		return;
+	    moments.add(row.data());
+	}
+
+	ScopedLock lock(m_state.mutex);
+	m_result.merge(moments);
+    }
+
+private:
+    const std::vector<std::string> &m_filenames;
+    unsigned int m_first, m_step;
+    std::vector<std::string> m_signals;
+    int m_npoints;
+    Moments &m_result;
+    StackState &m_state;
+};
+
+PSFStack::PSFStack(const std::vector<std::string> &filenames, int nworkers) :
+    m_filenames(filenames), m_npoints(-1) {
+    m_pool = new WorkerPool(nworkers);
+}
+
+PSFStack::~PSFStack() {
+    delete m_pool;
+}
+
+int PSFStack::get_npoints() {
+    if(m_npoints < 0) {
+	if(m_filenames.empty())
+	    return 0;
+
+	PSFDataSet ds(m_filenames[0]);
+	m_npoints = ds.is_swept() ? ds.get_sweep_npoints() : 1;
+    }
+
+    return m_npoints;
+}
+
+void PSFStack::stack(const std::string &signal, double *data) {
+    stack(std::vector<std::string>(1, signal), data);
+}
+
+void PSFStack::stack(const std::vector<std::string> &signals, double *data) {
+    int npoints = get_npoints();
+    int nruns = get_nruns();
+
+    StackState state;
+
+    for(int i=0; i < nruns; i++) {
+	std::vector<double *> rows;
+	for(unsigned int k=0; k < signals.size(); k++)
+	    rows.push_back(data + ((size_t)k * nruns + i) * npoints);
+
+	m_pool->submit(new StackTask(m_filenames[i], signals, npoints, rows, state));
+    }
+
+    m_pool->wait();
+
+    state.rethrow();
+}
+
+void PSFStack::reduce(const std::string &signal, PSFReduction &result,
+		      const std::vector<double> &percentiles) {
+    int npoints = get_npoints();
+    int nruns = get_nruns();
+
+    Moments moments(npoints);
+
+    result.percentiles.clear();
+
+    if(percentiles.empty()) {
+	StackState state;
+
+	for(int i=0; i < m_pool->get_nthreads(); i++)
+	    m_pool->submit(new ReduceTask(m_filenames, i, m_pool->get_nthreads(),
+					  signal, npoints, moments, state));
+	m_pool->wait();
+
+	state.rethrow();
+    } else if((size_t)nruns * npoints > 0) {
+	std::vector<double> data((size_t)nruns * npoints);
+
+	stack(signal, &data[0]);
+
+	for(int i=0; i < nruns; i++)
+	    moments.add(&data[(size_t)i * npoints]);
+
+	for(unsigned int k=0; k < percentiles.size(); k++) {
+	    result.percentiles.push_back(std::vector<double>(npoints));
+	    percentile(&data[0], nruns, npoints, percentiles[k], &result.percentiles.back()[0]);
+	}
+    } else
+	// Nothing to stack without runs or points, percentiles of no runs
+	// are NAN
+	for(unsigned int k=0; k < percentiles.size(); k++)
+	    result.percentiles.push_back(std::vector<double>(npoints, NAN));
+
+    moments.get_result(result);
+}
+
+void PSFStack::percentile(const double *data, int nruns, int npoints,
+			  double p, double *result) {
+    if(nruns == 0) {
+	std::fill(result, result + npoints, NAN);
+	return;
+    }
+
+    double rank = std::min(std::max(p, 0.0), 100.0) / 100.0 * (nruns - 1);
+    int lo = (int)floor(rank);
+    double frac = rank - lo;
+
+    std::vector<double> column(nruns);
+
+    for(int j=0; j < npoints; j++) {
+	for(int i=0; i < nruns; i++)
+	    column[i] = data[(size_t)i * npoints + j];
+
+	std::nth_element(column.begin(), column.begin() + lo, column.end());
+	double value = column[lo];
+
+	if(frac > 0)
+	    value += frac * (*std::min_element(column.begin() + lo + 1, column.end()) - value);
+
+	result[j] = value;
+    }
+}
@@ -0,0 +1,70 @@
+#include "psf.h"
+#include "psfinternal.h"
+
+#include <sys/time.h>
+#include <sys/resource.h>
+
+bool psf_stats = false;
+
+__thread PSFStats *psf_current_stats = NULL;
+
+void psf_enable_stats(bool enable) {
+    psf_stats = enable;
+}
+
+bool psf_stats_enabled() {
+    return psf_stats;
+}
+
+void PSFStats::reset() {
+    open_time = header_time = type_time = sweep_time = trace_time = value_time = 0;
+    decode_time = 0;
+    decode_calls = points_decoded = traces_decoded = 0;
+    metadata_bytes = value_bytes = 0;
+    objects_allocated = 0;
+    minor_faults = major_faults = 0;
+    cache_hits = cache_misses = 0;
+    read_calls = read_bytes = prefetch_bytes = 0;
+}
+
+static void get_faults(long *minflt, long *majflt) {
+    struct rusage usage;
+#ifdef RUSAGE_THREAD
+    getrusage(RUSAGE_THREAD, &usage);
+#else
+    getrusage(RUSAGE_SELF, &usage);
+#endif
+    *minflt = usage.ru_minflt;
+    *majflt = usage.ru_majflt;
+}
+
+StatsScope::StatsScope(PSFStats &stats, double PSFStats::*time) : m_stats(NULL), m_time(time) {
+    if(!psf_stats)
+	return;
+
+    m_stats = &stats;
+    m_prevstats = psf_current_stats;
+    psf_current_stats = m_stats;
+
+    clock_gettime(CLOCK_MONOTONIC, &m_start);
+    get_faults(&m_minflt, &m_majflt);
+}
+
+StatsScope::~StatsScope() {
+    if(!m_stats)
+	return;
+
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    m_stats->*m_time += (end.tv_sec - m_start.tv_sec) + 1e-9 * (end.tv_nsec - m_start.tv_nsec);
+
+    // Nested scopes only count the faults of the outermost scope
+    if(m_prevstats != m_stats) {
+	long minflt, majflt;
+	get_faults(&minflt, &majflt);
+	m_stats->minor_faults += minflt - m_minflt;
+	m_stats->major_faults += majflt - m_majflt;
+    }
+
+    psf_current_stats = m_prevstats;
+}
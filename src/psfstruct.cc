@@ -20,7 +20,17 @@ int StructDef::deserialize(const char *buf) {
 	child = deserialize_child(&buf);  
 	if(child) {
 	    add_child(child);
-	    _datasize += ((DataTypeDef *)child)->datasize();
+
+	    const DataTypeDef *def = (DataTypeDef *)child;
+
+	    Item item;
+	    item.name = def->get_name();
+	    item.def = def;
+	    item.offset = _datasize;
+	    item.decode = def->get_decoder();
+	    m_items.push_back(item);
+
+	    _datasize += def->datasize();
 	}
     } while (child);
 
@@ -0,0 +1,163 @@
+#include "psf.h"
+#include "psfdata.h"
+#include "psfinternal.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+//
+// Find the shape of a nested sweep from the values of its outer sweeps. The
+// values of each outer sweep are constant over a run of points that is a
+// multiple of the run of the next inner sweep.
+//
+void ValueSectionSweep::_create_sweepshape() const {
+    const SweepSection &sweeps = m_psf->get_sweep_section();
+    int nsweeps = sweeps.size();
+
+    std::vector<std::vector<double> > values(nsweeps);
+
+    if(nsweeps > 1) {
+	// Outer sweep values are only stored in simple sweeps
+	if(windowedsweep)
+	    throw NotImplemented();
+
+	Filter filter(sweeps.begin() + 1, sweeps.end());
+
+	std::vector<Collector> collectors;
+	for(int i=1; i < nsweeps; i++)
+	    collectors.push_back(Collector(i == 1 ? &values[0] : NULL, &values[i]));
+
+	reduce(filter, 0, m_npoints, collectors);
+    } else
+	for(int i=0; i < m_npoints; i++)
+	    values[0].push_back(get_param_value(i));
+
+    std::vector<int> shape(nsweeps, 0), strides(nsweeps, 1);
+    std::vector<std::vector<double> > axes(nsweeps);
+
+    if(m_npoints > 0) {
+	for(int i=1; i < nsweeps; i++) {
+	    const std::vector<double> &v = values[i];
+
+	    int run = 1;
+	    while(run < m_npoints && v[run] == v[0])
+		run++;
+
+	    if(run % strides[i - 1] || m_npoints % run)
+		throw NotImplemented();
+
+	    for(int p=0; p < m_npoints; p++)
+		if(v[p] != v[p - p % run])
+		    throw NotImplemented();
+
+	    strides[i] = run;
+	}
+
+	for(int i=0; i < nsweeps; i++) {
+	    shape[i] = (i == nsweeps - 1 ? m_npoints : strides[i + 1]) / strides[i];
+
+	    for(int j=0; j < shape[i]; j++)
+		axes[i].push_back(values[i][j * strides[i]]);
+	}
+    }
+
+    // Outermost first
+    m_strides.assign(strides.rbegin(), strides.rend());
+    m_axes.assign(axes.rbegin(), axes.rend());
+    m_shape.assign(shape.rbegin(), shape.rend());
+}
+
+const std::vector<int> &ValueSectionSweep::get_shape() const {
+    m_sweepshape.run(this, &ValueSectionSweep::_create_sweepshape);
+
+    return m_shape;
+}
+
+PSFSweepArray ValueSectionSweep::get_array(const std::string &name, const std::vector<int> &start,
+					   const std::vector<int> &count) const {
+    const std::vector<int> &shape = get_shape();
+    int ndims = shape.size();
+
+    Filter filter;
+    filter.push_back(&m_psf->get_trace_section().get_trace_by_name(name));
+
+    // The slice selects points of the outer sweeps only, the inner sweep is
+    // always whole
+    if((int)start.size() > ndims - 1 || (int)count.size() > ndims - 1)
+	throw std::out_of_range("slice has more entries than outer sweeps");
+
+    std::vector<int> lo(ndims, 0), n(shape);
+    for(int i=0; i < ndims - 1; i++) {
+	if(i < (int)start.size()) {
+	    lo[i] = start[i];
+	    if(lo[i] < 0 || lo[i] >= shape[i])
+		throw std::out_of_range("slice start outside of sweep");
+	}
+
+	if(i < (int)count.size())
+	    n[i] = count[i];
+	else
+	    n[i] = shape[i] - lo[i];
+	if(n[i] < 0 || n[i] > shape[i] - lo[i])
+	    throw std::out_of_range("slice count outside of sweep");
+    }
+
+    const SweepSection &sweeps = m_psf->get_sweep_section();
+
+    PSFSweepArray result;
+    result.shape = n;
+    for(int i=0; i < ndims; i++) {
+	result.names.push_back(dynamic_cast<const DataTypeRef *>(sweeps[ndims - 1 - i])->get_name());
+	result.axes.push_back(std::vector<double>(m_axes[i].begin() + lo[i],
+						  m_axes[i].begin() + lo[i] + n[i]));
+    }
+
+    // The selected points of the two innermost sweeps are contiguous
+    int last = std::max(ndims - 2, 0);
+    int runlength = n[last] * m_strides[last];
+
+    bool empty = false;
+    for(int i=0; i < ndims; i++)
+	if(n[i] == 0)
+	    empty = true;
+
+    result.data = NULL;
+
+    std::vector<int> index(lo.begin(), lo.begin() + last);
+
+    try {
+	for(;;) {
+	    int point = lo[last] * m_strides[last];
+	    for(int i=0; i < last; i++)
+		point += index[i] * m_strides[i];
+
+	    SweepValue *v = get_values(filter, point, empty ? 0 : runlength);
+
+	    if(result.data) {
+		result.data->extend(v->at(0));
+		delete v;
+	    } else {
+		result.data = v->at(0);
+
+		// Clear vector to avoid deallocation of the result
+		v->clear();
+		delete v;
+	    }
+
+	    // Next point of the outer sweeps
+	    int i = last - 1;
+	    while(i >= 0 && ++index[i] == lo[i] + n[i]) {
+		index[i] = lo[i];
+		i--;
+	    }
+
+	    if(i < 0 || empty)
+		break;
+	}
+    } catch (...) {
+	delete result.data;
+	throw;
+    }
+
+    return result;
+}
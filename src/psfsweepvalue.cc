@@ -3,6 +3,9 @@
 #include "psfinternal.h"
 
 #include <assert.h>
+#include <math.h>
+
+#include <algorithm>
 
 ValueSectionSweep::ValueSectionSweep(PSFFile *psf) : m_psf(psf) {
     m_chunktype = ValueSectionSweep::type;
@@ -10,6 +13,8 @@ ValueSectionSweep::ValueSectionSweep(PSFFile *psf) : m_psf(psf) {
     windowedsweep = m_psf->get_header_properties().hasprop("PSF window size");
 
     m_valuebuf = endbuf = NULL;
+
+    m_npoints = m_psf->get_header_properties().find("PSF sweep points");
 }
 
 void ValueSectionSweep::_create_valueoffsetmap(bool windowedsweep) {    
@@ -34,6 +39,18 @@ void ValueSectionSweep::_create_valueoffsetmap(bool windowedsweep) {
       valueoffset += child_datasize;
     }
   } else {
+    // Values of the outer sweeps of nested sweeps precede the trace values
+    const SweepSection &sweeps = m_psf->get_sweep_section();
+    for(unsigned int i=1; i < sweeps.size(); i++) {
+      ref = dynamic_cast<const DataTypeRef *>(sweeps[i]);
+
+      child_datasize = ref->datasize();
+      m_offsetmap[ref->get_id()] = valueoffset + 8;
+
+      m_valuesize += 8 + child_datasize;
+      valueoffset += 8 + child_datasize;
+    }
+
     for(itrace = m_psf->get_trace_section().begin(); itrace != m_psf->get_trace_section().end(); itrace++) {
       ref = dynamic_cast<const DataTypeRef *>(*itrace);
 
@@ -45,8 +62,8 @@ void ValueSectionSweep::_create_valueoffsetmap(bool windowedsweep) {
 	// is a trace in the trace section with the same datatypeid as in the sweep.
 	// Data types of sweeps have a property called "key" which is set to "sweep" which
 	// will be used to detect this problem to get a correct offset and child_datasize
-	std::string key = datatypedef.get_properties().find("key").tostring();
-	if ("sweep" == key)
+	const PropertyBlock &typeprops = datatypedef.get_properties();
+	if (typeprops.hasprop("key") && "sweep" == typeprops.find("key").tostring())
 	  continue;
 
 	child_datasize = datatypedef.datasize();
@@ -63,24 +80,67 @@ void ValueSectionSweep::_create_valueoffsetmap(bool windowedsweep) {
 }
 
 SweepValue* ValueSectionSweep::get_values(Filter &filter) const {
-    const char *buf = m_valuebuf;
+    return get_values(filter, 0, m_npoints);
+}
+
+PSFVector* ValueSectionSweep::get_values(std::string name) const {
+    return get_values(name, 0, m_npoints);
+}
 
+PSFVector* ValueSectionSweep::get_param_values() const {
+    return get_param_values(0, m_npoints);
+}
+
+SweepValue* ValueSectionSweep::get_values(Filter &filter, int start, int n) const {
     SweepValue *value = new_value();
-    
-    int n = m_psf->get_header_properties().find("PSF sweep points");
-    
-    int windowoffset = 0;
-    value->deserialize(buf, &n, windowoffset, m_psf, filter);
+
+    try {
+	get_values(filter, start, n, value);
+    } catch (...) {
+	delete value;
+	throw;
+    }
 
     return value;
 }
 
-PSFVector* ValueSectionSweep::get_values(std::string name) const {
+int ValueSectionSweep::get_values(Filter &filter, int start, int n, SweepValue *value) const {
+    // Clip the range to the available points
+    if(start < 0)
+	start = 0;
+    if(start > m_npoints)
+	start = m_npoints;
+    if(n > m_npoints - start)
+	n = m_npoints - start;
+    if(n < 0)
+	n = 0;
+
+    PSFStats &stats = m_psf->get_stats();
+    StatsScope scope(stats, &PSFStats::decode_time);
+
+    int windowoffset = 0;
+    const char *buf = _seek_point(start, &windowoffset);
+
+    LoadScope load(m_psf, buf, _point_bytes(buf, start, n));
+
+    long nbytes = value->deserialize(buf, &n, windowoffset, m_psf, filter);
+
+    if(psf_stats) {
+	stats.decode_calls++;
+	stats.points_decoded += n;
+	stats.traces_decoded += filter.size();
+	stats.value_bytes += nbytes;
+    }
+
+    return n;
+}
+
+PSFVector* ValueSectionSweep::get_values(std::string name, int start, int n) const {
     // Create filter for retrieving the trace with correct name
     Filter filter;
     filter.push_back(&m_psf->get_trace_section().get_trace_by_name(name));
     
-    SweepValue *v = get_values(filter);
+    SweepValue *v = get_values(filter, start, n);
     
     PSFVector *result = v->at(0);
     
@@ -92,10 +152,251 @@ PSFVector* ValueSectionSweep::get_values(std::string name) const {
     return result;
 }
 
+std::vector<PSFVector *> ValueSectionSweep::get_values(const NameList &names) const {
+    Filter filter;
+    for(NameList::const_iterator i=names.begin(); i != names.end(); i++)
+	filter.push_back(&m_psf->get_trace_section().get_trace_by_name(*i));
+
+    SweepValue *v = get_values(filter, 0, m_npoints);
+
+    std::vector<PSFVector *> result(v->begin(), v->end());
+
+    // Clear vector to avoid deallocation of result
+    v->clear();
+
+    delete v;
+
+    return result;
+}
+
+Filter ValueSectionSweep::get_real_traces(const NameList &names) const {
+    Filter filter;
 
-PSFVector* ValueSectionSweep::get_param_values() const {
+    for(NameList::const_iterator i=names.begin(); i != names.end(); i++) {
+	const DataTypeRef &trace = m_psf->get_trace_section().get_trace_by_name(*i);
+
+	switch(trace.get_def().m_datatypeid) {
+	case TYPEID_INT8:
+	case TYPEID_INT32:
+	case TYPEID_DOUBLE:
+	    break;
+	default:
+	    throw NotImplemented();
+	}
+
+	filter.push_back(&trace);
+    }
+
+    return filter;
+}
+
+template<class Consumer>
+void ValueSectionSweep::reduce(Filter &filter, int start, int n, std::vector<Consumer> &consumers) const {
+    DecodePlan plan(m_psf, filter, ConsumerValue<Consumer>::target);
+
+    reduce(plan, start, n, consumers);
+}
+
+// Points reduced per load, the blocks of the previous points can be dropped
+// by the pread backend while the next points are reduced
+static const int REDUCE_BLOCKSIZE = 65536;
+
+template<class Consumer>
+void ValueSectionSweep::reduce(const DecodePlan &plan, int start, int n, std::vector<Consumer> &consumers) const {
+    // Clip the range to the available points
+    if(start < 0)
+	start = 0;
+    if(start > m_npoints)
+	start = m_npoints;
+    if(n > m_npoints - start)
+	n = m_npoints - start;
+    if(n < 0)
+	n = 0;
+
+    PSFStats &stats = m_psf->get_stats();
+    StatsScope scope(stats, &PSFStats::decode_time);
+
+    long nbytes = 0;
+    for(int i=0; i < n; i += REDUCE_BLOCKSIZE) {
+	int count = std::min(REDUCE_BLOCKSIZE, n - i);
+
+	int windowoffset = 0;
+	const char *buf = _seek_point(start + i, &windowoffset);
+
+	LoadScope load(m_psf, buf, _point_bytes(buf, start + i, count));
+
+	if(windowedsweep) {
+	    SweepValueWindowed value;
+	    nbytes += value.reduce(buf, count, windowoffset, m_psf, plan, consumers);
+	} else {
+	    SweepValueSimple value;
+	    nbytes += value.reduce(buf, count, m_psf, plan, consumers);
+	}
+    }
+
+    for(unsigned int i=0; i < consumers.size(); i++)
+	consumers[i].finish();
+
+    if(psf_stats) {
+	stats.decode_calls++;
+	stats.points_decoded += n;
+	stats.traces_decoded += plan.size();
+	stats.value_bytes += nbytes;
+    }
+}
+
+std::vector<PSFSweepReduction> ValueSectionSweep::reduce(const NameList &names, int start, int n) const {
+    Filter filter = get_real_traces(names);
+
+    std::vector<Reducer> reducers(filter.size());
+
+    reduce(filter, start, n, reducers);
+
+    std::vector<PSFSweepReduction> result(reducers.size());
+    for(unsigned int i=0; i < reducers.size(); i++)
+	reducers[i].get_result(result[i]);
+
+    return result;
+}
+
+template<class T>
+int ValueSectionSweep::get_values_into(const NameList &names, int start, int n, T *const *outs,
+				       double *x) const {
+    const DecodePlan::Target target = DecodeTarget<T>::target;
+
+    // Real traces, and complex traces when decoding complex values
+    Filter filter;
+    for(NameList::const_iterator i=names.begin(); i != names.end(); i++) {
+	const DataTypeRef &trace = m_psf->get_trace_section().get_trace_by_name(*i);
+
+	switch(trace.get_def().m_datatypeid) {
+	case TYPEID_INT8:
+	case TYPEID_INT32:
+	case TYPEID_DOUBLE:
+	    break;
+	case TYPEID_COMPLEXDOUBLE:
+	    if(target != DecodePlan::COMPLEX)
+		throw NotImplemented();
+	    break;
+	default:
+	    throw NotImplemented();
+	}
+
+	filter.push_back(&trace);
+    }
+
+    DecodePlan plan(m_psf, filter, target);
+
+    // Clip the range to the available points
+    if(start < 0)
+	start = 0;
+    if(start > m_npoints)
+	start = m_npoints;
+    if(n > m_npoints - start)
+	n = m_npoints - start;
+    if(n < 0)
+	n = 0;
+
+    PSFStats &stats = m_psf->get_stats();
+    StatsScope scope(stats, &PSFStats::decode_time);
+
+    int windowoffset = 0;
+    const char *buf = _seek_point(start, &windowoffset);
+
+    LoadScope load(m_psf, buf, _point_bytes(buf, start, n));
+
+    long nbytes;
+    if(windowedsweep) {
+	SweepValueWindowed value;
+	nbytes = value.decode_into(buf, n, windowoffset, m_psf, plan, outs, x);
+    } else {
+	SweepValueSimple value;
+	nbytes = value.decode_into(buf, n, m_psf, plan, outs, x);
+    }
+
+    if(psf_stats) {
+	stats.decode_calls++;
+	stats.points_decoded += n;
+	stats.traces_decoded += plan.size();
+	stats.value_bytes += nbytes;
+    }
+
+    return n;
+}
+
+double ValueSectionSweep::get_param_value(int point) const {
+    const DataTypeRef &paramtype = dynamic_cast<const DataTypeRef &>(*m_psf->get_sweep_section()[0]);
+
+    int windowoffset;
+    const char *buf = _seek_point(point, &windowoffset);
+
+    LoadScope load(m_psf, buf, 8 + (windowoffset + 1) * paramtype.datasize());
+
+    // Skip the chunk header and the parameter type id or window size
+    return paramtype.get_def().deserialize_double(buf + 8 + windowoffset * paramtype.datasize());
+}
+
+bool ValueSectionSweep::is_descending() const {
+    return m_npoints > 1 && get_param_value(m_npoints - 1) < get_param_value(0);
+}
+
+int ValueSectionSweep::find_point(double x, bool after) const {
+    bool descending = is_descending();
+    int lo = 0, hi = m_npoints;
+
+    while(lo < hi) {
+	int mid = lo + (hi - lo) / 2;
+	double value = get_param_value(mid);
+
+	bool before;
+	if(descending)
+	    before = after ? value >= x : value > x;
+	else
+	    before = after ? value <= x : value < x;
+
+	if(before)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+
+    return lo;
+}
+
+PSFDecimation ValueSectionSweep::decimate(const std::string &name, double lo, double hi, int nbuckets,
+					  PSFDecimationMode mode) const {
+    Filter filter = get_real_traces(NameList(1, name));
+
+    // The points in [lo, hi] are consecutive, from hi down to lo in a
+    // descending sweep
+    int start, n;
+    if(is_descending()) {
+	start = find_point(hi);
+	n = find_point(lo, true) - start;
+    } else {
+	start = find_point(lo);
+	n = find_point(hi, true) - start;
+    }
+
+    PSFDecimation result;
+
+    if(nbuckets < 1)
+	return result;
+
+    if(mode == DECIMATE_LTTB) {
+	std::vector<LTTBDecimator> decimators(1, LTTBDecimator(lo, hi, nbuckets, &result));
+	reduce(filter, start, n, decimators);
+    } else {
+	std::vector<Decimator> decimators(1, Decimator(lo, hi, nbuckets, &result));
+	reduce(filter, start, n, decimators);
+    }
+
+    return result;
+}
+
+PSFVector* ValueSectionSweep::get_param_values(int start, int n) const {
     Filter filter;
-    SweepValue *v = get_values(filter);
+    SweepValue *v = get_values(filter, start, n);
 
     PSFVector *result = v->get_param_values(true);
 
@@ -104,8 +405,100 @@ PSFVector* ValueSectionSweep::get_param_values() const {
     return result;
 }
 
+//
+// Return a pointer to the value chunk holding the given point. For windowed
+// sweeps the position of the point within its window is returned in
+// windowoffset.
+//
+const char *ValueSectionSweep::_seek_point(int point, int *windowoffset) const {
+    const DataTypeRef &paramtype = dynamic_cast<const DataTypeRef &>(*m_psf->get_sweep_section()[0]);
+
+    *windowoffset = 0;
+
+    if(!windowedsweep)
+	// Each point is a chunk header, the sweep value and the trace values
+	return m_valuebuf + (long)point * (8 + paramtype.datasize() + m_valuesize);
+
+    if(!m_windowindex.done()) {
+	PSF_STATS_ADD(cache_misses, 1);
+	m_windowindex.run(this, &ValueSectionSweep::_create_windowindex);
+    } else
+	PSF_STATS_ADD(cache_hits, 1);
+
+    if(point >= m_npoints)
+	return m_windowbufs.back();
 
-int ValueSectionSweep::deserialize(const char *buf, int abspos) {
+    int window = std::upper_bound(m_windowstarts.begin(), m_windowstarts.end(), point) - 
+	m_windowstarts.begin() - 1;
+
+    *windowoffset = point - m_windowstarts[window];
+
+    return m_windowbufs[window];
+}
+
+//
+// Number of bytes from buf, the chunk of the start point returned by
+// _seek_point, to the end of the chunk of the last point.
+//
+long ValueSectionSweep::_point_bytes(const char *buf, int start, int n) const {
+    const DataTypeRef &paramtype = dynamic_cast<const DataTypeRef &>(*m_psf->get_sweep_section()[0]);
+
+    if(n <= 0)
+	return 0;
+
+    if(!windowedsweep)
+	return (long)n * (8 + paramtype.datasize() + m_valuesize);
+
+    // End of the window holding the last point
+    int window = std::upper_bound(m_windowstarts.begin(), m_windowstarts.end(), start + n - 1) - 
+	m_windowstarts.begin() - 1;
+
+    return m_windowbufs[window + 1] - buf;
+}
+
+void ValueSectionSweep::prefetch(int start, int n) const {
+    if(start < 0)
+	start = 0;
+    if(start > m_npoints)
+	start = m_npoints;
+    if(n > m_npoints - start)
+	n = m_npoints - start;
+
+    int windowoffset;
+    const char *buf = _seek_point(start, &windowoffset);
+
+    m_psf->prefetch(buf, _point_bytes(buf, start, n));
+}
+
+void ValueSectionSweep::_create_windowindex() const {
+    const DataTypeRef &paramtype = dynamic_cast<const DataTypeRef &>(*m_psf->get_sweep_section()[0]);
+    int windowsize = m_psf->get_header_properties().find("PSF window size");
+    int ntraces    = m_psf->get_header_properties().find("PSF traces");
+
+    const char *buf = m_valuebuf;
+    int point = 0;
+
+    // Start over if a previous attempt failed to read the file
+    m_windowbufs.clear();
+    m_windowstarts.clear();
+
+    while(point < m_npoints) {
+	LoadScope load(m_psf, buf, 8);
+
+	int n = GET_INT32(buf + 4) & 0xffff;
+
+	m_windowbufs.push_back(buf);
+	m_windowstarts.push_back(point);
+
+	buf += 8 + n * paramtype.datasize() + ntraces * windowsize;
+	point += n;
+    }
+
+    // Sentinel marking the end of the windows
+    m_windowbufs.push_back(buf);
+}
+
+int ValueSectionSweep::deserialize(const char *buf, long abspos) {
     const char *startbuf = buf;
 
     buf += Chunk::deserialize(buf);
@@ -132,12 +525,13 @@ int ValueSectionSweep::get_valueoffset(int id) const {
     return m_offsetmap.find(id)->second;
 }
     
-const ValueSectionSweep::iterator ValueSectionSweep::begin(SweepValue *value, ChildList &filter) const {
-    return iterator(value, m_valuebuf, m_psf, &filter);
+const ValueSectionSweep::iterator ValueSectionSweep::begin(SweepValue *value, Filter &filter,
+							  int blocksize) const {
+    return iterator(value, this, &filter, 0, blocksize);
 }    
 
 const ValueSectionSweep::iterator ValueSectionSweep::end() const {
-    return iterator(NULL, endbuf-4, NULL, NULL);
+    return iterator(NULL, this, NULL, m_npoints, 0);
 }    
 
 SweepValue * ValueSectionSweep::new_value() const {
@@ -156,134 +550,427 @@ PSFVector * SweepValue::get_param_values(bool release) {
     return result;	
 }
 
+void SweepValue::resize_vectors(const DataTypeRef &paramtype, Filter &filter, int n) {
+    if(size() != filter.size()) {
+	for(iterator i=begin(); i != end(); i++)
+	    delete *i;
+	clear();
+
+	for(Filter::const_iterator j=filter.begin(); j != filter.end(); j++)
+	    push_back(dynamic_cast<const DataTypeRef *>(*j)->new_vector());
+    }
+
+    for(iterator i=begin(); i != end(); i++)
+	(*i)->resize(n);
+
+    if(m_paramvalues == NULL)
+	m_paramvalues = paramtype.new_vector();
+    m_paramvalues->resize(n);
+}
+
 SweepValue::~SweepValue() {
     if (m_paramvalues)
 	delete(m_paramvalues);
 
+    if (m_plan)
+	delete(m_plan);
+
     for(std::vector<PSFVector *>::const_iterator i = begin(); i != end(); i++)
 	delete(*i);
 }
 
-int SweepValueWindowed::deserialize(const char *buf, int *totaln, int windowoffset, PSFFile *psf, 
+static bool offset_less(const DecodePlan::Entry &a, const DecodePlan::Entry &b) {
+    return a.offset < b.offset;
+}
+
+static DecodeFunction select_decoder(const DataTypeDef &def, DecodePlan::Target target) {
+    switch(target) {
+    case DecodePlan::DOUBLE:
+	return def.get_double_decoder();
+    case DecodePlan::COMPLEX:
+	return def.get_complex_decoder();
+    default:
+	return def.get_decoder();
+    }
+}
+
+DecodePlan::DecodePlan(PSFFile *psf, const Filter &filter, Target target) :
+    m_psf(psf), m_filter(filter), m_target(target) {
+    const ValueSectionSweep &valuesection = psf->get_value_section_sweep();
+
+    const DataTypeRef &paramtype = dynamic_cast<const DataTypeRef &>(*psf->get_sweep_section()[0]);
+    m_param.def = &paramtype.get_def();
+    m_param.decode = select_decoder(*m_param.def, target == NATIVE ? NATIVE : DOUBLE);
+    m_param.offset = 0;
+    m_param.datasize = m_param.def->datasize();
+    m_param.column = -1;
+
+    m_entries.reserve(filter.size());
+    for(unsigned int j=0; j < filter.size(); j++) {
+	const DataTypeRef &trace = dynamic_cast<const DataTypeRef &>(*filter[j]);
+
+	Entry entry;
+	entry.def = &trace.get_def();
+	entry.decode = select_decoder(*entry.def, target);
+	entry.offset = valuesection.get_valueoffset(trace.get_id());
+	entry.datasize = entry.def->datasize();
+	entry.column = j;
+	m_entries.push_back(entry);
+    }
+
+    std::stable_sort(m_entries.begin(), m_entries.end(), offset_less);
+}
+
+const DecodePlan &SweepValue::get_plan(PSFFile *psf, Filter &filter) {
+    if(m_plan == NULL || !m_plan->matches(psf, filter, DecodePlan::NATIVE)) {
+	delete m_plan;
+	m_plan = NULL;
+	m_plan = new DecodePlan(psf, filter, DecodePlan::NATIVE);
+    }
+
+    return *m_plan;
+}
+
+// Points of a simple sweep that are decoded trace by trace while they stay
+// in the cache
+static const int SIMPLE_BLOCKSIZE = 1024;
+
+//
+// Deserialize *totaln points of a windowed sweep, skipping the first
+// windowoffset points of the first window
+//
+long SweepValueWindowed::deserialize(const char *buf, int *totaln, int windowoffset, PSFFile *psf, 
 				    Filter &filter) {
     const char *startbuf = buf;
 
     int windowsize = psf->get_header_properties().find("PSF window size");
     int ntraces    = psf->get_header_properties().find("PSF traces");
 
-    // Create parameter vector
     DataTypeRef &paramtype = *((DataTypeRef *)psf->get_sweep_section()[0]);
-    if(m_paramvalues == NULL)
-	m_paramvalues = paramtype.new_vector();
 
-    // Create data vectors
-    clear();
-    for(ChildList::const_iterator j=filter.begin(); j != filter.end(); j++) {
-	DataTypeRef *trace = (DataTypeRef *) *j;
-	PSFVector *vec = trace->new_vector();
-	vec->resize(*totaln);
-	push_back(vec);
-    }
+    const DecodePlan &plan = get_plan(psf, filter);
+    const DecodePlan::Entry &param = plan.get_param();
+
+    resize_vectors(paramtype, filter, *totaln);
 
     for(int i=0; i < *totaln; ) {
 	buf += Chunk::deserialize(buf);
     
 	int tmp = GET_INT32(buf);
-	int windowleft = tmp >> 16; 
 	int n = tmp & 0xffff;       // Number of data points in window
 
 	buf += 4;
-	windowoffset += 4;
-    
-	// Deserialize parameter values from file to parameter vector (m_paramvalues)
-	int pwinstart = m_paramvalues->size();
-	m_paramvalues->resize(m_paramvalues->size() + n);
-	for(int j=0; j < n; j++)
-	    buf += paramtype.deserialize_data(m_paramvalues->ptr_at(pwinstart + j), buf);
-
-	const char *valuebuf = buf;        // Save start of trace values pointer in buffer
-	const_iterator idatavec = begin(); // Init iterator of destination trace vectors
-	for(Filter::const_iterator j=filter.begin(); j != filter.end(); j++, idatavec++) {
-	    const DataTypeRef &typeref = dynamic_cast<const DataTypeRef &>(**j);
-
-	    // calculate buffer pointer
-	    buf = valuebuf +  psf->get_value_section_sweep().get_valueoffset((*j)->get_id()) +
-		(windowsize - n * typeref.datasize());
-	    
-	    for(int k=0; k < n; k++)
-		buf += typeref.deserialize_data((*idatavec)->ptr_at(i+k), buf);
+
+	// Number of points to copy from this window
+	int skip = windowoffset;
+	int count = std::min(n - skip, *totaln - i);
+	windowoffset = 0;
+
+	if(count > 0) {
+	    // Deserialize parameter values from file to parameter vector (m_paramvalues)
+	    param.decode(*param.def, m_paramvalues->ptr_at(i), buf + skip * param.datasize,
+			 count, param.datasize);
+
+	    // Trace values are right aligned in their window
+	    const char *valuebuf = buf + n * param.datasize;
+	    for(DecodePlan::const_iterator j=plan.begin(); j != plan.end(); j++)
+		j->decode(*j->def, at(j->column)->ptr_at(i),
+			  valuebuf + j->offset + windowsize - (n - skip) * j->datasize,
+			  count, j->datasize);
 	}
 
 	// Advance buffer pointer to end of trace values
-	buf = valuebuf + ntraces * windowsize;
-	i += n;
+	buf += n * param.datasize + ntraces * windowsize;
+	i += count;
     }
     return buf - startbuf;
 }
 
-int SweepValueSimple::deserialize(const char *buf, int *n, int windowoffset, PSFFile *psf, Filter &filter) {
-    const char *startbuf = buf;
+// Points of a simple sweep are not in windows, there is no window offset
+long SweepValueSimple::deserialize(const char *buf, int *n, int, PSFFile *psf, Filter &filter) {
     const ValueSectionSweep &valuesection = psf->get_value_section_sweep();
 
-    // Create data vectors
-    for(ChildList::const_iterator j=filter.begin(); j != filter.end(); j++) {
-	DataTypeRef *trace = (DataTypeRef *) *j;
-	PSFVector *vec = trace->new_vector();
-	vec->resize(*n);
-	push_back(vec);
+    DataTypeRef &paramtype = *((DataTypeRef *)psf->get_sweep_section()[0]);
+
+    const DecodePlan &plan = get_plan(psf, filter);
+    const DecodePlan::Entry &param = plan.get_param();
+
+    // Chunk header, parameter type id, parameter value and trace values
+    int pointsize = 8 + param.datasize + valuesection.get_valuesize();
+
+    resize_vectors(paramtype, filter, *n);
+
+    if(*n > 0) {
+	Chunk::deserialize(buf);
+	assert((int)GET_INT32(buf + 4) == paramtype.get_id());
     }
 
-    DataTypeRef &paramtype = *((DataTypeRef *)psf->get_sweep_section()[0]);
+    for(int i=0; i < *n; i += SIMPLE_BLOCKSIZE) {
+	int count = std::min(SIMPLE_BLOCKSIZE, *n - i);
+	const char *pointbuf = buf + (long)i * pointsize + 8;
+	const char *valuebuf = pointbuf + param.datasize;
 
-    if(m_paramvalues == NULL)
-	m_paramvalues = paramtype.new_vector();
+	param.decode(*param.def, m_paramvalues->ptr_at(i), pointbuf, count, pointsize);
+
+	for(DecodePlan::const_iterator j=plan.begin(); j != plan.end(); j++)
+	    j->decode(*j->def, at(j->column)->ptr_at(i), valuebuf + j->offset, count, pointsize);
+    }
+
+    return (long)*n * pointsize;
+}
+
+//
+// Reduce n points of a windowed sweep, skipping the first windowoffset
+// points of the first window
+//
+template<class Consumer>
+long SweepValueWindowed::reduce(const char *buf, int totaln, int windowoffset, PSFFile *psf,
+			       const DecodePlan &plan, std::vector<Consumer> &consumers) {
+    typedef typename ConsumerValue<Consumer>::type Value;
+
+    const char *startbuf = buf;
 
-    int paramstartidx = m_paramvalues->size();
+    int windowsize = psf->get_header_properties().find("PSF window size");
+    int ntraces    = psf->get_header_properties().find("PSF traces");
 
-    m_paramvalues->resize(paramstartidx + *n);
+    const DecodePlan::Entry &param = plan.get_param();
 
-    for(int i=0; i < *n; i++) {
-	const char *pointstartbuf = buf;
+    // Sweep and trace values of the current window
+    std::vector<double> x;
+    std::vector<Value> y;
 
+    for(int i=0; i < totaln; ) {
 	buf += Chunk::deserialize(buf);
-    
-	int paramtypeid = GET_INT32(buf);
+
+	int n = GET_INT32(buf) & 0xffff;       // Number of data points in window
 	buf += 4;
-    
-	assert(paramtypeid == paramtype.get_id());
 
-	buf += paramtype.deserialize_data(m_paramvalues->ptr_at(paramstartidx + i), buf);
+	// Number of points to reduce from this window
+	int skip = windowoffset;
+	int count = std::min(n - skip, totaln - i);
+	windowoffset = 0;
+
+	if(count > 0) {
+	    x.resize(count);
+	    y.resize(count);
+	    param.decode(*param.def, &x[0], buf + skip * param.datasize, count, param.datasize);
+
+	    const char *valuebuf = buf + n * param.datasize;
+	    for(DecodePlan::const_iterator j=plan.begin(); j != plan.end(); j++) {
+		j->decode(*j->def, &y[0], valuebuf + j->offset + windowsize - (n - skip) * j->datasize,
+			  count, j->datasize);
+
+		Consumer &consumer = consumers[j->column];
+		for(int k=0; k < count; k++)
+		    consumer.add(x[k], y[k]);
+	    }
+	}
 
-	const char *valuebuf = buf;
+	buf += n * param.datasize + ntraces * windowsize;
+	i += count;
+    }
 
-	int k=0;
-	for(Filter::const_iterator j=filter.begin(); j != filter.end(); j++, k++) {
-	    const DataTypeRef *trace = dynamic_cast<const DataTypeRef *>(*j);
+    return buf - startbuf;
+}
+
+template<class Consumer>
+long SweepValueSimple::reduce(const char *buf, int n, PSFFile *psf,
+			     const DecodePlan &plan, std::vector<Consumer> &consumers) {
+    typedef typename ConsumerValue<Consumer>::type Value;
+
+    const ValueSectionSweep &valuesection = psf->get_value_section_sweep();
+
+    const DecodePlan::Entry &param = plan.get_param();
+
+    // Chunk header, parameter type id, parameter value and trace values
+    int pointsize = 8 + param.datasize + valuesection.get_valuesize();
+
+    std::vector<double> x(std::min(n, SIMPLE_BLOCKSIZE));
+    std::vector<Value> y(x.size());
+
+    for(int i=0; i < n; i += SIMPLE_BLOCKSIZE) {
+	int count = std::min(SIMPLE_BLOCKSIZE, n - i);
+	const char *pointbuf = buf + (long)i * pointsize + 8;
+	const char *valuebuf = pointbuf + param.datasize;
+
+	param.decode(*param.def, &x[0], pointbuf, count, pointsize);
 
-	    buf = valuebuf + valuesection.get_valueoffset(trace->get_id());
+	for(DecodePlan::const_iterator j=plan.begin(); j != plan.end(); j++) {
+	    j->decode(*j->def, &y[0], valuebuf + j->offset, count, pointsize);
 
-	    trace->deserialize_data(this->at(k)->ptr_at(i), buf);
+	    Consumer &consumer = consumers[j->column];
+	    for(int k=0; k < count; k++)
+		consumer.add(x[k], y[k]);
 	}
-	buf = valuebuf + valuesection.get_valuesize();
+    }
+
+    return (long)n * pointsize;
+}
+
+//
+// Decode n points of a windowed sweep straight into the caller arrays,
+// skipping the first windowoffset points of the first window
+//
+template<class T>
+long SweepValueWindowed::decode_into(const char *buf, int totaln, int windowoffset, PSFFile *psf,
+				    const DecodePlan &plan, T *const *outs, double *x) {
+    const char *startbuf = buf;
+
+    int windowsize = psf->get_header_properties().find("PSF window size");
+    int ntraces    = psf->get_header_properties().find("PSF traces");
+
+    const DecodePlan::Entry &param = plan.get_param();
+
+    for(int i=0; i < totaln; ) {
+	buf += Chunk::deserialize(buf);
+
+	int n = GET_INT32(buf) & 0xffff;       // Number of data points in window
+	buf += 4;
+
+	// Number of points to decode from this window
+	int skip = windowoffset;
+	int count = std::min(n - skip, totaln - i);
+	windowoffset = 0;
+
+	if(count > 0) {
+	    if(x)
+		param.decode(*param.def, x + i, buf + skip * param.datasize, count, param.datasize);
+
+	    const char *valuebuf = buf + n * param.datasize;
+	    for(DecodePlan::const_iterator j=plan.begin(); j != plan.end(); j++)
+		j->decode(*j->def, outs[j->column] + i,
+			  valuebuf + j->offset + windowsize - (n - skip) * j->datasize,
+			  count, j->datasize);
+	}
+
+	buf += n * param.datasize + ntraces * windowsize;
+	i += count;
     }
 
     return buf - startbuf;
 }
 
+template<class T>
+long SweepValueSimple::decode_into(const char *buf, int n, PSFFile *psf,
+				  const DecodePlan &plan, T *const *outs, double *x) {
+    const ValueSectionSweep &valuesection = psf->get_value_section_sweep();
+
+    const DecodePlan::Entry &param = plan.get_param();
+
+    // Chunk header, parameter type id, parameter value and trace values
+    int pointsize = 8 + param.datasize + valuesection.get_valuesize();
+
+    // Blocks keep the points being decoded in the cache for all traces
+    for(int i=0; i < n; i += SIMPLE_BLOCKSIZE) {
+	int count = std::min(SIMPLE_BLOCKSIZE, n - i);
+	const char *pointbuf = buf + (long)i * pointsize + 8;
+	const char *valuebuf = pointbuf + param.datasize;
+
+	if(x)
+	    param.decode(*param.def, x + i, pointbuf, count, pointsize);
+
+	for(DecodePlan::const_iterator j=plan.begin(); j != plan.end(); j++)
+	    j->decode(*j->def, outs[j->column] + i, valuebuf + j->offset, count, pointsize);
+    }
+
+    return (long)n * pointsize;
+}
+
+void Reducer::get_result(PSFSweepReduction &result) const {
+    result.npoints = m_n;
+
+    if(m_n == 0) {
+	result.xstart = result.xend = NAN;
+	result.min = result.max = result.min_x = result.max_x = NAN;
+	result.average = result.rms = NAN;
+	result.integral = 0;
+	return;
+    }
+
+    result.xstart = m_xstart;
+    result.xend = m_x;
+    result.min = m_min;
+    result.max = m_max;
+    result.min_x = m_minx;
+    result.max_x = m_maxx;
+    result.integral = m_integral;
+
+    double span = m_x - m_xstart;
+
+    if(span != 0) {
+	result.average = m_integral / span;
+	result.rms = sqrt(m_integral2 / span);
+    } else {
+	// Single point
+	result.average = m_y;
+	result.rms = fabs(m_y);
+    }
+}
+
+void LTTBDecimator::average(const Points &points, double &x, double &y) {
+    x = y = 0;
+    for(Points::const_iterator i=points.begin(); i != points.end(); i++) {
+	x += i->first;
+	y += i->second;
+    }
+    x /= points.size();
+    y /= points.size();
+}
+
+void LTTBDecimator::select(const Points &points, double cx, double cy) {
+    if(points.empty())
+	return;
+
+    Points::const_iterator selected = points.begin();
+    double maxarea = -1;
+
+    for(Points::const_iterator i=points.begin(); i != points.end(); i++) {
+	double area = fabs((m_ax - cx) * (i->second - m_ay) - (m_ax - i->first) * (cy - m_ay));
+	if(area > maxarea) {
+	    maxarea = area;
+	    selected = i;
+	}
+    }
+
+    select_point(selected->first, selected->second);
+}
+
+void LTTBDecimator::finish() {
+    if(m_current.empty())
+	return;
+
+    std::pair<double, double> last = m_current.back();
+    m_current.pop_back();
+
+    if(m_current.empty())
+	select(m_pending, last.first, last.second);
+    else {
+	double cx, cy;
+	average(m_current, cx, cy);
+	select(m_pending, cx, cy);
+	select(m_current, last.first, last.second);
+    }
+
+    select_point(last.first, last.second);
+}
 
 template<class T>
 int SweepValueIterator<T>::deserialize() {
-    if((m_buf == NULL) || (m_psf == NULL) || (m_filter == NULL))
+    if((m_v == NULL) || (m_values == NULL) || (m_filter == NULL) ||
+       (m_point >= m_values->get_npoints()))
 	return 0;
-    
-    int chunkid = GET_INT32(m_buf);
 
-    int n = 1;
-    int windowoffset = 0;
-
-    if(chunkid != CHUNKID_VALUESECTIONEND)
-	return m_v->deserialize(m_buf, &n, windowoffset, m_psf, *m_filter);
-    else
-	return 0;
+    return m_values->get_values(*m_filter, m_point, m_blocksize, m_v);
 }
 
+template class SweepValueIterator<SweepValue>;
+
+// Used by PSFPyramid, resample(), get_complex() and evaluate()
+template void ValueSectionSweep::reduce(Filter &, int, int, std::vector<PyramidBuilder> &) const;
+template void ValueSectionSweep::reduce(Filter &, int, int, std::vector<Collector> &) const;
+template void ValueSectionSweep::reduce(Filter &, int, int, std::vector<ComplexCollector> &) const;
+template void ValueSectionSweep::reduce(const DecodePlan &, int, int, std::vector<Collector> &) const;
+template void ValueSectionSweep::reduce(const DecodePlan &, int, int, std::vector<ComplexCollector> &) const;
+template int ValueSectionSweep::get_values_into(const NameList &, int, int, double *const *, double *) const;
+template int ValueSectionSweep::get_values_into(const NameList &, int, int, PSFComplexDouble *const *,
+						double *) const;
@@ -0,0 +1,370 @@
+#include "psf.h"
+#include "psfdata.h"
+#include "psfinternal.h"
+#include "psfthread.h"
+#include "psftext.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#ifdef HAVE_TO_CHARS_DOUBLE
+#include <charconv>
+#endif
+
+// Size of the output buffer that is collected before writing to the file
+static const std::size_t WRITEBUFFER_SIZE = 1 << 20;
+
+// Approximate size of the decoded values of a block
+static const std::size_t BLOCK_BYTES = 8 << 20;
+static const int MAX_BLOCK_POINTS = 1 << 16;
+
+char *PSFTextExport::format_double(double value, char *buf) {
+#ifdef HAVE_TO_CHARS_DOUBLE
+    return std::to_chars(buf, buf + MAX_DOUBLE_LENGTH, value).ptr;
+#else
+    // Fewest of 15, 16 and 17 significant digits that read back as the value
+    for(int precision=15; ; precision++) {
+	int len = snprintf(buf, MAX_DOUBLE_LENGTH, "%.*g", precision, value);
+	if(precision == 17 || strtod(buf, NULL) == value)
+	    return buf + len;
+    }
+#endif
+}
+
+//
+// Decoding of a group of real signals, or of one complex signal, of a block
+// of sweep points
+//
+class PSFTextExport::DecodeTask: public WorkerPool::Task {
+public:
+    DecodeTask(const PSFDataSet &ds, const std::vector<std::string> &names,
+	       const std::vector<double *> &outs, PSFComplexDouble *complexout,
+	       int start, int n, bool *failed) :
+	m_ds(ds), m_names(names), m_outs(outs), m_complexout(complexout),
+	m_start(start), m_n(n), m_failed(failed) {}
+
+    void run() {
+	try {
+	    if(m_complexout)
+		m_ds.get_signal_into(m_names[0], m_complexout, m_n, m_start, m_n);
+	    else
+		m_ds.get_signals_into(m_names, &m_outs[0], m_n, m_start, m_n);
+	} catch (...) {
+	    __atomic_store_n(m_failed, true, __ATOMIC_RELAXED);
+	}
+    }
+
+private:
+    const PSFDataSet &m_ds;
+    std::vector<std::string> m_names;
+    std::vector<double *> m_outs;
+    PSFComplexDouble *m_complexout;
+    int m_start, m_n;
+    bool *m_failed;
+};
+
+//
+// Formatting of the rows [first, last) of the columns of a block into a
+// text buffer of its own
+//
+class PSFTextExport::FormatTask: public WorkerPool::Task {
+public:
+    FormatTask(const std::vector<const double *> &columns, int first, int last,
+	       char separator, std::string &text) :
+	m_columns(columns), m_first(first), m_last(last), m_separator(separator), m_text(text) {}
+
+    void run() {
+	int ncolumns = m_columns.size();
+
+	m_text.resize((size_t)(m_last - m_first) * (ncolumns * (MAX_DOUBLE_LENGTH + 1)));
+	char *start = &m_text[0], *p = start;
+
+	for(int i=m_first; i < m_last; i++) {
+	    for(int j=0; j < ncolumns; j++) {
+		if(j > 0)
+		    *p++ = m_separator;
+		p = format_double(m_columns[j][i], p);
+	    }
+	    *p++ = '\n';
+	}
+
+	m_text.resize(p - start);
+    }
+
+private:
+    const std::vector<const double *> &m_columns;
+    int m_first, m_last;
+    char m_separator;
+    std::string &m_text;
+};
+
+PSFTextExport::PSFTextExport(const PSFDataSet &ds) :
+    m_ds(ds), m_start(0), m_n(INT_MAX), m_separator(','), m_header(true),
+    m_blocksize(0), m_nthreads(0), m_fd(-1), m_bytes(0) {
+}
+
+void PSFTextExport::set_block_size(int npoints) {
+    m_blocksize = std::max(npoints, 0);
+}
+
+// Real and complex signals of a swept data set. Other signals are skipped
+// when all signals are exported, as are the traces of the sweep parameter
+// in waveform families which have no values.
+std::vector<PSFTextExport::Column> PSFTextExport::get_columns() const {
+    std::vector<std::string> names = m_signals;
+    if(names.empty())
+	names = m_ds.get_signal_names();
+
+    std::vector<Column> columns;
+    for(std::vector<std::string>::const_iterator i=names.begin(); i != names.end(); i++) {
+	const DataTypeRef &trace = m_ds.m_psf->get_trace_section().get_trace_by_name(*i);
+	const PropertyBlock &typeprops = trace.get_datatype().get_properties();
+
+	if(m_signals.empty() && typeprops.hasprop("key") && typeprops.find("key").tostring() == "sweep")
+	    continue;
+
+	Column column;
+	column.name = *i;
+
+	switch(trace.get_datatype().m_datatypeid) {
+	case TYPEID_INT8:
+	case TYPEID_INT32:
+	case TYPEID_DOUBLE:
+	    column.complex = false;
+	    break;
+	case TYPEID_COMPLEXDOUBLE:
+	    column.complex = true;
+	    break;
+	default:
+	    if(m_signals.empty())
+		continue;
+	    throw NotImplemented();
+	}
+
+	columns.push_back(column);
+    }
+
+    return columns;
+}
+
+void PSFTextExport::write(const std::string &filename) {
+    if(filename == "-") {
+	write(STDOUT_FILENO);
+	return;
+    }
+
+    int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if(fd == -1)
+	throw FileOpenError();
+
+    try {
+	write(fd);
+    } catch (...) {
+	::close(fd);
+	throw;
+    }
+
+    if(::close(fd) == -1)
+	throw FileCloseError();
+}
+
+void PSFTextExport::write(int fd) {
+    m_fd = fd;
+    m_outbuf.clear();
+    m_bytes = 0;
+
+    if(m_ds.is_swept())
+	write_swept();
+    else
+	write_nonswept();
+
+    flush();
+}
+
+void PSFTextExport::write_header(const std::vector<std::string> &names) {
+    if(!m_header)
+	return;
+
+    std::string line;
+    for(unsigned int j=0; j < names.size(); j++) {
+	if(j > 0)
+	    line += m_separator;
+	line += names[j];
+    }
+    line += '\n';
+
+    output(line.data(), line.size());
+}
+
+void PSFTextExport::write_swept() {
+    std::vector<Column> columns = get_columns();
+
+    std::vector<std::string> header(1, m_ds.get_sweep_param_names()[0]);
+    std::vector<std::string> realnames, complexnames;
+    for(std::vector<Column>::const_iterator i=columns.begin(); i != columns.end(); i++) {
+	if(i->complex) {
+	    header.push_back(i->name + ".re");
+	    header.push_back(i->name + ".im");
+	    complexnames.push_back(i->name);
+	} else {
+	    header.push_back(i->name);
+	    realnames.push_back(i->name);
+	}
+    }
+
+    write_header(header);
+
+    int npoints = m_ds.get_sweep_npoints();
+    int start = std::max(std::min(m_start, npoints), 0);
+    int n = std::max(std::min(m_n, npoints - start), 0);
+
+    int blocksize = m_blocksize;
+    if(blocksize == 0)
+	blocksize = std::max(1, std::min(MAX_BLOCK_POINTS,
+					 (int)(BLOCK_BYTES / (header.size() * sizeof(double)))));
+    blocksize = std::min(blocksize, std::max(n, 1));
+
+    // Columns of a block in the order of the header, complex values are
+    // decoded and then split into their parts
+    std::vector<std::vector<double> > values(header.size(), std::vector<double>(blocksize));
+    std::vector<std::vector<PSFComplexDouble> > complexes(complexnames.size(),
+							   std::vector<PSFComplexDouble>(blocksize));
+    std::vector<const double *> outcolumns;
+    std::vector<double *> realouts;
+    std::vector<int> complexcolumns;
+
+    for(unsigned int j=0; j < header.size(); j++)
+	outcolumns.push_back(&values[j][0]);
+
+    unsigned int j = 1;
+    for(std::vector<Column>::const_iterator i=columns.begin(); i != columns.end(); i++) {
+	if(i->complex) {
+	    complexcolumns.push_back(j);
+	    j += 2;
+	} else
+	    realouts.push_back(&values[j++][0]);
+    }
+
+    WorkerPool pool(m_nthreads);
+    int nthreads = pool.get_nthreads();
+    int ngroups = std::min(nthreads, (int)realnames.size());
+    std::vector<std::string> texts(nthreads);
+
+    for(int block=start; block < start + n; block += blocksize) {
+	int m = std::min(blocksize, start + n - block);
+	bool failed = false;
+
+	m_ds.get_sweep_values_into(&values[0][0], m, block, m);
+
+	// Real signals in one pass per group, complex signals one by one
+	for(int g=0; g < ngroups; g++) {
+	    std::vector<std::string> groupnames;
+	    std::vector<double *> outs;
+	    for(unsigned int k=g; k < realnames.size(); k += ngroups) {
+		groupnames.push_back(realnames[k]);
+		outs.push_back(realouts[k]);
+	    }
+	    pool.submit(new DecodeTask(m_ds, groupnames, outs, NULL, block, m, &failed));
+	}
+
+	for(unsigned int k=0; k < complexnames.size(); k++)
+	    pool.submit(new DecodeTask(m_ds, std::vector<std::string>(1, complexnames[k]),
+				       std::vector<double *>(), &complexes[k][0], block, m, &failed));
+
+	pool.wait();
+
+	if(failed)
+	    throw FileReadError();
+
+	for(unsigned int k=0; k < complexnames.size(); k++)
+	    for(int i=0; i < m; i++) {
+		values[complexcolumns[k]][i] = complexes[k][i].real();
+		values[complexcolumns[k] + 1][i] = complexes[k][i].imag();
+	    }
+
+	// Consecutive ranges of rows are formatted in parallel and written in order
+	int rows = (m + nthreads - 1) / nthreads;
+	for(int t=0; t < nthreads; t++)
+	    pool.submit(new FormatTask(outcolumns, std::min(t * rows, m), std::min((t + 1) * rows, m),
+				       m_separator, texts[t]));
+	pool.wait();
+
+	for(int t=0; t < nthreads; t++)
+	    output(texts[t].data(), texts[t].size());
+    }
+}
+
+// Non swept signals as a single row, other than real and complex signals
+// are skipped when all signals are exported
+void PSFTextExport::write_nonswept() {
+    std::vector<std::string> names = m_signals;
+    if(names.empty())
+	names = m_ds.get_signal_names();
+
+    std::vector<std::string> header;
+    std::vector<double> values;
+
+    for(std::vector<std::string>::const_iterator i=names.begin(); i != names.end(); i++) {
+	const PSFScalar &scalar = m_ds.get_signal_scalar(*i);
+
+	if(const PSFComplexDoubleScalar *z = dynamic_cast<const PSFComplexDoubleScalar *>(&scalar)) {
+	    header.push_back(*i + ".re");
+	    header.push_back(*i + ".im");
+	    values.push_back(z->value.real());
+	    values.push_back(z->value.imag());
+	} else if(dynamic_cast<const PSFDoubleScalar *>(&scalar) ||
+		  dynamic_cast<const PSFInt32Scalar *>(&scalar) ||
+		  dynamic_cast<const PSFInt8Scalar *>(&scalar)) {
+	    header.push_back(*i);
+	    values.push_back((double)scalar);
+	} else if(!m_signals.empty())
+	    throw NotImplemented();
+    }
+
+    write_header(header);
+
+    std::string line;
+    char buf[MAX_DOUBLE_LENGTH];
+    for(unsigned int j=0; j < values.size(); j++) {
+	if(j > 0)
+	    line += m_separator;
+	line.append(buf, format_double(values[j], buf) - buf);
+    }
+    line += '\n';
+
+    output(line.data(), line.size());
+}
+
+static void write_all(int fd, const char *p, std::size_t left) {
+    while(left > 0) {
+	ssize_t n = ::write(fd, p, left);
+	if(n < 0)
+	    throw FileWriteError();
+	p += n;
+	left -= n;
+    }
+}
+
+// Text of whole blocks is written without copying it to the buffer
+void PSFTextExport::output(const char *buf, std::size_t size) {
+    m_bytes += size;
+
+    if(m_outbuf.size() + size > WRITEBUFFER_SIZE)
+	flush();
+
+    if(size >= WRITEBUFFER_SIZE)
+	write_all(m_fd, buf, size);
+    else
+	m_outbuf.append(buf, size);
+}
+
+void PSFTextExport::flush() {
+    write_all(m_fd, m_outbuf.data(), m_outbuf.size());
+    m_outbuf.clear();
+}
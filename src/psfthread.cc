@@ -0,0 +1,88 @@
+#include "psfthread.h"
+
+#include <unistd.h>
+
+WorkerPool::WorkerPool(int nthreads) : m_nthreads(nthreads), m_running(0), m_stop(false) {
+    if(m_nthreads < 1)
+	m_nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if(m_nthreads < 1)
+	m_nthreads = 1;
+}
+
+WorkerPool::~WorkerPool() {
+    {
+	ScopedLock lock(m_mutex);
+	m_stop = true;
+	m_wakeup.broadcast();
+    }
+
+    for(std::vector<pthread_t>::const_iterator i=m_threads.begin(); i != m_threads.end(); i++)
+	pthread_join(*i, NULL);
+
+    // Tasks that never ran
+    for(std::deque<Task *>::const_iterator i=m_queue.begin(); i != m_queue.end(); i++)
+	delete *i;
+}
+
+void WorkerPool::start() {
+    for(int i=0; i < m_nthreads; i++) {
+	pthread_t thread;
+	if(pthread_create(&thread, NULL, worker, this) == 0)
+	    m_threads.push_back(thread);
+    }
+}
+
+void WorkerPool::submit(Task *task) {
+    ScopedLock lock(m_mutex);
+
+    if(m_threads.empty())
+	start();
+
+    // Run the task in the calling thread if no thread could be started
+    if(m_threads.empty()) {
+	m_mutex.unlock();
+	task->run();
+	delete task;
+	m_mutex.lock();
+	return;
+    }
+
+    m_queue.push_back(task);
+    m_wakeup.signal();
+}
+
+void WorkerPool::wait() {
+    ScopedLock lock(m_mutex);
+
+    while(!m_queue.empty() || m_running > 0)
+	m_idle.wait(m_mutex);
+}
+
+void *WorkerPool::worker(void *arg) {
+    WorkerPool *pool = (WorkerPool *)arg;
+
+    pool->m_mutex.lock();
+    while(true) {
+	while(pool->m_queue.empty() && !pool->m_stop)
+	    pool->m_wakeup.wait(pool->m_mutex);
+
+	if(pool->m_stop)
+	    break;
+
+	Task *task = pool->m_queue.front();
+	pool->m_queue.pop_front();
+	pool->m_running++;
+	pool->m_mutex.unlock();
+
+	task->run();
+	delete task;
+
+	pool->m_mutex.lock();
+	pool->m_running--;
+	if(pool->m_queue.empty() && pool->m_running == 0)
+	    pool->m_idle.broadcast();
+    }
+    pool->m_mutex.unlock();
+
+    return NULL;
+}
@@ -0,0 +1,126 @@
+#ifndef _PSF_THREAD
+#define _PSF_THREAD
+
+#include <pthread.h>
+
+#include <deque>
+#include <vector>
+
+//
+// Thin wrappers of the pthread primitives used by the library
+//
+class Mutex {
+ public:
+    Mutex() { pthread_mutex_init(&m_mutex, NULL); }
+    ~Mutex() { pthread_mutex_destroy(&m_mutex); }
+
+    void lock() { pthread_mutex_lock(&m_mutex); }
+    void unlock() { pthread_mutex_unlock(&m_mutex); }
+
+ private:
+    friend class Condition;
+
+    Mutex(const Mutex &);
+    Mutex &operator=(const Mutex &);
+
+    pthread_mutex_t m_mutex;
+};
+
+class ScopedLock {
+ public:
+    ScopedLock(Mutex &mutex) : m_mutex(mutex) { m_mutex.lock(); }
+    ~ScopedLock() { m_mutex.unlock(); }
+
+ private:
+    ScopedLock(const ScopedLock &);
+    ScopedLock &operator=(const ScopedLock &);
+
+    Mutex &m_mutex;
+};
+
+class Condition {
+ public:
+    Condition() { pthread_cond_init(&m_cond, NULL); }
+    ~Condition() { pthread_cond_destroy(&m_cond); }
+
+    void wait(Mutex &mutex) { pthread_cond_wait(&m_cond, &mutex.m_mutex); }
+    void signal() { pthread_cond_signal(&m_cond); }
+    void broadcast() { pthread_cond_broadcast(&m_cond); }
+
+ private:
+    Condition(const Condition &);
+    Condition &operator=(const Condition &);
+
+    pthread_cond_t m_cond;
+};
+
+//
+// Lazy initialization of an object that is shared by threads. The first
+// call runs the initialization while the others wait for it, later calls
+// only check a flag. If the initialization throws it is run again by the
+// next call.
+//
+class Once {
+ public:
+    Once() : m_done(false) {}
+
+    template<class T>
+    void run(const T *object, void (T::*init)() const) {
+	if(__atomic_load_n(&m_done, __ATOMIC_ACQUIRE))
+	    return;
+
+	ScopedLock lock(m_mutex);
+
+	if(!m_done) {
+	    (object->*init)();
+	    __atomic_store_n(&m_done, true, __ATOMIC_RELEASE);
+	}
+    }
+
+    bool done() const { return __atomic_load_n(&m_done, __ATOMIC_ACQUIRE); }
+
+ private:
+    Once(const Once &);
+    Once &operator=(const Once &);
+
+    bool m_done;
+    Mutex m_mutex;
+};
+
+//
+// Fixed size pool of worker threads running queued tasks. The threads are
+// started when the first task is submitted.
+//
+class WorkerPool {
+ public:
+    class Task {
+    public:
+	virtual ~Task() {}
+	virtual void run() = 0;
+    };
+
+    WorkerPool(int nthreads=0);
+    ~WorkerPool();
+
+    // Queue a task, the pool deletes it after it has run
+    void submit(Task *task);
+
+    // Wait until all queued tasks have run
+    void wait();
+
+    int get_nthreads() const { return m_nthreads; }
+
+ private:
+    static void *worker(void *pool);
+    void start();
+
+    int m_nthreads;
+    std::vector<pthread_t> m_threads;
+    std::deque<Task *> m_queue;
+    int m_running;
+    bool m_stop;
+    Mutex m_mutex;
+    Condition m_wakeup, m_idle;
+};
+
+#endif
@@ -0,0 +1,185 @@
+#include "psf.h"
+#include "psfdata.h"
+#include "psfinternal.h"
+
+#include <stdint.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+
+// Cache budget of the trace values and the output of a block of points and
+// traces, and the number of traces of each task
+static const long TRANSPOSE_BLOCKBYTES = 256 << 10;
+static const int TRANSPOSE_TRACES = 64;
+
+// Back a large fresh array with huge pages where available, which saves
+// most of the page faults and TLB misses of filling it
+static void advise_hugepages(const void *data, size_t size) {
+#ifdef MADV_HUGEPAGE
+    const uintptr_t HUGEPAGE = 2 << 20;
+
+    uintptr_t begin = ((uintptr_t)data + HUGEPAGE - 1) & ~(HUGEPAGE - 1);
+    uintptr_t end = ((uintptr_t)data + size) & ~(HUGEPAGE - 1);
+
+    if(end > begin)
+	madvise((void *)begin, end - begin, MADV_HUGEPAGE);
+#endif
+}
+
+//
+// Points of a window of a windowed sweep, or a block of points of a simple
+// sweep, with buf at the trace values of the first point
+//
+struct TransposeSegment {
+    const char *buf;
+    int start, n;
+};
+
+typedef std::vector<TransposeSegment> TransposeSegments;
+
+//
+// Decode the traces [first, last) of the plan for all segments into their
+// columns
+//
+class TransposeTask: public WorkerPool::Task {
+public:
+    TransposeTask(const TransposeSegments &segments, const DecodePlan &plan, int first, int last,
+		  int windowsize, int pointsize, double *values, int npoints) :
+	m_segments(segments), m_plan(plan), m_first(first), m_last(last),
+	m_windowsize(windowsize), m_pointsize(pointsize), m_values(values), m_npoints(npoints) {}
+
+    void run() {
+	for(TransposeSegments::const_iterator s=m_segments.begin(); s != m_segments.end(); s++)
+	    for(int j=m_first; j < m_last; j++) {
+		const DecodePlan::Entry &entry = m_plan[j];
+		double *dest = m_values + (size_t)entry.column * m_npoints + s->start;
+
+		if(m_windowsize)
+		    // Trace values are right aligned in their window
+		    entry.decode(*entry.def, dest,
+				 s->buf + entry.offset + m_windowsize - s->n * entry.datasize,
+				 s->n, entry.datasize);
+		else
+		    entry.decode(*entry.def, dest, s->buf + entry.offset, s->n, m_pointsize);
+	    }
+    }
+
+private:
+    const TransposeSegments &m_segments;
+    const DecodePlan &m_plan;
+    int m_first, m_last;
+    int m_windowsize, m_pointsize;
+    double *m_values;
+    int m_npoints;
+};
+
+PSFSignalMatrix ValueSectionSweep::transpose(const NameList &names, int nthreads) const {
+    PSFSignalMatrix result;
+
+    // All traces with real values
+    if(names.empty()) {
+	NameList all = m_psf->get_trace_section().get_names();
+
+	for(NameList::const_iterator i=all.begin(); i != all.end(); i++)
+	    switch(m_psf->get_trace_section().get_trace_by_name(*i).get_def().m_datatypeid) {
+	    case TYPEID_INT8:
+	    case TYPEID_INT32:
+	    case TYPEID_DOUBLE:
+		result.names.push_back(*i);
+	    }
+    } else
+	result.names = names;
+
+    Filter filter = get_real_traces(result.names);
+    DecodePlan plan(m_psf, filter, DecodePlan::DOUBLE);
+    const DecodePlan::Entry &param = plan.get_param();
+
+    int n = m_npoints;
+    result.npoints = n;
+    result.x.resize(n);
+    size_t size = (size_t)n * filter.size();
+    result.values.reserve(size);
+    if(size > 0)
+	advise_hugepages(result.values.data(), size * sizeof(double));
+    result.values.resize(size);
+
+    if(n == 0)
+	return result;
+
+    PSFStats &stats = m_psf->get_stats();
+    StatsScope scope(stats, &PSFStats::decode_time);
+
+    int windowoffset;
+    const char *buf = _seek_point(0, &windowoffset);
+    long nbytes = _point_bytes(buf, 0, n);
+
+    LoadScope load(m_psf, buf, nbytes);
+
+    int windowsize = 0, pointsize = 0;
+    TransposeSegments segments;
+
+    if(windowedsweep) {
+	windowsize = m_psf->get_header_properties().find("PSF window size");
+
+	for(unsigned int i=0; i + 1 < m_windowbufs.size(); i++) {
+	    TransposeSegment segment;
+	    segment.start = m_windowstarts[i];
+	    segment.n = (i + 2 < m_windowbufs.size() ? m_windowstarts[i + 1] : n) - segment.start;
+	    segment.buf = m_windowbufs[i] + 8 + segment.n * param.datasize;
+	    segments.push_back(segment);
+
+	    param.decode(*param.def, &result.x[segment.start], m_windowbufs[i] + 8,
+			 segment.n, param.datasize);
+	}
+    } else {
+	// Chunk header, parameter type id, parameter value and trace values
+	pointsize = 8 + param.datasize + m_valuesize;
+
+	// Blocks of points where the values of the traces of a task and their
+	// output fit the cache
+	long span = 0;
+	for(int j=0; j < plan.size(); j += TRANSPOSE_TRACES) {
+	    const DecodePlan::Entry &first = plan[j];
+	    const DecodePlan::Entry &last = plan[std::min(j + TRANSPOSE_TRACES, plan.size()) - 1];
+
+	    span = std::max(span, (long)(last.offset + last.datasize - first.offset));
+	}
+	int blocksize = std::max(16L, TRANSPOSE_BLOCKBYTES / (span + TRANSPOSE_TRACES * (long)sizeof(double)));
+
+	for(int i=0; i < n; i += blocksize) {
+	    TransposeSegment segment;
+	    segment.start = i;
+	    segment.n = std::min(blocksize, n - i);
+	    segment.buf = buf + (long)i * pointsize + 8 + param.datasize;
+	    segments.push_back(segment);
+	}
+
+	param.decode(*param.def, &result.x[0], buf + 8, n, pointsize);
+    }
+
+    // One task per block of traces
+    std::vector<TransposeTask *> tasks;
+    for(int j=0; j < plan.size(); j += TRANSPOSE_TRACES)
+	tasks.push_back(new TransposeTask(segments, plan, j, std::min(j + TRANSPOSE_TRACES, plan.size()),
+					  windowsize, pointsize, &result.values[0], n));
+
+    if(tasks.size() > 1 && nthreads != 1) {
+	WorkerPool pool(nthreads);
+	for(unsigned int i=0; i < tasks.size(); i++)
+	    pool.submit(tasks[i]);
+	pool.wait();
+    } else
+	for(unsigned int i=0; i < tasks.size(); i++) {
+	    tasks[i]->run();
+	    delete tasks[i];
+	}
+
+    if(psf_stats) {
+	stats.decode_calls++;
+	stats.points_decoded += n;
+	stats.traces_decoded += plan.size();
+	stats.value_bytes += nbytes;
+    }
+
+    return result;
+}
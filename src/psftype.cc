@@ -75,7 +75,133 @@ int DataTypeDef::deserialize_data(void *data, const char *buf) const {
     }
 }
 
+double DataTypeDef::deserialize_double(const char *buf) const {
+    switch(m_datatypeid) {
+    case TYPEID_INT8:
+	return *((int8_t *)buf+3);
+    case TYPEID_INT32:
+	return (int32_t)GET_INT32(buf);
+    case TYPEID_DOUBLE:
+	double value;
+	GET_DOUBLE(value, buf);
+	return value;
+    default:
+	throw NotImplemented();
+    }
+}
+
+PSFComplexDouble DataTypeDef::deserialize_complex(const char *buf) const {
+    if(m_datatypeid == TYPEID_COMPLEXDOUBLE) {
+	double re, im;
+	GET_DOUBLE(re, buf); GET_DOUBLE(im, buf + 8);
+	return PSFComplexDouble(re, im);
+    } else
+	return deserialize_double(buf);
+}
+
+//
+// Decoders
+//
+
+// Values as stored in the file
+struct Int8Value {
+    static PSFInt8 get(const char *buf) { return *((int8_t *)buf+3); }
+};
+
+struct Int32Value {
+    static PSFInt32 get(const char *buf) { return GET_INT32(buf); }
+};
+
+struct DoubleValue {
+    static PSFDouble get(const char *buf) {
+	PSFDouble value;
+	GET_DOUBLE(value, buf);
+	return value;
+    }
+};
+
+struct ComplexDoubleValue {
+    static PSFComplexDouble get(const char *buf) {
+	double re, im;
+	GET_DOUBLE(re, buf); GET_DOUBLE(im, buf + 8);
+	return PSFComplexDouble(re, im);
+    }
+};
+
+// Decode file values of type Value to elements of type T
+template<class Value, class T>
+static void decode(const DataTypeDef &, void *dest, const char *buf, int n, int stride) {
+    T *out = (T *)dest;
+
+    for(int i=0; i < n; i++, buf += stride)
+	out[i] = Value::get(buf);
+}
+
+// Decode structs with the item layout of their definition, the item values
+// of a previous decode are reused
+static void decode_struct(const DataTypeDef &def, void *dest, const char *buf, int n, int stride) {
+    const std::vector<StructDef::Item> &items = def.m_structdef->get_items();
+    Struct *out = (Struct *)dest;
+
+    for(int i=0; i < n; i++, buf += stride)
+	for(std::vector<StructDef::Item>::const_iterator item=items.begin(); item != items.end(); item++) {
+	    PSFScalar *&value = out[i][item->name];
+
+	    if(value == NULL)
+		value = item->def->new_scalar();
+
+	    item->decode(*item->def, value->ptr(), buf + item->offset, 1, 0);
+	}
+}
+
+DecodeFunction DataTypeDef::get_decoder() const {
+    switch(m_datatypeid) {
+    case TYPEID_INT8:
+	return decode<Int8Value, PSFInt8>;
+    case TYPEID_INT32:
+	return decode<Int32Value, PSFInt32>;
+    case TYPEID_DOUBLE:
+	return decode<DoubleValue, PSFDouble>;
+    case TYPEID_COMPLEXDOUBLE:
+	return decode<ComplexDoubleValue, PSFComplexDouble>;
+    case TYPEID_STRUCT:
+	return decode_struct;
+    default:
+	throw UnknownType(m_datatypeid);
+    }
+}
+
+DecodeFunction DataTypeDef::get_double_decoder() const {
+    switch(m_datatypeid) {
+    case TYPEID_INT8:
+	return decode<Int8Value, double>;
+    case TYPEID_INT32:
+	return decode<Int32Value, double>;
+    case TYPEID_DOUBLE:
+	return decode<DoubleValue, double>;
+    default:
+	throw NotImplemented();
+    }
+}
+
+DecodeFunction DataTypeDef::get_complex_decoder() const {
+    switch(m_datatypeid) {
+    case TYPEID_INT8:
+	return decode<Int8Value, PSFComplexDouble>;
+    case TYPEID_INT32:
+	return decode<Int32Value, PSFComplexDouble>;
+    case TYPEID_DOUBLE:
+	return decode<DoubleValue, PSFComplexDouble>;
+    case TYPEID_COMPLEXDOUBLE:
+	return decode<ComplexDoubleValue, PSFComplexDouble>;
+    default:
+	throw NotImplemented();
+    }
+}
+
 PSFScalar *DataTypeDef::new_scalar() const {
+    PSF_STATS_ADD(objects_allocated, 1);
+
     switch(m_datatypeid) {
     case TYPEID_INT8:
 	return new PSFInt8Scalar();
@@ -93,6 +219,8 @@ PSFScalar *DataTypeDef::new_scalar() const {
 }
 
 PSFVector *DataTypeDef::new_vector() const {
+    PSF_STATS_ADD(objects_allocated, 1);
+
     switch(m_datatypeid) {
     case TYPEID_INT8:
 	return new PSFInt8Vector();
@@ -0,0 +1,781 @@
+#include "psf.h"
+#include "psfdata.h"
+#include "psfinternal.h"
+#include "psfwriter.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+// Size of the output buffer that is collected before writing to the file
+static const std::size_t WRITEBUFFER_SIZE = 1 << 20;
+
+PSFWriter::PSFWriter(std::string filename) :
+    m_filename(filename), m_state(DEFINE), m_nextid(1), m_sweeptype(-1), m_sweepid(-1),
+    m_windowsize(0), m_pos(0), m_npointspos(0), m_sweepminpos(0), m_sweepmaxpos(0),
+    m_valueendpos(0), m_npoints(0), m_sweepmin(0), m_sweepmax(0), m_alldouble(true),
+    m_windowpoints(0), m_windown(0) {
+
+    m_fd = ::open(m_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+    if (m_fd == -1)
+	throw FileOpenError();
+}
+
+PSFWriter::~PSFWriter() {
+    try {
+	close();
+    } catch (std::exception &) {
+	// Destructors must not throw
+    }
+}
+
+//
+// Definitions
+//
+
+void PSFWriter::add_header_property(const std::string &name, const PSFScalar &value) {
+    if(m_state != DEFINE)
+	throw InvalidWriterState();
+
+    put_property(m_header, name, value);
+    m_headernames.push_back(name);
+}
+
+int PSFWriter::add_type(const std::string &name, int datatypeid, const PropertyMap &properties) {
+    if(m_state != DEFINE)
+	throw InvalidWriterState();
+
+    Type type;
+    type.id = new_id();
+    type.name = name;
+    type.datatypeid = datatypeid;
+    type.datasize = psfdata_size(datatypeid);
+    put_properties(type.properties, properties);
+    m_types.push_back(type);
+
+    if(datatypeid != TYPEID_DOUBLE)
+	m_alldouble = false;
+
+    return type.id;
+}
+
+int PSFWriter::add_struct_type(const std::string &name, const StructMembers &members,
+			       const PropertyMap &properties) {
+    if(m_state != DEFINE)
+	throw InvalidWriterState();
+
+    Type type;
+    type.id = new_id();
+    type.name = name;
+    type.datatypeid = TYPEID_STRUCT;
+    type.datasize = 0;
+    type.members = members;
+    for(StructMembers::const_iterator i=members.begin(); i != members.end(); i++)
+	type.datasize += psfdata_size(i->second);
+    put_properties(type.properties, properties);
+    m_types.push_back(type);
+
+    m_alldouble = false;
+
+    return type.id;
+}
+
+const PSFWriter::Type &PSFWriter::get_type(int id) const {
+    for(std::vector<Type>::const_iterator i=m_types.begin(); i != m_types.end(); i++)
+	if(i->id == id)
+	    return *i;
+    throw NotFound();
+}
+
+void PSFWriter::add_sweep(const std::string &name, int type, const PropertyMap &properties) {
+    if(m_state != DEFINE || !m_nonsweepvalues.empty())
+	throw InvalidWriterState();
+
+    get_type(type);
+
+    if(m_sweeptype == -1) {
+	m_sweeptype = type;
+	m_sweepid = new_id();
+	m_sweepname = name;
+	put_properties(m_sweepproperties, properties);
+    } else {
+	Sweep sweep;
+	sweep.id = new_id();
+	sweep.name = name;
+	sweep.type = type;
+	put_properties(sweep.properties, properties);
+	m_outersweeps.push_back(sweep);
+    }
+}
+
+int PSFWriter::add_trace(const std::string &name, int type, const std::string &group,
+			 const PropertyMap &properties) {
+    if(m_state != DEFINE || !m_nonsweepvalues.empty())
+	throw InvalidWriterState();
+
+    get_type(type);
+
+    Trace trace;
+    trace.id = new_id();
+    trace.name = name;
+    trace.type = type;
+    trace.group = -1;
+    put_properties(trace.properties, properties);
+
+    if(!group.empty()) {
+	for(std::size_t i=0; i < m_groups.size(); i++)
+	    if(m_groups[i].name == group)
+		trace.group = i;
+
+	if(trace.group == -1) {
+	    Group newgroup;
+	    newgroup.id = new_id();
+	    newgroup.name = group;
+	    m_groups.push_back(newgroup);
+	    trace.group = m_groups.size() - 1;
+	}
+	m_groups[trace.group].traces.push_back(m_traces.size());
+    }
+
+    m_traces.push_back(trace);
+
+    return trace.id;
+}
+
+void PSFWriter::set_window_size(int windowsize) {
+    if(m_state != DEFINE || windowsize <= 0)
+	throw InvalidWriterState();
+
+    m_windowsize = windowsize;
+}
+
+void PSFWriter::add_value(const std::string &name, int type, const PSFScalar &value,
+			  const PropertyMap &properties) {
+    if(m_state != DEFINE || m_sweeptype != -1 || !m_traces.empty())
+	throw InvalidWriterState();
+
+    const Type &valuetype = get_type(type);
+
+    std::string buf;
+    put_int32(buf, NonSweepValue::type);
+    put_int32(buf, new_id());
+    put_string(buf, name);
+    put_int32(buf, type);
+    put_data(buf, valuetype, value);
+    put_properties(buf, properties);
+
+    // Offsets are relative to the start of the values and adjusted when the section is written
+    m_nonsweepindex.push_back(std::make_pair(name, (uint32_t)m_nonsweepvalues.size()));
+    m_nonsweepvalues += buf;
+}
+
+//
+// Serialization
+//
+
+void PSFWriter::put_int32(std::string &buf, uint32_t value) const {
+    uint32_t be = htonl(value);
+    buf.append((const char *)&be, 4);
+}
+
+void PSFWriter::put_double(std::string &buf, double value) const {
+    uint64_t bits;
+    memcpy(&bits, &value, 8);
+    uint64_t be = htobe64(bits);
+    buf.append((const char *)&be, 8);
+}
+
+void PSFWriter::put_string(std::string &buf, const std::string &value) const {
+    put_int32(buf, value.size());
+    buf.append(value);
+    // Align to 32-bit boundary
+    buf.append((4 - value.size()) & 3, '\0');
+}
+
+void PSFWriter::put_property(std::string &buf, const std::string &name, const PSFScalar &value) const {
+    if(const PSFStringScalar *p = dynamic_cast<const PSFStringScalar *>(&value)) {
+	put_int32(buf, 33);
+	put_string(buf, name);
+	put_string(buf, p->value);
+    } else if(dynamic_cast<const PSFInt32Scalar *>(&value) || dynamic_cast<const PSFInt8Scalar *>(&value)) {
+	put_int32(buf, 34);
+	put_string(buf, name);
+	put_int32(buf, (int)value);
+    } else if(const PSFDoubleScalar *p = dynamic_cast<const PSFDoubleScalar *>(&value)) {
+	put_int32(buf, 35);
+	put_string(buf, name);
+	put_double(buf, p->value);
+    } else
+	throw NotImplemented();
+}
+
+void PSFWriter::put_properties(std::string &buf, const PropertyMap &properties) const {
+    for(PropertyMap::const_iterator i=properties.begin(); i != properties.end(); i++)
+	put_property(buf, i->first, *i->second);
+}
+
+void PSFWriter::put_data(std::string &buf, const Type &type, const PSFScalar &value) const {
+    switch(type.datatypeid) {
+    case TYPEID_INT8:
+	put_int32(buf, (uint8_t)(int)value);
+	break;
+    case TYPEID_INT32:
+	put_int32(buf, (int)value);
+	break;
+    case TYPEID_DOUBLE:
+	put_double(buf, (double)value);
+	break;
+    case TYPEID_COMPLEXDOUBLE:
+	if(const PSFComplexDoubleScalar *p = dynamic_cast<const PSFComplexDoubleScalar *>(&value)) {
+	    put_double(buf, p->value.real());
+	    put_double(buf, p->value.imag());
+	} else {
+	    put_double(buf, (double)value);
+	    put_double(buf, 0.0);
+	}
+	break;
+    case TYPEID_STRUCT: {
+	const Struct &s = dynamic_cast<const StructScalar &>(value).value;
+	for(StructMembers::const_iterator i=type.members.begin(); i != type.members.end(); i++) {
+	    Struct::const_iterator member = s.find(i->first);
+	    if(member == s.end())
+		throw NotFound();
+
+	    Type membertype;
+	    membertype.datatypeid = i->second;
+	    put_data(buf, membertype, *member->second);
+	}
+	break;
+    }
+    default:
+	throw UnknownType(type.datatypeid);
+    }
+}
+
+//
+// Output
+//
+
+void PSFWriter::write(const std::string &buf) {
+    m_outbuf += buf;
+    m_pos += buf.size();
+
+    // PSF files use 32-bit file offsets
+    if(m_pos > 0xffffffffULL)
+	throw FileWriteError();
+
+    if(m_outbuf.size() >= WRITEBUFFER_SIZE)
+	flush();
+}
+
+void PSFWriter::flush() {
+    const char *p = m_outbuf.data();
+    std::size_t left = m_outbuf.size();
+
+    while(left > 0) {
+	ssize_t n = ::write(m_fd, p, left);
+	if(n < 0)
+	    throw FileWriteError();
+	p += n;
+	left -= n;
+    }
+    m_outbuf.clear();
+}
+
+void PSFWriter::patch_int32(uint64_t pos, uint32_t value) {
+    uint32_t be = htonl(value);
+    if(pwrite(m_fd, &be, 4, pos) != 4)
+	throw FileWriteError();
+}
+
+void PSFWriter::patch_double(uint64_t pos, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, 8);
+    uint64_t be = htobe64(bits);
+    if(pwrite(m_fd, &be, 8, pos) != 8)
+	throw FileWriteError();
+}
+
+void PSFWriter::write_header_section() {
+    bool swept = m_sweeptype != -1;
+    std::string buf;
+    uint64_t start = m_pos;
+
+    m_toc.push_back(std::make_pair(SECTION_HEADER, (uint32_t)start));
+
+    int ntraces = m_traces.size();
+
+    // Properties that are set by the writer unless given by the user
+    std::vector<std::pair<std::string, PSFScalar *> > props;
+    props.push_back(std::make_pair("PSFversion", new PSFStringScalar("1.1")));
+    props.push_back(std::make_pair("PSF style", new PSFInt32Scalar(7)));
+    props.push_back(std::make_pair("PSF types", new PSFInt32Scalar(m_types.size())));
+    props.push_back(std::make_pair("PSF sweeps", new PSFInt32Scalar(swept ? 1 + m_outersweeps.size() : 0)));
+    props.push_back(std::make_pair("PSF sweep points", new PSFInt32Scalar(0)));
+    if(swept) {
+	props.push_back(std::make_pair("PSF sweep min", new PSFDoubleScalar(0)));
+	props.push_back(std::make_pair("PSF sweep max", new PSFDoubleScalar(0)));
+	props.push_back(std::make_pair("PSF groups", new PSFInt32Scalar(m_groups.size())));
+	props.push_back(std::make_pair("PSF traces", new PSFInt32Scalar(ntraces)));
+    }
+    if(m_windowsize) {
+	props.push_back(std::make_pair("PSF window size", new PSFInt32Scalar(m_windowsize)));
+	props.push_back(std::make_pair("PSF buffer size", new PSFInt32Scalar(m_windowsize * ntraces)));
+    }
+
+    put_int32(buf, HeaderSection::type);
+    put_int32(buf, 0);
+    for(std::size_t i=0; i < props.size(); i++) {
+	const std::string &name = props[i].first;
+	if(std::find(m_headernames.begin(), m_headernames.end(), name) == m_headernames.end()) {
+	    put_property(buf, name, *props[i].second);
+
+	    // Remember value positions that are known first when the file is closed
+	    uint64_t valuepos = start + buf.size() - (name == "PSF sweep points" ? 4 : 8);
+	    if(name == "PSF sweep points")
+		m_npointspos = valuepos;
+	    else if(name == "PSF sweep min")
+		m_sweepminpos = valuepos;
+	    else if(name == "PSF sweep max")
+		m_sweepmaxpos = valuepos;
+	}
+	delete props[i].second;
+    }
+    buf += m_header;
+    put_int32(buf, SECTION_HEADER + 1);
+
+    uint32_t endpos = htonl(start + buf.size());
+    buf.replace(4, 4, (const char *)&endpos, 4);
+    write(buf);
+}
+
+void PSFWriter::write_type_section() {
+    std::string buf;
+    std::vector<std::pair<uint32_t, uint32_t> > index;
+    uint64_t start = m_pos;
+
+    m_toc.push_back(std::make_pair(SECTION_TYPE, (uint32_t)start));
+
+    put_int32(buf, TypeSection::type);
+    put_int32(buf, 0);
+    put_int32(buf, 22);
+    put_int32(buf, 0);
+
+    for(std::vector<Type>::const_iterator i=m_types.begin(); i != m_types.end(); i++) {
+	index.push_back(std::make_pair(i->id, start + buf.size()));
+
+	put_int32(buf, DataTypeDef::type);
+	put_int32(buf, i->id);
+	put_string(buf, i->name);
+	put_int32(buf, 0);
+	put_int32(buf, i->datatypeid);
+
+	if(i->datatypeid == TYPEID_STRUCT) {
+	    for(StructMembers::const_iterator j=i->members.begin(); j != i->members.end(); j++) {
+		put_int32(buf, DataTypeDef::type);
+		put_int32(buf, new_id());
+		put_string(buf, j->first);
+		put_int32(buf, 0);
+		put_int32(buf, j->second);
+	    }
+	    put_int32(buf, 18);
+	}
+	buf += i->properties;
+    }
+
+    uint32_t subendpos = htonl(start + buf.size());
+    buf.replace(12, 4, (const char *)&subendpos, 4);
+
+    put_int32(buf, Index::type);
+    put_int32(buf, 8 * index.size());
+    for(std::size_t i=0; i < index.size(); i++) {
+	put_int32(buf, index[i].first);
+	put_int32(buf, index[i].second);
+    }
+    put_int32(buf, SECTION_TYPE + 1);
+
+    uint32_t endpos = htonl(start + buf.size());
+    buf.replace(4, 4, (const char *)&endpos, 4);
+    write(buf);
+}
+
+void PSFWriter::write_sweep_section() {
+    std::string buf;
+    uint64_t start = m_pos;
+
+    m_toc.push_back(std::make_pair(SECTION_SWEEP, (uint32_t)start));
+
+    put_int32(buf, SweepSection::type);
+    put_int32(buf, 0);
+    put_int32(buf, DataTypeRef::type);
+    put_int32(buf, m_sweepid);
+    put_string(buf, m_sweepname);
+    put_int32(buf, m_sweeptype);
+    buf += m_sweepproperties;
+    for(std::vector<Sweep>::const_iterator i=m_outersweeps.begin(); i != m_outersweeps.end(); i++) {
+	put_int32(buf, DataTypeRef::type);
+	put_int32(buf, i->id);
+	put_string(buf, i->name);
+	put_int32(buf, i->type);
+	buf += i->properties;
+    }
+    put_int32(buf, SECTION_SWEEP + 1);
+
+    uint32_t endpos = htonl(start + buf.size());
+    buf.replace(4, 4, (const char *)&endpos, 4);
+    write(buf);
+}
+
+// First four characters of a name as used in the index of traces and values
+static uint32_t index_key(const std::string &name) {
+    char key[4] = { 0, 0, 0, 0 };
+    name.copy(key, 4);
+    return ntohl(*(uint32_t *)key);
+}
+
+void PSFWriter::write_trace_section() {
+    std::string buf, index;
+    uint64_t start = m_pos;
+
+    m_toc.push_back(std::make_pair(SECTION_TRACE, (uint32_t)start));
+
+    put_int32(buf, TraceSection::type);
+    put_int32(buf, 0);
+    put_int32(buf, 22);
+    put_int32(buf, 0);
+
+    // Traces are stored in the order they were added, a group is stored
+    // where its first trace was added.
+    std::vector<bool> groupwritten(m_groups.size(), false);
+    m_order.clear();
+    for(std::size_t i=0; i < m_traces.size(); i++) {
+	const Trace &trace = m_traces[i];
+
+	if(trace.group == -1) {
+	    put_int32(index, index_key(trace.name));
+	    put_int32(index, start + buf.size());
+	    put_int32(index, 0);
+	    put_int32(index, 0xffffffff);
+
+	    put_int32(buf, DataTypeRef::type);
+	    put_int32(buf, trace.id);
+	    put_string(buf, trace.name);
+	    put_int32(buf, trace.type);
+	    buf += trace.properties;
+
+	    m_order.push_back(i);
+	} else if(!groupwritten[trace.group]) {
+	    const Group &group = m_groups[trace.group];
+	    groupwritten[trace.group] = true;
+
+	    put_int32(index, index_key(group.name));
+	    put_int32(index, start + buf.size());
+	    put_int32(index, 0);
+	    put_int32(index, group.traces.size());
+
+	    put_int32(buf, GroupDef::type);
+	    put_int32(buf, group.id);
+	    put_string(buf, group.name);
+	    put_int32(buf, group.traces.size());
+	    for(std::vector<int>::const_iterator j=group.traces.begin(); j != group.traces.end(); j++) {
+		const Trace &member = m_traces[*j];
+
+		put_int32(index, index_key(member.name));
+		put_int32(index, start + buf.size());
+		put_int32(index, group.id);
+		put_int32(index, 0xffffffff);
+
+		put_int32(buf, DataTypeRef::type);
+		put_int32(buf, member.id);
+		put_string(buf, member.name);
+		put_int32(buf, member.type);
+		buf += member.properties;
+
+		m_order.push_back(*j);
+	    }
+	}
+    }
+
+    uint32_t subendpos = htonl(start + buf.size());
+    buf.replace(12, 4, (const char *)&subendpos, 4);
+
+    put_int32(buf, TraceIndex::type);
+    put_int32(buf, index.size());
+    buf += index;
+    put_int32(buf, SECTION_TRACE + 1);
+
+    uint32_t endpos = htonl(start + buf.size());
+    buf.replace(4, 4, (const char *)&endpos, 4);
+    write(buf);
+}
+
+void PSFWriter::write_nonsweep_value_section() {
+    std::string buf;
+    uint64_t start = m_pos;
+
+    m_toc.push_back(std::make_pair(SECTION_VALUE, (uint32_t)start));
+
+    put_int32(buf, ValueSectionNonSweep::type);
+    put_int32(buf, 0);
+    put_int32(buf, 22);
+    put_int32(buf, start + 16 + m_nonsweepvalues.size());
+    buf += m_nonsweepvalues;
+
+    put_int32(buf, Index::type);
+    put_int32(buf, 8 * m_nonsweepindex.size());
+    for(std::size_t i=0; i < m_nonsweepindex.size(); i++) {
+	put_int32(buf, index_key(m_nonsweepindex[i].first));
+	put_int32(buf, start + 16 + m_nonsweepindex[i].second);
+    }
+    put_int32(buf, CHUNKID_VALUESECTIONEND);
+
+    uint32_t endpos = htonl(start + buf.size());
+    buf.replace(4, 4, (const char *)&endpos, 4);
+    write(buf);
+}
+
+//
+// Values
+//
+
+void PSFWriter::begin_values() {
+    if(m_state != DEFINE)
+	return;
+
+    if(m_windowsize && !m_outersweeps.empty())
+	throw InvalidWriterState();
+
+    // Windowed sweeps need all traces in groups
+    if(m_windowsize) {
+	for(std::size_t i=0; i < m_traces.size(); i++)
+	    if(m_traces[i].group == -1) {
+		int group = -1;
+		for(std::size_t j=0; j < m_groups.size(); j++)
+		    if(m_groups[j].name == "group")
+			group = j;
+		if(group == -1) {
+		    Group newgroup;
+		    newgroup.id = new_id();
+		    newgroup.name = "group";
+		    m_groups.push_back(newgroup);
+		    group = m_groups.size() - 1;
+		}
+		m_traces[i].group = group;
+		m_groups[group].traces.push_back(i);
+	    }
+    }
+
+    std::string buf;
+    put_int32(buf, 0x400);
+    write(buf);
+
+    write_header_section();
+    write_type_section();
+
+    if(m_sweeptype != -1) {
+	write_sweep_section();
+	write_trace_section();
+
+	buf.clear();
+	m_toc.push_back(std::make_pair(SECTION_VALUE, (uint32_t)m_pos));
+	put_int32(buf, ValueSectionSweep::type);
+	m_valueendpos = m_pos + 4;
+	put_int32(buf, 0);
+
+	if(m_windowsize) {
+	    // Pad so that the first window is aligned to the window size
+	    uint64_t padstart = m_pos + 16;
+	    uint32_t padsize = (m_windowsize - padstart % m_windowsize) % m_windowsize;
+	    put_int32(buf, ZeroPad::type);
+	    put_int32(buf, padsize);
+	    buf.append(padsize, '\0');
+
+	    m_windowpoints = 0xffff;
+	    for(std::size_t i=0; i < m_traces.size(); i++)
+		m_windowpoints = std::min(m_windowpoints, m_windowsize / get_type(m_traces[i].type).datasize);
+	    if(m_windowpoints < 1)
+		throw InvalidWriterState();
+
+	    m_windowvalues.resize(m_traces.size());
+	    m_windown = 0;
+	}
+	write(buf);
+    }
+    m_state = VALUES;
+}
+
+void PSFWriter::put_point(double sweepvalue) {
+    if(m_npoints == 0)
+	m_sweepmin = m_sweepmax = sweepvalue;
+    m_sweepmin = std::min(m_sweepmin, sweepvalue);
+    m_sweepmax = std::max(m_sweepmax, sweepvalue);
+    m_npoints++;
+}
+
+void PSFWriter::append_point(const PSFScalar &sweepvalue, const std::vector<const PSFScalar *> &values) {
+    append_point(std::vector<const PSFScalar *>(1, &sweepvalue), values);
+}
+
+void PSFWriter::append_point(const std::vector<const PSFScalar *> &sweepvalues,
+			     const std::vector<const PSFScalar *> &values) {
+    begin_values();
+
+    if(m_state != VALUES || m_sweeptype == -1 || values.size() != m_traces.size() ||
+       sweepvalues.size() != 1 + m_outersweeps.size())
+	throw InvalidWriterState();
+
+    const Type &sweeptype = get_type(m_sweeptype);
+    const PSFScalar &sweepvalue = *sweepvalues[0];
+
+    if(m_windowsize) {
+	put_data(m_windowparams, sweeptype, sweepvalue);
+	for(std::size_t i=0; i < m_traces.size(); i++)
+	    put_data(m_windowvalues[i], get_type(m_traces[i].type), *values[i]);
+
+	if(++m_windown == m_windowpoints)
+	    flush_window();
+    } else {
+	std::string buf;
+	put_int32(buf, SweepValue::type);
+	put_int32(buf, m_sweepid);
+	put_data(buf, sweeptype, sweepvalue);
+
+	// Outer sweep values are stored like traces before the trace values
+	for(std::size_t i=0; i < m_outersweeps.size(); i++) {
+	    put_int32(buf, DataTypeRef::type);
+	    put_int32(buf, m_outersweeps[i].id);
+	    put_data(buf, get_type(m_outersweeps[i].type), *sweepvalues[i + 1]);
+	}
+
+	int group = -1;
+	for(std::vector<int>::const_iterator i=m_order.begin(); i != m_order.end(); i++) {
+	    const Trace &trace = m_traces[*i];
+	    if(trace.group == -1) {
+		put_int32(buf, DataTypeRef::type);
+		put_int32(buf, trace.id);
+	    } else if(trace.group != group) {
+		put_int32(buf, GroupDef::type);
+		put_int32(buf, m_groups[trace.group].id);
+	    }
+	    group = trace.group;
+	    put_data(buf, get_type(trace.type), *values[*i]);
+	}
+	write(buf);
+    }
+    put_point((double)sweepvalue);
+}
+
+void PSFWriter::append_point(double sweepvalue, const double *values) {
+    begin_values();
+
+    if(m_state != VALUES || m_sweeptype == -1 || !m_alldouble || !m_outersweeps.empty())
+	throw InvalidWriterState();
+
+    if(m_windowsize) {
+	put_double(m_windowparams, sweepvalue);
+	for(std::size_t i=0; i < m_traces.size(); i++)
+	    put_double(m_windowvalues[i], values[i]);
+
+	if(++m_windown == m_windowpoints)
+	    flush_window();
+    } else {
+	std::string buf;
+	buf.reserve(16 + m_traces.size() * 16);
+	put_int32(buf, SweepValue::type);
+	put_int32(buf, m_sweepid);
+	put_double(buf, sweepvalue);
+
+	int group = -1;
+	for(std::vector<int>::const_iterator i=m_order.begin(); i != m_order.end(); i++) {
+	    const Trace &trace = m_traces[*i];
+	    if(trace.group == -1) {
+		put_int32(buf, DataTypeRef::type);
+		put_int32(buf, trace.id);
+	    } else if(trace.group != group) {
+		put_int32(buf, GroupDef::type);
+		put_int32(buf, m_groups[trace.group].id);
+	    }
+	    group = trace.group;
+	    put_double(buf, values[*i]);
+	}
+	write(buf);
+    }
+    put_point(sweepvalue);
+}
+
+void PSFWriter::flush_window() {
+    if(m_windown == 0)
+	return;
+
+    std::string buf;
+    put_int32(buf, SweepValue::type);
+    put_int32(buf, ((m_windowpoints - m_windown) << 16) | m_windown);
+    buf += m_windowparams;
+    write(buf);
+
+    // Values are stored at the end of each trace window
+    for(std::vector<int>::const_iterator i=m_order.begin(); i != m_order.end(); i++) {
+	std::string &values = m_windowvalues[*i];
+	buf.assign(m_windowsize - values.size(), '\0');
+	buf += values;
+	write(buf);
+	values.clear();
+    }
+    m_windowparams.clear();
+    m_windown = 0;
+}
+
+void PSFWriter::end_values() {
+    std::string buf;
+
+    if(m_sweeptype != -1) {
+	if(m_windowsize)
+	    flush_window();
+
+	put_int32(buf, CHUNKID_VALUESECTIONEND);
+	write(buf);
+    } else
+	write_nonsweep_value_section();
+}
+
+void PSFWriter::close() {
+    if(m_state == CLOSED)
+	return;
+
+    begin_values();
+    end_values();
+
+    // Section table of contents and trailer
+    uint32_t tocpos = m_pos;
+    std::string buf;
+    for(std::size_t i=0; i < m_toc.size(); i++) {
+	put_int32(buf, m_toc[i].first);
+	put_int32(buf, m_toc[i].second);
+    }
+    buf += "Clarissa";
+    put_int32(buf, tocpos);
+    write(buf);
+    flush();
+
+    // Fill in values that were unknown when the header was written
+    if(m_sweeptype != -1) {
+	patch_int32(m_valueendpos, tocpos);
+	if(m_npointspos)
+	    patch_int32(m_npointspos, m_npoints);
+	if(m_sweepminpos)
+	    patch_double(m_sweepminpos, m_sweepmin);
+	if(m_sweepmaxpos)
+	    patch_double(m_sweepmaxpos, m_sweepmax);
+    }
+
+    m_state = CLOSED;
+
+    if(::close(m_fd) == -1)
+	throw FileCloseError();
+    m_fd = -1;
+}
@@ -0,0 +1,194 @@
+// CppUnit unit test for PSFArrowExport
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <cppunit/TestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/BriefTestProgressListener.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+
+#include "psf.h"
+#include "psfwriter.h"
+#include "psfarrow.h"
+
+static const char *psffile = "test_psfarrow.psf";
+static const char *arrowfile = "test_psfarrow.arrow";
+
+class TestPSFArrowExport : public CPPUNIT_NS::TestCase {
+    CPPUNIT_TEST_SUITE(TestPSFArrowExport);
+
+    CPPUNIT_TEST(test_stream);
+    CPPUNIT_TEST(test_file);
+    CPPUNIT_TEST(test_batches);
+
+    CPPUNIT_TEST_EXCEPTION(test_unknown_signal, NotFound);
+
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp(void);
+    void tearDown(void) { remove(psffile); remove(arrowfile); }
+
+protected:
+    void test_stream();
+    void test_file();
+    void test_batches();
+
+    void test_unknown_signal();
+
+private:
+    std::string read_output() const;
+    std::vector<std::string> messages(const std::string &data, std::size_t pos) const;
+};
+
+static uint32_t get_le32(const std::string &buf, std::size_t pos) {
+    const unsigned char *p = (const unsigned char *)buf.data() + pos;
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void TestPSFArrowExport::setUp(void) {
+    PSFWriter writer(psffile);
+
+    int sweeptype = writer.add_type("sweep", TYPEID_DOUBLE);
+    int valuetype = writer.add_type("V", TYPEID_DOUBLE);
+    writer.add_sweep("time", sweeptype);
+    writer.add_trace("a", valuetype);
+    writer.add_trace("b", valuetype);
+    writer.set_window_size(64);
+
+    double values[2];
+    for(int i=0; i < 100; i++) {
+	values[0] = i;
+	values[1] = -i;
+	writer.append_point(1e-9 * i, values);
+    }
+}
+
+std::string TestPSFArrowExport::read_output() const {
+    std::ifstream in(arrowfile, std::ios::binary);
+    std::stringstream data;
+    data << in.rdbuf();
+    return data.str();
+}
+
+//
+// Split an Arrow IPC stream at pos into the metadata of its messages
+//
+std::vector<std::string> TestPSFArrowExport::messages(const std::string &data, std::size_t pos) const {
+    std::vector<std::string> result;
+
+    while(true) {
+	CPPUNIT_ASSERT(pos + 8 <= data.size());
+	CPPUNIT_ASSERT_EQUAL(get_le32(data, pos), (uint32_t)0xffffffff);
+
+	uint32_t size = get_le32(data, pos + 4);
+	if(size == 0)
+	    break;
+
+	// Metadata and body are aligned to 8 bytes
+	CPPUNIT_ASSERT_EQUAL(size % 8, (uint32_t)0);
+
+	std::string metadata = data.substr(pos + 8, size);
+	result.push_back(metadata);
+
+	// Body length is field 3 of the message table
+	uint32_t table = get_le32(metadata, 0);
+	uint32_t vtable = table - get_le32(metadata, table);
+	uint16_t offset = (unsigned char)metadata[vtable + 10] | ((unsigned char)metadata[vtable + 11] << 8);
+	uint32_t bodylength = offset ? get_le32(metadata, table + offset) : 0;
+
+	pos += 8 + size + bodylength;
+    }
+    return result;
+}
+
+void TestPSFArrowExport::test_stream() {
+    PSFArrowExport exporter(psffile);
+    exporter.set_batch_size(1000);
+    exporter.write(arrowfile);
+
+    std::string data = read_output();
+
+    // Schema and a single record batch
+    std::vector<std::string> msgs = messages(data, 0);
+    CPPUNIT_ASSERT_EQUAL(msgs.size(), (std::size_t)2);
+    CPPUNIT_ASSERT(msgs[0].find("time") != std::string::npos);
+    CPPUNIT_ASSERT(msgs[0].find("PSF sweep points") != std::string::npos);
+
+    // Body holds the sweep values and both traces in native byte order
+    double value;
+    std::size_t body = 8 + get_le32(data, 4) + 8 + get_le32(data, 8 + get_le32(data, 4) + 4);
+    memcpy(&value, data.data() + body + 99 * 8, 8);
+    CPPUNIT_ASSERT_EQUAL(value, 99e-9);
+    memcpy(&value, data.data() + body + 100 * 8 + 42 * 8, 8);
+    CPPUNIT_ASSERT_EQUAL(value, 42.0);
+    memcpy(&value, data.data() + body + 200 * 8 + 42 * 8, 8);
+    CPPUNIT_ASSERT_EQUAL(value, -42.0);
+}
+
+void TestPSFArrowExport::test_file() {
+    PSFArrowExport exporter(psffile);
+    exporter.set_format(PSFArrowExport::FILE);
+    exporter.write(arrowfile);
+
+    std::string data = read_output();
+
+    CPPUNIT_ASSERT_EQUAL(data.substr(0, 8), std::string("ARROW1\0\0", 8));
+    CPPUNIT_ASSERT_EQUAL(data.substr(data.size() - 6), std::string("ARROW1"));
+
+    uint32_t footersize = get_le32(data, data.size() - 10);
+    CPPUNIT_ASSERT(footersize < data.size());
+    CPPUNIT_ASSERT_EQUAL(messages(data, 8).size(), (std::size_t)2);
+}
+
+void TestPSFArrowExport::test_batches() {
+    PSFArrowExport exporter(psffile);
+    std::vector<std::string> signals(1, "b");
+    exporter.set_signals(signals);
+    exporter.set_batch_size(30);
+    exporter.write(arrowfile);
+
+    std::string data = read_output();
+
+    // Schema and four batches of at most 30 points
+    std::vector<std::string> msgs = messages(data, 0);
+    CPPUNIT_ASSERT_EQUAL(msgs.size(), (std::size_t)5);
+}
+
+void TestPSFArrowExport::test_unknown_signal() {
+    PSFArrowExport exporter(psffile);
+    std::vector<std::string> signals(1, "nonexisting");
+    exporter.set_signals(signals);
+    exporter.write(arrowfile);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestPSFArrowExport);
+
+int main(int argc, char *argv[]) {
+    // Create the event manager and test controller
+    CPPUNIT_NS::TestResult controller;
+
+    // Add a listener that colllects test result
+    CPPUNIT_NS::TestResultCollector result;
+    controller.addListener( &result );
+
+    // Add a listener that print dots as test run.
+    CPPUNIT_NS::BriefTestProgressListener progress;
+    controller.addListener( &progress );
+
+    // Add the top suite to the test runner
+    CPPUNIT_NS::TestRunner runner;
+    runner.addTest( CPPUNIT_NS::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( controller );
+
+    return result.wasSuccessful() ? 0 : 1;
+}
@@ -0,0 +1,231 @@
+// CppUnit unit test for asynchronous extraction
+
+#include <stdio.h>
+
+#include <vector>
+
+#include <cppunit/TestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/BriefTestProgressListener.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+
+#include "psf.h"
+#include "psfdata.h"
+#include "psfwriter.h"
+#include "psfasync.h"
+
+static const char *filename = "test_psfasync.psf";
+
+static const int npoints = 2500;
+
+class TestPSFAsync : public CPPUNIT_NS::TestCase {
+    CPPUNIT_TEST_SUITE(TestPSFAsync);
+
+    CPPUNIT_TEST(test_simple);
+    CPPUNIT_TEST(test_windowed);
+    CPPUNIT_TEST(test_cancel);
+    CPPUNIT_TEST(test_prefetch);
+    CPPUNIT_TEST(test_errors);
+
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void tearDown(void) { psf_enable_stats(false); remove(filename); }
+
+protected:
+    void test_simple();
+    void test_windowed();
+    void test_cancel();
+    void test_prefetch();
+    void test_errors();
+
+    void write(int windowsize);
+    void check();
+};
+
+void TestPSFAsync::write(int windowsize) {
+    PSFWriter writer(filename);
+
+    int sweeptype = writer.add_type("sweep", TYPEID_DOUBLE);
+    int inttype = writer.add_type("count", TYPEID_INT32);
+    int complextype = writer.add_type("complex", TYPEID_COMPLEXDOUBLE);
+    writer.add_sweep("time", sweeptype);
+    writer.add_trace("a", sweeptype);
+    writer.add_trace("z", complextype);
+    writer.add_trace("n", inttype);
+    if(windowsize)
+	writer.set_window_size(windowsize);
+
+    for(int i=0; i < npoints; i++) {
+	PSFDoubleScalar a(0.5 * i);
+	PSFComplexDoubleScalar z(PSFComplexDouble(i, -2.0 * i));
+	PSFInt32Scalar n(7 - i);
+	std::vector<const PSFScalar *> values;
+	values.push_back(&a);
+	values.push_back(&z);
+	values.push_back(&n);
+	writer.append_point(PSFDoubleScalar(i * 1e-3), values);
+    }
+}
+
+// Blocks of points that do not divide the sweep or the windows
+void TestPSFAsync::check() {
+    PSFDataSet ds(filename);
+    PSFAsyncReader reader(ds, 2, 333);
+
+    PSFFuture *a = reader.get_signal_async("a");
+
+    std::vector<std::string> names;
+    names.push_back("n");
+    names.push_back("z");
+    names.push_back("a");
+    PSFFuture *all = reader.get_signals_async(names);
+
+    PSFDoubleVector *ref = dynamic_cast<PSFDoubleVector *>(ds.get_signal_vector("a"));
+    const PSFDoubleVector *v = dynamic_cast<const PSFDoubleVector *>(a->get());
+    CPPUNIT_ASSERT(v != NULL);
+    CPPUNIT_ASSERT(*v == *ref);
+    CPPUNIT_ASSERT(a->ready());
+    delete ref;
+
+    // Integer signals are converted to double
+    const std::vector<PSFBase *> &values = all->get_all();
+    CPPUNIT_ASSERT_EQUAL((int)values.size(), 3);
+    const PSFDoubleVector *n = dynamic_cast<const PSFDoubleVector *>(values[0]);
+    const PSFComplexDoubleVector *z = dynamic_cast<const PSFComplexDoubleVector *>(values[1]);
+    CPPUNIT_ASSERT(n != NULL && z != NULL);
+    CPPUNIT_ASSERT_EQUAL((int)n->size(), npoints);
+    CPPUNIT_ASSERT_EQUAL((int)z->size(), npoints);
+    for(int i=0; i < npoints; i++) {
+	CPPUNIT_ASSERT_EQUAL(n->at(i), 7.0 - i);
+	CPPUNIT_ASSERT(z->at(i) == PSFComplexDouble(i, -2.0 * i));
+    }
+    CPPUNIT_ASSERT(*dynamic_cast<const PSFDoubleVector *>(values[2]) == *v);
+
+    delete a;
+    delete all;
+}
+
+void TestPSFAsync::test_simple() {
+    write(0);
+    check();
+}
+
+void TestPSFAsync::test_windowed() {
+    write(512);
+    check();
+}
+
+// A cancelled extraction never returns part of a signal
+void TestPSFAsync::test_cancel() {
+    write(0);
+
+    PSFDataSet ds(filename);
+    PSFAsyncReader reader(ds, 1, 1);
+
+    std::vector<PSFFuture *> futures;
+    for(int i=0; i < 20; i++) {
+	futures.push_back(reader.get_signal_async("a"));
+	futures.back()->cancel();
+    }
+
+    int ncancelled = 0;
+    for(int i=0; i < 20; i++) {
+	try {
+	    const PSFDoubleVector *v = dynamic_cast<const PSFDoubleVector *>(futures[i]->get());
+	    CPPUNIT_ASSERT_EQUAL((int)v->size(), npoints);
+	    CPPUNIT_ASSERT_EQUAL(v->back(), 0.5 * (npoints - 1));
+	} catch (const Cancelled &) {
+	    CPPUNIT_ASSERT(futures[i]->cancelled());
+	    ncancelled++;
+	}
+	delete futures[i];
+    }
+    CPPUNIT_ASSERT(ncancelled > 0);
+
+    // Futures may be deleted before they finish and outlive the reader
+    PSFAsyncReader *other = new PSFAsyncReader(ds, 1, 1);
+    delete other->get_signal_async("a");
+    PSFFuture *pending = other->get_signal_async("a");
+    delete other;
+    CPPUNIT_ASSERT(pending->ready());
+    delete pending;
+}
+
+void TestPSFAsync::test_prefetch() {
+    write(512);
+
+    psf_enable_stats(true);
+
+    PSFDataSet ds(filename);
+    PSFAsyncReader reader(ds);
+
+    std::vector<std::string> names;
+    names.push_back("nonexisting");
+    names.push_back("a");
+    reader.prefetch(names);
+    reader.wait();
+
+    uint64_t allbytes = ds.get_stats().prefetch_bytes;
+    CPPUNIT_ASSERT(allbytes > 0);
+
+    PSFFuture *a = reader.get_signal_async("a");
+    CPPUNIT_ASSERT_EQUAL(dynamic_cast<const PSFDoubleVector *>(a->get())->at(10), 5.0);
+    delete a;
+
+    // A range reads ahead only its points
+    reader.prefetch(names, 0, 100);
+    reader.wait();
+
+    uint64_t rangebytes = ds.get_stats().prefetch_bytes - allbytes;
+    CPPUNIT_ASSERT(rangebytes > 0 && rangebytes < allbytes / 10);
+}
+
+// Exceptions of the extraction are thrown by get()
+void TestPSFAsync::test_errors() {
+    write(0);
+
+    PSFDataSet ds(filename);
+    PSFAsyncReader reader(ds);
+
+    PSFFuture *f = reader.get_signal_async("nonexisting");
+    CPPUNIT_ASSERT_THROW(f->get(), NotFound);
+    CPPUNIT_ASSERT_THROW(f->get(), NotFound);
+    CPPUNIT_ASSERT(!f->cancelled());
+    delete f;
+
+    // A future without names has no signal to get
+    f = reader.get_signals_async(std::vector<std::string>());
+    CPPUNIT_ASSERT(f->get_all().empty());
+    CPPUNIT_ASSERT_THROW(f->get(), NotFound);
+    delete f;
+
+    ds.close();
+    f = reader.get_signal_async("a");
+    CPPUNIT_ASSERT_THROW(f->get(), DataSetNotOpen);
+    delete f;
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestPSFAsync);
+
+int main(int argc, char *argv[]) {
+    // Create the event manager and test controller
+    CPPUNIT_NS::TestResult controller;
+
+    // Add a listener that colllects test result
+    CPPUNIT_NS::TestResultCollector result;
+    controller.addListener( &result );
+
+    // Add a listener that print dots as test run.
+    CPPUNIT_NS::BriefTestProgressListener progress;
+    controller.addListener( &progress );
+
+    // Add the top suite to the test runner
+    CPPUNIT_NS::TestRunner runner;
+    runner.addTest( CPPUNIT_NS::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( controller );
+
+    return result.wasSuccessful() ? 0 : 1;
+}
@@ -0,0 +1,203 @@
+// CppUnit unit test for the block iterator
+
+#include <stdio.h>
+
+#include <cppunit/TestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/BriefTestProgressListener.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+
+#include "psf.h"
+#include "psfdata.h"
+#include "psfwriter.h"
+#include "psfblockiterator.h"
+
+static const char *filename = "test_psfblockiterator.psf";
+
+static const int npoints = 1000;
+
+class TestPSFBlockIterator : public CPPUNIT_NS::TestCase {
+    CPPUNIT_TEST_SUITE(TestPSFBlockIterator);
+
+    CPPUNIT_TEST(test_windowed);
+    CPPUNIT_TEST(test_simple);
+    CPPUNIT_TEST(test_reuse);
+    CPPUNIT_TEST(test_mixed_types);
+    CPPUNIT_TEST(test_errors);
+
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void tearDown(void) { remove(filename); }
+
+protected:
+    void test_windowed();
+    void test_simple();
+    void test_reuse();
+    void test_mixed_types();
+    void test_errors();
+
+    void write(int windowsize);
+    void check_blocks(int blocksize);
+};
+
+void TestPSFBlockIterator::write(int windowsize) {
+    PSFWriter writer(filename);
+
+    int sweeptype = writer.add_type("sweep", TYPEID_DOUBLE);
+    writer.add_sweep("time", sweeptype);
+    writer.add_trace("a", sweeptype);
+    writer.add_trace("b", sweeptype);
+    if(windowsize)
+	writer.set_window_size(windowsize);
+
+    for(int i=0; i < npoints; i++) {
+	double values[2] = { 2.0 * i, -1.0 * i };
+	writer.append_point(i * 0.5, values);
+    }
+}
+
+// The blocks put together equal the signals
+void TestPSFBlockIterator::check_blocks(int blocksize) {
+    PSFDataSet ds(filename);
+
+    std::vector<std::string> names;
+    names.push_back("b");
+    names.push_back("a");
+
+    PSFBlockIterator blocks(ds, names, blocksize);
+
+    int point = 0;
+    while(blocks.next()) {
+	CPPUNIT_ASSERT_EQUAL(blocks.get_start(), point);
+	CPPUNIT_ASSERT_EQUAL(blocks.size(), std::min(blocksize, npoints - point));
+
+	const PSFDoubleVector &x = dynamic_cast<const PSFDoubleVector &>(blocks.get_sweep_values());
+	const PSFDoubleVector &b = dynamic_cast<const PSFDoubleVector &>(blocks.get_values(0));
+	const PSFDoubleVector &a = dynamic_cast<const PSFDoubleVector &>(blocks.get_values(1));
+	CPPUNIT_ASSERT_EQUAL(x.size(), (size_t)blocks.size());
+	CPPUNIT_ASSERT_EQUAL(a.size(), (size_t)blocks.size());
+
+	for(int i=0; i < blocks.size(); i++, point++) {
+	    CPPUNIT_ASSERT_EQUAL(x[i], point * 0.5);
+	    CPPUNIT_ASSERT_EQUAL(a[i], 2.0 * point);
+	    CPPUNIT_ASSERT_EQUAL(b[i], -1.0 * point);
+	}
+    }
+
+    CPPUNIT_ASSERT_EQUAL(point, npoints);
+    CPPUNIT_ASSERT(!blocks.next());
+}
+
+void TestPSFBlockIterator::test_windowed() {
+    // Blocks that start and end within windows
+    write(64);
+    check_blocks(37);
+    check_blocks(8);
+    check_blocks(npoints * 2);
+}
+
+void TestPSFBlockIterator::test_simple() {
+    write(0);
+    check_blocks(37);
+    check_blocks(1);
+}
+
+void TestPSFBlockIterator::test_reuse() {
+    write(64);
+
+    PSFDataSet ds(filename);
+    PSFBlockIterator blocks(ds, std::vector<std::string>(1, "a"), 100);
+
+    CPPUNIT_ASSERT(blocks.next());
+    const PSFVector *a = &blocks.get_values(0);
+    const PSFVector *x = &blocks.get_sweep_values();
+
+    while(blocks.next()) {
+	CPPUNIT_ASSERT_EQUAL(&blocks.get_values(0), a);
+	CPPUNIT_ASSERT_EQUAL(&blocks.get_sweep_values(), x);
+    }
+}
+
+// Traces of different types requested in another order than in the file
+void TestPSFBlockIterator::test_mixed_types() {
+    for(int windowsize=0; windowsize <= 64; windowsize += 64) {
+	{
+	    PSFWriter writer(filename);
+
+	    int sweeptype = writer.add_type("sweep", TYPEID_DOUBLE);
+	    int inttype = writer.add_type("count", TYPEID_INT32);
+	    writer.add_sweep("time", sweeptype);
+	    writer.add_trace("a", sweeptype);
+	    writer.add_trace("n", inttype);
+	    writer.add_trace("b", sweeptype);
+	    if(windowsize)
+		writer.set_window_size(windowsize);
+
+	    for(int i=0; i < npoints; i++) {
+		PSFDoubleScalar a(2.0 * i), b(-1.0 * i);
+		PSFInt32Scalar n(i * 3);
+		std::vector<const PSFScalar *> values;
+		values.push_back(&a);
+		values.push_back(&n);
+		values.push_back(&b);
+		writer.append_point(PSFDoubleScalar(i), values);
+	    }
+	}
+
+	PSFDataSet ds(filename);
+
+	std::vector<std::string> names;
+	names.push_back("b");
+	names.push_back("n");
+	names.push_back("a");
+
+	PSFBlockIterator blocks(ds, names, 37);
+
+	int point = 0;
+	while(blocks.next()) {
+	    const PSFDoubleVector &b = dynamic_cast<const PSFDoubleVector &>(blocks.get_values(0));
+	    const PSFInt32Vector &n = dynamic_cast<const PSFInt32Vector &>(blocks.get_values(1));
+	    const PSFDoubleVector &a = dynamic_cast<const PSFDoubleVector &>(blocks.get_values(2));
+
+	    for(int i=0; i < blocks.size(); i++, point++) {
+		CPPUNIT_ASSERT_EQUAL(a[i], 2.0 * point);
+		CPPUNIT_ASSERT_EQUAL(n[i], point * 3);
+		CPPUNIT_ASSERT_EQUAL(b[i], -1.0 * point);
+	    }
+	}
+
+	CPPUNIT_ASSERT_EQUAL(point, npoints);
+    }
+}
+
+void TestPSFBlockIterator::test_errors() {
+    write(0);
+
+    PSFDataSet ds(filename);
+    CPPUNIT_ASSERT_THROW(PSFBlockIterator(ds, std::vector<std::string>(1, "nonexisting")), NotFound);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestPSFBlockIterator);
+
+int main(int argc, char *argv[]) {
+    // Create the event manager and test controller
+    CPPUNIT_NS::TestResult controller;
+
+    // Add a listener that colllects test result
+    CPPUNIT_NS::TestResultCollector result;
+    controller.addListener( &result );
+
+    // Add a listener that print dots as test run.
+    CPPUNIT_NS::BriefTestProgressListener progress;
+    controller.addListener( &progress );
+
+    // Add the top suite to the test runner
+    CPPUNIT_NS::TestRunner runner;
+    runner.addTest( CPPUNIT_NS::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( controller );
+
+    return result.wasSuccessful() ? 0 : 1;
+}
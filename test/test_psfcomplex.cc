@@ -0,0 +1,196 @@
+// CppUnit unit test for the real valued outputs of complex signals
+
+#include <stdio.h>
+#include <math.h>
+
+#include <vector>
+
+#include <cppunit/TestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/BriefTestProgressListener.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+
+#include "psf.h"
+#include "psfdata.h"
+#include "psfwriter.h"
+
+static const char *filename = "test_psfcomplex.psf";
+
+static const int npoints = 5000;
+
+// Delay line with a gain, its phase wraps several times over the sweep
+static const double gain = 0.5;
+static const double delay = 1e-4;
+
+static double frequency(int i) { return 1000 + 10.0 * i; }
+
+class TestPSFComplex : public CPPUNIT_NS::TestCase {
+    CPPUNIT_TEST_SUITE(TestPSFComplex);
+
+    CPPUNIT_TEST(test_parts);
+    CPPUNIT_TEST(test_magnitude);
+    CPPUNIT_TEST(test_phase);
+    CPPUNIT_TEST(test_windowed);
+    CPPUNIT_TEST(test_real_signal);
+
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp(void) { write(0); }
+    void tearDown(void) { remove(filename); }
+
+protected:
+    void test_parts();
+    void test_magnitude();
+    void test_phase();
+    void test_windowed();
+    void test_real_signal();
+
+    void write(int windowsize);
+    void check_phase(int start, int n);
+};
+
+void TestPSFComplex::write(int windowsize) {
+    PSFWriter writer(filename);
+
+    int sweeptype = writer.add_type("sweep", TYPEID_DOUBLE);
+    int complextype = writer.add_type("complex", TYPEID_COMPLEXDOUBLE);
+    writer.add_sweep("freq", sweeptype);
+    writer.add_trace("out", complextype);
+    writer.add_trace("real", sweeptype);
+    if(windowsize)
+	writer.set_window_size(windowsize);
+
+    for(int i=0; i < npoints; i++) {
+	double f = frequency(i);
+	PSFDoubleScalar sweep(f), real(f);
+	PSFComplexDoubleScalar out(std::polar(gain, -2 * M_PI * f * delay));
+
+	std::vector<const PSFScalar *> values;
+	values.push_back(&out);
+	values.push_back(&real);
+	writer.append_point(sweep, values);
+    }
+}
+
+// Copy of the values of a vector which is deleted
+static std::vector<double> take(PSFVector *v) {
+    const PSFDoubleVector &dv = dynamic_cast<const PSFDoubleVector &>(*v);
+    std::vector<double> result(dv.begin(), dv.end());
+    delete v;
+    return result;
+}
+
+void TestPSFComplex::test_parts() {
+    PSFDataSet ds(filename);
+
+    std::vector<PSFComplexOutput> outputs;
+    outputs.push_back(COMPLEX_REAL);
+    outputs.push_back(COMPLEX_IMAG);
+    std::vector<PSFVector *> result = ds.get_signal_complex("out", outputs);
+    std::vector<double> re = take(result[0]), im = take(result[1]);
+
+    const PSFComplexDoubleVector &expected =
+	dynamic_cast<const PSFComplexDoubleVector &>(*ds.get_signal_vector("out"));
+
+    CPPUNIT_ASSERT_EQUAL((int)re.size(), npoints);
+    for(int i=0; i < npoints; i++) {
+	CPPUNIT_ASSERT_EQUAL(expected[i].real(), re[i]);
+	CPPUNIT_ASSERT_EQUAL(expected[i].imag(), im[i]);
+    }
+    delete &expected;
+}
+
+void TestPSFComplex::test_magnitude() {
+    PSFDataSet ds(filename);
+
+    std::vector<PSFComplexOutput> outputs;
+    outputs.push_back(COMPLEX_MAG);
+    outputs.push_back(COMPLEX_DB20);
+    std::vector<PSFVector *> result = ds.get_signal_complex("out", outputs, 100, 50);
+    std::vector<double> mag = take(result[0]), db = take(result[1]);
+
+    CPPUNIT_ASSERT_EQUAL((int)mag.size(), 50);
+    for(int i=0; i < 50; i++) {
+	CPPUNIT_ASSERT_DOUBLES_EQUAL(gain, mag[i], 1e-12);
+	CPPUNIT_ASSERT_DOUBLES_EQUAL(20 * log10(gain), db[i], 1e-9);
+    }
+}
+
+void TestPSFComplex::check_phase(int start, int n) {
+    PSFDataSet ds(filename);
+
+    std::vector<PSFComplexOutput> outputs;
+    outputs.push_back(COMPLEX_PHASE);
+    outputs.push_back(COMPLEX_PHASE_UNWRAPPED);
+    outputs.push_back(COMPLEX_GROUP_DELAY);
+    std::vector<PSFVector *> result = ds.get_signal_complex("out", outputs, start, n);
+    std::vector<double> phase = take(result[0]), unwrapped = take(result[1]), groupdelay = take(result[2]);
+
+    CPPUNIT_ASSERT_EQUAL((int)phase.size(), n);
+
+    // The first phase is within (-180, 180]
+    double offset = unwrapped[0] + 360 * frequency(start) * delay;
+
+    for(int i=0; i < n; i++) {
+	double expected = -360 * frequency(start + i) * delay;
+
+	CPPUNIT_ASSERT(phase[i] > -180 && phase[i] <= 180);
+	CPPUNIT_ASSERT_DOUBLES_EQUAL(0, remainder(phase[i] - expected, 360), 1e-6);
+	CPPUNIT_ASSERT_DOUBLES_EQUAL(expected + offset, unwrapped[i], 1e-6);
+	CPPUNIT_ASSERT_DOUBLES_EQUAL(delay, groupdelay[i], 1e-12);
+    }
+}
+
+void TestPSFComplex::test_phase() {
+    check_phase(0, npoints);
+    check_phase(1234, 2000);
+}
+
+void TestPSFComplex::test_windowed() {
+    write(512);
+    check_phase(0, npoints);
+    check_phase(4000, 1000);
+}
+
+void TestPSFComplex::test_real_signal() {
+    PSFDataSet ds(filename);
+
+    std::vector<PSFComplexOutput> outputs;
+    outputs.push_back(COMPLEX_IMAG);
+    outputs.push_back(COMPLEX_MAG);
+    std::vector<PSFVector *> result = ds.get_signal_complex("real", outputs, 10, 5);
+    std::vector<double> im = take(result[0]), mag = take(result[1]);
+
+    for(int i=0; i < 5; i++) {
+	CPPUNIT_ASSERT_EQUAL(0.0, im[i]);
+	CPPUNIT_ASSERT_EQUAL(frequency(10 + i), mag[i]);
+    }
+
+    CPPUNIT_ASSERT(take(ds.get_signal_complex("out", std::vector<PSFComplexOutput>(1, COMPLEX_MAG),
+					      npoints, 10)[0]).empty());
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestPSFComplex);
+
+int main(int argc, char *argv[]) {
+    // Create the event manager and test controller
+    CPPUNIT_NS::TestResult controller;
+
+    // Add a listener that colllects test result
+    CPPUNIT_NS::TestResultCollector result;
+    controller.addListener( &result );
+
+    // Add a listener that print dots as test run.
+    CPPUNIT_NS::BriefTestProgressListener progress;
+    controller.addListener( &progress );
+
+    // Add the top suite to the test runner
+    CPPUNIT_NS::TestRunner runner;
+    runner.addTest( CPPUNIT_NS::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( controller );
+
+    return result.wasSuccessful() ? 0 : 1;
+}
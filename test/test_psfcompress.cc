@@ -0,0 +1,244 @@
+// CppUnit unit test for reading gzip compressed PSF files
+
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include <zlib.h>
+
+#include <cppunit/TestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/BriefTestProgressListener.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+
+#include "psf.h"
+#include "psfdata.h"
+#include "psfwriter.h"
+
+static const char *filename = "test_psfcompress.psf";
+static const char *gzfilename = "test_psfcompress.psf.gz";
+
+// Enough points for several access points in the decompressed file
+static const int npoints = 700000;
+
+class TestPSFCompress : public CPPUNIT_NS::TestCase {
+    CPPUNIT_TEST_SUITE(TestPSFCompress);
+
+    CPPUNIT_TEST(test_gzip);
+    CPPUNIT_TEST(test_members);
+    CPPUNIT_TEST(test_bgzf);
+    CPPUNIT_TEST(test_truncated);
+    CPPUNIT_TEST(test_cache);
+
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp(void);
+    void tearDown(void) { psf_enable_stats(false); remove(filename); remove(gzfilename); }
+
+protected:
+    void test_gzip();
+    void test_members();
+    void test_bgzf();
+    void test_truncated();
+    void test_cache();
+
+    void write(int windowsize);
+    void check_values();
+};
+
+static std::vector<char> read_file(const char *name) {
+    std::vector<char> data;
+
+    FILE *f = fopen(name, "rb");
+    char buf[65536];
+    size_t n;
+    while((n = fread(buf, 1, sizeof(buf), f)) > 0)
+	data.insert(data.end(), buf, buf + n);
+    fclose(f);
+
+    return data;
+}
+
+static void write_file(const char *name, const std::vector<char> &data) {
+    FILE *f = fopen(name, "wb");
+    fwrite(&data[0], 1, data.size(), f);
+    fclose(f);
+}
+
+// Compress the data as one gzip member, with the BGZF extra field if bgzf is set
+static std::vector<char> gzip(const char *data, size_t len, bool bgzf) {
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 31, 8, Z_DEFAULT_STRATEGY);
+
+    unsigned char extra[6] = { 'B', 'C', 2, 0, 0, 0 };
+    gz_header header;
+    memset(&header, 0, sizeof(header));
+    if(bgzf) {
+	header.extra = extra;
+	header.extra_len = sizeof(extra);
+	deflateSetHeader(&strm, &header);
+    }
+
+    std::vector<char> result(deflateBound(&strm, len) + 64);
+    strm.next_in = (Bytef *)data;
+    strm.avail_in = len;
+    strm.next_out = (Bytef *)&result[0];
+    strm.avail_out = result.size();
+    deflate(&strm, Z_FINISH);
+    result.resize(result.size() - strm.avail_out);
+    deflateEnd(&strm);
+
+    if(bgzf) {
+	// Total member size minus one
+	result[16] = (result.size() - 1) & 0xff;
+	result[17] = (result.size() - 1) >> 8;
+    }
+
+    return result;
+}
+
+// Compress the file in members of membersize bytes
+static void compress(size_t membersize, bool bgzf) {
+    std::vector<char> data = read_file(filename), result;
+
+    for(size_t i=0; i < data.size(); i += membersize) {
+	std::vector<char> member = gzip(&data[i], std::min(membersize, data.size() - i), bgzf);
+	result.insert(result.end(), member.begin(), member.end());
+    }
+
+    write_file(gzfilename, result);
+}
+
+// Copy of the values of a vector which is deleted
+static std::vector<double> take(PSFVector *v) {
+    const PSFDoubleVector &dv = dynamic_cast<const PSFDoubleVector &>(*v);
+    std::vector<double> result(dv.begin(), dv.end());
+    delete v;
+    return result;
+}
+
+void TestPSFCompress::setUp(void) {
+    write(512);
+}
+
+void TestPSFCompress::write(int windowsize) {
+    PSFWriter writer(filename);
+
+    int sweeptype = writer.add_type("sweep", TYPEID_DOUBLE);
+    writer.add_sweep("time", sweeptype);
+    writer.add_trace("a", sweeptype);
+    writer.add_trace("b", sweeptype);
+    if(windowsize)
+	writer.set_window_size(windowsize);
+
+    for(int i=0; i < npoints; i++) {
+	double values[2] = { 2.0 * i, -1.0 * i };
+	writer.append_point(i, values);
+    }
+}
+
+// Decoded values of the compressed file equal the values of the file
+void TestPSFCompress::check_values() {
+    PSFDataSet ds(filename);
+    PSFDataSet gzds(gzfilename);
+
+    CPPUNIT_ASSERT_EQUAL(gzds.get_sweep_npoints(), npoints);
+    CPPUNIT_ASSERT(gzds.get_signal_names() == ds.get_signal_names());
+
+    // Ranges out of order, within and across access points
+    int starts[4] = { npoints - 1000, 10, npoints / 2, 300000 };
+    for(int i=0; i < 4; i++) {
+	std::vector<double> v = take(gzds.get_signal_vector("a", starts[i], 1000));
+	CPPUNIT_ASSERT(v == take(ds.get_signal_vector("a", starts[i], 1000)));
+    }
+
+    CPPUNIT_ASSERT(take(gzds.get_signal_vector("b")) == take(ds.get_signal_vector("b")));
+    CPPUNIT_ASSERT(take(gzds.get_sweep_values()) == take(ds.get_sweep_values()));
+}
+
+void TestPSFCompress::test_gzip() {
+    compress(1UL << 30, false);
+    check_values();
+}
+
+void TestPSFCompress::test_members() {
+    // Plain gzip members are found by decompressing the file
+    compress(3000000, false);
+    check_values();
+}
+
+void TestPSFCompress::test_bgzf() {
+    compress(65280, true);
+    check_values();
+
+    // A small range of a simple sweep only decompresses the members it needs
+    write(0);
+    compress(65280, true);
+    check_values();
+
+    psf_enable_stats(true);
+
+    PSFIOOptions options;
+    options.blocksize = 65536;
+    PSFDataSet ds(gzfilename, options);
+    std::vector<double> v = take(ds.get_signal_vector("b", npoints / 2, 10));
+
+    CPPUNIT_ASSERT_EQUAL(v[0], -1.0 * (npoints / 2));
+    CPPUNIT_ASSERT(ds.get_stats().read_bytes < 1000000);
+}
+
+void TestPSFCompress::test_truncated() {
+    compress(1UL << 30, false);
+
+    std::vector<char> data = read_file(gzfilename);
+    data.resize(data.size() / 2);
+    write_file(gzfilename, data);
+
+    CPPUNIT_ASSERT_THROW(PSFDataSet ds(gzfilename), InvalidFileError);
+}
+
+void TestPSFCompress::test_cache() {
+    compress(3000000, false);
+
+    psf_enable_stats(true);
+
+    // Decompressed blocks beyond the cache are dropped and decompressed again
+    PSFIOOptions options;
+    options.blocksize = 65536;
+    options.cachesize = 4 * 65536;
+    PSFDataSet ds(filename);
+    PSFDataSet gzds(gzfilename, options);
+
+    std::vector<double> expected = take(ds.get_signal_vector("b"));
+    CPPUNIT_ASSERT(take(gzds.get_signal_vector("b")) == expected);
+    uint64_t read_bytes = gzds.get_stats().read_bytes;
+    CPPUNIT_ASSERT(take(gzds.get_signal_vector("b")) == expected);
+    CPPUNIT_ASSERT(gzds.get_stats().read_bytes > read_bytes);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestPSFCompress);
+
+int main(int argc, char *argv[]) {
+    // Create the event manager and test controller
+    CPPUNIT_NS::TestResult controller;
+
+    // Add a listener that colllects test result
+    CPPUNIT_NS::TestResultCollector result;
+    controller.addListener( &result );
+
+    // Add a listener that print dots as test run.
+    CPPUNIT_NS::BriefTestProgressListener progress;
+    controller.addListener( &progress );
+
+    // Add the top suite to the test runner
+    CPPUNIT_NS::TestRunner runner;
+    runner.addTest( CPPUNIT_NS::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( controller );
+
+    return result.wasSuccessful() ? 0 : 1;
+}
@@ -0,0 +1,229 @@
+// CppUnit stress test for concurrent readers of one data set
+
+#include <stdio.h>
+#include <pthread.h>
+
+#include <algorithm>
+#include <sstream>
+#include <vector>
+
+#include <cppunit/TestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/BriefTestProgressListener.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+
+#include "psf.h"
+#include "psfdata.h"
+#include "psfwriter.h"
+
+static const char *filename = "test_psfconcurrent.psf";
+
+static const int ntraces = 40;
+static const int npoints = 20000;
+static const int nthreads = 8;
+static const int iterations = 100;
+
+class TestPSFConcurrent : public CPPUNIT_NS::TestCase {
+    CPPUNIT_TEST_SUITE(TestPSFConcurrent);
+
+    CPPUNIT_TEST(test_simple);
+    CPPUNIT_TEST(test_windowed);
+    CPPUNIT_TEST(test_pread);
+    CPPUNIT_TEST(test_file_cache);
+
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void tearDown(void) {
+	psf_enable_file_cache(0);
+	remove(filename);
+    }
+
+protected:
+    void test_simple();
+    void test_windowed();
+    void test_pread();
+    void test_file_cache();
+};
+
+static std::string trace_name(int j) {
+    std::stringstream name;
+    name << "t" << j;
+    return name.str();
+}
+
+static void write(int windowsize) {
+    PSFWriter writer(filename);
+
+    int sweeptype = writer.add_type("sweep", TYPEID_DOUBLE);
+    writer.add_sweep("time", sweeptype);
+    for(int j=0; j < ntraces; j++)
+	writer.add_trace(trace_name(j), sweeptype);
+    if(windowsize)
+	writer.set_window_size(windowsize);
+
+    std::vector<double> values(ntraces);
+    for(int i=0; i < npoints; i++) {
+	for(int j=0; j < ntraces; j++)
+	    values[j] = (i % 1000) * 0.25 - j;
+	writer.append_point(i * 1e-3, &values[0]);
+    }
+}
+
+// Signals read by a single thread from a data set of their own
+static std::vector<std::vector<double> > read_reference() {
+    PSFDataSet ds(filename);
+    std::vector<std::vector<double> > result;
+
+    for(int j=0; j < ntraces; j++) {
+	PSFDoubleVector *v = dynamic_cast<PSFDoubleVector *>(ds.get_signal_vector(trace_name(j)));
+	result.push_back(*v);
+	delete v;
+    }
+
+    return result;
+}
+
+//
+// Reader thread, extracts different signals and ranges of one data set, or
+// of a data set of its own if ds is NULL, and counts the mismatches
+//
+struct Reader {
+    const PSFDataSet *ds;
+    PSFIOOptions options;
+    const std::vector<std::vector<double> > *reference;
+    int id;
+    int errors;
+
+    void run();
+    static void *start(void *reader) { ((Reader *)reader)->run(); return NULL; }
+};
+
+void Reader::run() {
+    PSFDataSet *own = ds ? NULL : new PSFDataSet(filename, options);
+    const PSFDataSet &data = ds ? *ds : *own;
+    std::vector<double> out(npoints);
+
+    for(int k=0; k < iterations; k++) {
+	int j = (id * 7 + k) % ntraces;
+	int start = (id * 997 + k * 131) % npoints;
+	int n = std::min(1 + (k * 263) % 5000, npoints - start);
+	const std::vector<double> &ref = (*reference)[j];
+
+	try {
+	    switch(k % 3) {
+	    case 0: {
+		PSFDoubleVector *v = dynamic_cast<PSFDoubleVector *>(
+		    data.get_signal_vector(trace_name(j), start, n));
+		if(std::vector<double>(*v) != std::vector<double>(ref.begin() + start,
+								   ref.begin() + start + n))
+		    errors++;
+		delete v;
+		break;
+	    }
+	    case 1:
+		if(data.get_signal_into(trace_name(j), &out[0], out.size(), start, n) != n ||
+		   !std::equal(out.begin(), out.begin() + n, ref.begin() + start))
+		    errors++;
+		break;
+	    case 2: {
+		PSFSweepReduction r = data.get_signal_reduction(trace_name(j), start, n);
+		double max = *std::max_element(ref.begin() + start, ref.begin() + start + n);
+		if(r.npoints != n || r.max != max)
+		    errors++;
+		break;
+	    }
+	    }
+	} catch(...) {
+	    errors++;
+	}
+    }
+
+    delete own;
+}
+
+// Run the readers and check that all of them read the reference values
+static void run_readers(const PSFDataSet *ds, const PSFIOOptions &options) {
+    std::vector<std::vector<double> > reference = read_reference();
+
+    std::vector<Reader> readers(nthreads);
+    std::vector<pthread_t> threads(nthreads);
+
+    for(int i=0; i < nthreads; i++) {
+	readers[i].ds = ds;
+	readers[i].options = options;
+	readers[i].reference = &reference;
+	readers[i].id = i;
+	readers[i].errors = 0;
+	pthread_create(&threads[i], NULL, &Reader::start, &readers[i]);
+    }
+
+    for(int i=0; i < nthreads; i++) {
+	pthread_join(threads[i], NULL);
+	CPPUNIT_ASSERT_EQUAL(readers[i].errors, 0);
+    }
+}
+
+void TestPSFConcurrent::test_simple() {
+    write(0);
+
+    PSFDataSet ds(filename);
+    run_readers(&ds, PSFIOOptions());
+}
+
+// The window index is built by the first of the readers
+void TestPSFConcurrent::test_windowed() {
+    write(512);
+
+    PSFDataSet ds(filename);
+    run_readers(&ds, PSFIOOptions());
+}
+
+// Blocks are read by the readers that need them first
+void TestPSFConcurrent::test_pread() {
+    write(512);
+
+    PSFIOOptions options;
+    options.backend = IO_PREAD;
+    options.blocksize = 4096;
+
+    // Blocks are dropped while other readers load them
+    options.cachesize = 4 * 4096;
+
+    PSFDataSet ds(filename, options);
+    run_readers(&ds, options);
+}
+
+// Data sets of the same file opened by the readers share the cached file
+void TestPSFConcurrent::test_file_cache() {
+    write(512);
+
+    psf_enable_file_cache(1 << 20);
+    run_readers(NULL, PSFIOOptions());
+
+    CPPUNIT_ASSERT_EQUAL(psf_get_file_cache_stats().files, (uint64_t)1);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestPSFConcurrent);
+
+int main(int argc, char *argv[]) {
+    // Create the event manager and test controller
+    CPPUNIT_NS::TestResult controller;
+
+    // Add a listener that colllects test result
+    CPPUNIT_NS::TestResultCollector result;
+    controller.addListener( &result );
+
+    // Add a listener that print dots as test run.
+    CPPUNIT_NS::BriefTestProgressListener progress;
+    controller.addListener( &progress );
+
+    // Add the top suite to the test runner
+    CPPUNIT_NS::TestRunner runner;
+    runner.addTest( CPPUNIT_NS::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( controller );
+
+    return result.wasSuccessful() ? 0 : 1;
+}
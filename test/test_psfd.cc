@@ -0,0 +1,282 @@
+// CppUnit unit test for psfd and its client
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <vector>
+
+#include <cppunit/TestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/BriefTestProgressListener.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+
+#include "psf.h"
+#include "psfdata.h"
+#include "psfwriter.h"
+#include "psfclient.h"
+#include "psfserver.h"
+
+static const char *filename = "test_psfd.psf";
+static const char *socketname = "test_psfd.sock";
+
+static const int npoints = 3000;
+
+class TestPSFD : public CPPUNIT_NS::TestCase {
+    CPPUNIT_TEST_SUITE(TestPSFD);
+
+    CPPUNIT_TEST(test_names);
+    CPPUNIT_TEST(test_signal);
+    CPPUNIT_TEST(test_complex);
+    CPPUNIT_TEST(test_reduction);
+    CPPUNIT_TEST(test_errors);
+    CPPUNIT_TEST(test_nonswept);
+    CPPUNIT_TEST(test_paths);
+    CPPUNIT_TEST(test_clients);
+
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp(void);
+    void tearDown(void);
+
+protected:
+    void test_names();
+    void test_signal();
+    void test_complex();
+    void test_reduction();
+    void test_errors();
+    void test_nonswept();
+    void test_paths();
+    void test_clients();
+
+    PSFServer *m_server;
+    pthread_t m_thread;
+};
+
+static void *run_server(void *server) {
+    ((PSFServer *)server)->run();
+    return NULL;
+}
+
+void TestPSFD::setUp() {
+    {
+	PSFWriter writer(filename);
+
+	int sweeptype = writer.add_type("sweep", TYPEID_DOUBLE);
+	int complextype = writer.add_type("complex", TYPEID_COMPLEXDOUBLE);
+	writer.add_sweep("freq", sweeptype);
+	writer.add_trace("a", sweeptype);
+	writer.add_trace("z", complextype);
+	writer.set_window_size(512);
+
+	for(int i=0; i < npoints; i++) {
+	    PSFDoubleScalar a(0.5 * i);
+	    PSFComplexDoubleScalar z(PSFComplexDouble(i, -i));
+	    std::vector<const PSFScalar *> values;
+	    values.push_back(&a);
+	    values.push_back(&z);
+	    writer.append_point(PSFDoubleScalar(i), values);
+	}
+    }
+
+    psf_enable_file_cache(1 << 20);
+
+    m_server = new PSFServer(socketname);
+    pthread_create(&m_thread, NULL, run_server, m_server);
+}
+
+void TestPSFD::tearDown() {
+    m_server->stop();
+    pthread_join(m_thread, NULL);
+    delete m_server;
+
+    psf_enable_file_cache(0);
+    remove(filename);
+}
+
+void TestPSFD::test_names() {
+    PSFClient client(socketname);
+
+    std::vector<std::string> names = client.get_signal_names(filename);
+    CPPUNIT_ASSERT_EQUAL((int)names.size(), 2);
+    CPPUNIT_ASSERT_EQUAL(names[0], std::string("a"));
+
+    // Files are listed by their absolute path
+    std::vector<std::string> files = client.list();
+    CPPUNIT_ASSERT_EQUAL((int)files.size(), 1);
+    CPPUNIT_ASSERT(files[0][0] == '/');
+}
+
+void TestPSFD::test_signal() {
+    PSFClient client(socketname);
+
+    PSFSharedArray *a = client.get_signal(filename, "a");
+    CPPUNIT_ASSERT_EQUAL(a->size(), npoints);
+    CPPUNIT_ASSERT(!a->is_complex());
+    for(int i=0; i < npoints; i++)
+	CPPUNIT_ASSERT_EQUAL(a->data()[i], 0.5 * i);
+    delete a;
+
+    a = client.get_signal(filename, "a", 1000, 10);
+    CPPUNIT_ASSERT_EQUAL(a->size(), 10);
+    CPPUNIT_ASSERT_EQUAL(a->data()[9], 0.5 * 1009);
+    delete a;
+
+    a = client.get_signal(filename, "a", npoints, 10);
+    CPPUNIT_ASSERT_EQUAL(a->size(), 0);
+    delete a;
+
+    PSFSharedArray *x = client.get_sweep_values(filename, 5, 3);
+    CPPUNIT_ASSERT_EQUAL(x->size(), 3);
+    CPPUNIT_ASSERT_EQUAL(x->data()[0], 5.0);
+    delete x;
+}
+
+void TestPSFD::test_complex() {
+    PSFClient client(socketname);
+
+    PSFSharedArray *z = client.get_signal(filename, "z", 100, 50);
+    CPPUNIT_ASSERT(z->is_complex());
+    CPPUNIT_ASSERT_EQUAL(z->size(), 50);
+    CPPUNIT_ASSERT(z->complex_data()[1] == PSFComplexDouble(101, -101));
+    delete z;
+}
+
+void TestPSFD::test_reduction() {
+    PSFClient client(socketname);
+    PSFDataSet ds(filename);
+
+    PSFSweepReduction r = client.get_signal_reduction(filename, "a", 10, 100);
+    PSFSweepReduction ref = ds.get_signal_reduction("a", 10, 100);
+
+    CPPUNIT_ASSERT_EQUAL(r.npoints, ref.npoints);
+    CPPUNIT_ASSERT_EQUAL(r.max, ref.max);
+    CPPUNIT_ASSERT_EQUAL(r.rms, ref.rms);
+    CPPUNIT_ASSERT_EQUAL(r.integral, ref.integral);
+}
+
+// Errors of the server are thrown by the client and keep the connection
+void TestPSFD::test_errors() {
+    PSFClient client(socketname);
+
+    CPPUNIT_ASSERT_THROW(client.get_signal(filename, "nonexisting"), NotFound);
+    CPPUNIT_ASSERT_THROW(client.get_signal_reduction(filename, "z"), NotImplemented);
+    CPPUNIT_ASSERT_THROW(client.get_signal_names("nonexisting.psf"), FileOpenError);
+
+    PSFSharedArray *a = client.get_signal(filename, "a", 0, 1);
+    CPPUNIT_ASSERT_EQUAL(a->size(), 1);
+    delete a;
+
+    CPPUNIT_ASSERT_THROW(PSFClient("nonexisting.sock"), ConnectionError);
+}
+
+// Signals of files without a sweep are errors that keep the connection
+void TestPSFD::test_nonswept() {
+    PSFClient client(socketname);
+
+    CPPUNIT_ASSERT_EQUAL(client.get_signal_names("data/dcOp.dc")[0], std::string("vin"));
+    CPPUNIT_ASSERT_THROW(client.get_signal("data/dcOp.dc", "vout", 0, 10), NotImplemented);
+    CPPUNIT_ASSERT_THROW(client.get_sweep_values("data/dcOp.dc"), NotImplemented);
+    CPPUNIT_ASSERT_THROW(client.get_signal_reduction("data/dcOp.dc", "vout"), NotImplemented);
+
+    PSFSharedArray *a = client.get_signal(filename, "a", 0, 1);
+    CPPUNIT_ASSERT_EQUAL(a->size(), 1);
+    delete a;
+}
+
+// Relative paths are refused by the server, the socket is private
+void TestPSFD::test_paths() {
+    struct stat st;
+    CPPUNIT_ASSERT(stat(socketname, &st) == 0);
+    CPPUNIT_ASSERT_EQUAL((int)(st.st_mode & 0777), 0600);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socketname);
+    CPPUNIT_ASSERT(connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+
+    Message request, reply;
+    request.push_back("names");
+    request.push_back(filename);
+    send_message(sock, request);
+    CPPUNIT_ASSERT(recv_message(sock, reply));
+    CPPUNIT_ASSERT_EQUAL(reply[0], std::string("error"));
+    CPPUNIT_ASSERT_EQUAL(reply[1], std::string("FileOpenError"));
+
+    close(sock);
+
+    // Only stale sockets are replaced
+    CPPUNIT_ASSERT_THROW(new PSFServer(filename), ConnectionError);
+    CPPUNIT_ASSERT(stat(filename, &st) == 0);
+}
+
+struct ClientThread {
+    int errors;
+
+    static void *run(void *arg) {
+	ClientThread *thread = (ClientThread *)arg;
+
+	try {
+	    PSFClient client(socketname);
+
+	    for(int k=0; k < 50; k++) {
+		PSFSharedArray *a = client.get_signal(filename, "a", k * 10, 100);
+		if(a->size() != 100 || a->data()[99] != 0.5 * (k * 10 + 99))
+		    thread->errors++;
+		delete a;
+	    }
+	} catch(std::exception &) {
+	    thread->errors++;
+	}
+
+	return NULL;
+    }
+};
+
+void TestPSFD::test_clients() {
+    const int nclients = 8;
+
+    std::vector<ClientThread> clients(nclients);
+    std::vector<pthread_t> threads(nclients);
+
+    for(int i=0; i < nclients; i++) {
+	clients[i].errors = 0;
+	pthread_create(&threads[i], NULL, &ClientThread::run, &clients[i]);
+    }
+
+    for(int i=0; i < nclients; i++) {
+	pthread_join(threads[i], NULL);
+	CPPUNIT_ASSERT_EQUAL(clients[i].errors, 0);
+    }
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestPSFD);
+
+int main(int argc, char *argv[]) {
+    // Create the event manager and test controller
+    CPPUNIT_NS::TestResult controller;
+
+    // Add a listener that colllects test result
+    CPPUNIT_NS::TestResultCollector result;
+    controller.addListener( &result );
+
+    // Add a listener that print dots as test run.
+    CPPUNIT_NS::BriefTestProgressListener progress;
+    controller.addListener( &progress );
+
+    // Add the top suite to the test runner
+    CPPUNIT_NS::TestRunner runner;
+    runner.addTest( CPPUNIT_NS::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( controller );
+
+    return result.wasSuccessful() ? 0 : 1;
+}
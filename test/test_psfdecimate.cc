@@ -0,0 +1,221 @@
+// CppUnit unit test for decimation and the min/max pyramid
+
+#include <stdio.h>
+#include <unistd.h>
+#include <math.h>
+
+#include <cppunit/TestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/BriefTestProgressListener.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+
+#include "psf.h"
+#include "psfwriter.h"
+#include "psfpyramid.h"
+
+static const char *filename = "test_psfdecimate.psf";
+static const char *pyrfilename = "test_psfdecimate.pyr";
+static const int npoints = 100000;
+
+class TestPSFDecimate : public CPPUNIT_NS::TestCase {
+    CPPUNIT_TEST_SUITE(TestPSFDecimate);
+
+    CPPUNIT_TEST(test_minmax);
+    CPPUNIT_TEST(test_range);
+    CPPUNIT_TEST(test_lttb);
+    CPPUNIT_TEST(test_pyramid);
+    CPPUNIT_TEST(test_pyramid_file);
+    CPPUNIT_TEST(test_descending);
+
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp(void);
+    void tearDown(void) { remove(filename); remove(pyrfilename); }
+
+protected:
+    void test_minmax();
+    void test_range();
+    void test_lttb();
+    void test_pyramid();
+    void test_pyramid_file();
+    void test_descending();
+};
+
+// A sawtooth with a period of 1000 points sampled at x = i
+static double sawtooth(int i) {
+    return (i % 1000) / 1000.0;
+}
+
+void TestPSFDecimate::setUp(void) {
+    PSFWriter writer(filename);
+
+    int sweeptype = writer.add_type("sweep", TYPEID_DOUBLE);
+    writer.add_sweep("time", sweeptype);
+    writer.add_trace("saw", sweeptype);
+    writer.set_window_size(4096);
+
+    for(int i=0; i < npoints; i++) {
+	double value = sawtooth(i);
+	writer.append_point(i, &value);
+    }
+}
+
+void TestPSFDecimate::test_minmax() {
+    PSFDataSet ds(filename);
+
+    PSFDecimation d = ds.get_signal_decimated("saw", 0, npoints, 100);
+
+    CPPUNIT_ASSERT_EQUAL(d.x.size(), (size_t)100);
+    for(int i=0; i < 100; i++) {
+	CPPUNIT_ASSERT_EQUAL(d.x[i], i * 1000.0);
+	CPPUNIT_ASSERT_EQUAL(d.min[i], 0.0);
+	CPPUNIT_ASSERT_EQUAL(d.max[i], 0.999);
+    }
+}
+
+void TestPSFDecimate::test_range() {
+    PSFDataSet ds(filename);
+
+    // Points 1500 to 2500 in 4 buckets of 250 points
+    PSFDecimation d = ds.get_signal_decimated("saw", 1500, 2499.5, 4);
+
+    CPPUNIT_ASSERT_EQUAL(d.x.size(), (size_t)4);
+    CPPUNIT_ASSERT_EQUAL(d.x[0], 1500.0);
+    CPPUNIT_ASSERT_EQUAL(d.min[0], 0.5);
+    CPPUNIT_ASSERT_EQUAL(d.max[1], 0.999);
+    CPPUNIT_ASSERT_EQUAL(d.min[2], 0.0);
+    CPPUNIT_ASSERT_EQUAL(d.max[3], 0.499);
+
+    // Empty buckets are left out
+    d = ds.get_signal_decimated("saw", 10, 12, 100);
+    CPPUNIT_ASSERT_EQUAL(d.x.size(), (size_t)3);
+
+    // Outside the sweep
+    CPPUNIT_ASSERT(ds.get_signal_decimated("saw", -10, -5, 100).x.empty());
+
+    CPPUNIT_ASSERT_THROW(ds.get_signal_decimated("nonexisting", 0, 1, 10), NotFound);
+}
+
+void TestPSFDecimate::test_lttb() {
+    PSFDataSet ds(filename);
+
+    PSFDecimation d = ds.get_signal_decimated("saw", 0, npoints, 200, DECIMATE_LTTB);
+
+    // First and last point and one point per bucket
+    CPPUNIT_ASSERT_EQUAL(d.x.size(), (size_t)202);
+    CPPUNIT_ASSERT_EQUAL(d.x.front(), 0.0);
+    CPPUNIT_ASSERT_EQUAL(d.x.back(), npoints - 1.0);
+
+    for(unsigned int i=0; i < d.x.size(); i++) {
+	CPPUNIT_ASSERT_EQUAL(d.min[i], sawtooth((int)d.x[i]));
+	CPPUNIT_ASSERT_EQUAL(d.min[i], d.max[i]);
+	if(i > 0)
+	    CPPUNIT_ASSERT(d.x[i] > d.x[i - 1]);
+    }
+
+    // The sawtooth peaks are selected
+    CPPUNIT_ASSERT_EQUAL(d.min[2], 0.999);
+}
+
+void TestPSFDecimate::test_pyramid() {
+    PSFDataSet ds(filename);
+    PSFPyramid pyramid(ds, "saw", pyrfilename);
+
+    CPPUNIT_ASSERT(pyramid.is_built());
+    CPPUNIT_ASSERT(pyramid.get_nlevels() > 1);
+
+    PSFDecimation d = pyramid.get_decimated(0, npoints, 50);
+    CPPUNIT_ASSERT_EQUAL(d.x.size(), (size_t)50);
+    for(int i=0; i < 50; i++) {
+	CPPUNIT_ASSERT_EQUAL(d.min[i], 0.0);
+	CPPUNIT_ASSERT_EQUAL(d.max[i], 0.999);
+    }
+
+    // Narrow ranges are decimated from the data set
+    PSFDecimation exact = ds.get_signal_decimated("saw", 1500, 1600, 4);
+    d = pyramid.get_decimated(1500, 1600, 4);
+    CPPUNIT_ASSERT(d.x == exact.x && d.min == exact.min && d.max == exact.max);
+}
+
+void TestPSFDecimate::test_pyramid_file() {
+    PSFDataSet ds(filename);
+
+    CPPUNIT_ASSERT(PSFPyramid(ds, "saw", pyrfilename).is_built());
+    CPPUNIT_ASSERT(!PSFPyramid(ds, "saw", pyrfilename).is_built());
+
+    // Not used for another signal
+    CPPUNIT_ASSERT_THROW(PSFPyramid(ds, "nonexisting", pyrfilename), NotFound);
+
+    PSFPyramid pyramid(ds, "saw", pyrfilename);
+    PSFDecimation d = pyramid.get_decimated(0, npoints, 10);
+    CPPUNIT_ASSERT_EQUAL(d.x.size(), (size_t)10);
+    CPPUNIT_ASSERT_EQUAL(d.max[9], 0.999);
+
+    // Default file name
+    PSFPyramid defaultpyramid(ds, "saw");
+    CPPUNIT_ASSERT_EQUAL(defaultpyramid.get_filename(), std::string(filename) + ".saw.pyr");
+    CPPUNIT_ASSERT(access(defaultpyramid.get_filename().c_str(), R_OK) == 0);
+    remove(defaultpyramid.get_filename().c_str());
+}
+
+void TestPSFDecimate::test_descending() {
+    {
+	PSFWriter writer(filename);
+
+	int sweeptype = writer.add_type("sweep", TYPEID_DOUBLE);
+	writer.add_sweep("temp", sweeptype);
+	writer.add_trace("saw", sweeptype);
+	writer.set_window_size(4096);
+
+	for(int i=0; i < npoints; i++) {
+	    double value = sawtooth(i);
+	    writer.append_point(npoints - 1 - i, &value);
+	}
+    }
+
+    PSFDataSet ds(filename);
+
+    // Sweep values 97500 down to 96501 are points 2499 down to 1500
+    PSFDecimation d = ds.get_signal_decimated("saw", npoints - 2500, npoints - 1501, 4);
+
+    CPPUNIT_ASSERT_EQUAL(d.x.size(), (size_t)4);
+    CPPUNIT_ASSERT_EQUAL(d.x[0], npoints - 1501.0);
+    CPPUNIT_ASSERT_EQUAL(d.min[0], 0.5);
+    CPPUNIT_ASSERT_EQUAL(d.max[1], 0.999);
+    CPPUNIT_ASSERT_EQUAL(d.min[2], 0.0);
+    CPPUNIT_ASSERT_EQUAL(d.max[3], 0.499);
+
+    CPPUNIT_ASSERT_EQUAL(ds.get_signal_decimated("saw", 10, 12, 100).x.size(), (size_t)3);
+    CPPUNIT_ASSERT(ds.get_signal_decimated("saw", -10, -5, 100).x.empty());
+
+    // The pyramid falls back to the data set
+    PSFPyramid pyramid(ds, "saw", pyrfilename);
+    PSFDecimation exact = ds.get_signal_decimated("saw", 0, npoints, 50);
+    d = pyramid.get_decimated(0, npoints, 50);
+    CPPUNIT_ASSERT(d.x == exact.x && d.min == exact.min && d.max == exact.max);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestPSFDecimate);
+
+int main(int argc, char *argv[]) {
+    // Create the event manager and test controller
+    CPPUNIT_NS::TestResult controller;
+
+    // Add a listener that colllects test result
+    CPPUNIT_NS::TestResultCollector result;
+    controller.addListener( &result );
+
+    // Add a listener that print dots as test run.
+    CPPUNIT_NS::BriefTestProgressListener progress;
+    controller.addListener( &progress );
+
+    // Add the top suite to the test runner
+    CPPUNIT_NS::TestRunner runner;
+    runner.addTest( CPPUNIT_NS::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( controller );
+
+    return result.wasSuccessful() ? 0 : 1;
+}
@@ -0,0 +1,203 @@
+// CppUnit unit test for expressions over signals
+
+#include <stdio.h>
+#include <math.h>
+
+#include <vector>
+
+#include <cppunit/TestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/BriefTestProgressListener.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+
+#include "psf.h"
+#include "psfdata.h"
+#include "psfwriter.h"
+
+static const char *filename = "test_psfexpression.psf";
+
+// More points than are evaluated in one block
+static const int npoints = 10000;
+
+class TestPSFExpression : public CPPUNIT_NS::TestCase {
+    CPPUNIT_TEST_SUITE(TestPSFExpression);
+
+    CPPUNIT_TEST(test_arithmetic);
+    CPPUNIT_TEST(test_precedence);
+    CPPUNIT_TEST(test_functions);
+    CPPUNIT_TEST(test_complex);
+    CPPUNIT_TEST(test_range);
+    CPPUNIT_TEST(test_errors);
+
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp(void);
+    void tearDown(void) { remove(filename); }
+
+protected:
+    void test_arithmetic();
+    void test_precedence();
+    void test_functions();
+    void test_complex();
+    void test_range();
+    void test_errors();
+
+    std::vector<double> evaluate(const std::string &expression);
+};
+
+static double outp(int i) { return 1 + 0.001 * i; }
+static double outn(int i) { return 0.5 - 0.0002 * i; }
+static PSFComplexDouble ac(int i) { return PSFComplexDouble(1 + i, -2.0 * i); }
+
+void TestPSFExpression::setUp(void) {
+    PSFWriter writer(filename);
+
+    int sweeptype = writer.add_type("sweep", TYPEID_DOUBLE);
+    int complextype = writer.add_type("complex", TYPEID_COMPLEXDOUBLE);
+    writer.add_sweep("time", sweeptype);
+    writer.add_trace("outp", sweeptype);
+    writer.add_trace("outn", sweeptype);
+    writer.add_trace("I0.vdd:p", sweeptype);
+    writer.add_trace("ac", complextype);
+
+    for(int i=0; i < npoints; i++) {
+	PSFDoubleScalar sweep(i), a(outp(i)), b(outn(i)), c(-0.01);
+	PSFComplexDoubleScalar d(ac(i));
+
+	std::vector<const PSFScalar *> values;
+	values.push_back(&a);
+	values.push_back(&b);
+	values.push_back(&c);
+	values.push_back(&d);
+	writer.append_point(sweep, values);
+    }
+}
+
+std::vector<double> TestPSFExpression::evaluate(const std::string &expression) {
+    PSFDataSet ds(filename);
+
+    PSFVector *v = ds.get_signal_expression(expression);
+    const PSFDoubleVector &dv = dynamic_cast<const PSFDoubleVector &>(*v);
+    std::vector<double> result(dv.begin(), dv.end());
+    delete v;
+
+    return result;
+}
+
+void TestPSFExpression::test_arithmetic() {
+    std::vector<double> diff = evaluate("V(outp) - V(outn)");
+    std::vector<double> power = evaluate("I(I0.vdd:p)*V(outp)");
+    std::vector<double> quoted = evaluate("\"outp\" / outn + 2");
+
+    CPPUNIT_ASSERT_EQUAL((int)diff.size(), npoints);
+    for(int i=0; i < npoints; i++) {
+	CPPUNIT_ASSERT_EQUAL(outp(i) - outn(i), diff[i]);
+	CPPUNIT_ASSERT_EQUAL(-0.01 * outp(i), power[i]);
+	CPPUNIT_ASSERT_EQUAL(outp(i) / outn(i) + 2, quoted[i]);
+    }
+}
+
+void TestPSFExpression::test_precedence() {
+    std::vector<double> v = evaluate("-2^2 + 3*outp - (1 - 4) / 2 + 2^3^2 + 1e-3");
+
+    for(int i=0; i < npoints; i += 97)
+	CPPUNIT_ASSERT_DOUBLES_EQUAL(-4 + 3 * outp(i) + 1.5 + 512 + 1e-3, v[i], 1e-9);
+}
+
+void TestPSFExpression::test_functions() {
+    std::vector<double> db = evaluate("db20(outp/outn)");
+    std::vector<double> root = evaluate("sqrt(abs(outn)) + exp(log(outp))");
+
+    for(int i=0; i < npoints; i += 89) {
+	CPPUNIT_ASSERT_DOUBLES_EQUAL(20 * log10(fabs(outp(i) / outn(i))), db[i], 1e-9);
+	CPPUNIT_ASSERT_DOUBLES_EQUAL(sqrt(fabs(outn(i))) + outp(i), root[i], 1e-9);
+    }
+}
+
+void TestPSFExpression::test_complex() {
+    PSFDataSet ds(filename);
+
+    // Complex arithmetic with a real signal
+    PSFVector *v = ds.get_signal_expression("ac * outp / (ac + 1)");
+    const PSFComplexDoubleVector &cv = dynamic_cast<const PSFComplexDoubleVector &>(*v);
+    for(int i=0; i < npoints; i += 101) {
+	PSFComplexDouble expected = ac(i) * outp(i) / (ac(i) + 1.0);
+	CPPUNIT_ASSERT_DOUBLES_EQUAL(expected.real(), cv[i].real(), 1e-9);
+	CPPUNIT_ASSERT_DOUBLES_EQUAL(expected.imag(), cv[i].imag(), 1e-9);
+    }
+    delete v;
+
+    // Real valued functions of complex values
+    std::vector<double> db = evaluate("db20(ac) - phase(ac) + imag(ac)");
+    for(int i=0; i < npoints; i += 101) {
+	double expected = 20 * log10(abs(ac(i))) - arg(ac(i)) * 180 / M_PI + ac(i).imag();
+	CPPUNIT_ASSERT_DOUBLES_EQUAL(expected, db[i], 1e-9);
+    }
+}
+
+void TestPSFExpression::test_range() {
+    PSFDataSet ds(filename);
+
+    PSFVector *v = ds.get_signal_expression("outp + outn", 5000, 4200);
+    const PSFDoubleVector &dv = dynamic_cast<const PSFDoubleVector &>(*v);
+
+    CPPUNIT_ASSERT_EQUAL((int)dv.size(), 4200);
+    for(int i=0; i < 4200; i++)
+	CPPUNIT_ASSERT_EQUAL(outp(5000 + i) + outn(5000 + i), dv[i]);
+    delete v;
+
+    // Range clipped to the sweep
+    v = ds.get_signal_expression("2", npoints - 3, 10);
+    CPPUNIT_ASSERT_EQUAL((int)dynamic_cast<const PSFDoubleVector &>(*v).size(), 3);
+    CPPUNIT_ASSERT_EQUAL(dynamic_cast<const PSFDoubleVector &>(*v)[2], 2.0);
+    delete v;
+}
+
+void TestPSFExpression::test_errors() {
+    PSFDataSet ds(filename);
+
+    CPPUNIT_ASSERT_THROW(ds.get_signal_expression("outp +"), InvalidExpression);
+    CPPUNIT_ASSERT_THROW(ds.get_signal_expression("(outp"), InvalidExpression);
+    CPPUNIT_ASSERT_THROW(ds.get_signal_expression("foo(outp)"), InvalidExpression);
+    CPPUNIT_ASSERT_THROW(ds.get_signal_expression("outp outn"), InvalidExpression);
+    CPPUNIT_ASSERT_THROW(ds.get_signal_expression("V(missing)"), NotFound);
+
+    // Deep nesting is rejected, not a stack overflow
+    CPPUNIT_ASSERT_THROW(ds.get_signal_expression(std::string(100000, '(') + "outp" +
+						  std::string(100000, ')')), InvalidExpression);
+    CPPUNIT_ASSERT_THROW(ds.get_signal_expression(std::string(100000, '-') + "outp"),
+			 InvalidExpression);
+    std::string functions;
+    for(int i=0; i < 100000; i++)
+	functions += "abs(";
+    CPPUNIT_ASSERT_THROW(ds.get_signal_expression(functions + "outp"), InvalidExpression);
+
+    PSFVector *v = ds.get_signal_expression(std::string(100, '(') + "-outp" + std::string(100, ')'));
+    CPPUNIT_ASSERT_EQUAL((int)dynamic_cast<const PSFDoubleVector &>(*v).size(), npoints);
+    delete v;
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestPSFExpression);
+
+int main(int argc, char *argv[]) {
+    // Create the event manager and test controller
+    CPPUNIT_NS::TestResult controller;
+
+    // Add a listener that colllects test result
+    CPPUNIT_NS::TestResultCollector result;
+    controller.addListener( &result );
+
+    // Add a listener that print dots as test run.
+    CPPUNIT_NS::BriefTestProgressListener progress;
+    controller.addListener( &progress );
+
+    // Add the top suite to the test runner
+    CPPUNIT_NS::TestRunner runner;
+    runner.addTest( CPPUNIT_NS::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( controller );
+
+    return result.wasSuccessful() ? 0 : 1;
+}
@@ -0,0 +1,202 @@
+// CppUnit unit test for the process wide file cache
+
+#include <dirent.h>
+#include <stdio.h>
+
+#include <vector>
+
+#include <cppunit/TestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/BriefTestProgressListener.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+
+#include "psf.h"
+#include "psfdata.h"
+#include "psfwriter.h"
+
+static const char *filename = "test_psffilecache.psf";
+
+class TestPSFFileCache : public CPPUNIT_NS::TestCase {
+    CPPUNIT_TEST_SUITE(TestPSFFileCache);
+
+    CPPUNIT_TEST(test_shared);
+    CPPUNIT_TEST(test_modified);
+    CPPUNIT_TEST(test_eviction);
+    CPPUNIT_TEST(test_disabled);
+    CPPUNIT_TEST(test_descriptors);
+
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp(void) {
+	psf_enable_file_cache(1 << 20);
+	psf_clear_file_cache();
+    }
+    void tearDown(void) {
+	psf_enable_file_cache(0);
+	remove(filename);
+    }
+
+protected:
+    void test_shared();
+    void test_modified();
+    void test_eviction();
+    void test_disabled();
+    void test_descriptors();
+};
+
+static void write(int npoints) {
+    PSFWriter writer(filename);
+
+    int sweeptype = writer.add_type("sweep", TYPEID_DOUBLE);
+    writer.add_sweep("time", sweeptype);
+    writer.add_trace("a", sweeptype);
+    writer.add_trace("b", sweeptype);
+
+    for(int i=0; i < npoints; i++) {
+	double values[] = {1.0 * i, -1.0 * i};
+	writer.append_point(0.1 * i, values);
+    }
+}
+
+static double get_last(const PSFDataSet &ds, const char *name) {
+    PSFDoubleVector *v = dynamic_cast<PSFDoubleVector *>(ds.get_signal_vector(name));
+    double result = v->back();
+    delete v;
+
+    return result;
+}
+
+// Data sets of the same file share one parsed file that stays cached after
+// they are closed
+void TestPSFFileCache::test_shared() {
+    write(100);
+
+    PSFFileCacheStats before = psf_get_file_cache_stats();
+    {
+	PSFDataSet ds1(filename);
+	PSFDataSet ds2(filename);
+
+	CPPUNIT_ASSERT_EQUAL(get_last(ds1, "a"), 99.0);
+	CPPUNIT_ASSERT_EQUAL(get_last(ds2, "b"), -99.0);
+
+	ds1.close();
+	CPPUNIT_ASSERT_EQUAL(get_last(ds2, "a"), 99.0);
+    }
+    PSFFileCacheStats after = psf_get_file_cache_stats();
+
+    CPPUNIT_ASSERT_EQUAL(after.misses - before.misses, (uint64_t)1);
+    CPPUNIT_ASSERT_EQUAL(after.hits - before.hits, (uint64_t)1);
+    CPPUNIT_ASSERT_EQUAL(after.files, (uint64_t)1);
+    CPPUNIT_ASSERT(after.bytes > 0);
+
+    PSFDataSet ds(filename);
+    CPPUNIT_ASSERT_EQUAL(psf_get_file_cache_stats().hits - after.hits, (uint64_t)1);
+
+    psf_clear_file_cache();
+    CPPUNIT_ASSERT_EQUAL(psf_get_file_cache_stats().files, (uint64_t)1);
+    ds.close();
+    psf_clear_file_cache();
+    CPPUNIT_ASSERT_EQUAL(psf_get_file_cache_stats().files, (uint64_t)0);
+}
+
+// A rewritten file is parsed again
+void TestPSFFileCache::test_modified() {
+    write(100);
+    {
+	PSFDataSet ds(filename);
+	CPPUNIT_ASSERT_EQUAL(ds.get_sweep_npoints(), 100);
+    }
+
+    remove(filename);
+    write(200);
+
+    PSFFileCacheStats before = psf_get_file_cache_stats();
+    PSFDataSet ds(filename);
+    CPPUNIT_ASSERT_EQUAL(ds.get_sweep_npoints(), 200);
+    CPPUNIT_ASSERT_EQUAL(get_last(ds, "a"), 199.0);
+    CPPUNIT_ASSERT_EQUAL(psf_get_file_cache_stats().misses - before.misses, (uint64_t)1);
+}
+
+// Unused files are closed when the cache is full, files in use are kept
+void TestPSFFileCache::test_eviction() {
+    write(100);
+
+    psf_enable_file_cache(1);
+
+    PSFFileCacheStats before = psf_get_file_cache_stats();
+    {
+	PSFDataSet ds(filename);
+	CPPUNIT_ASSERT_EQUAL(psf_get_file_cache_stats().files, (uint64_t)1);
+	CPPUNIT_ASSERT_EQUAL(get_last(ds, "a"), 99.0);
+    }
+    PSFFileCacheStats after = psf_get_file_cache_stats();
+
+    CPPUNIT_ASSERT_EQUAL(after.evictions - before.evictions, (uint64_t)1);
+    CPPUNIT_ASSERT_EQUAL(after.files, (uint64_t)0);
+    CPPUNIT_ASSERT_EQUAL(after.bytes, (uint64_t)0);
+}
+
+void TestPSFFileCache::test_disabled() {
+    write(100);
+
+    psf_enable_file_cache(0);
+    CPPUNIT_ASSERT(!psf_file_cache_enabled());
+
+    PSFFileCacheStats before = psf_get_file_cache_stats();
+    PSFDataSet ds(filename);
+    CPPUNIT_ASSERT_EQUAL(get_last(ds, "b"), -99.0);
+    CPPUNIT_ASSERT_EQUAL(psf_get_file_cache_stats().misses, before.misses);
+    CPPUNIT_ASSERT_EQUAL(psf_get_file_cache_stats().files, (uint64_t)0);
+}
+
+static int count_descriptors() {
+    int n = 0;
+
+    DIR *dir = opendir("/proc/self/fd");
+    while(readdir(dir))
+	n++;
+    closedir(dir);
+
+    return n;
+}
+
+// A cached file keeps one descriptor, lookups close the descriptors they open
+void TestPSFFileCache::test_descriptors() {
+    write(100);
+
+    int before = count_descriptors();
+    {
+	PSFDataSet ds1(filename);
+	PSFDataSet ds2(filename);
+	CPPUNIT_ASSERT_EQUAL(count_descriptors(), before + 1);
+    }
+    CPPUNIT_ASSERT_THROW(PSFDataSet ds("nonexisting.psf"), FileOpenError);
+
+    psf_clear_file_cache();
+    CPPUNIT_ASSERT_EQUAL(count_descriptors(), before);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestPSFFileCache);
+
+int main(int argc, char *argv[]) {
+    // Create the event manager and test controller
+    CPPUNIT_NS::TestResult controller;
+
+    // Add a listener that colllects test result
+    CPPUNIT_NS::TestResultCollector result;
+    controller.addListener( &result );
+
+    // Add a listener that print dots as test run.
+    CPPUNIT_NS::BriefTestProgressListener progress;
+    controller.addListener( &progress );
+
+    // Add the top suite to the test runner
+    CPPUNIT_NS::TestRunner runner;
+    runner.addTest( CPPUNIT_NS::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( controller );
+
+    return result.wasSuccessful() ? 0 : 1;
+}
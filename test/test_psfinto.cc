@@ -0,0 +1,203 @@
+// CppUnit unit test for decoding into caller arrays
+
+#include <stdio.h>
+
+#include <vector>
+
+#include <cppunit/TestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/BriefTestProgressListener.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+
+#include "psf.h"
+#include "psfdata.h"
+#include "psfwriter.h"
+
+static const char *filename = "test_psfinto.psf";
+
+static const int npoints = 2500;
+
+class TestPSFInto : public CPPUNIT_NS::TestCase {
+    CPPUNIT_TEST_SUITE(TestPSFInto);
+
+    CPPUNIT_TEST(test_simple);
+    CPPUNIT_TEST(test_windowed);
+    CPPUNIT_TEST(test_capacity);
+    CPPUNIT_TEST(test_complex);
+    CPPUNIT_TEST(test_errors);
+    CPPUNIT_TEST(test_nonswept);
+
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void tearDown(void) { remove(filename); }
+
+protected:
+    void test_simple();
+    void test_windowed();
+    void test_capacity();
+    void test_complex();
+    void test_errors();
+    void test_nonswept();
+
+    void write(int windowsize);
+    void check();
+};
+
+void TestPSFInto::write(int windowsize) {
+    PSFWriter writer(filename);
+
+    int sweeptype = writer.add_type("sweep", TYPEID_DOUBLE);
+    int inttype = writer.add_type("count", TYPEID_INT32);
+    int complextype = writer.add_type("complex", TYPEID_COMPLEXDOUBLE);
+    writer.add_sweep("time", sweeptype);
+    writer.add_trace("a", sweeptype);
+    writer.add_trace("z", complextype);
+    writer.add_trace("n", inttype);
+    if(windowsize)
+	writer.set_window_size(windowsize);
+
+    for(int i=0; i < npoints; i++) {
+	PSFDoubleScalar a(0.5 * i);
+	PSFComplexDoubleScalar z(PSFComplexDouble(i, -2.0 * i));
+	PSFInt32Scalar n(7 - i);
+	std::vector<const PSFScalar *> values;
+	values.push_back(&a);
+	values.push_back(&z);
+	values.push_back(&n);
+	writer.append_point(PSFDoubleScalar(i * 1e-3), values);
+    }
+}
+
+// Whole signals and ranges agree with the decoded vectors
+void TestPSFInto::check() {
+    PSFDataSet ds(filename);
+
+    CPPUNIT_ASSERT_EQUAL(ds.get_signal_size("a"), npoints);
+
+    std::vector<double> a(npoints), n(npoints), x(npoints);
+    CPPUNIT_ASSERT_EQUAL(ds.get_signal_into("a", &a[0], a.size()), npoints);
+    CPPUNIT_ASSERT_EQUAL(ds.get_sweep_values_into(&x[0], x.size()), npoints);
+
+    PSFDoubleVector *ref = dynamic_cast<PSFDoubleVector *>(ds.get_signal_vector("a"));
+    PSFDoubleVector *xref = dynamic_cast<PSFDoubleVector *>(ds.get_sweep_values());
+    for(int i=0; i < npoints; i++) {
+	CPPUNIT_ASSERT_EQUAL(a[i], ref->at(i));
+	CPPUNIT_ASSERT_EQUAL(x[i], xref->at(i));
+    }
+    delete ref;
+    delete xref;
+
+    // Several signals from a range that starts inside a window
+    int start = 301, count = 1700;
+    CPPUNIT_ASSERT_EQUAL(ds.get_signal_size("n", start, count), count);
+
+    std::vector<std::string> names;
+    names.push_back("n");
+    names.push_back("a");
+    double *outs[] = {&n[0], &a[0]};
+    CPPUNIT_ASSERT_EQUAL(ds.get_signals_into(names, outs, npoints, start, count), count);
+
+    for(int i=0; i < count; i++) {
+	CPPUNIT_ASSERT_EQUAL(n[i], 7.0 - (start + i));
+	CPPUNIT_ASSERT_EQUAL(a[i], 0.5 * (start + i));
+    }
+}
+
+void TestPSFInto::test_simple() {
+    write(0);
+    check();
+}
+
+void TestPSFInto::test_windowed() {
+    write(512);
+    check();
+}
+
+// Ranges are clipped to the points and to the capacity of the arrays
+void TestPSFInto::test_capacity() {
+    write(512);
+
+    PSFDataSet ds(filename);
+
+    CPPUNIT_ASSERT_EQUAL(ds.get_signal_size("a", npoints - 10, 100), 10);
+    CPPUNIT_ASSERT_EQUAL(ds.get_signal_size("a", npoints + 10, 100), 0);
+
+    std::vector<double> a(20, -1.0);
+    CPPUNIT_ASSERT_EQUAL(ds.get_signal_into("a", &a[0], 16, 1000, 100), 16);
+    for(int i=0; i < 16; i++)
+	CPPUNIT_ASSERT_EQUAL(a[i], 0.5 * (1000 + i));
+    CPPUNIT_ASSERT_EQUAL(a[16], -1.0);
+
+    CPPUNIT_ASSERT_EQUAL(ds.get_signal_into("a", &a[0], a.size(), npoints - 5, 100), 5);
+    CPPUNIT_ASSERT_EQUAL(a[4], 0.5 * (npoints - 1));
+
+    CPPUNIT_ASSERT_EQUAL(ds.get_signal_into("a", &a[0], 0), 0);
+}
+
+void TestPSFInto::test_complex() {
+    write(0);
+
+    PSFDataSet ds(filename);
+
+    std::vector<PSFComplexDouble> z(npoints), a(npoints);
+    CPPUNIT_ASSERT_EQUAL(ds.get_signal_into("z", &z[0], z.size()), npoints);
+    CPPUNIT_ASSERT_EQUAL(ds.get_signal_into("a", &a[0], a.size(), 10, 5), 5);
+
+    for(int i=0; i < npoints; i++)
+	CPPUNIT_ASSERT(z[i] == PSFComplexDouble(i, -2.0 * i));
+    CPPUNIT_ASSERT(a[0] == PSFComplexDouble(5.0, 0));
+}
+
+void TestPSFInto::test_errors() {
+    write(0);
+
+    PSFDataSet ds(filename);
+
+    std::vector<double> out(npoints);
+    CPPUNIT_ASSERT_THROW(ds.get_signal_size("nonexisting"), NotFound);
+    CPPUNIT_ASSERT_THROW(ds.get_signal_into("nonexisting", &out[0], out.size()), NotFound);
+    CPPUNIT_ASSERT_THROW(ds.get_signal_into("z", &out[0], out.size()), NotImplemented);
+}
+
+// Files without a sweep have no traces to decode into arrays
+void TestPSFInto::test_nonswept() {
+    PSFDataSet ds("data/dcOp.dc");
+
+    std::vector<double> out(npoints);
+    std::vector<PSFComplexDouble> complexout(npoints);
+    double *outs[] = { &out[0] };
+    std::vector<std::string> names(1, "vout");
+
+    CPPUNIT_ASSERT_THROW(ds.get_signal_size("vout"), NotImplemented);
+    CPPUNIT_ASSERT_THROW(ds.get_signal_size("vout", 0, 10), NotImplemented);
+    CPPUNIT_ASSERT_THROW(ds.get_signal_into("vout", &out[0], out.size()), NotImplemented);
+    CPPUNIT_ASSERT_THROW(ds.get_signal_into("vout", &complexout[0], complexout.size(), 0, 10),
+			 NotImplemented);
+    CPPUNIT_ASSERT_THROW(ds.get_signals_into(names, outs, out.size()), NotImplemented);
+    CPPUNIT_ASSERT_THROW(ds.get_sweep_values_into(&out[0], out.size()), NotImplemented);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestPSFInto);
+
+int main(int argc, char *argv[]) {
+    // Create the event manager and test controller
+    CPPUNIT_NS::TestResult controller;
+
+    // Add a listener that colllects test result
+    CPPUNIT_NS::TestResultCollector result;
+    controller.addListener( &result );
+
+    // Add a listener that print dots as test run.
+    CPPUNIT_NS::BriefTestProgressListener progress;
+    controller.addListener( &progress );
+
+    // Add the top suite to the test runner
+    CPPUNIT_NS::TestRunner runner;
+    runner.addTest( CPPUNIT_NS::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( controller );
+
+    return result.wasSuccessful() ? 0 : 1;
+}
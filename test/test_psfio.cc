@@ -0,0 +1,211 @@
+// CppUnit unit test for the I/O backends
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include <cppunit/TestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/BriefTestProgressListener.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+
+#include "psf.h"
+#include "psfdata.h"
+#include "psfwriter.h"
+
+static const char *windowedfile = "test_psfio_windowed.psf";
+static const char *simplefile = "test_psfio_simple.psf";
+
+static const int npoints = 20000;
+
+class TestPSFIO : public CPPUNIT_NS::TestCase {
+    CPPUNIT_TEST_SUITE(TestPSFIO);
+
+    CPPUNIT_TEST(test_pread_windowed);
+    CPPUNIT_TEST(test_pread_simple);
+    CPPUNIT_TEST(test_read_counters);
+    CPPUNIT_TEST(test_partial_read);
+    CPPUNIT_TEST(test_prefetch);
+    CPPUNIT_TEST(test_cache);
+
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp(void);
+    void tearDown(void) { psf_enable_stats(false); remove(windowedfile); remove(simplefile); }
+
+protected:
+    void test_pread_windowed();
+    void test_pread_simple();
+    void test_read_counters();
+    void test_partial_read();
+    void test_prefetch();
+    void test_cache();
+
+    void compare_backends(const char *filename);
+};
+
+static void write_file(const char *filename, int windowsize) {
+    PSFWriter writer(filename);
+
+    int sweeptype = writer.add_type("sweep", TYPEID_DOUBLE);
+    writer.add_sweep("time", sweeptype);
+    writer.add_trace("a", sweeptype);
+    writer.add_trace("b", sweeptype);
+    if(windowsize)
+	writer.set_window_size(windowsize);
+
+    for(int i=0; i < npoints; i++) {
+	double values[2] = { 2.0 * i, -1.0 * i };
+	writer.append_point(i, values);
+    }
+}
+
+void TestPSFIO::setUp(void) {
+    write_file(windowedfile, 256);
+    write_file(simplefile, 0);
+}
+
+// Copy of the values of a vector which is deleted
+static std::vector<double> take(PSFVector *v) {
+    const PSFDoubleVector &dv = dynamic_cast<const PSFDoubleVector &>(*v);
+    std::vector<double> result(dv.begin(), dv.end());
+    delete v;
+    return result;
+}
+
+static PSFIOOptions pread_options(int blocksize=4 << 20) {
+    PSFIOOptions options;
+    options.backend = IO_PREAD;
+    options.advice = ADVICE_SEQUENTIAL;
+    options.blocksize = blocksize;
+    return options;
+}
+
+void TestPSFIO::compare_backends(const char *filename) {
+    PSFDataSet mmapds(filename);
+    PSFDataSet preadds(filename, pread_options(4096));
+
+    CPPUNIT_ASSERT_EQUAL(preadds.get_sweep_npoints(), npoints);
+
+    std::vector<double> expected = take(mmapds.get_signal_vector("b"));
+    std::vector<double> a = take(preadds.get_signal_vector("b", 1000, 3000));
+    std::vector<double> b = take(preadds.get_signal_vector("b"));
+
+    CPPUNIT_ASSERT(b == expected);
+    CPPUNIT_ASSERT(a == std::vector<double>(expected.begin() + 1000, expected.begin() + 4000));
+}
+
+void TestPSFIO::test_pread_windowed() {
+    compare_backends(windowedfile);
+}
+
+void TestPSFIO::test_pread_simple() {
+    compare_backends(simplefile);
+}
+
+void TestPSFIO::test_read_counters() {
+    psf_enable_stats(true);
+
+    PSFDataSet mmapds(windowedfile);
+    delete mmapds.get_signal_vector("a");
+    CPPUNIT_ASSERT_EQUAL(mmapds.get_stats().read_calls, (uint64_t)0);
+
+    PSFDataSet preadds(windowedfile, pread_options());
+    delete preadds.get_signal_vector("a");
+    CPPUNIT_ASSERT(preadds.get_stats().read_calls > 0);
+    CPPUNIT_ASSERT(preadds.get_stats().read_bytes > 0);
+
+    // Loaded blocks are not read again
+    uint64_t read_bytes = preadds.get_stats().read_bytes;
+    delete preadds.get_signal_vector("b");
+    CPPUNIT_ASSERT_EQUAL(preadds.get_stats().read_bytes, read_bytes);
+}
+
+void TestPSFIO::test_partial_read() {
+    psf_enable_stats(true);
+
+    PSFDataSet ds(simplefile, pread_options(4096));
+    std::vector<double> v = take(ds.get_signal_vector("a", 10000, 10));
+
+    CPPUNIT_ASSERT_EQUAL(v[0], 20000.0);
+
+    // Only the metadata and the blocks of the decoded points are read
+    FILE *f = fopen(simplefile, "r");
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fclose(f);
+
+    CPPUNIT_ASSERT(ds.get_stats().read_bytes > 0);
+    CPPUNIT_ASSERT(ds.get_stats().read_bytes < (uint64_t)size / 4);
+}
+
+void TestPSFIO::test_prefetch() {
+    psf_enable_stats(true);
+
+    PSFDataSet mmapds(windowedfile);
+    mmapds.prefetch(100, 1000);
+    CPPUNIT_ASSERT(mmapds.get_stats().prefetch_bytes > 0);
+
+    PSFDataSet preadds(simplefile, pread_options());
+    preadds.prefetch(npoints - 10, 1000);
+    CPPUNIT_ASSERT(preadds.get_stats().prefetch_bytes > 0);
+
+    // Prefetching does not change the decoded values
+    std::vector<double> v = take(preadds.get_signal_vector("a", npoints - 10, 10));
+    CPPUNIT_ASSERT_EQUAL(v[9], 2.0 * (npoints - 1));
+}
+
+void TestPSFIO::test_cache() {
+    psf_enable_stats(true);
+
+    const char *filenames[] = { simplefile, windowedfile };
+    for(int i=0; i < 2; i++) {
+	// Blocks of one page and a cache of two blocks
+	long pagesize = sysconf(_SC_PAGESIZE);
+	PSFIOOptions options = pread_options(pagesize);
+	options.cachesize = 2 * pagesize;
+
+	PSFDataSet mmapds(filenames[i]);
+	PSFDataSet ds(filenames[i], options);
+
+	std::vector<double> expected = take(mmapds.get_signal_vector("b"));
+
+	// Dropped blocks are read again
+	CPPUNIT_ASSERT(take(ds.get_signal_vector("b")) == expected);
+	uint64_t read_bytes = ds.get_stats().read_bytes;
+	CPPUNIT_ASSERT(take(ds.get_signal_vector("b")) == expected);
+	CPPUNIT_ASSERT(ds.get_stats().read_bytes > read_bytes);
+
+	// The blocks of the last points stay in the cache
+	read_bytes = ds.get_stats().read_bytes;
+	std::vector<double> v = take(ds.get_signal_vector("a", npoints - 10, 10));
+	CPPUNIT_ASSERT_EQUAL(v[9], 2.0 * (npoints - 1));
+	CPPUNIT_ASSERT_EQUAL(ds.get_stats().read_bytes, read_bytes);
+    }
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestPSFIO);
+
+int main(int argc, char *argv[]) {
+    // Create the event manager and test controller
+    CPPUNIT_NS::TestResult controller;
+
+    // Add a listener that colllects test result
+    CPPUNIT_NS::TestResultCollector result;
+    controller.addListener( &result );
+
+    // Add a listener that print dots as test run.
+    CPPUNIT_NS::BriefTestProgressListener progress;
+    controller.addListener( &progress );
+
+    // Add the top suite to the test runner
+    CPPUNIT_NS::TestRunner runner;
+    runner.addTest( CPPUNIT_NS::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( controller );
+
+    return result.wasSuccessful() ? 0 : 1;
+}
@@ -0,0 +1,229 @@
+// CppUnit unit test for the psfquery command
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <cppunit/TestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/BriefTestProgressListener.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+
+#include "psf.h"
+#include "psfdata.h"
+#include "psfwriter.h"
+
+// The command of the build tree, tests run in the test directory
+static const char *psfquery = "../src/psfquery";
+
+static const char *filename = "test_psfquery.psf";
+static const char *outfilename = "test_psfquery.out";
+
+static const int npoints = 1000;
+
+class TestPSFQuery : public CPPUNIT_NS::TestCase {
+    CPPUNIT_TEST_SUITE(TestPSFQuery);
+
+    CPPUNIT_TEST(test_list);
+    CPPUNIT_TEST(test_props);
+    CPPUNIT_TEST(test_extract_csv);
+    CPPUNIT_TEST(test_extract_raw);
+    CPPUNIT_TEST(test_extract_npy);
+    CPPUNIT_TEST(test_reduce);
+
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp(void);
+    void tearDown(void) { remove(filename); remove(outfilename); }
+
+protected:
+    void test_list();
+    void test_props();
+    void test_extract_csv();
+    void test_extract_raw();
+    void test_extract_npy();
+    void test_reduce();
+};
+
+static double sweep_value(int i) { return i * 1e-3; }
+static double a_value(int i) { return 0.5 * i; }
+static double b_value(int i) { return -1.0 * i; }
+
+void TestPSFQuery::setUp(void) {
+    PSFWriter writer(filename);
+
+    PSFStringScalar volt("V");
+    PropertyMap props;
+    props["units"] = &volt;
+
+    int sweeptype = writer.add_type("sweep", TYPEID_DOUBLE);
+    int complextype = writer.add_type("complex", TYPEID_COMPLEXDOUBLE);
+    writer.add_sweep("time", sweeptype);
+    writer.add_trace("a", sweeptype, "", props);
+    writer.add_trace("b", sweeptype);
+    writer.add_trace("z", complextype);
+    writer.set_window_size(512);
+
+    for(int i=0; i < npoints; i++) {
+	PSFDoubleScalar a(a_value(i)), b(b_value(i));
+	PSFComplexDoubleScalar z(PSFComplexDouble(i, 2 * i));
+	std::vector<const PSFScalar *> values;
+	values.push_back(&a);
+	values.push_back(&b);
+	values.push_back(&z);
+	writer.append_point(PSFDoubleScalar(sweep_value(i)), values);
+    }
+}
+
+// Standard output of psfquery with the arguments, which must succeed
+static std::string run(const std::string &args) {
+    std::string command = std::string(psfquery) + " " + args + " 2>/dev/null";
+    FILE *pipe = popen(command.c_str(), "r");
+    CPPUNIT_ASSERT(pipe != NULL);
+
+    std::string output;
+    char buf[4096];
+    size_t n;
+    while((n = fread(buf, 1, sizeof(buf), pipe)) > 0)
+	output.append(buf, n);
+
+    int status = pclose(pipe);
+    CPPUNIT_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    return output;
+}
+
+static std::vector<std::string> split(const std::string &s, char separator) {
+    std::vector<std::string> fields;
+    std::istringstream stream(s);
+    std::string field;
+
+    while(std::getline(stream, field, separator))
+	fields.push_back(field);
+
+    return fields;
+}
+
+static std::string read_output() {
+    std::ifstream in(outfilename, std::ios::binary);
+    std::ostringstream data;
+    data << in.rdbuf();
+    return data.str();
+}
+
+// Rows of time, a, z.re and z.im from point 10
+static void check_rows(const double *values, int nrows) {
+    for(int i=0; i < nrows; i++) {
+	int point = 10 + i;
+	CPPUNIT_ASSERT_EQUAL(values[4 * i], sweep_value(point));
+	CPPUNIT_ASSERT_EQUAL(values[4 * i + 1], a_value(point));
+	CPPUNIT_ASSERT_EQUAL(values[4 * i + 2], (double)point);
+	CPPUNIT_ASSERT_EQUAL(values[4 * i + 3], 2.0 * point);
+    }
+}
+
+void TestPSFQuery::test_list() {
+    CPPUNIT_ASSERT_EQUAL(run(std::string("list ") + filename), std::string("a\nb\nz\n"));
+    CPPUNIT_ASSERT_EQUAL(run(std::string("list ") + filename + " 'b*'"), std::string("b\n"));
+}
+
+void TestPSFQuery::test_props() {
+    CPPUNIT_ASSERT_EQUAL(run(std::string("props ") + filename + " a"), std::string("a\n  units: V\n"));
+}
+
+void TestPSFQuery::test_extract_csv() {
+    std::vector<std::string> rows =
+	split(run(std::string("-s 10 -n 5 extract ") + filename + " a z"), '\n');
+
+    CPPUNIT_ASSERT_EQUAL((int)rows.size(), 6);
+    CPPUNIT_ASSERT_EQUAL(rows[0], std::string("time,a,z.re,z.im"));
+
+    std::vector<double> values;
+    for(int i=1; i < 6; i++) {
+	std::vector<std::string> fields = split(rows[i], ',');
+	CPPUNIT_ASSERT_EQUAL((int)fields.size(), 4);
+	for(int j=0; j < 4; j++)
+	    values.push_back(strtod(fields[j].c_str(), NULL));
+    }
+    check_rows(&values[0], 5);
+}
+
+void TestPSFQuery::test_extract_raw() {
+    run(std::string("-f raw -s 10 -n 5 -o ") + outfilename + " extract " + filename + " a z");
+
+    std::string data = read_output();
+    CPPUNIT_ASSERT_EQUAL((int)data.size(), 5 * 4 * (int)sizeof(double));
+
+    std::vector<double> values(5 * 4);
+    memcpy(&values[0], data.data(), data.size());
+    check_rows(&values[0], 5);
+}
+
+void TestPSFQuery::test_extract_npy() {
+    run(std::string("-f npy -s 10 -n 5 -o ") + outfilename + " extract " + filename + " a z");
+
+    std::string data = read_output();
+    CPPUNIT_ASSERT(data.size() > 10);
+    CPPUNIT_ASSERT_EQUAL(data.substr(0, 8), std::string("\x93NUMPY\x01\x00", 8));
+
+    // The data follows the header aligned to 64 bytes
+    int headerlen = 10 + ((unsigned char)data[8] | (unsigned char)data[9] << 8);
+    CPPUNIT_ASSERT_EQUAL(headerlen % 64, 0);
+    CPPUNIT_ASSERT(data.substr(10, headerlen - 10).find("'shape': (5, 4)") != std::string::npos);
+    CPPUNIT_ASSERT_EQUAL((int)data.size(), headerlen + 5 * 4 * (int)sizeof(double));
+
+    std::vector<double> values(5 * 4);
+    memcpy(&values[0], data.data() + headerlen, values.size() * sizeof(double));
+    check_rows(&values[0], 5);
+}
+
+void TestPSFQuery::test_reduce() {
+    // The complex signal is skipped
+    std::vector<std::string> rows = split(run(std::string("reduce ") + filename), '\n');
+
+    CPPUNIT_ASSERT_EQUAL((int)rows.size(), 3);
+    CPPUNIT_ASSERT_EQUAL(rows[0].substr(0, 26), std::string("signal,npoints,xstart,xend"));
+
+    std::vector<std::string> a = split(rows[1], ',');
+    std::vector<std::string> b = split(rows[2], ',');
+    CPPUNIT_ASSERT_EQUAL(a[0], std::string("a"));
+    CPPUNIT_ASSERT_EQUAL(b[0], std::string("b"));
+
+    // npoints, min and max
+    CPPUNIT_ASSERT_EQUAL(atoi(a[1].c_str()), npoints);
+    CPPUNIT_ASSERT_EQUAL(strtod(a[4].c_str(), NULL), a_value(0));
+    CPPUNIT_ASSERT_EQUAL(strtod(a[5].c_str(), NULL), a_value(npoints - 1));
+    CPPUNIT_ASSERT_EQUAL(strtod(b[4].c_str(), NULL), b_value(npoints - 1));
+    CPPUNIT_ASSERT_EQUAL(strtod(b[5].c_str(), NULL), b_value(0));
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestPSFQuery);
+
+int main(int argc, char *argv[]) {
+    // Create the event manager and test controller
+    CPPUNIT_NS::TestResult controller;
+
+    // Add a listener that colllects test result
+    CPPUNIT_NS::TestResultCollector result;
+    controller.addListener( &result );
+
+    // Add a listener that print dots as test run.
+    CPPUNIT_NS::BriefTestProgressListener progress;
+    controller.addListener( &progress );
+
+    // Add the top suite to the test runner
+    CPPUNIT_NS::TestRunner runner;
+    runner.addTest( CPPUNIT_NS::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( controller );
+
+    return result.wasSuccessful() ? 0 : 1;
+}
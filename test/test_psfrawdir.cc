@@ -0,0 +1,179 @@
+// CppUnit unit test for raw directory access
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <cppunit/TestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/BriefTestProgressListener.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+
+#include "psf.h"
+#include "psfwriter.h"
+#include "psfrawdir.h"
+
+static const std::string dirname = "test_psfrawdir.raw";
+
+class TestPSFRawDir : public CPPUNIT_NS::TestCase {
+    CPPUNIT_TEST_SUITE(TestPSFRawDir);
+
+    CPPUNIT_TEST(test_names);
+    CPPUNIT_TEST(test_lookup);
+    CPPUNIT_TEST(test_prefetch);
+    CPPUNIT_TEST(test_get_signals);
+    CPPUNIT_TEST(test_nonswept);
+
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp(void);
+    void tearDown(void);
+
+protected:
+    void test_names();
+    void test_lookup();
+    void test_prefetch();
+    void test_get_signals();
+    void test_nonswept();
+};
+
+void TestPSFRawDir::setUp(void) {
+    mkdir(dirname.c_str(), 0755);
+
+    {
+	PSFWriter writer(dirname + "/tran.tran");
+
+	int sweeptype = writer.add_type("sweep", TYPEID_DOUBLE);
+	writer.add_sweep("time", sweeptype);
+	writer.add_trace("a", sweeptype);
+	writer.add_trace("b", sweeptype);
+
+	for(int i=0; i < 100; i++) {
+	    double values[2] = { (double)i, 2.0 * i };
+	    writer.append_point(i, values);
+	}
+    }
+
+    {
+	PSFWriter writer(dirname + "/dcOp.dc");
+
+	int type = writer.add_type("V", TYPEID_DOUBLE);
+	writer.add_value("vdd", type, PSFDoubleScalar(1.8));
+	writer.add_value("vss", type, PSFDoubleScalar(0.0));
+    }
+
+    FILE *log = fopen((dirname + "/logFile").c_str(), "w");
+    fputs("not a psf file\n", log);
+    fclose(log);
+}
+
+void TestPSFRawDir::tearDown(void) {
+    remove((dirname + "/tran.tran").c_str());
+    remove((dirname + "/dcOp.dc").c_str());
+    remove((dirname + "/logFile").c_str());
+    rmdir(dirname.c_str());
+}
+
+void TestPSFRawDir::test_names() {
+    PSFRawDir rawdir(dirname);
+
+    CPPUNIT_ASSERT_EQUAL(rawdir.get_names().size(), (size_t)2);
+    CPPUNIT_ASSERT_EQUAL(rawdir.get_names()[0], std::string("dcOp.dc"));
+    CPPUNIT_ASSERT_EQUAL(rawdir.get_names()[1], std::string("tran.tran"));
+
+    CPPUNIT_ASSERT_THROW(PSFRawDir("nonexisting.raw"), FileOpenError);
+}
+
+void TestPSFRawDir::test_lookup() {
+    PSFRawDir rawdir(dirname);
+
+    CPPUNIT_ASSERT(rawdir.has("tran"));
+    CPPUNIT_ASSERT(rawdir.has("tran.tran"));
+    CPPUNIT_ASSERT(!rawdir.has("logFile"));
+
+    PSFDataSet &tran = rawdir["tran"];
+    CPPUNIT_ASSERT(tran.is_swept());
+    CPPUNIT_ASSERT_EQUAL(&tran, &rawdir.get("tran.tran"));
+
+    CPPUNIT_ASSERT_THROW(rawdir.get("logFile"), NotFound);
+}
+
+void TestPSFRawDir::test_prefetch() {
+    PSFRawDir rawdir(dirname, 2);
+
+    rawdir.prefetch_all();
+    rawdir.wait();
+
+    CPPUNIT_ASSERT_EQUAL(rawdir["tran"].get_sweep_npoints(), 100);
+    CPPUNIT_ASSERT(!rawdir["dcOp"].is_swept());
+
+    std::vector<std::string> names(1, "ac");
+    CPPUNIT_ASSERT_THROW(rawdir.prefetch(names), NotFound);
+}
+
+void TestPSFRawDir::test_get_signals() {
+    PSFRawDir rawdir(dirname);
+
+    std::vector<std::string> names;
+    names.push_back("b");
+    names.push_back("a");
+
+    std::vector<PSFBase *> signals = rawdir["tran"].get_signals(names);
+
+    CPPUNIT_ASSERT_EQUAL(signals.size(), (size_t)2);
+
+    PSFDoubleVector *b = dynamic_cast<PSFDoubleVector *>(signals[0]);
+    PSFDoubleVector *a = dynamic_cast<PSFDoubleVector *>(signals[1]);
+    CPPUNIT_ASSERT(a && b);
+    CPPUNIT_ASSERT_EQUAL(a->size(), (size_t)100);
+    CPPUNIT_ASSERT_EQUAL((*a)[10], 10.0);
+    CPPUNIT_ASSERT_EQUAL((*b)[10], 20.0);
+
+    for(size_t i=0; i < signals.size(); i++)
+	delete signals[i];
+
+    names.push_back("c");
+    CPPUNIT_ASSERT_THROW(rawdir["tran"].get_signals(names), NotFound);
+}
+
+void TestPSFRawDir::test_nonswept() {
+    PSFRawDir rawdir(dirname);
+
+    std::vector<std::string> names;
+    names.push_back("vdd");
+    names.push_back("vss");
+
+    std::vector<PSFBase *> signals = rawdir["dcOp"].get_signals(names);
+
+    CPPUNIT_ASSERT_EQUAL(signals.size(), (size_t)2);
+    CPPUNIT_ASSERT_EQUAL((double)*dynamic_cast<PSFScalar *>(signals[0]), 1.8);
+
+    for(size_t i=0; i < signals.size(); i++)
+	delete signals[i];
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestPSFRawDir);
+
+int main(int argc, char *argv[]) {
+    // Create the event manager and test controller
+    CPPUNIT_NS::TestResult controller;
+
+    // Add a listener that colllects test result
+    CPPUNIT_NS::TestResultCollector result;
+    controller.addListener( &result );
+
+    // Add a listener that print dots as test run.
+    CPPUNIT_NS::BriefTestProgressListener progress;
+    controller.addListener( &progress );
+
+    // Add the top suite to the test runner
+    CPPUNIT_NS::TestRunner runner;
+    runner.addTest( CPPUNIT_NS::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( controller );
+
+    return result.wasSuccessful() ? 0 : 1;
+}
@@ -0,0 +1,183 @@
+// CppUnit unit test for reductions computed while decoding
+
+#include <stdio.h>
+#include <math.h>
+
+#include <cppunit/TestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/BriefTestProgressListener.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+
+#include "psf.h"
+#include "psfwriter.h"
+
+static const char *simplefile = "test_psfreduce_simple.psf";
+static const char *windowedfile = "test_psfreduce_windowed.psf";
+
+class TestPSFReduce : public CPPUNIT_NS::TestCase {
+    CPPUNIT_TEST_SUITE(TestPSFReduce);
+
+    CPPUNIT_TEST(test_simple);
+    CPPUNIT_TEST(test_windowed);
+    CPPUNIT_TEST(test_range);
+    CPPUNIT_TEST(test_signals);
+    CPPUNIT_TEST(test_errors);
+
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp(void);
+    void tearDown(void) { remove(simplefile); remove(windowedfile); }
+
+protected:
+    void test_simple();
+    void test_windowed();
+    void test_range();
+    void test_signals();
+    void test_errors();
+
+    void check_ramp(const char *filename);
+};
+
+// Sweep points x = i^2 / 100 with a = x and b = 1 - 2x, the sweep is non
+// uniform so the integrals depend on the sweep values
+static void write_file(const char *filename, int windowsize) {
+    PSFWriter writer(filename);
+
+    int sweeptype = writer.add_type("sweep", TYPEID_DOUBLE);
+    int complextype = writer.add_type("complex", TYPEID_COMPLEXDOUBLE);
+    writer.add_sweep("time", sweeptype);
+    writer.add_trace("a", sweeptype);
+    writer.add_trace("b", sweeptype);
+    if(windowsize)
+	writer.set_window_size(windowsize);
+    else
+	writer.add_trace("c", complextype);
+
+    for(int i=0; i <= 100; i++) {
+	double x = i * i / 100.0;
+	PSFDoubleScalar sweep(x), a(x), b(1 - 2 * x);
+	PSFComplexDoubleScalar c(PSFComplexDouble(x, 0));
+
+	std::vector<const PSFScalar *> values;
+	values.push_back(&a);
+	values.push_back(&b);
+	if(!windowsize)
+	    values.push_back(&c);
+	writer.append_point(sweep, values);
+    }
+}
+
+void TestPSFReduce::setUp(void) {
+    write_file(simplefile, 0);
+    write_file(windowedfile, 96);
+}
+
+void TestPSFReduce::check_ramp(const char *filename) {
+    PSFDataSet ds(filename);
+
+    PSFSweepReduction r = ds.get_signal_reduction("a");
+
+    CPPUNIT_ASSERT_EQUAL(r.npoints, 101);
+    CPPUNIT_ASSERT_EQUAL(r.xstart, 0.0);
+    CPPUNIT_ASSERT_EQUAL(r.xend, 100.0);
+    CPPUNIT_ASSERT_EQUAL(r.min, 0.0);
+    CPPUNIT_ASSERT_EQUAL(r.max, 100.0);
+    CPPUNIT_ASSERT_EQUAL(r.max_x, 100.0);
+    CPPUNIT_ASSERT_EQUAL(r.peak_to_peak(), 100.0);
+
+    // The trapezoidal rule is exact for a linear signal
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(r.integral, 5000.0, 1e-9);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(r.average, 50.0, 1e-9);
+
+    // rms of x over [0, 100] is 100/sqrt(3), the trapezoidal rule on x^2
+    // overestimates it by the sum of dx^3 / 6
+    double error = 0;
+    for(int i=1; i <= 100; i++) {
+	double dx = (i * i - (i - 1) * (i - 1)) / 100.0;
+	error += dx * dx * dx / 6;
+    }
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(r.rms, sqrt((1e6 / 3 + error) / 100), 1e-9);
+
+    PSFSweepReduction b = ds.get_signal_reduction("b");
+    CPPUNIT_ASSERT_EQUAL(b.min, -199.0);
+    CPPUNIT_ASSERT_EQUAL(b.min_x, 100.0);
+    CPPUNIT_ASSERT_EQUAL(b.max, 1.0);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(b.integral, 100.0 - 10000.0, 1e-9);
+}
+
+void TestPSFReduce::test_simple() {
+    check_ramp(simplefile);
+}
+
+void TestPSFReduce::test_windowed() {
+    check_ramp(windowedfile);
+}
+
+void TestPSFReduce::test_range() {
+    PSFDataSet ds(windowedfile);
+
+    // Points 10 to 19, x = 1 to 3.61
+    PSFSweepReduction r = ds.get_signal_reduction("a", 10, 10);
+    CPPUNIT_ASSERT_EQUAL(r.npoints, 10);
+    CPPUNIT_ASSERT_EQUAL(r.xstart, 1.0);
+    CPPUNIT_ASSERT_EQUAL(r.xend, 3.61);
+    CPPUNIT_ASSERT_EQUAL(r.min, 1.0);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(r.integral, (3.61 * 3.61 - 1) / 2, 1e-9);
+
+    // Clipped to the available points
+    CPPUNIT_ASSERT_EQUAL(ds.get_signal_reduction("a", 95, 100).npoints, 6);
+
+    // A single point
+    PSFSweepReduction p = ds.get_signal_reduction("b", 100, 1);
+    CPPUNIT_ASSERT_EQUAL(p.average, -199.0);
+    CPPUNIT_ASSERT_EQUAL(p.rms, 199.0);
+    CPPUNIT_ASSERT_EQUAL(p.integral, 0.0);
+
+    // No points
+    CPPUNIT_ASSERT_EQUAL(ds.get_signal_reduction("a", 200, 10).npoints, 0);
+}
+
+void TestPSFReduce::test_signals() {
+    PSFDataSet ds(simplefile);
+
+    std::vector<std::string> names;
+    names.push_back("b");
+    names.push_back("a");
+
+    std::vector<PSFSweepReduction> r = ds.get_signal_reductions(names);
+    CPPUNIT_ASSERT_EQUAL(r.size(), (size_t)2);
+    CPPUNIT_ASSERT_EQUAL(r[0].min, -199.0);
+    CPPUNIT_ASSERT_EQUAL(r[1].min, 0.0);
+}
+
+void TestPSFReduce::test_errors() {
+    PSFDataSet ds(simplefile);
+
+    CPPUNIT_ASSERT_THROW(ds.get_signal_reduction("d"), NotFound);
+    CPPUNIT_ASSERT_THROW(ds.get_signal_reduction("c"), NotImplemented);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestPSFReduce);
+
+int main(int argc, char *argv[]) {
+    // Create the event manager and test controller
+    CPPUNIT_NS::TestResult controller;
+
+    // Add a listener that colllects test result
+    CPPUNIT_NS::TestResultCollector result;
+    controller.addListener( &result );
+
+    // Add a listener that print dots as test run.
+    CPPUNIT_NS::BriefTestProgressListener progress;
+    controller.addListener( &progress );
+
+    // Add the top suite to the test runner
+    CPPUNIT_NS::TestRunner runner;
+    runner.addTest( CPPUNIT_NS::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( controller );
+
+    return result.wasSuccessful() ? 0 : 1;
+}
@@ -0,0 +1,206 @@
+// CppUnit unit test for resampling signals onto a sweep grid
+
+#include <stdio.h>
+#include <math.h>
+
+#include <cppunit/TestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/BriefTestProgressListener.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+
+#include "psf.h"
+#include "psfwriter.h"
+
+static const char *filename = "test_psfresample.psf";
+
+// More points than are decoded in one chunk
+static const int npoints = 70000;
+
+class TestPSFResample : public CPPUNIT_NS::TestCase {
+    CPPUNIT_TEST_SUITE(TestPSFResample);
+
+    CPPUNIT_TEST(test_linear);
+    CPPUNIT_TEST(test_hold);
+    CPPUNIT_TEST(test_cubic);
+    CPPUNIT_TEST(test_outside);
+    CPPUNIT_TEST(test_errors);
+
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp(void);
+    void tearDown(void) { remove(filename); }
+
+protected:
+    void test_linear();
+    void test_hold();
+    void test_cubic();
+    void test_outside();
+    void test_errors();
+
+    std::vector<PSFVector *> resample(const std::vector<double> &grid, PSFInterpolation method);
+};
+
+// Non uniform sweep with a linear and a quadratic signal
+static double sweep_value(int i) { return i + (i % 3) * 0.25; }
+static double linear(double x) { return 3 * x + 1; }
+static double quadratic(double x) { return x * x - x; }
+
+void TestPSFResample::setUp(void) {
+    PSFWriter writer(filename);
+
+    int sweeptype = writer.add_type("sweep", TYPEID_DOUBLE);
+    int complextype = writer.add_type("complex", TYPEID_COMPLEXDOUBLE);
+    writer.add_sweep("time", sweeptype);
+    writer.add_trace("linear", sweeptype);
+    writer.add_trace("quadratic", sweeptype);
+    writer.add_trace("complex", complextype);
+
+    for(int i=0; i < npoints; i++) {
+	double x = sweep_value(i);
+	PSFDoubleScalar sweep(x), a(linear(x)), b(quadratic(x));
+	PSFComplexDoubleScalar c(PSFComplexDouble(x, x));
+
+	std::vector<const PSFScalar *> values;
+	values.push_back(&a);
+	values.push_back(&b);
+	values.push_back(&c);
+	writer.append_point(sweep, values);
+    }
+}
+
+std::vector<PSFVector *> TestPSFResample::resample(const std::vector<double> &grid, PSFInterpolation method) {
+    PSFDataSet ds(filename);
+
+    std::vector<std::string> names;
+    names.push_back("linear");
+    names.push_back("quadratic");
+
+    return ds.get_signals_resampled(names, grid, method);
+}
+
+// Uniform grid across the sweep with the last sweep point at its end
+static std::vector<double> uniform_grid(int n) {
+    std::vector<double> grid;
+    double end = sweep_value(npoints - 1);
+    for(int i=0; i < n; i++)
+	grid.push_back(end * i / (n - 1));
+    return grid;
+}
+
+void TestPSFResample::test_linear() {
+    std::vector<double> grid = uniform_grid(10001);
+    std::vector<PSFVector *> result = resample(grid, INTERP_LINEAR);
+
+    CPPUNIT_ASSERT_EQUAL(result.size(), (size_t)2);
+
+    PSFDoubleVector &a = *dynamic_cast<PSFDoubleVector *>(result[0]);
+    CPPUNIT_ASSERT_EQUAL(a.size(), grid.size());
+    for(unsigned int i=0; i < grid.size(); i++)
+	CPPUNIT_ASSERT_DOUBLES_EQUAL(a[i], linear(grid[i]), 1e-9 * linear(grid[i]));
+
+    delete result[0];
+    delete result[1];
+}
+
+void TestPSFResample::test_hold() {
+    std::vector<double> grid;
+    grid.push_back(sweep_value(5));
+    grid.push_back(sweep_value(5) + 0.25);
+    grid.push_back(sweep_value(npoints - 1));
+
+    std::vector<PSFVector *> result = resample(grid, INTERP_HOLD);
+
+    PSFDoubleVector &a = *dynamic_cast<PSFDoubleVector *>(result[0]);
+    CPPUNIT_ASSERT_EQUAL(a[0], linear(sweep_value(5)));
+    CPPUNIT_ASSERT_EQUAL(a[1], linear(sweep_value(5)));
+    CPPUNIT_ASSERT_EQUAL(a[2], linear(sweep_value(npoints - 1)));
+
+    delete result[0];
+    delete result[1];
+}
+
+void TestPSFResample::test_cubic() {
+    // The three point slopes make the spline exact for a quadratic, except
+    // in the first and last interval
+    std::vector<double> grid;
+    for(double x=2; x < npoints - 2; x += 7.3)
+	grid.push_back(x);
+
+    std::vector<PSFVector *> result = resample(grid, INTERP_CUBIC);
+
+    PSFDoubleVector &b = *dynamic_cast<PSFDoubleVector *>(result[1]);
+    for(unsigned int i=0; i < grid.size(); i++)
+	CPPUNIT_ASSERT_DOUBLES_EQUAL(b[i], quadratic(grid[i]), 1e-9 * quadratic(grid[i]));
+
+    delete result[0];
+    delete result[1];
+}
+
+void TestPSFResample::test_outside() {
+    std::vector<double> grid;
+    grid.push_back(-1);
+    grid.push_back(0);
+    grid.push_back(npoints + 1);
+
+    std::vector<PSFVector *> result = resample(grid, INTERP_LINEAR);
+
+    PSFDoubleVector &a = *dynamic_cast<PSFDoubleVector *>(result[0]);
+    CPPUNIT_ASSERT(isnan(a[0]));
+    CPPUNIT_ASSERT_EQUAL(a[1], 1.0);
+    CPPUNIT_ASSERT(isnan(a[2]));
+
+    delete result[0];
+    delete result[1];
+}
+
+void TestPSFResample::test_errors() {
+    PSFDataSet ds(filename);
+
+    std::vector<double> grid(1, 0.0);
+
+    CPPUNIT_ASSERT_THROW(ds.get_signals_resampled(std::vector<std::string>(1, "nonexisting"), grid),
+			 NotFound);
+    CPPUNIT_ASSERT_THROW(ds.get_signals_resampled(std::vector<std::string>(1, "complex"), grid),
+			 NotImplemented);
+
+    // Descending sweeps are not resampled
+    {
+	PSFWriter writer(filename);
+	int sweeptype = writer.add_type("sweep", TYPEID_DOUBLE);
+	writer.add_sweep("temp", sweeptype);
+	writer.add_trace("linear", sweeptype);
+	for(int i=0; i < 10; i++) {
+	    double value = i;
+	    writer.append_point(10 - i, &value);
+	}
+    }
+
+    PSFDataSet descending(filename);
+    CPPUNIT_ASSERT_THROW(descending.get_signals_resampled(std::vector<std::string>(1, "linear"), grid),
+			 NotImplemented);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestPSFResample);
+
+int main(int argc, char *argv[]) {
+    // Create the event manager and test controller
+    CPPUNIT_NS::TestResult controller;
+
+    // Add a listener that colllects test result
+    CPPUNIT_NS::TestResultCollector result;
+    controller.addListener( &result );
+
+    // Add a listener that print dots as test run.
+    CPPUNIT_NS::BriefTestProgressListener progress;
+    controller.addListener( &progress );
+
+    // Add the top suite to the test runner
+    CPPUNIT_NS::TestRunner runner;
+    runner.addTest( CPPUNIT_NS::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( controller );
+
+    return result.wasSuccessful() ? 0 : 1;
+}
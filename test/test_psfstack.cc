@@ -0,0 +1,235 @@
+// CppUnit unit test for stacking signals of many files
+
+#include <stdio.h>
+#include <math.h>
+
+#include <sstream>
+
+#include <cppunit/TestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/BriefTestProgressListener.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+
+#include "psf.h"
+#include "psfwriter.h"
+#include "psfstack.h"
+
+static const int nruns = 5;
+static const int npoints = 50;
+
+class TestPSFStack : public CPPUNIT_NS::TestCase {
+    CPPUNIT_TEST_SUITE(TestPSFStack);
+
+    CPPUNIT_TEST(test_stack);
+    CPPUNIT_TEST(test_stack_signals);
+    CPPUNIT_TEST(test_reduce);
+    CPPUNIT_TEST(test_percentiles);
+    CPPUNIT_TEST(test_nonswept);
+    CPPUNIT_TEST(test_errors);
+    CPPUNIT_TEST(test_empty);
+
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp(void);
+    void tearDown(void);
+
+protected:
+    void test_stack();
+    void test_stack_signals();
+    void test_reduce();
+    void test_percentiles();
+    void test_nonswept();
+    void test_errors();
+    void test_empty();
+
+private:
+    std::vector<std::string> m_filenames;
+};
+
+static std::string run_filename(const char *prefix, int run) {
+    std::stringstream name;
+    name << prefix << run << ".psf";
+    return name.str();
+}
+
+// Run r of signal a at point i is i + r, b is -a
+static void write_run(const std::string &filename, int run, int n) {
+    PSFWriter writer(filename);
+
+    int sweeptype = writer.add_type("sweep", TYPEID_DOUBLE);
+    writer.add_sweep("time", sweeptype);
+    writer.add_trace("a", sweeptype);
+    writer.add_trace("b", sweeptype);
+    writer.set_window_size(128);
+
+    for(int i=0; i < n; i++) {
+	double values[2] = { (double)(i + run), -(double)(i + run) };
+	writer.append_point(i, values);
+    }
+}
+
+void TestPSFStack::setUp(void) {
+    m_filenames.clear();
+    for(int r=0; r < nruns; r++) {
+	m_filenames.push_back(run_filename("test_psfstack", r));
+	write_run(m_filenames.back(), r, npoints);
+    }
+}
+
+void TestPSFStack::tearDown(void) {
+    for(unsigned int i=0; i < m_filenames.size(); i++)
+	remove(m_filenames[i].c_str());
+}
+
+void TestPSFStack::test_stack() {
+    PSFStack stack(m_filenames, 2);
+
+    CPPUNIT_ASSERT_EQUAL(stack.get_nruns(), nruns);
+    CPPUNIT_ASSERT_EQUAL(stack.get_npoints(), npoints);
+
+    std::vector<double> data(nruns * npoints);
+    stack.stack("a", &data[0]);
+
+    for(int r=0; r < nruns; r++)
+	for(int i=0; i < npoints; i++)
+	    CPPUNIT_ASSERT_EQUAL(data[r * npoints + i], (double)(i + r));
+}
+
+void TestPSFStack::test_stack_signals() {
+    PSFStack stack(m_filenames, 2);
+
+    std::vector<std::string> signals;
+    signals.push_back("a");
+    signals.push_back("b");
+
+    std::vector<double> data(2 * nruns * npoints);
+    stack.stack(signals, &data[0]);
+
+    CPPUNIT_ASSERT_EQUAL(data[3 * npoints + 7], 10.0);
+    CPPUNIT_ASSERT_EQUAL(data[(nruns + 3) * npoints + 7], -10.0);
+}
+
+void TestPSFStack::test_reduce() {
+    PSFStack stack(m_filenames, 3);
+
+    PSFReduction result;
+    stack.reduce("a", result);
+
+    CPPUNIT_ASSERT_EQUAL(result.nruns, nruns);
+    CPPUNIT_ASSERT_EQUAL(result.mean.size(), (size_t)npoints);
+    CPPUNIT_ASSERT(result.percentiles.empty());
+
+    // Runs 0..4 have mean 2 and sample variance 2.5
+    for(int i=0; i < npoints; i++) {
+	CPPUNIT_ASSERT_DOUBLES_EQUAL(result.mean[i], i + 2.0, 1e-12);
+	CPPUNIT_ASSERT_DOUBLES_EQUAL(result.stddev[i], sqrt(2.5), 1e-12);
+	CPPUNIT_ASSERT_EQUAL(result.min[i], (double)i);
+	CPPUNIT_ASSERT_EQUAL(result.max[i], i + 4.0);
+    }
+}
+
+void TestPSFStack::test_percentiles() {
+    PSFStack stack(m_filenames);
+
+    std::vector<double> percentiles;
+    percentiles.push_back(50);
+    percentiles.push_back(90);
+
+    PSFReduction result;
+    stack.reduce("a", result, percentiles);
+
+    CPPUNIT_ASSERT_EQUAL(result.percentiles.size(), (size_t)2);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(result.percentiles[0][10], 12.0, 1e-12);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(result.percentiles[1][10], 13.6, 1e-12);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(result.mean[10], 12.0, 1e-12);
+}
+
+void TestPSFStack::test_nonswept() {
+    std::vector<std::string> filenames;
+
+    for(int r=0; r < 3; r++) {
+	filenames.push_back(run_filename("test_psfstack_dc", r));
+
+	PSFWriter writer(filenames.back());
+	int type = writer.add_type("V", TYPEID_DOUBLE);
+	writer.add_value("vout", type, PSFDoubleScalar(r * 0.5));
+    }
+
+    PSFStack stack(filenames);
+    CPPUNIT_ASSERT_EQUAL(stack.get_npoints(), 1);
+
+    double data[3];
+    stack.stack("vout", data);
+    CPPUNIT_ASSERT_EQUAL(data[2], 1.0);
+
+    for(unsigned int i=0; i < filenames.size(); i++)
+	remove(filenames[i].c_str());
+}
+
+void TestPSFStack::test_errors() {
+    std::vector<double> data(nruns * npoints);
+
+    PSFStack stack(m_filenames);
+    CPPUNIT_ASSERT_THROW(stack.stack("c", &data[0]), NotFound);
+
+    std::vector<std::string> filenames(m_filenames);
+    filenames.push_back("nonexisting.psf");
+    PSFStack missing(filenames);
+    std::vector<double> missingdata((nruns + 1) * npoints);
+    CPPUNIT_ASSERT_THROW(missing.stack("a", &missingdata[0]), FileOpenError);
+
+    // A run with a different number of points
+    write_run(m_filenames.back(), 0, npoints + 1);
+    PSFStack mismatch(m_filenames);
+    CPPUNIT_ASSERT_THROW(mismatch.stack("a", &data[0]), InvalidFileError);
+    PSFReduction result;
+    CPPUNIT_ASSERT_THROW(mismatch.reduce("a", result), InvalidFileError);
+}
+
+void TestPSFStack::test_empty() {
+    std::vector<double> percentiles(1, 50.0);
+    PSFReduction result;
+
+    PSFStack empty((std::vector<std::string>()));
+    empty.reduce("a", result, percentiles);
+    CPPUNIT_ASSERT_EQUAL(result.nruns, 0);
+    CPPUNIT_ASSERT_EQUAL(result.percentiles.size(), (size_t)1);
+    CPPUNIT_ASSERT(result.percentiles[0].empty());
+
+    // Runs without points
+    for(int r=0; r < nruns; r++)
+	write_run(m_filenames[r], r, 0);
+
+    PSFStack stack(m_filenames);
+    CPPUNIT_ASSERT_EQUAL(stack.get_npoints(), 0);
+    stack.reduce("a", result, percentiles);
+    CPPUNIT_ASSERT(result.percentiles[0].empty());
+    stack.reduce("a", result);
+    CPPUNIT_ASSERT_EQUAL(result.nruns, nruns);
+    CPPUNIT_ASSERT(result.mean.empty());
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestPSFStack);
+
+int main(int argc, char *argv[]) {
+    // Create the event manager and test controller
+    CPPUNIT_NS::TestResult controller;
+
+    // Add a listener that colllects test result
+    CPPUNIT_NS::TestResultCollector result;
+    controller.addListener( &result );
+
+    // Add a listener that print dots as test run.
+    CPPUNIT_NS::BriefTestProgressListener progress;
+    controller.addListener( &progress );
+
+    // Add the top suite to the test runner
+    CPPUNIT_NS::TestRunner runner;
+    runner.addTest( CPPUNIT_NS::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( controller );
+
+    return result.wasSuccessful() ? 0 : 1;
+}
@@ -0,0 +1,129 @@
+// CppUnit unit test for the performance statistics
+
+#include <stdio.h>
+
+#include <memory>
+
+#include <cppunit/TestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/BriefTestProgressListener.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+
+#include "psf.h"
+#include "psfwriter.h"
+
+static const char *filename = "test_psfstats.psf";
+
+class TestPSFStats : public CPPUNIT_NS::TestCase {
+    CPPUNIT_TEST_SUITE(TestPSFStats);
+
+    CPPUNIT_TEST(test_disabled);
+    CPPUNIT_TEST(test_open);
+    CPPUNIT_TEST(test_decode);
+    CPPUNIT_TEST(test_reset);
+
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp(void);
+    void tearDown(void) { psf_enable_stats(false); remove(filename); }
+
+protected:
+    void test_disabled();
+    void test_open();
+    void test_decode();
+    void test_reset();
+};
+
+void TestPSFStats::setUp(void) {
+    PSFWriter writer(filename);
+
+    int sweeptype = writer.add_type("sweep", TYPEID_DOUBLE);
+    writer.add_sweep("time", sweeptype);
+    writer.add_trace("a", sweeptype);
+    writer.add_trace("b", sweeptype);
+    writer.set_window_size(64);
+
+    double values[2] = { 1.0, 2.0 };
+    for(int i=0; i < 100; i++)
+	writer.append_point(i, values);
+}
+
+void TestPSFStats::test_disabled() {
+    psf_enable_stats(false);
+    CPPUNIT_ASSERT(!psf_stats_enabled());
+
+    PSFDataSet ds(filename);
+    delete ds.get_signal_vector("a");
+
+    CPPUNIT_ASSERT_EQUAL(ds.get_stats().open_time, 0.0);
+    CPPUNIT_ASSERT_EQUAL(ds.get_stats().decode_calls, (uint64_t)0);
+    CPPUNIT_ASSERT_EQUAL(ds.get_stats().objects_allocated, (uint64_t)0);
+}
+
+void TestPSFStats::test_open() {
+    psf_enable_stats(true);
+
+    PSFDataSet ds(filename);
+    const PSFStats &stats = ds.get_stats();
+
+    CPPUNIT_ASSERT(stats.open_time > 0);
+    CPPUNIT_ASSERT(stats.open_time >= stats.header_time + stats.type_time + stats.trace_time);
+    CPPUNIT_ASSERT(stats.metadata_bytes > 0);
+    CPPUNIT_ASSERT(stats.objects_allocated > 0);
+    CPPUNIT_ASSERT_EQUAL(stats.decode_calls, (uint64_t)0);
+}
+
+void TestPSFStats::test_decode() {
+    psf_enable_stats(true);
+
+    PSFDataSet ds(filename);
+    delete ds.get_signal_vector("a");
+    delete ds.get_signal_vector("b", 10, 20);
+
+    const PSFStats &stats = ds.get_stats();
+    CPPUNIT_ASSERT_EQUAL(stats.decode_calls, (uint64_t)2);
+    CPPUNIT_ASSERT_EQUAL(stats.points_decoded, (uint64_t)120);
+    CPPUNIT_ASSERT_EQUAL(stats.traces_decoded, (uint64_t)2);
+    CPPUNIT_ASSERT(stats.value_bytes > 0);
+    CPPUNIT_ASSERT(stats.decode_time > 0);
+
+    // The window index is built by the first decode
+    CPPUNIT_ASSERT_EQUAL(stats.cache_misses, (uint64_t)1);
+    CPPUNIT_ASSERT_EQUAL(stats.cache_hits, (uint64_t)1);
+}
+
+void TestPSFStats::test_reset() {
+    psf_enable_stats(true);
+
+    PSFDataSet ds(filename);
+    delete ds.get_signal_vector("a");
+    ds.reset_stats();
+
+    CPPUNIT_ASSERT_EQUAL(ds.get_stats().open_time, 0.0);
+    CPPUNIT_ASSERT_EQUAL(ds.get_stats().decode_calls, (uint64_t)0);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestPSFStats);
+
+int main(int argc, char *argv[]) {
+    // Create the event manager and test controller
+    CPPUNIT_NS::TestResult controller;
+
+    // Add a listener that colllects test result
+    CPPUNIT_NS::TestResultCollector result;
+    controller.addListener( &result );
+
+    // Add a listener that print dots as test run.
+    CPPUNIT_NS::BriefTestProgressListener progress;
+    controller.addListener( &progress );
+
+    // Add the top suite to the test runner
+    CPPUNIT_NS::TestRunner runner;
+    runner.addTest( CPPUNIT_NS::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( controller );
+
+    return result.wasSuccessful() ? 0 : 1;
+}
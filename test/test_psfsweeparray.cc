@@ -0,0 +1,251 @@
+// CppUnit unit test for nested sweeps
+
+#include <stdio.h>
+
+#include <stdexcept>
+
+#include <cppunit/TestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/BriefTestProgressListener.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+
+#include "psf.h"
+#include "psfwriter.h"
+
+static const char *filename = "test_psfsweeparray.psf";
+
+class TestPSFSweepArray : public CPPUNIT_NS::TestCase {
+    CPPUNIT_TEST_SUITE(TestPSFSweepArray);
+
+    CPPUNIT_TEST(test_shape);
+    CPPUNIT_TEST(test_array);
+    CPPUNIT_TEST(test_slice);
+    CPPUNIT_TEST(test_single_sweep);
+    CPPUNIT_TEST(test_irregular);
+    CPPUNIT_TEST(test_windowed);
+
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp(void);
+    void tearDown(void) { psf_enable_stats(false); remove(filename); }
+
+protected:
+    void test_shape();
+    void test_array();
+    void test_slice();
+    void test_single_sweep();
+    void test_irregular();
+    void test_windowed();
+};
+
+// Transient of 5 points for 3 temperatures and 2 supply voltages
+static const int ntime = 5, ntemp = 3, nvdd = 2;
+
+static double value(int vdd, int temp, int time) { return vdd * 100 + temp * 10 + time; }
+
+void TestPSFSweepArray::setUp(void) {
+    PSFWriter writer(filename);
+
+    int sweeptype = writer.add_type("sweep", TYPEID_DOUBLE);
+    writer.add_sweep("time", sweeptype);
+    writer.add_sweep("temp", sweeptype);
+    writer.add_sweep("vdd", sweeptype);
+    writer.add_trace("out", sweeptype);
+
+    for(int vdd=0; vdd < nvdd; vdd++)
+	for(int temp=0; temp < ntemp; temp++)
+	    for(int time=0; time < ntime; time++) {
+		PSFDoubleScalar t(time * 1e-9), tc(temp * 25.0), v(1.0 + vdd * 0.1);
+		PSFDoubleScalar out(value(vdd, temp, time));
+
+		std::vector<const PSFScalar *> sweepvalues;
+		sweepvalues.push_back(&t);
+		sweepvalues.push_back(&tc);
+		sweepvalues.push_back(&v);
+
+		writer.append_point(sweepvalues, std::vector<const PSFScalar *>(1, &out));
+	    }
+}
+
+void TestPSFSweepArray::test_shape() {
+    PSFDataSet ds(filename);
+
+    CPPUNIT_ASSERT_EQUAL(ds.get_nsweeps(), 3);
+    CPPUNIT_ASSERT_EQUAL(ds.get_sweep_npoints(), nvdd * ntemp * ntime);
+
+    std::vector<int> shape = ds.get_sweep_shape();
+    CPPUNIT_ASSERT_EQUAL(shape.size(), (size_t)3);
+    CPPUNIT_ASSERT_EQUAL(shape[0], nvdd);
+    CPPUNIT_ASSERT_EQUAL(shape[1], ntemp);
+    CPPUNIT_ASSERT_EQUAL(shape[2], ntime);
+
+    // The flattened signal is unchanged by the outer sweep values
+    PSFDoubleVector *out = dynamic_cast<PSFDoubleVector *>(ds.get_signal_vector("out"));
+    CPPUNIT_ASSERT_EQUAL(out->size(), (size_t)(nvdd * ntemp * ntime));
+    CPPUNIT_ASSERT_EQUAL((*out)[ntime * ntemp + 1], value(1, 0, 1));
+    delete out;
+}
+
+void TestPSFSweepArray::test_array() {
+    PSFDataSet ds(filename);
+
+    PSFSweepArray array = ds.get_signal_array("out");
+
+    CPPUNIT_ASSERT_EQUAL(array.names[0], std::string("vdd"));
+    CPPUNIT_ASSERT_EQUAL(array.names[2], std::string("time"));
+    CPPUNIT_ASSERT_EQUAL(array.axes[0][1], 1.1);
+    CPPUNIT_ASSERT_EQUAL(array.axes[1][2], 50.0);
+    CPPUNIT_ASSERT_EQUAL(array.axes[2][3], 3 * 1e-9);
+
+    PSFDoubleVector &data = *dynamic_cast<PSFDoubleVector *>(array.data);
+    CPPUNIT_ASSERT_EQUAL(data.size(), (size_t)(nvdd * ntemp * ntime));
+
+    for(int vdd=0; vdd < nvdd; vdd++)
+	for(int temp=0; temp < ntemp; temp++)
+	    for(int time=0; time < ntime; time++)
+		CPPUNIT_ASSERT_EQUAL(data[(vdd * ntemp + temp) * ntime + time], value(vdd, temp, time));
+
+    delete array.data;
+}
+
+void TestPSFSweepArray::test_slice() {
+    psf_enable_stats(true);
+
+    PSFDataSet ds(filename);
+    ds.get_sweep_shape();
+    ds.reset_stats();
+
+    std::vector<int> start, count;
+    start.push_back(1);
+    start.push_back(1);
+    count.push_back(1);
+    count.push_back(ntemp - 1);
+
+    PSFSweepArray array = ds.get_signal_array("out", start, count);
+
+    CPPUNIT_ASSERT_EQUAL(array.shape[0], 1);
+    CPPUNIT_ASSERT_EQUAL(array.shape[1], ntemp - 1);
+    CPPUNIT_ASSERT_EQUAL(array.shape[2], ntime);
+    CPPUNIT_ASSERT_EQUAL(array.axes[0].size(), (size_t)1);
+    CPPUNIT_ASSERT_EQUAL(array.axes[1][0], 25.0);
+
+    PSFDoubleVector &data = *dynamic_cast<PSFDoubleVector *>(array.data);
+    CPPUNIT_ASSERT_EQUAL(data.size(), (size_t)((ntemp - 1) * ntime));
+    CPPUNIT_ASSERT_EQUAL(data[0], value(1, 1, 0));
+    CPPUNIT_ASSERT_EQUAL(data[ntime + 4], value(1, 2, 4));
+
+    // Only the selected inner sweeps are decoded
+    CPPUNIT_ASSERT_EQUAL(ds.get_stats().points_decoded, (uint64_t)((ntemp - 1) * ntime));
+
+    delete array.data;
+
+    // Empty slice
+    count[0] = 0;
+    array = ds.get_signal_array("out", start, count);
+    CPPUNIT_ASSERT_EQUAL(array.data->size(), (size_t)0);
+    delete array.data;
+
+    // Slices outside of the sweeps or of the wrong rank
+    count[0] = 2;
+    CPPUNIT_ASSERT_THROW(ds.get_signal_array("out", start, count), std::out_of_range);
+    count[0] = -1;
+    CPPUNIT_ASSERT_THROW(ds.get_signal_array("out", start, count), std::out_of_range);
+    count[0] = 1;
+    start[1] = ntemp;
+    CPPUNIT_ASSERT_THROW(ds.get_signal_array("out", start, count), std::out_of_range);
+    start[1] = -1;
+    CPPUNIT_ASSERT_THROW(ds.get_signal_array("out", start, count), std::out_of_range);
+    start[1] = 0;
+    start.push_back(0);
+    CPPUNIT_ASSERT_THROW(ds.get_signal_array("out", start, count), std::out_of_range);
+    CPPUNIT_ASSERT_THROW(ds.get_signal_array("out", std::vector<int>(), std::vector<int>(3, 1)),
+			 std::out_of_range);
+}
+
+void TestPSFSweepArray::test_single_sweep() {
+    {
+	PSFWriter writer(filename);
+	int sweeptype = writer.add_type("sweep", TYPEID_DOUBLE);
+	writer.add_sweep("time", sweeptype);
+	writer.add_trace("out", sweeptype);
+	writer.set_window_size(64);
+
+	for(int i=0; i < 20; i++) {
+	    double v = 2 * i;
+	    writer.append_point(i, &v);
+	}
+    }
+
+    PSFDataSet ds(filename);
+
+    CPPUNIT_ASSERT(ds.get_sweep_shape() == std::vector<int>(1, 20));
+
+    PSFSweepArray array = ds.get_signal_array("out");
+    CPPUNIT_ASSERT_EQUAL(array.names[0], std::string("time"));
+    CPPUNIT_ASSERT_EQUAL(array.axes[0][19], 19.0);
+    CPPUNIT_ASSERT_EQUAL(dynamic_cast<PSFDoubleVector &>(*array.data)[19], 38.0);
+    delete array.data;
+}
+
+void TestPSFSweepArray::test_irregular() {
+    {
+	PSFWriter writer(filename);
+	int sweeptype = writer.add_type("sweep", TYPEID_DOUBLE);
+	writer.add_sweep("time", sweeptype);
+	writer.add_sweep("temp", sweeptype);
+	writer.add_trace("out", sweeptype);
+
+	// Inner sweeps of 2 and 3 points
+	for(int i=0; i < 5; i++) {
+	    PSFDoubleScalar t(i), temp(i < 2 ? 0 : 1);
+	    std::vector<const PSFScalar *> sweepvalues;
+	    sweepvalues.push_back(&t);
+	    sweepvalues.push_back(&temp);
+	    writer.append_point(sweepvalues, std::vector<const PSFScalar *>(1, &t));
+	}
+    }
+
+    PSFDataSet ds(filename);
+
+    CPPUNIT_ASSERT_THROW(ds.get_sweep_shape(), NotImplemented);
+}
+
+void TestPSFSweepArray::test_windowed() {
+    PSFWriter writer(filename);
+    int sweeptype = writer.add_type("sweep", TYPEID_DOUBLE);
+    writer.add_sweep("time", sweeptype);
+    writer.add_sweep("temp", sweeptype);
+    writer.add_trace("out", sweeptype);
+    writer.set_window_size(64);
+
+    PSFDoubleScalar t(0);
+    std::vector<const PSFScalar *> sweepvalues(2, &t);
+
+    CPPUNIT_ASSERT_THROW(writer.append_point(sweepvalues, std::vector<const PSFScalar *>(1, &t)),
+			 InvalidWriterState);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestPSFSweepArray);
+
+int main(int argc, char *argv[]) {
+    // Create the event manager and test controller
+    CPPUNIT_NS::TestResult controller;
+
+    // Add a listener that colllects test result
+    CPPUNIT_NS::TestResultCollector result;
+    controller.addListener( &result );
+
+    // Add a listener that print dots as test run.
+    CPPUNIT_NS::BriefTestProgressListener progress;
+    controller.addListener( &progress );
+
+    // Add the top suite to the test runner
+    CPPUNIT_NS::TestRunner runner;
+    runner.addTest( CPPUNIT_NS::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( controller );
+
+    return result.wasSuccessful() ? 0 : 1;
+}
@@ -0,0 +1,244 @@
+// CppUnit unit test for the text export
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <cppunit/TestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/BriefTestProgressListener.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+
+#include "psf.h"
+#include "psfdata.h"
+#include "psfwriter.h"
+#include "psftext.h"
+
+static const char *filename = "test_psftext.psf";
+static const char *textfilename = "test_psftext.csv";
+
+static const int npoints = 3000;
+
+class TestPSFText : public CPPUNIT_NS::TestCase {
+    CPPUNIT_TEST_SUITE(TestPSFText);
+
+    CPPUNIT_TEST(test_format_double);
+    CPPUNIT_TEST(test_simple);
+    CPPUNIT_TEST(test_windowed);
+    CPPUNIT_TEST(test_options);
+    CPPUNIT_TEST(test_nonswept);
+
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void tearDown(void) { remove(filename); remove(textfilename); }
+
+protected:
+    void test_format_double();
+    void test_simple();
+    void test_windowed();
+    void test_options();
+    void test_nonswept();
+
+    void write(int windowsize);
+    void check();
+    std::vector<std::vector<std::string> > read(char separator);
+};
+
+static double sweep_value(int i) { return i * 1e-3 / 7; }
+static double a_value(int i) { return sin(0.01 * i) / 3; }
+
+void TestPSFText::write(int windowsize) {
+    PSFWriter writer(filename);
+
+    int sweeptype = writer.add_type("sweep", TYPEID_DOUBLE);
+    int inttype = writer.add_type("count", TYPEID_INT32);
+    int complextype = writer.add_type("complex", TYPEID_COMPLEXDOUBLE);
+    writer.add_sweep("time", sweeptype);
+    writer.add_trace("a", sweeptype);
+    writer.add_trace("z", complextype);
+    writer.add_trace("n", inttype);
+    if(windowsize)
+	writer.set_window_size(windowsize);
+
+    for(int i=0; i < npoints; i++) {
+	PSFDoubleScalar a(a_value(i));
+	PSFComplexDoubleScalar z(PSFComplexDouble(i, -0.1 * i));
+	PSFInt32Scalar n(7 - i);
+	std::vector<const PSFScalar *> values;
+	values.push_back(&a);
+	values.push_back(&z);
+	values.push_back(&n);
+	writer.append_point(PSFDoubleScalar(sweep_value(i)), values);
+    }
+}
+
+std::vector<std::vector<std::string> > TestPSFText::read(char separator) {
+    std::ifstream in(textfilename);
+    std::vector<std::vector<std::string> > rows;
+    std::string line;
+
+    while(std::getline(in, line)) {
+	std::vector<std::string> fields;
+	std::istringstream fieldstream(line);
+	std::string field;
+	while(std::getline(fieldstream, field, separator))
+	    fields.push_back(field);
+	rows.push_back(fields);
+    }
+
+    return rows;
+}
+
+// Values read back exactly, blocks and threads do not divide the sweep
+void TestPSFText::check() {
+    PSFDataSet ds(filename);
+    PSFTextExport exporter(ds);
+    exporter.set_block_size(333);
+    exporter.set_nthreads(3);
+    exporter.write(textfilename);
+
+    std::vector<std::vector<std::string> > rows = read(',');
+    CPPUNIT_ASSERT_EQUAL((int)rows.size(), npoints + 1);
+
+    std::vector<std::string> header = rows[0];
+    CPPUNIT_ASSERT_EQUAL((int)header.size(), 5);
+    CPPUNIT_ASSERT_EQUAL(header[0], std::string("time"));
+    CPPUNIT_ASSERT_EQUAL(header[1], std::string("a"));
+    CPPUNIT_ASSERT_EQUAL(header[2], std::string("z.re"));
+    CPPUNIT_ASSERT_EQUAL(header[3], std::string("z.im"));
+    CPPUNIT_ASSERT_EQUAL(header[4], std::string("n"));
+
+    for(int i=0; i < npoints; i++) {
+	const std::vector<std::string> &row = rows[i + 1];
+	CPPUNIT_ASSERT_EQUAL((int)row.size(), 5);
+	CPPUNIT_ASSERT_EQUAL(strtod(row[0].c_str(), NULL), sweep_value(i));
+	CPPUNIT_ASSERT_EQUAL(strtod(row[1].c_str(), NULL), a_value(i));
+	CPPUNIT_ASSERT_EQUAL(strtod(row[2].c_str(), NULL), (double)i);
+	CPPUNIT_ASSERT_EQUAL(strtod(row[3].c_str(), NULL), -0.1 * i);
+	CPPUNIT_ASSERT_EQUAL(strtod(row[4].c_str(), NULL), 7.0 - i);
+    }
+
+    CPPUNIT_ASSERT(exporter.get_bytes() > 0);
+}
+
+void TestPSFText::test_format_double() {
+    char buf[PSFTextExport::MAX_DOUBLE_LENGTH];
+
+    double values[] = { 0.1, 1e-300, -1.5, 123456789.0, 5e-324, 1.7976931348623157e308 };
+    for(unsigned int i=0; i < sizeof(values) / sizeof(values[0]); i++) {
+	*PSFTextExport::format_double(values[i], buf) = '\0';
+	CPPUNIT_ASSERT_EQUAL(strtod(buf, NULL), values[i]);
+    }
+
+    *PSFTextExport::format_double(0.1, buf) = '\0';
+    CPPUNIT_ASSERT_EQUAL(std::string(buf), std::string("0.1"));
+
+    *PSFTextExport::format_double(-0.0, buf) = '\0';
+    CPPUNIT_ASSERT(signbit(strtod(buf, NULL)));
+
+    *PSFTextExport::format_double(NAN, buf) = '\0';
+    CPPUNIT_ASSERT(isnan(strtod(buf, NULL)));
+
+    srand(1);
+    for(int i=0; i < 100000; i++) {
+	double value = (double)rand() / rand() * pow(10.0, rand() % 600 - 300);
+	*PSFTextExport::format_double(value, buf) = '\0';
+	CPPUNIT_ASSERT_EQUAL(strtod(buf, NULL), value);
+    }
+}
+
+void TestPSFText::test_simple() {
+    write(0);
+    check();
+}
+
+void TestPSFText::test_windowed() {
+    write(512);
+    check();
+}
+
+void TestPSFText::test_options() {
+    write(512);
+
+    PSFDataSet ds(filename);
+    PSFTextExport exporter(ds);
+
+    std::vector<std::string> names;
+    names.push_back("n");
+    names.push_back("a");
+    exporter.set_signals(names);
+    exporter.set_range(npoints - 10, 100);
+    exporter.set_separator('\t');
+    exporter.set_header(false);
+    exporter.write(textfilename);
+
+    std::vector<std::vector<std::string> > rows = read('\t');
+    CPPUNIT_ASSERT_EQUAL((int)rows.size(), 10);
+    for(int i=0; i < 10; i++) {
+	int point = npoints - 10 + i;
+	CPPUNIT_ASSERT_EQUAL((int)rows[i].size(), 3);
+	CPPUNIT_ASSERT_EQUAL(strtod(rows[i][1].c_str(), NULL), 7.0 - point);
+	CPPUNIT_ASSERT_EQUAL(strtod(rows[i][2].c_str(), NULL), a_value(point));
+    }
+
+    // A range after the sweep leaves only the header
+    exporter.set_header(true);
+    exporter.set_range(npoints, 10);
+    exporter.write(textfilename);
+    CPPUNIT_ASSERT_EQUAL((int)read('\t').size(), 1);
+
+    names.push_back("nonexisting");
+    exporter.set_signals(names);
+    CPPUNIT_ASSERT_THROW(exporter.write(textfilename), NotFound);
+}
+
+void TestPSFText::test_nonswept() {
+    {
+	PSFWriter writer(filename);
+	int doubletype = writer.add_type("value", TYPEID_DOUBLE);
+	int complextype = writer.add_type("complex", TYPEID_COMPLEXDOUBLE);
+	writer.add_value("x", doubletype, PSFDoubleScalar(0.3));
+	writer.add_value("y", complextype, PSFComplexDoubleScalar(PSFComplexDouble(1.5, -2)));
+    }
+
+    PSFDataSet ds(filename);
+    PSFTextExport exporter(ds);
+    exporter.write(textfilename);
+
+    std::vector<std::vector<std::string> > rows = read(',');
+    CPPUNIT_ASSERT_EQUAL((int)rows.size(), 2);
+    CPPUNIT_ASSERT_EQUAL((int)rows[0].size(), 3);
+    CPPUNIT_ASSERT_EQUAL(rows[0][2], std::string("y.im"));
+    CPPUNIT_ASSERT_EQUAL(rows[1][0], std::string("0.3"));
+    CPPUNIT_ASSERT_EQUAL(strtod(rows[1][2].c_str(), NULL), -2.0);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestPSFText);
+
+int main(int argc, char *argv[]) {
+    // Create the event manager and test controller
+    CPPUNIT_NS::TestResult controller;
+
+    // Add a listener that colllects test result
+    CPPUNIT_NS::TestResultCollector result;
+    controller.addListener( &result );
+
+    // Add a listener that print dots as test run.
+    CPPUNIT_NS::BriefTestProgressListener progress;
+    controller.addListener( &progress );
+
+    // Add the top suite to the test runner
+    CPPUNIT_NS::TestRunner runner;
+    runner.addTest( CPPUNIT_NS::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( controller );
+
+    return result.wasSuccessful() ? 0 : 1;
+}
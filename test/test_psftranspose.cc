@@ -0,0 +1,189 @@
+// CppUnit unit test for the whole file transpose
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sstream>
+#include <vector>
+
+#include <cppunit/TestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/BriefTestProgressListener.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+
+#include "psf.h"
+#include "psfdata.h"
+#include "psfwriter.h"
+
+static const char *filename = "test_psftranspose.psf";
+
+// More traces than one task decodes
+static const int ntraces = 150;
+static const int npoints = 3000;
+
+class TestPSFTranspose : public CPPUNIT_NS::TestCase {
+    CPPUNIT_TEST_SUITE(TestPSFTranspose);
+
+    CPPUNIT_TEST(test_simple);
+    CPPUNIT_TEST(test_windowed);
+    CPPUNIT_TEST(test_names);
+    CPPUNIT_TEST(test_mixed_types);
+
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void tearDown(void) { remove(filename); }
+
+protected:
+    void test_simple();
+    void test_windowed();
+    void test_names();
+    void test_mixed_types();
+
+    void write(int windowsize);
+    void check(int nthreads);
+};
+
+static std::string trace_name(int j) {
+    std::stringstream name;
+    name << "t" << j;
+    return name.str();
+}
+
+static double value(int point, int trace) {
+    return point * 0.25 - trace;
+}
+
+void TestPSFTranspose::write(int windowsize) {
+    PSFWriter writer(filename);
+
+    int sweeptype = writer.add_type("sweep", TYPEID_DOUBLE);
+    writer.add_sweep("time", sweeptype);
+    for(int j=0; j < ntraces; j++)
+	writer.add_trace(trace_name(j), sweeptype);
+    if(windowsize)
+	writer.set_window_size(windowsize);
+
+    std::vector<double> values(ntraces);
+    for(int i=0; i < npoints; i++) {
+	for(int j=0; j < ntraces; j++)
+	    values[j] = value(i, j);
+	writer.append_point(i * 0.5, &values[0]);
+    }
+}
+
+void TestPSFTranspose::check(int nthreads) {
+    PSFDataSet ds(filename);
+
+    PSFSignalMatrix matrix = ds.get_signal_matrix(nthreads);
+
+    CPPUNIT_ASSERT_EQUAL((int)matrix.names.size(), ntraces);
+    CPPUNIT_ASSERT_EQUAL(matrix.npoints, npoints);
+    CPPUNIT_ASSERT_EQUAL(matrix.values.size(), (size_t)ntraces * npoints);
+
+    for(int i=0; i < npoints; i++)
+	CPPUNIT_ASSERT_EQUAL(matrix.x[i], i * 0.5);
+
+    for(int j=0; j < ntraces; j++) {
+	int trace = atoi(matrix.names[j].c_str() + 1);
+	const double *column = matrix.column(j);
+
+	for(int i=0; i < npoints; i++)
+	    CPPUNIT_ASSERT_EQUAL(column[i], value(i, trace));
+    }
+}
+
+void TestPSFTranspose::test_simple() {
+    write(0);
+    check(1);
+    check(0);
+}
+
+void TestPSFTranspose::test_windowed() {
+    write(256);
+    check(1);
+    check(3);
+}
+
+void TestPSFTranspose::test_names() {
+    write(0);
+
+    PSFDataSet ds(filename);
+
+    std::vector<std::string> names;
+    names.push_back("t100");
+    names.push_back("t3");
+
+    PSFSignalMatrix matrix = ds.get_signal_matrix(names);
+    CPPUNIT_ASSERT(matrix.names == names);
+    CPPUNIT_ASSERT_EQUAL(matrix.values.size(), (size_t)2 * npoints);
+    CPPUNIT_ASSERT_EQUAL(matrix.column(0)[7], value(7, 100));
+    CPPUNIT_ASSERT_EQUAL(matrix.column(1)[npoints - 1], value(npoints - 1, 3));
+
+    CPPUNIT_ASSERT_THROW(ds.get_signal_matrix(std::vector<std::string>(1, "nonexisting")), NotFound);
+}
+
+// Integer traces are converted and complex traces are left out
+void TestPSFTranspose::test_mixed_types() {
+    {
+	PSFWriter writer(filename);
+
+	int sweeptype = writer.add_type("sweep", TYPEID_DOUBLE);
+	int inttype = writer.add_type("count", TYPEID_INT32);
+	int complextype = writer.add_type("complex", TYPEID_COMPLEXDOUBLE);
+	writer.add_sweep("freq", sweeptype);
+	writer.add_trace("a", sweeptype);
+	writer.add_trace("z", complextype);
+	writer.add_trace("n", inttype);
+
+	for(int i=0; i < npoints; i++) {
+	    PSFDoubleScalar a(2.0 * i);
+	    PSFComplexDoubleScalar z(PSFComplexDouble(i, -i));
+	    PSFInt32Scalar n(-3 * i);
+	    std::vector<const PSFScalar *> values;
+	    values.push_back(&a);
+	    values.push_back(&z);
+	    values.push_back(&n);
+	    writer.append_point(PSFDoubleScalar(i), values);
+	}
+    }
+
+    PSFDataSet ds(filename);
+
+    PSFSignalMatrix matrix = ds.get_signal_matrix();
+    CPPUNIT_ASSERT_EQUAL((int)matrix.names.size(), 2);
+
+    for(int j=0; j < 2; j++) {
+	const double *column = matrix.column(j);
+	double scale = matrix.names[j] == "a" ? 2.0 : -3.0;
+
+	for(int i=0; i < npoints; i++)
+	    CPPUNIT_ASSERT_EQUAL(column[i], scale * i);
+    }
+
+    CPPUNIT_ASSERT_THROW(ds.get_signal_matrix(std::vector<std::string>(1, "z")), NotImplemented);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestPSFTranspose);
+
+int main(int argc, char *argv[]) {
+    // Create the event manager and test controller
+    CPPUNIT_NS::TestResult controller;
+
+    // Add a listener that colllects test result
+    CPPUNIT_NS::TestResultCollector result;
+    controller.addListener( &result );
+
+    // Add a listener that print dots as test run.
+    CPPUNIT_NS::BriefTestProgressListener progress;
+    controller.addListener( &progress );
+
+    // Add the top suite to the test runner
+    CPPUNIT_NS::TestRunner runner;
+    runner.addTest( CPPUNIT_NS::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( controller );
+
+    return result.wasSuccessful() ? 0 : 1;
+}
@@ -0,0 +1,260 @@
+// CppUnit unit test for PSFWriter
+
+#include <stdio.h>
+
+#include <iostream>
+#include <vector>
+#include <memory>
+
+#include <cppunit/TestRunner.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/BriefTestProgressListener.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+
+#include "psf.h"
+#include "psfwriter.h"
+
+static const char *filename = "test_psfwriter.psf";
+
+class TestPSFWriter : public CPPUNIT_NS::TestCase {
+    CPPUNIT_TEST_SUITE(TestPSFWriter);
+
+    CPPUNIT_TEST(test_simple_sweep);
+    CPPUNIT_TEST(test_windowed_sweep);
+    CPPUNIT_TEST(test_grouped_sweep);
+    CPPUNIT_TEST(test_struct_sweep);
+    CPPUNIT_TEST(test_complex_sweep);
+    CPPUNIT_TEST(test_nonsweep_values);
+    CPPUNIT_TEST(test_sweep_range);
+
+    CPPUNIT_TEST_EXCEPTION(test_define_after_values, InvalidWriterState);
+
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp(void) {}
+    void tearDown(void) { remove(filename); }
+
+protected:
+    void test_simple_sweep();
+    void test_windowed_sweep();
+    void test_grouped_sweep();
+    void test_struct_sweep();
+    void test_complex_sweep();
+    void test_nonsweep_values();
+    void test_sweep_range();
+
+    void test_define_after_values();
+
+private:
+    void write_double_sweep(int windowsize, const char *group, int npoints);
+    void check_double_sweep(int npoints);
+};
+
+static double sweep_value(int i) { return 1e-9 * i * i; }
+static double trace_value(int j, int i) { return j + 0.5 * i; }
+
+void TestPSFWriter::write_double_sweep(int windowsize, const char *group, int npoints) {
+    PSFWriter writer(filename);
+
+    PSFStringScalar node("node"), volt("V");
+    PropertyMap props, traceprops;
+    props["key"] = &node;
+    traceprops["units"] = &volt;
+
+    writer.add_header_property("simulator", PSFStringScalar("test"));
+    int sweeptype = writer.add_type("sweep", TYPEID_DOUBLE);
+    int valuetype = writer.add_type("V", TYPEID_DOUBLE, props);
+    writer.add_sweep("time", sweeptype);
+    writer.add_trace("a", valuetype, group);
+    writer.add_trace("b", valuetype, "", traceprops);
+    writer.add_trace("c", valuetype, group);
+    if(windowsize)
+	writer.set_window_size(windowsize);
+
+    double values[3];
+    for(int i=0; i < npoints; i++) {
+	for(int j=0; j < 3; j++)
+	    values[j] = trace_value(j, i);
+	writer.append_point(sweep_value(i), values);
+    }
+    writer.close();
+}
+
+void TestPSFWriter::check_double_sweep(int npoints) {
+    PSFDataSet ds(filename);
+
+    CPPUNIT_ASSERT(ds.is_swept());
+    CPPUNIT_ASSERT_EQUAL(ds.get_sweep_npoints(), npoints);
+    CPPUNIT_ASSERT_EQUAL(ds.get_sweep_param_names()[0], std::string("time"));
+    CPPUNIT_ASSERT_EQUAL(ds.get_header_properties().find("simulator")->second->tostring(),
+			 std::string("test"));
+    CPPUNIT_ASSERT_EQUAL(ds.get_signal_properties("b").find("units")->second->tostring(),
+			 std::string("V"));
+
+    std::auto_ptr<PSFDoubleVector> sweep(dynamic_cast<PSFDoubleVector *>(ds.get_sweep_values()));
+    CPPUNIT_ASSERT_EQUAL(sweep->size(), (std::size_t)npoints);
+    for(int i=0; i < npoints; i++)
+	CPPUNIT_ASSERT_EQUAL((*sweep)[i], sweep_value(i));
+
+    const char *names[] = { "a", "b", "c" };
+    for(int j=0; j < 3; j++) {
+	std::auto_ptr<PSFDoubleVector> vec(dynamic_cast<PSFDoubleVector *>(ds.get_signal_vector(names[j])));
+	CPPUNIT_ASSERT_EQUAL(vec->size(), (std::size_t)npoints);
+	for(int i=0; i < npoints; i++)
+	    CPPUNIT_ASSERT_EQUAL((*vec)[i], trace_value(j, i));
+    }
+}
+
+void TestPSFWriter::test_simple_sweep() {
+    write_double_sweep(0, "", 100);
+    check_double_sweep(100);
+}
+
+void TestPSFWriter::test_windowed_sweep() {
+    // 8 points per window, the last window is partially filled
+    write_double_sweep(64, "", 100);
+    check_double_sweep(100);
+}
+
+void TestPSFWriter::test_grouped_sweep() {
+    write_double_sweep(0, "group", 50);
+    check_double_sweep(50);
+}
+
+void TestPSFWriter::test_struct_sweep() {
+    {
+	PSFWriter writer(filename);
+
+	PSFWriter::StructMembers members;
+	members.push_back(std::make_pair("vgs", TYPEID_DOUBLE));
+	members.push_back(std::make_pair("region", TYPEID_INT32));
+
+	int sweeptype = writer.add_type("sweep", TYPEID_DOUBLE);
+	int structtype = writer.add_struct_type("opinfo", members);
+	writer.add_sweep("temp", sweeptype);
+	writer.add_trace("m1", structtype);
+
+	Struct s;
+	s["vgs"] = new PSFDoubleScalar(0.0);
+	s["region"] = new PSFInt32Scalar(0);
+	StructScalar value(s);
+	std::vector<const PSFScalar *> values(1, &value);
+
+	for(int i=0; i < 10; i++) {
+	    dynamic_cast<PSFDoubleScalar *>(value.value["vgs"])->value = 0.1 * i;
+	    dynamic_cast<PSFInt32Scalar *>(value.value["region"])->value = i % 3;
+	    writer.append_point(PSFDoubleScalar(i), values);
+	}
+    }
+
+    PSFDataSet ds(filename);
+    std::auto_ptr<StructVector> vec(dynamic_cast<StructVector *>(ds.get_signal_vector("m1")));
+    CPPUNIT_ASSERT_EQUAL(vec->size(), (std::size_t)10);
+    for(int i=0; i < 10; i++) {
+	CPPUNIT_ASSERT_EQUAL((double)*(*vec)[i]["vgs"], 0.1 * i);
+	CPPUNIT_ASSERT_EQUAL((int)*(*vec)[i]["region"], i % 3);
+    }
+}
+
+void TestPSFWriter::test_complex_sweep() {
+    {
+	PSFWriter writer(filename);
+
+	int sweeptype = writer.add_type("sweep", TYPEID_DOUBLE);
+	int complextype = writer.add_type("V", TYPEID_COMPLEXDOUBLE);
+	writer.add_sweep("freq", sweeptype);
+	writer.add_trace("out", complextype);
+	writer.set_window_size(256);
+
+	PSFComplexDoubleScalar value;
+	std::vector<const PSFScalar *> values(1, &value);
+	for(int i=0; i < 40; i++) {
+	    value.value = PSFComplexDouble(i, -i);
+	    writer.append_point(PSFDoubleScalar(1e3 * i), values);
+	}
+    }
+
+    PSFDataSet ds(filename);
+    std::auto_ptr<PSFComplexDoubleVector> vec(dynamic_cast<PSFComplexDoubleVector *>(ds.get_signal_vector("out")));
+    CPPUNIT_ASSERT_EQUAL(vec->size(), (std::size_t)40);
+    for(int i=0; i < 40; i++)
+	CPPUNIT_ASSERT((*vec)[i] == PSFComplexDouble(i, -i));
+}
+
+void TestPSFWriter::test_nonsweep_values() {
+    {
+	PSFWriter writer(filename);
+
+	PSFStringScalar volt("V");
+	PropertyMap props;
+	props["units"] = &volt;
+
+	int valuetype = writer.add_type("V", TYPEID_DOUBLE);
+	writer.add_value("vin", valuetype, PSFDoubleScalar(5.0), props);
+	writer.add_value("vout", valuetype, PSFDoubleScalar(2.5));
+	writer.close();
+    }
+
+    PSFDataSet ds(filename);
+    CPPUNIT_ASSERT(!ds.is_swept());
+    CPPUNIT_ASSERT_EQUAL(ds.get_signal_names().size(), (std::size_t)2);
+    CPPUNIT_ASSERT_EQUAL((double)ds.get_signal_scalar("vin"), 5.0);
+    CPPUNIT_ASSERT_EQUAL((double)ds.get_signal_scalar("vout"), 2.5);
+    CPPUNIT_ASSERT_EQUAL(ds.get_signal_properties("vin").find("units")->second->tostring(),
+			 std::string("V"));
+}
+
+void TestPSFWriter::test_sweep_range() {
+    // Ranges starting and ending inside windows of 8 points
+    write_double_sweep(64, "", 100);
+
+    PSFDataSet ds(filename);
+
+    std::auto_ptr<PSFDoubleVector> sweep(dynamic_cast<PSFDoubleVector *>(ds.get_sweep_values(13, 20)));
+    CPPUNIT_ASSERT_EQUAL(sweep->size(), (std::size_t)20);
+    for(int i=0; i < 20; i++)
+	CPPUNIT_ASSERT_EQUAL((*sweep)[i], sweep_value(13 + i));
+
+    std::auto_ptr<PSFDoubleVector> vec(dynamic_cast<PSFDoubleVector *>(ds.get_signal_vector("c", 95, 10)));
+    CPPUNIT_ASSERT_EQUAL(vec->size(), (std::size_t)5);
+    for(int i=0; i < 5; i++)
+	CPPUNIT_ASSERT_EQUAL((*vec)[i], trace_value(2, 95 + i));
+}
+
+void TestPSFWriter::test_define_after_values() {
+    PSFWriter writer(filename);
+
+    int sweeptype = writer.add_type("sweep", TYPEID_DOUBLE);
+    writer.add_sweep("time", sweeptype);
+    writer.add_trace("a", sweeptype);
+
+    double value = 1.0;
+    writer.append_point(0.0, &value);
+
+    writer.add_trace("b", sweeptype);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestPSFWriter);
+
+int main(int argc, char *argv[]) {
+    // Create the event manager and test controller
+    CPPUNIT_NS::TestResult controller;
+
+    // Add a listener that colllects test result
+    CPPUNIT_NS::TestResultCollector result;
+    controller.addListener( &result );
+
+    // Add a listener that print dots as test run.
+    CPPUNIT_NS::BriefTestProgressListener progress;
+    controller.addListener( &progress );
+
+    // Add the top suite to the test runner
+    CPPUNIT_NS::TestRunner runner;
+    runner.addTest( CPPUNIT_NS::TestFactoryRegistry::getRegistry().makeTest() );
+    runner.run( controller );
+
+    return result.wasSuccessful() ? 0 : 1;
+}